@@ -0,0 +1,125 @@
+/**
+ * @file analyze.c
+ * @brief Benchmark and correctness check of the analysis kernels.
+ *
+ * Every kernel the CPU supports has to count exactly the same histograms and sums as the scalar kernel,
+ * including row tails, padded strides and more pixels than fit into the 8-bit counters of one pass.
+ * Plain colours have to be classified as expected. Then a 4K frame is timed. Exits with 1 if any check fails.
+ *
+ * Build and run with: make bench-analyze
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analyze.h"
+#include "kernel.h"
+
+#define BENCH_WIDTH 3840
+#define BENCH_HEIGHT 2160
+#define BENCH_ITERATIONS 50
+
+static const int sizes[][3] = {{1, 1, 0}, {15, 3, 4}, {33, 7, 0}, {97, 61, 12}, {4099, 5, 0}, {640, 480, 0}};
+
+// Plain colour and the period it has to be classified as
+typedef struct BenchColour {
+    const char *name; // Description of the colour.
+    unsigned char bgra[4]; // The colour.
+    int period; // Expected period.
+} BenchColour;
+
+static const BenchColour colours[] = {
+    {"black", {0, 0, 0, 255}, ANALYZE_NIGHT},
+    {"navy", {90, 30, 20, 255}, ANALYZE_NIGHT},
+    {"white", {255, 255, 255, 255}, ANALYZE_DAY},
+    {"sky blue", {235, 206, 135, 255}, ANALYZE_DAY},
+    {"sunset orange", {40, 120, 220, 255}, ANALYZE_TWILIGHT},
+    {"dusk grey", {110, 100, 100, 255}, ANALYZE_TWILIGHT},
+};
+
+// Image analysed by one run and the analysis it produces
+typedef struct BenchAnalysis {
+    Image image; // Input.
+    ImageAnalysis analysis; // Output.
+} BenchAnalysis;
+
+/**
+ * @brief Analyses the image once, see KernelRun.
+ */
+static void benchRun(void *context, int iteration);
+
+/**
+ * @brief Compares a kernel against the scalar kernel on one image size.
+ *
+ * @return Returns 0 if all histograms match, or 1 otherwise.
+ */
+static int benchVerify(const char *kernel, int width, int height, int padding);
+
+/**
+ * @brief Compares a kernel against the scalar kernel on all sizes and times it, see KernelCheck.
+ */
+static int benchCheck(void *context, const char *kernel);
+
+static void benchRun(void *context, int iteration) {
+    BenchAnalysis *bench = context;
+    analyzeReset(&bench->analysis);
+    analyzeRows(&bench->analysis, bench->image.pixels, bench->image.stride, bench->image.width, bench->image.height);
+}
+
+static int benchVerify(const char *kernel, int width, int height, int padding) {
+    BenchAnalysis bench;
+    if (kernelImage(&bench.image, width, height, padding, 7) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    int result = kernelMatches(analyzeSetKernel, kernel, benchRun, &bench, &bench.analysis, sizeof(ImageAnalysis));
+    free(bench.image.pixels);
+    if (result != 0) {
+        fprintf(stderr, "%s differs from scalar at %dx%d, padding %d\n", kernel, width, height, padding);
+    }
+    return result;
+}
+
+static int benchCheck(void *context, const char *kernel) {
+    int mismatch = 0;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]) && !mismatch; i++) {
+        mismatch = benchVerify(kernel, sizes[i][0], sizes[i][1], sizes[i][2]);
+    }
+    char label[32];
+    snprintf(label, sizeof(label), "%dx%d", BENCH_WIDTH, BENCH_HEIGHT);
+    kernelTime(kernel, mismatch, label, BENCH_WIDTH * (double)BENCH_HEIGHT, BENCH_ITERATIONS, benchRun, context);
+    return mismatch;
+}
+
+int main() {
+    printf("Default kernel: %s\n", analyzeKernelName());
+    int failures = 0;
+
+    analyzeSetKernel("scalar");
+    for (size_t i = 0; i < sizeof(colours) / sizeof(colours[0]); i++) {
+        unsigned char pixels[64 * 4];
+        for (int p = 0; p < 64; p++) {
+            memcpy(pixels + p * 4, colours[i].bgra, 4);
+        }
+        ImageAnalysis analysis;
+        analyzeReset(&analysis);
+        analyzeRows(&analysis, pixels, 64 * 4, 64, 1);
+        int period = analyzePeriod(&analysis);
+        if (period != colours[i].period) {
+            fprintf(stderr, "%s is %s instead of %s (luminance %.3f, warmth %.3f)\n", colours[i].name, analyzePeriodName(period),
+                    analyzePeriodName(colours[i].period), analyzeLuminance(&analysis), analyzeWarmth(&analysis));
+            failures++;
+        }
+    }
+    printf("Periods       %s\n", failures != 0 ? "FAILED" : "ok");
+
+    BenchAnalysis bench;
+    if (kernelImage(&bench.image, BENCH_WIDTH, BENCH_HEIGHT, 0, 8) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    failures += kernelEach(analyzeSetKernel, benchCheck, &bench);
+    free(bench.image.pixels);
+    return failures != 0;
+}
@@ -0,0 +1,191 @@
+/**
+ * @file anim.c
+ * @brief Benchmark and correctness check of the packed animation decoder.
+ *
+ * Decodes an asset written by tooling/packAnimation.py (see bench/anim.py) and compares every frame byte by
+ * byte against the raw frames it was packed from, seeking forwards, backwards and in a scattered order.
+ * Then corrupted copies of the asset (header, offset table and runs) have to be rejected by animOpen(), and
+ * seeking is timed. Exits with 1 if any check fails.
+ *
+ * Build and run with: make bench-anim
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "anim.h"
+#include "kernel.h"
+
+#define BENCH_ITERATIONS 2000
+
+/**
+ * @brief Reads a whole file into memory.
+ *
+ * @return Returns the contents, or NULL if it cannot be read. Must be freed by the caller.
+ */
+static unsigned char *benchReadFile(const char *path, size_t *size);
+
+/**
+ * @brief Seeks to a frame and compares it against the raw frames.
+ */
+static int benchSeekMatches(PackedAnimation *animation, const unsigned char *frames, int frame);
+
+/**
+ * @brief Returns whether animOpen() rejects an asset.
+ */
+static int benchRejects(const unsigned char *data, size_t size);
+
+/**
+ * @brief Writes a little endian u32.
+ */
+static void benchWrite32(unsigned char *data, unsigned int value);
+
+static unsigned char *benchReadFile(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    unsigned char *data = NULL;
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+        data = malloc(length > 0 ? length : 1);
+        if (data != NULL && fread(data, 1, length, file) != (size_t)length) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(file);
+    *size = (size_t)length;
+    return data;
+}
+
+static int benchSeekMatches(PackedAnimation *animation, const unsigned char *frames, int frame) {
+    size_t frameSize = (size_t)animation->width * animation->height * 4;
+    return animSeek(animation, frame) == 0 && animation->frame == frame
+           && memcmp(animation->pixels, frames + frame * frameSize, frameSize) == 0;
+}
+
+static int benchRejects(const unsigned char *data, size_t size) {
+    PackedAnimation animation;
+    int rejected = animOpen(&animation, data, size) != 0;
+    animClose(&animation);
+    return rejected;
+}
+
+static void benchWrite32(unsigned char *data, unsigned int value) {
+    for (int i = 0; i < 4; i++) {
+        data[i] = (unsigned char)(value >> (i * 8));
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <packed asset> <raw frames>\n", argv[0]);
+        return 1;
+    }
+    size_t size, framesSize;
+    unsigned char *data = benchReadFile(argv[1], &size);
+    unsigned char *frames = benchReadFile(argv[2], &framesSize);
+    PackedAnimation animation;
+    if (data == NULL || frames == NULL || animOpen(&animation, data, size) != 0) {
+        fprintf(stderr, "Failure loading %s and %s\n", argv[1], argv[2]);
+        return 1;
+    }
+    int count = animation.frameCount;
+    size_t frameSize = (size_t)animation.width * animation.height * 4;
+    printf("%d frames of %dx%d, %zu bytes packed\n", count, animation.width, animation.height, size);
+
+    int failures = 0;
+    failures += kernelReport("raw frames match the header", framesSize == frameSize * count);
+    if (failures != 0) {
+        return 1;
+    }
+    failures += kernelReport("open decodes frame 0", animation.frame == 0 && memcmp(animation.pixels, frames, frameSize) == 0);
+
+    int matches = 1;
+    for (int i = 0; i < count; i++) {
+        matches &= benchSeekMatches(&animation, frames, i);
+    }
+    failures += kernelReport("forward seek matches", matches);
+    matches = 1;
+    for (int i = count - 1; i >= 0; i--) {
+        matches &= benchSeekMatches(&animation, frames, i);
+    }
+    failures += kernelReport("backward seek matches", matches);
+    // Jumps of varying length in both directions, the same frame reached either way has to be identical.
+    matches = 1;
+    for (int i = 0; i < count * 3; i++) {
+        matches &= benchSeekMatches(&animation, frames, (i * 7 + i / count) % count);
+    }
+    failures += kernelReport("scattered seek matches", matches);
+    failures += kernelReport("seek out of range fails",
+                             animSeek(&animation, -1) != 0 && animSeek(&animation, count) != 0 && benchSeekMatches(&animation, frames, 0));
+
+    // Corrupted copies of the asset, the offset table starts right after the header.
+    size_t table = ANIM_HEADER_SIZE;
+    size_t start = table + ((size_t)count + 1) * 4;
+    size_t runs = (size_t)animation.width * animation.height / 128 + 1;
+    size_t literal = 1 + 128 * 4;
+    unsigned char *corrupt = calloc(size + runs * literal, 1);
+    if (corrupt == NULL) {
+        return 1;
+    }
+    failures += kernelReport("truncated header is rejected", benchRejects(data, ANIM_HEADER_SIZE - 1));
+    failures += kernelReport("truncated offsets are rejected", benchRejects(data, start - 1));
+    failures += kernelReport("truncated data is rejected", benchRejects(data, size - 1));
+    memcpy(corrupt, data, size);
+    corrupt[0] = 'X';
+    failures += kernelReport("bad magic is rejected", benchRejects(corrupt, size));
+    memcpy(corrupt, data, size);
+    corrupt[4] = ANIM_VERSION + 1;
+    failures += kernelReport("bad version is rejected", benchRejects(corrupt, size));
+    memcpy(corrupt, data, size);
+    corrupt[6] = corrupt[7] = 0;
+    failures += kernelReport("zero frames are rejected", benchRejects(corrupt, size));
+    memcpy(corrupt, data, size);
+    benchWrite32(corrupt + start - 4, (unsigned int)size + 1);
+    failures += kernelReport("offset past the end is rejected", benchRejects(corrupt, size));
+    memcpy(corrupt, data, size);
+    benchWrite32(corrupt + table + 4, (unsigned int)start - 1);
+    failures += kernelReport("decreasing offsets are rejected", benchRejects(corrupt, size));
+
+    // Frame 0 replaced by runs covering more pixels than the frame, the other frames left empty.
+    memset(corrupt + start, 127, runs);
+    for (int i = 1; i <= count; i++) {
+        benchWrite32(corrupt + table + i * 4, (unsigned int)(start + runs));
+    }
+    failures += kernelReport("skip past the frame is rejected", benchRejects(corrupt, start + runs));
+    memset(corrupt + start, 0, runs * literal);
+    for (size_t i = 0; i < runs; i++) {
+        corrupt[start + i * literal] = 255;
+    }
+    for (int i = 1; i <= count; i++) {
+        benchWrite32(corrupt + table + i * 4, (unsigned int)(start + runs * literal));
+    }
+    failures += kernelReport("literal past the frame is rejected", benchRejects(corrupt, start + runs * literal));
+    // A literal run of 73 pixels with only one pixel left in the frame data.
+    corrupt[start] = 200;
+    benchWrite32(corrupt + table + 4, (unsigned int)(start + 5));
+    failures += kernelReport("cut literal run is rejected", benchRejects(corrupt, start + runs * literal));
+    free(corrupt);
+
+    // Stepping to the next frame applies one delta, jumping back to the start applies all of them.
+    double begin = kernelNow();
+    for (int n = 0; n < BENCH_ITERATIONS; n++) {
+        animSeek(&animation, n % count);
+    }
+    double step = kernelNow() - begin;
+    begin = kernelNow();
+    for (int n = 0; n < BENCH_ITERATIONS; n++) {
+        animSeek(&animation, n % 2 == 0 ? count - 1 : 0);
+    }
+    double jump = kernelNow() - begin;
+    printf("step  mean %.3f us\n", step * 1000 / BENCH_ITERATIONS);
+    printf("jump  mean %.3f us over %d frames\n", jump * 1000 / BENCH_ITERATIONS, count - 1);
+
+    animClose(&animation);
+    free(frames);
+    free(data);
+    return failures != 0;
+}
@@ -0,0 +1,48 @@
+"""Module to write the reference asset of `make bench-anim`.
+
+Generates frames with changing rectangles, unchanged frames and runs longer than a control byte holds,
+packs them with `tooling/packAnimation.py` and writes the asset next to the raw BGRA frames it was built from.
+"""
+import argparse
+import os
+import random
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tooling"))
+from packAnimation import pack
+
+def make_frames(count, size, seed):
+    """Builds the frames, each one a copy of the previous frame with a few rectangles redrawn."""
+    rng = random.Random(seed)
+    frame = bytearray(size * size * 4)
+    frames = []
+    for i in range(count):
+        # Every fourth frame repeats the previous one, so empty deltas are covered.
+        for _ in range(0 if i % 4 == 3 else rng.randint(1, 3)):
+            left, top = rng.randrange(size), rng.randrange(size)
+            right, bottom = rng.randint(left + 1, size), rng.randint(top + 1, size)
+            transparent = rng.random() < 0.25
+            for y in range(top, bottom):
+                for x in range(left, right):
+                    pixel = b"\0\0\0\0" if transparent else bytes(rng.randrange(256) for _ in range(3)) + b"\xff"
+                    frame[(y * size + x) * 4:(y * size + x + 1) * 4] = pixel
+        frames.append(bytes(frame))
+    return frames
+
+def main():
+    parser = argparse.ArgumentParser(description="Write a packed animation and its raw frames.")
+    parser.add_argument("-o", "--output", required=True, help="Packed asset to write")
+    parser.add_argument("-r", "--raw", required=True, help="Raw BGRA frames to write")
+    parser.add_argument("-n", "--count", type=int, default=24, help="Number of frames (default 24)")
+    parser.add_argument("-s", "--size", type=int, default=48, help="Frame size in pixels (default 48)")
+    parser.add_argument("-d", "--delay", type=int, default=10, help="Time between frames in ms (default 10)")
+
+    args = parser.parse_args()
+    frames = make_frames(args.count, args.size, 11)
+    with open(args.output, "wb") as f:
+        f.write(pack(frames, args.size, args.delay))
+    with open(args.raw, "wb") as f:
+        f.write(b"".join(frames))
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,280 @@
+/**
+ * @file bench.c
+ * @brief Microbenchmark harness, writes the results as JSON to stdout.
+ *
+ * Every case is warmed up and then sampled: each sample times a batch of calls, so the latency of
+ * operations shorter than the timer resolution is still meaningful. Cases with several threads start
+ * all threads behind a barrier and pool their samples.
+ *
+ * Allocations are counted by wrapping malloc, calloc and realloc at link time (-Wl,--wrap=...). Only
+ * calls made from the linked objects are seen; allocations inside the C library itself are not.
+ *
+ * Usage: bench [--filter TEXT] [--dir DIRECTORY]
+ *   --filter  Only run cases whose name contains TEXT.
+ *   --dir     Working directory for the generated configs, images and logs.
+ *
+ * Build and run with: make bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "thread.h"
+#include "blend.h"
+#include "bench.h"
+
+#define BENCH_WARMUP_DIVISOR 10 // Warm up with iterations / BENCH_WARMUP_DIVISOR samples.
+
+// State of one thread of a case
+typedef struct BenchWorker {
+    const BenchCase *benchCase; // Case being run.
+    int thread; // Index of the thread.
+    double *samples; // Receives the nanoseconds per call of each sample.
+    long failures; // Number of failed calls.
+} BenchWorker;
+
+static atomic_ulong benchAllocations; // Calls to malloc, calloc and realloc.
+static atomic_ulong benchAllocatedBytes; // Bytes requested by those calls.
+static atomic_int benchReady; // Threads waiting at the start barrier.
+static atomic_int benchGo; // Releases the threads from the start barrier.
+static const char *benchFilter = NULL; // Substring of the case names to run.
+static int benchFirstResult = 1; // Whether no result has been written yet.
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+
+/**
+ * @brief Counting wrappers, the linker redirects malloc, calloc and realloc to them.
+ */
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t count, size_t size);
+void *__wrap_realloc(void *pointer, size_t size);
+
+/**
+ * @brief Returns whether a case should run with the current --filter.
+ *
+ * @param name Name of the case.
+ * @return Returns 1 if the case is selected, or 0 otherwise.
+ */
+int benchSelected(const char *name);
+
+/**
+ * @brief Runs a case and writes its result.
+ *
+ * @param benchCase The case to run.
+ * @return Returns 0 on success, or 1 if the case could not be run.
+ */
+int benchRun(const BenchCase *benchCase);
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds.
+ */
+static double benchNow();
+
+/**
+ * @brief Takes the samples of one thread, waiting at the start barrier first when threaded.
+ */
+static void benchWorker(void *argument);
+
+/**
+ * @brief Orders samples ascending for qsort().
+ */
+static int benchCompare(const void *a, const void *b);
+
+/**
+ * @brief Returns the percentile of sorted samples using the nearest rank.
+ */
+static double benchPercentile(const double *samples, size_t count, double percentile);
+
+void *__wrap_malloc(size_t size) {
+    atomic_fetch_add_explicit(&benchAllocations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&benchAllocatedBytes, size, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    atomic_fetch_add_explicit(&benchAllocations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&benchAllocatedBytes, count * size, memory_order_relaxed);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+    atomic_fetch_add_explicit(&benchAllocations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&benchAllocatedBytes, size, memory_order_relaxed);
+    return __real_realloc(pointer, size);
+}
+
+int benchSelected(const char *name) {
+    return benchFilter == NULL || strstr(name, benchFilter) != NULL;
+}
+
+static double benchNow() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static void benchWorker(void *argument) {
+    BenchWorker *worker = argument;
+    const BenchCase *benchCase = worker->benchCase;
+
+    if (benchCase->threads > 1) {
+        atomic_fetch_add(&benchReady, 1);
+        while (!atomic_load(&benchGo)) {
+        }
+    }
+    for (int i = 0; i < benchCase->iterations; i++) {
+        double start = benchNow();
+        for (int j = 0; j < benchCase->batch; j++) {
+            if (benchCase->function(benchCase->context, worker->thread) != 0) {
+                worker->failures++;
+            }
+        }
+        worker->samples[i] = (benchNow() - start) / benchCase->batch;
+        if (benchCase->after != NULL) {
+            benchCase->after(benchCase->context, worker->thread);
+        }
+    }
+}
+
+static int benchCompare(const void *a, const void *b) {
+    double left = *(const double *)a, right = *(const double *)b;
+    return (left > right) - (left < right);
+}
+
+static double benchPercentile(const double *samples, size_t count, double percentile) {
+    size_t rank = (size_t)(percentile / 100.0 * count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    return samples[(rank > count ? count : rank) - 1];
+}
+
+int benchRun(const BenchCase *benchCase) {
+    if (!benchSelected(benchCase->name)) {
+        return 0;
+    }
+    fprintf(stderr, "%-24s %-16s threads %d\n", benchCase->name, benchCase->parameter, benchCase->threads);
+
+    // Warm up caches, lazily initialized state and the allocator.
+    int warmup = benchCase->iterations / BENCH_WARMUP_DIVISOR;
+    for (int i = 0; i < (warmup > 0 ? warmup : 1) * benchCase->batch; i++) {
+        benchCase->function(benchCase->context, 0);
+    }
+    if (benchCase->after != NULL) {
+        benchCase->after(benchCase->context, 0);
+    }
+
+    size_t count = (size_t)benchCase->iterations * benchCase->threads;
+    double *samples = malloc(count * sizeof(double));
+    BenchWorker *workers = calloc(benchCase->threads, sizeof(BenchWorker));
+    Thread **threads = calloc(benchCase->threads, sizeof(Thread *));
+    if (samples == NULL || workers == NULL || threads == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        free(samples);
+        free(workers);
+        free(threads);
+        return 1;
+    }
+    for (int t = 0; t < benchCase->threads; t++) {
+        workers[t].benchCase = benchCase;
+        workers[t].thread = t;
+        workers[t].samples = samples + (size_t)t * benchCase->iterations;
+    }
+
+    atomic_store(&benchReady, 0);
+    atomic_store(&benchGo, 0);
+    int started = 0;
+    if (benchCase->threads > 1) {
+        for (; started < benchCase->threads; started++) {
+            threads[started] = threadStart(benchWorker, &workers[started]);
+            if (threads[started] == NULL) {
+                break;
+            }
+        }
+        while (atomic_load(&benchReady) < started) {
+        }
+    }
+
+    unsigned long allocations = atomic_load(&benchAllocations);
+    unsigned long allocatedBytes = atomic_load(&benchAllocatedBytes);
+    double start = benchNow();
+    if (benchCase->threads > 1) {
+        atomic_store(&benchGo, 1);
+        for (int t = 0; t < started; t++) {
+            threadJoin(threads[t]);
+        }
+    } else {
+        benchWorker(&workers[0]);
+    }
+    double elapsed = benchNow() - start;
+    allocations = atomic_load(&benchAllocations) - allocations;
+    allocatedBytes = atomic_load(&benchAllocatedBytes) - allocatedBytes;
+
+    int result = 0;
+    if (benchCase->threads > 1 && started < benchCase->threads) {
+        fprintf(stderr, "Failure starting threads for %s\n", benchCase->name);
+        result = 1;
+    } else {
+        long failures = 0;
+        double total = 0;
+        for (int t = 0; t < benchCase->threads; t++) {
+            failures += workers[t].failures;
+        }
+        for (size_t i = 0; i < count; i++) {
+            total += samples[i];
+        }
+        qsort(samples, count, sizeof(double), benchCompare);
+
+        double operations = (double)count * benchCase->batch;
+        printf("%s\n    {\"name\": \"%s\", \"parameter\": \"%s\", \"threads\": %d, \"operations\": %.0f, "
+               "\"mean_ns\": %.1f, \"p50_ns\": %.1f, \"p99_ns\": %.1f, \"ops_per_second\": %.1f, "
+               "\"allocations_per_op\": %.3f, \"bytes_per_op\": %.1f, \"failures\": %ld, \"failure_rate\": %.4f}",
+               benchFirstResult ? "" : ",", benchCase->name, benchCase->parameter, benchCase->threads, operations,
+               total / count, benchPercentile(samples, count, 50), benchPercentile(samples, count, 99),
+               operations / (elapsed / 1e9), allocations / operations, allocatedBytes / operations, failures,
+               failures / operations);
+        benchFirstResult = 0;
+    }
+
+    free(samples);
+    free(workers);
+    free(threads);
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    const char *directory = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            benchFilter = argv[++i];
+        } else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+            directory = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--filter TEXT] [--dir DIRECTORY]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (directory != NULL) {
+        mkdir(directory, 0755);
+        if (chdir(directory) != 0) {
+            fprintf(stderr, "Failure entering %s\n", directory);
+            return 1;
+        }
+    }
+
+    time_t now = time(NULL);
+    char timestamp[32];
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    printf("{\n  \"timestamp\": \"%s\",\n  \"compiler\": \"%s\",\n  \"blend_kernel\": \"%s\",\n  \"results\": [",
+           timestamp, __VERSION__, blendKernelName());
+    int result = benchSuite();
+    printf("\n  ]\n}\n");
+    return result;
+}
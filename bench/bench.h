@@ -0,0 +1,22 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Operation under test, returns nonzero if the operation failed
+typedef int (*BenchFunction)(void *context, int thread);
+
+// Options of one benchmark run
+typedef struct BenchCase {
+    const char *name; // Name of the operation, e.g. "ini.read".
+    const char *parameter; // Input size or variant, e.g. "keys=256".
+    int threads; // Number of threads calling the function at the same time.
+    int iterations; // Number of samples per thread.
+    int batch; // Calls timed together per sample, for operations shorter than the timer resolution.
+    BenchFunction function; // The operation.
+    void *context; // Passed to every call.
+    BenchFunction after; // Called untimed after each sample, e.g. to drain a queue, may be NULL.
+} BenchCase;
+
+int benchSelected(const char *name);
+int benchRun(const BenchCase *benchCase);
+int benchSuite();
+#endif // BENCH_H
@@ -0,0 +1,104 @@
+/**
+ * @file blend.c
+ * @brief Benchmark and correctness check of the blend kernels.
+ *
+ * Every kernel the CPU supports is compared byte by byte against the scalar kernel, including row
+ * tails and padded strides, and then timed on 4K frames. Exits with 1 if any kernel differs.
+ *
+ * Build and run with: make bench-blend
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "blend.h"
+#include "kernel.h"
+
+#define BENCH_WIDTH 3840
+#define BENCH_HEIGHT 2160
+#define BENCH_ITERATIONS 50
+
+static const int alphas[] = {0, 1, 64, 127, 128, 129, 255, BLEND_MAX};
+static const int sizes[][3] = {{1, 1, 0}, {13, 7, 0}, {1001, 17, 12}, {640, 480, 0}};
+
+// Images of one blend, the alpha is taken from the alpha list or the iteration
+typedef struct BenchBlend {
+    Image from; // First input.
+    Image to; // Second input.
+    Image target; // Output.
+    int alpha; // Alpha of the comparison, or -1 to vary it with the iteration.
+} BenchBlend;
+
+/**
+ * @brief Blends the images once, see KernelRun.
+ */
+static void benchRun(void *context, int iteration);
+
+/**
+ * @brief Compares a kernel against the scalar kernel on one image size.
+ *
+ * @return Returns 0 if all outputs match, or 1 otherwise.
+ */
+static int benchVerify(const char *kernel, int width, int height, int padding);
+
+/**
+ * @brief Compares a kernel against the scalar kernel on all sizes and times it, see KernelCheck.
+ */
+static int benchCheck(void *context, const char *kernel);
+
+static void benchRun(void *context, int iteration) {
+    BenchBlend *blend = context;
+    blendImages(&blend->from, &blend->to, &blend->target, blend->alpha >= 0 ? blend->alpha : (iteration * 37) % (BLEND_MAX + 1));
+}
+
+static int benchVerify(const char *kernel, int width, int height, int padding) {
+    BenchBlend blend;
+    if (kernelImage(&blend.from, width, height, padding, 1) != 0 || kernelImage(&blend.to, width, height, padding, 2) != 0
+        || kernelImage(&blend.target, width, height, padding, 3) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    int result = 0;
+    for (size_t i = 0; i < sizeof(alphas) / sizeof(alphas[0]) && result == 0; i++) {
+        blend.alpha = alphas[i];
+        if (kernelMatches(blendSetKernel, kernel, benchRun, &blend, blend.target.pixels, (size_t)blend.target.stride * height) != 0) {
+            fprintf(stderr, "%s differs from scalar at %dx%d, padding %d, alpha %d\n", kernel, width, height, padding, alphas[i]);
+            result = 1;
+        }
+    }
+
+    free(blend.from.pixels);
+    free(blend.to.pixels);
+    free(blend.target.pixels);
+    return result;
+}
+
+static int benchCheck(void *context, const char *kernel) {
+    // Odd widths and padded strides exercise the scalar tails of the vector kernels.
+    int mismatch = 0;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]) && !mismatch; i++) {
+        mismatch = benchVerify(kernel, sizes[i][0], sizes[i][1], sizes[i][2]);
+    }
+    char label[32];
+    snprintf(label, sizeof(label), "%dx%d", BENCH_WIDTH, BENCH_HEIGHT);
+    kernelTime(kernel, mismatch, label, BENCH_WIDTH * (double)BENCH_HEIGHT, BENCH_ITERATIONS, benchRun, context);
+    return mismatch;
+}
+
+int main() {
+    printf("Default kernel: %s\n", blendKernelName());
+
+    BenchBlend blend = {.alpha = -1};
+    if (kernelImage(&blend.from, BENCH_WIDTH, BENCH_HEIGHT, 0, 1) != 0 || kernelImage(&blend.to, BENCH_WIDTH, BENCH_HEIGHT, 0, 2) != 0
+        || kernelImage(&blend.target, BENCH_WIDTH, BENCH_HEIGHT, 0, 3) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    int failures = kernelEach(blendSetKernel, benchCheck, &blend);
+
+    free(blend.from.pixels);
+    free(blend.to.pixels);
+    free(blend.target.pixels);
+    return failures != 0;
+}
@@ -0,0 +1,247 @@
+/**
+ * @file cache.c
+ * @brief Benchmark and correctness check of the wallpaper cache.
+ *
+ * A generated image is resolved through the cache: the first resolve has to write a BMP with the pixels the
+ * scaler produces, the second, also through another spelling of the path, has to return the same entry
+ * without writing it again. Changing the resolution, the modification time, the file size, the scale options
+ * or the memory budget has to yield a new entry, and the stale entry of the source has to be removed while
+ * the entries of other sources stay. Under a size limit the least recently used entries have to be evicted.
+ * Then hits and misses are timed. Exits with 1 if any check fails.
+ *
+ * Build and run with: make bench-cache
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <utime.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "image.h"
+#include "kernel.h"
+
+#define BENCH_SOURCE_PATH "bench-cache-source.bmp"
+#define BENCH_OTHER_PATH "bench-cache-other.bmp"
+#define BENCH_SOURCE_WIDTH 1920
+#define BENCH_SOURCE_HEIGHT 1080
+#define BENCH_TARGET_WIDTH 1280
+#define BENCH_TARGET_HEIGHT 720
+#define BENCH_ITERATIONS 20
+#define BENCH_LRU_SOURCES 4
+
+/**
+ * @brief Writes a source image with pseudo random pixels and sets its modification time.
+ *
+ * @return Returns 0 on success, or 1 if it cannot be written.
+ */
+static int benchWriteSource(const char *path, int width, int height, time_t modified);
+
+/**
+ * @brief Checks that a cache entry exists and loads back at the given size.
+ */
+static int benchLoadsAt(const char *cachedPath, int width, int height);
+
+/**
+ * @brief Checks that a cache entry holds exactly what scaleImage() makes of the source with the cache options.
+ */
+static int benchMatchesScaler(const char *cachedPath, const char *sourcePath, int width, int height);
+
+/**
+ * @brief Returns whether a file exists.
+ */
+static int benchExists(const char *path);
+
+static int benchWriteSource(const char *path, int width, int height, time_t modified) {
+    Image image;
+    if (imageCreate(&image, width, height) != 0) {
+        return 1;
+    }
+    unsigned int seed = 11;
+    for (size_t i = 0; i < (size_t)image.stride * height; i++) {
+        seed = seed * 1103515245u + 12345u;
+        image.pixels[i] = (unsigned char)(seed >> 16);
+    }
+    int result = imageWriteBmp(path, &image);
+    imageFree(&image);
+    struct utimbuf times = {modified, modified};
+    return result || utime(path, &times) != 0;
+}
+
+static int benchLoadsAt(const char *cachedPath, int width, int height) {
+    Image image;
+    if (imageLoad(cachedPath, &image) != 0) {
+        return 0;
+    }
+    int matches = image.width == width && image.height == height;
+    imageFree(&image);
+    return matches;
+}
+
+static int benchMatchesScaler(const char *cachedPath, const char *sourcePath, int width, int height) {
+    Image source, expected, actual;
+    if (imageLoad(sourcePath, &source) != 0) {
+        return 0;
+    }
+    int matches = 0;
+    if (imageCreate(&expected, width, height) == 0) {
+        if (scaleImage(&source, &expected, wallpaperCacheOptions()) == 0 && imageLoad(cachedPath, &actual) == 0) {
+            matches = actual.width == width && actual.height == height;
+            for (int y = 0; matches && y < height; y++) {
+                matches = memcmp(actual.pixels + (size_t)y * actual.stride, expected.pixels + (size_t)y * expected.stride,
+                                 (size_t)width * 4) == 0;
+            }
+            imageFree(&actual);
+        }
+        imageFree(&expected);
+    }
+    imageFree(&source);
+    return matches;
+}
+
+static int benchExists(const char *path) {
+    struct stat info;
+    return stat(path, &info) == 0;
+}
+
+int main(int argc, char **argv) {
+    // The cache lives in CACHE_DIRECTORY relative to the working directory, so it runs in a scratch directory.
+    const char *directory = argc > 1 ? argv[1] : "bench-cache-data";
+    mkdir(directory, 0755);
+    if (chdir(directory) != 0) {
+        fprintf(stderr, "Failure entering %s\n", directory);
+        return 1;
+    }
+    ScaleOptions options = {SCALE_FILL, SCALE_BILINEAR, 0x000000, 0, SCALE_DEFAULT_MEMORY};
+    wallpaperCacheSetOptions(&options);
+    time_t modified = 1700000000;
+    if (benchWriteSource(BENCH_SOURCE_PATH, BENCH_SOURCE_WIDTH, BENCH_SOURCE_HEIGHT, modified) != 0) {
+        fprintf(stderr, "Failure writing %s\n", BENCH_SOURCE_PATH);
+        return 1;
+    }
+
+    int failures = 0;
+    char first[MAX_CACHE_PATH], second[MAX_CACHE_PATH], resized[MAX_CACHE_PATH];
+    char touched[MAX_CACHE_PATH], grown[MAX_CACHE_PATH], fitted[MAX_CACHE_PATH], budgeted[MAX_CACHE_PATH];
+    failures += kernelReport("miss writes the entry",
+                             wallpaperCacheResolve(BENCH_SOURCE_PATH, BENCH_TARGET_WIDTH, BENCH_TARGET_HEIGHT, first, sizeof(first)) == 0
+                             && benchLoadsAt(first, BENCH_TARGET_WIDTH, BENCH_TARGET_HEIGHT));
+    failures += kernelReport("entry matches the scaler", benchMatchesScaler(first, BENCH_SOURCE_PATH, BENCH_TARGET_WIDTH, BENCH_TARGET_HEIGHT));
+
+    // A rewrite would replace the file, a hit only refreshes the time of the same file.
+    struct utimbuf old = {1000, 1000};
+    struct stat before, info;
+    utime(first, &old);
+    stat(first, &before);
+    failures += kernelReport("hit returns the entry",
+                             wallpaperCacheResolve(BENCH_SOURCE_PATH, BENCH_TARGET_WIDTH, BENCH_TARGET_HEIGHT, second, sizeof(second)) == 0
+                             && strcmp(first, second) == 0 && stat(second, &info) == 0 && info.st_ino == before.st_ino);
+    failures += kernelReport("hit marks the entry as used", info.st_mtime > 1000);
+    failures += kernelReport("other path spelling hits",
+                             wallpaperCacheResolve("./" BENCH_SOURCE_PATH, BENCH_TARGET_WIDTH, BENCH_TARGET_HEIGHT, second, sizeof(second)) == 0
+                             && strcmp(first, second) == 0 && stat(second, &info) == 0 && info.st_ino == before.st_ino);
+
+    failures += kernelReport("resolution invalidates",
+                             wallpaperCacheResolve(BENCH_SOURCE_PATH, 640, 360, resized, sizeof(resized)) == 0
+                             && strcmp(resized, first) != 0 && benchLoadsAt(resized, 640, 360) && !benchExists(first));
+
+    struct utimbuf newer = {modified + 60, modified + 60};
+    utime(BENCH_SOURCE_PATH, &newer);
+    failures += kernelReport("modification time invalidates",
+                             wallpaperCacheResolve(BENCH_SOURCE_PATH, 640, 360, touched, sizeof(touched)) == 0
+                             && strcmp(touched, resized) != 0 && benchLoadsAt(touched, 640, 360) && !benchExists(resized));
+
+    // Same time, one column more.
+    failures += kernelReport("file size invalidates",
+                             benchWriteSource(BENCH_SOURCE_PATH, BENCH_SOURCE_WIDTH + 1, BENCH_SOURCE_HEIGHT, modified + 60) == 0
+                             && wallpaperCacheResolve(BENCH_SOURCE_PATH, 640, 360, grown, sizeof(grown)) == 0
+                             && strcmp(grown, touched) != 0 && benchLoadsAt(grown, 640, 360) && !benchExists(touched));
+
+    options.mode = SCALE_FIT;
+    wallpaperCacheSetOptions(&options);
+    failures += kernelReport("scale options invalidate",
+                             wallpaperCacheResolve(BENCH_SOURCE_PATH, 640, 360, fitted, sizeof(fitted)) == 0
+                             && strcmp(fitted, grown) != 0 && benchLoadsAt(fitted, 640, 360) && !benchExists(grown));
+    options.memory = 1 << 20;
+    wallpaperCacheSetOptions(&options);
+    failures += kernelReport("memory budget invalidates",
+                             wallpaperCacheResolve(BENCH_SOURCE_PATH, 640, 360, budgeted, sizeof(budgeted)) == 0
+                             && strcmp(budgeted, fitted) != 0 && benchLoadsAt(budgeted, 640, 360) && !benchExists(fitted));
+    options.memory = SCALE_DEFAULT_MEMORY;
+    wallpaperCacheSetOptions(&options);
+    failures += kernelReport("missing source fails",
+                             wallpaperCacheResolve("bench-cache-missing.bmp", 640, 360, second, sizeof(second)) != 0);
+
+    // Invalidating one source leaves the entries of other sources alone.
+    char other[MAX_CACHE_PATH], pruned[MAX_CACHE_PATH];
+    struct utimbuf newest = {modified + 120, modified + 120};
+    failures += kernelReport("prune keeps other sources",
+                             benchWriteSource(BENCH_OTHER_PATH, 320, 180, modified) == 0
+                             && wallpaperCacheResolve(BENCH_OTHER_PATH, 640, 360, other, sizeof(other)) == 0
+                             && utime(BENCH_SOURCE_PATH, &newest) == 0
+                             && wallpaperCacheResolve(BENCH_SOURCE_PATH, 640, 360, pruned, sizeof(pruned)) == 0
+                             && !benchExists(budgeted) && benchExists(pruned) && benchExists(other));
+    remove(pruned);
+    remove(other);
+    remove(BENCH_OTHER_PATH);
+
+    // Entries of several sources under a limit of three entries: the least recently used one is evicted,
+    // a hit protects an old entry, and files that are not entries are never counted or removed.
+    char sources[BENCH_LRU_SOURCES][64], entries[BENCH_LRU_SOURCES][MAX_CACHE_PATH];
+    int written = 1;
+    for (int i = 0; i < BENCH_LRU_SOURCES; i++) {
+        snprintf(sources[i], sizeof(sources[i]), "bench-cache-lru-%d.bmp", i);
+        written &= benchWriteSource(sources[i], 320, 180, modified) == 0;
+    }
+    for (int i = 0; i < BENCH_LRU_SOURCES - 1; i++) {
+        written &= wallpaperCacheResolve(sources[i], 640, 360, entries[i], sizeof(entries[i])) == 0;
+        struct utimbuf used = {2000 + i, 2000 + i};
+        utime(entries[i], &used);
+    }
+    FILE *frame = fopen(CACHE_DIRECTORY "/transition-0.bmp", "wb");
+    if (frame != NULL) {
+        fclose(frame);
+    }
+    written &= wallpaperCacheResolve(sources[0], 640, 360, entries[0], sizeof(entries[0])) == 0 && stat(entries[0], &info) == 0;
+    wallpaperCacheSetLimit(info.st_size * 3);
+    written &= wallpaperCacheResolve(sources[3], 640, 360, entries[3], sizeof(entries[3])) == 0;
+    failures += kernelReport("limit evicts the oldest entry",
+                             written && benchExists(entries[0]) && !benchExists(entries[1]) && benchExists(entries[2])
+                             && benchExists(entries[3]));
+    wallpaperCacheSetLimit(info.st_size);
+    int remaining = 0;
+    for (int i = 0; i < BENCH_LRU_SOURCES; i++) {
+        remaining += benchExists(entries[i]);
+    }
+    failures += kernelReport("lower limit evicts at once", remaining == 1 && benchExists(CACHE_DIRECTORY "/transition-0.bmp"));
+    wallpaperCacheSetLimit(CACHE_DEFAULT_LIMIT);
+    for (int i = 0; i < BENCH_LRU_SOURCES; i++) {
+        remove(entries[i]);
+        remove(sources[i]);
+    }
+    remove(CACHE_DIRECTORY "/transition-0.bmp");
+
+    // A miss decodes, scales and writes the BMP, a hit only hashes the key and checks the entry.
+    double missTotal = 0, hitTotal = 0;
+    for (int n = 0; n < BENCH_ITERATIONS; n++) {
+        remove(fitted);
+        double start = kernelNow();
+        wallpaperCacheResolve(BENCH_SOURCE_PATH, BENCH_TARGET_WIDTH, BENCH_TARGET_HEIGHT, fitted, sizeof(fitted));
+        double middle = kernelNow();
+        wallpaperCacheResolve(BENCH_SOURCE_PATH, BENCH_TARGET_WIDTH, BENCH_TARGET_HEIGHT, fitted, sizeof(fitted));
+        hitTotal += kernelNow() - middle;
+        missTotal += middle - start;
+    }
+    printf("miss  %dx%d->%dx%d  mean %.2f ms\n", BENCH_SOURCE_WIDTH + 1, BENCH_SOURCE_HEIGHT, BENCH_TARGET_WIDTH, BENCH_TARGET_HEIGHT,
+           missTotal / BENCH_ITERATIONS);
+    printf("hit   %dx%d->%dx%d  mean %.3f ms\n", BENCH_SOURCE_WIDTH + 1, BENCH_SOURCE_HEIGHT, BENCH_TARGET_WIDTH, BENCH_TARGET_HEIGHT,
+           hitTotal / BENCH_ITERATIONS);
+
+    remove(fitted);
+    remove(BENCH_SOURCE_PATH);
+    rmdir(CACHE_DIRECTORY);
+    return failures != 0;
+}
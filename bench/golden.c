@@ -0,0 +1,115 @@
+/**
+ * @file golden.c
+ * @brief Golden image check of the scaler.
+ *
+ * Scales the checked-in source image with every kernel the CPU supports, both filters and all composition
+ * modes, up and down, and compares each result against the reference rendered by Pillow (see bench/golden.py).
+ * A channel may differ by GOLDEN_TOLERANCE, since Pillow rounds its weights with more fraction bits;
+ * alpha has to stay opaque. Exits with 1 if any result is off or a reference is missing.
+ *
+ * Build and run with: make check-scale
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scale.h"
+#include "kernel.h"
+
+#define GOLDEN_TOLERANCE 1 // Largest allowed difference of a colour channel.
+#define GOLDEN_BACKGROUND 0x336699 // Background of the references, see bench/golden.py.
+#define GOLDEN_PATH_SIZE 512
+
+static const int targets[][2] = {{301, 170}, {67, 53}}; // Upscale and downscale, as in bench/golden.py.
+
+// Source and references of the check
+typedef struct Golden {
+    const char *directory; // Directory of source.png and the references.
+    Image source; // The decoded source.png.
+} Golden;
+
+/**
+ * @brief Returns the largest channel difference of two images of the same size, or 256 if alpha is not opaque.
+ */
+static int goldenDifference(const Image *actual, const Image *expected);
+
+/**
+ * @brief Scales the source with the current kernel and compares it against the reference of one case.
+ *
+ * @return The largest channel difference, or -1 if the reference cannot be loaded or scaling fails.
+ */
+static int goldenCompare(const char *directory, const Image *source, int filter, int mode, int width, int height);
+
+/**
+ * @brief Compares the selected kernel against the references of all filters and modes, see KernelCheck.
+ */
+static int goldenCheck(void *context, const char *kernel);
+
+static int goldenDifference(const Image *actual, const Image *expected) {
+    int largest = 0;
+    for (int y = 0; y < actual->height; y++) {
+        const unsigned char *a = actual->pixels + (size_t)y * actual->stride;
+        const unsigned char *e = expected->pixels + (size_t)y * expected->stride;
+        for (int x = 0; x < actual->width * 4; x++) {
+            int difference = abs(a[x] - e[x]);
+            if (x % 4 == 3 && a[x] != 255) {
+                return 256;
+            }
+            largest = difference > largest ? difference : largest;
+        }
+    }
+    return largest;
+}
+
+static int goldenCompare(const char *directory, const Image *source, int filter, int mode, int width, int height) {
+    char path[GOLDEN_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/%s-%s-%dx%d.png", directory, scaleFilterName(filter), scaleModeName(mode), width, height);
+    Image expected, actual;
+    if (imageLoad(path, &expected) != 0) {
+        fprintf(stderr, "Failure loading %s\n", path);
+        return -1;
+    }
+    ScaleOptions options = {mode, filter, GOLDEN_BACKGROUND, 0, 0};
+    int difference = -1;
+    if (expected.width == width && expected.height == height && imageCreate(&actual, width, height) == 0) {
+        if (scaleImage(source, &actual, &options) == 0) {
+            difference = goldenDifference(&actual, &expected);
+        }
+        imageFree(&actual);
+    }
+    imageFree(&expected);
+    return difference;
+}
+
+static int goldenCheck(void *context, const char *kernel) {
+    Golden *golden = context;
+    int failures = 0;
+    for (int filter = SCALE_BILINEAR; filter <= SCALE_LANCZOS3; filter++) {
+        for (int mode = SCALE_FILL; mode <= SCALE_SPAN; mode++) {
+            // The worst case over all targets is reported.
+            int largest = 0;
+            for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]) && largest >= 0; t++) {
+                int difference = goldenCompare(golden->directory, &golden->source, filter, mode, targets[t][0], targets[t][1]);
+                largest = difference < 0 || difference > largest ? difference : largest;
+            }
+            int passed = largest >= 0 && largest <= GOLDEN_TOLERANCE;
+            printf("%-6s  %-8s  %-7s  max %3d  %s\n", kernel, scaleFilterName(filter), scaleModeName(mode), largest, passed ? "ok" : "FAILED");
+            failures += !passed;
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    Golden golden = {argc > 1 ? argv[1] : "bench/golden"};
+    char path[GOLDEN_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/source.png", golden.directory);
+    if (imageLoad(path, &golden.source) != 0) {
+        fprintf(stderr, "Failure loading %s\n", path);
+        return 1;
+    }
+
+    int failures = kernelEach(scaleSetKernel, goldenCheck, &golden);
+    imageFree(&golden.source);
+    return failures != 0;
+}
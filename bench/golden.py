@@ -0,0 +1,81 @@
+"""Module to render the reference images of `make check-scale` with Pillow.
+
+Pillow's resampling is an independent implementation of the same filters: triangle and Lanczos-3 weights,
+widened when downscaling, applied in a horizontal and a vertical pass with 8-bit rounding in between. Its
+fixed point weights have more fraction bits, so results may differ by one level, which the check allows.
+The composition modes are laid out here the way `include/scale.c` documents them.
+
+The source is a crop of `img/night.jpg` with hard edges and a fine checkerboard drawn over it, saved as PNG so
+both sides decode the same pixels. Run from the repository root:
+
+    python3 bench/golden.py -o bench/golden
+"""
+import argparse
+import os
+
+from PIL import Image, ImageDraw
+
+SOURCE_SIZE = (160, 100)
+TARGETS = [(301, 170), (67, 53)]
+MODES = ["fill", "fit", "center", "stretch", "span"]
+FILTERS = {"bilinear": Image.BILINEAR, "lanczos3": Image.LANCZOS}
+BACKGROUND = (0x33, 0x66, 0x99)
+
+def make_source(path):
+    """Builds the source image from a crop of the night wallpaper with shapes that provoke ringing."""
+    photo = Image.open(path).convert("RGB")
+    source = photo.crop((1200, 600, 2800, 1600)).resize(SOURCE_SIZE, Image.LANCZOS)
+    draw = ImageDraw.Draw(source)
+    draw.rectangle((10, 10, 49, 39), fill=(255, 255, 255))
+    draw.rectangle((20, 18, 39, 31), fill=(0, 0, 0))
+    draw.line((60, 90, 150, 5), fill=(255, 0, 0), width=3)
+    for y in range(60, 90):
+        for x in range(100, 150):
+            if (x + y) % 2 == 0:
+                source.putpixel((x, y), (0, 255, 0))
+    return source
+
+def render(source, size, mode, resample):
+    """Lays the source out on a target of the given size like scaleRegion() and resamples it."""
+    width, height = size
+    source_width, source_height = source.size
+    scale_x, scale_y = width / source_width, height / source_height
+    target = Image.new("RGB", size, BACKGROUND)
+    if mode in ("fill", "span"):
+        scale = max(scale_x, scale_y)
+        box_width, box_height = width / scale, height / scale
+        left, top = (source_width - box_width) / 2, (source_height - box_height) / 2
+        return source.resize(size, resample, box=(left, top, left + box_width, top + box_height))
+    if mode == "stretch":
+        return source.resize(size, resample)
+    if mode == "fit":
+        scale = min(scale_x, scale_y)
+        # lround() of scaleRegion(), Python rounds halves to even.
+        fit_width = max(1, min(width, int(source_width * scale + 0.5)))
+        fit_height = max(1, min(height, int(source_height * scale + 0.5)))
+        target.paste(source.resize((fit_width, fit_height), resample), ((width - fit_width) // 2, (height - fit_height) // 2))
+        return target
+    # Center copies whole pixels.
+    copy_width, copy_height = min(source_width, width), min(source_height, height)
+    left, top = (source_width - copy_width) // 2, (source_height - copy_height) // 2
+    target.paste(source.crop((left, top, left + copy_width, top + copy_height)),
+                 ((width - copy_width) // 2, (height - copy_height) // 2))
+    return target
+
+def main():
+    parser = argparse.ArgumentParser(description="Render the reference images of the scale check.")
+    parser.add_argument("-o", "--output", required=True, help="Directory to write source.png and the references to")
+    parser.add_argument("-s", "--source", default=os.path.join("img", "night.jpg"), help="Photo the source is cut from")
+
+    args = parser.parse_args()
+    os.makedirs(args.output, exist_ok=True)
+    source = make_source(args.source)
+    source.save(os.path.join(args.output, "source.png"))
+    for name, resample in FILTERS.items():
+        for mode in MODES:
+            for size in TARGETS:
+                reference = render(source, size, mode, resample)
+                reference.save(os.path.join(args.output, f"{name}-{mode}-{size[0]}x{size[1]}.png"))
+
+if __name__ == "__main__":
+    main()
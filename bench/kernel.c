@@ -0,0 +1,157 @@
+/**
+ * @file kernel.c
+ * @brief Shared harness of the kernel checks: compare each SIMD kernel against the scalar one, then time it.
+ *
+ * Used by make bench-blend, bench-scale, bench-analyze and check-scale; bench-cache and bench-anim
+ * only use its timer and check reporter. A module under test passes its
+ * kernel selection function; the harness walks the scalar, SSE2 and AVX2 kernels, skips the ones the CPU
+ * lacks, and prints one line per timed operation with the mean and best of all iterations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "kernel.h"
+
+static const char *kernelNames[] = {"scalar", "sse2", "avx2"};
+
+/**
+ * @brief Allocates an image and fills it with pseudo random bytes, including the padding of each row.
+ *
+ * @param image Receives the image, its pixels are released with free() or imageFree().
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @param padding Bytes added to each row after width * 4.
+ * @param seed Seed of the random bytes.
+ * @return Returns 0 on success, or 1 if out of memory.
+ */
+int kernelImage(Image *image, int width, int height, int padding, unsigned int seed);
+
+/**
+ * @brief Returns a monotonic timestamp in milliseconds.
+ */
+double kernelNow();
+
+/**
+ * @brief Prints the result of a named check.
+ *
+ * @param name Describes what is checked.
+ * @param passed Whether the check passed.
+ * @return Returns 1 if the check failed, otherwise 0.
+ */
+int kernelReport(const char *name, int passed);
+
+/**
+ * @brief Selects each kernel the CPU supports in turn and runs the checks of the module on it.
+ *
+ * @param select Kernel selection of the module.
+ * @param check Checks and times the selected kernel.
+ * @param context Passed to check.
+ * @return Returns the total number of failed checks.
+ */
+int kernelEach(KernelSelect select, KernelCheck check, void *context);
+
+/**
+ * @brief Runs an operation with the scalar kernel and with another one, and compares the output.
+ *
+ * Both runs start from the same output contents, so bytes that only one kernel writes or skips show up
+ * as a difference. The kernel under test is left selected.
+ *
+ * @param select Kernel selection of the module.
+ * @param kernel Kernel under test.
+ * @param run Writes the output.
+ * @param context Passed to run.
+ * @param output Output of the operation, including any padding that must not change; holds the result of the kernel.
+ * @param size Size of output in bytes.
+ * @return Returns 0 if the outputs are equal, or 1 if they differ or memory runs out.
+ */
+int kernelMatches(KernelSelect select, const char *kernel, KernelRun run, void *context, void *output, size_t size);
+
+/**
+ * @brief Times an operation with the selected kernel and prints the result.
+ *
+ * @param kernel Name of the selected kernel.
+ * @param mismatch Whether the kernel failed its comparison against the scalar kernel.
+ * @param label Describes the operation, e.g. its size.
+ * @param pixels Pixels written per run, for the throughput.
+ * @param iterations Number of timed runs.
+ * @param run The operation.
+ * @param context Passed to run.
+ */
+void kernelTime(const char *kernel, int mismatch, const char *label, double pixels, int iterations, KernelRun run, void *context);
+
+int kernelImage(Image *image, int width, int height, int padding, unsigned int seed) {
+    image->width = width;
+    image->height = height;
+    image->stride = width * 4 + padding;
+    image->pixels = malloc((size_t)image->stride * height);
+    if (image->pixels == NULL) {
+        return 1;
+    }
+    for (size_t i = 0; i < (size_t)image->stride * height; i++) {
+        seed = seed * 1103515245u + 12345u;
+        image->pixels[i] = (unsigned char)(seed >> 16);
+    }
+    return 0;
+}
+
+double kernelNow() {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+int kernelReport(const char *name, int passed) {
+    printf("%-34s  %s\n", name, passed ? "ok" : "FAILED");
+    return !passed;
+}
+
+int kernelEach(KernelSelect select, KernelCheck check, void *context) {
+    int failures = 0;
+    for (size_t k = 0; k < sizeof(kernelNames) / sizeof(kernelNames[0]); k++) {
+        if (select(kernelNames[k]) != 0) {
+            printf("%-6s  unsupported\n", kernelNames[k]);
+            continue;
+        }
+        failures += check(context, kernelNames[k]);
+    }
+    return failures;
+}
+
+int kernelMatches(KernelSelect select, const char *kernel, KernelRun run, void *context, void *output, size_t size) {
+    unsigned char *initial = malloc(size), *expected = malloc(size);
+    if (initial == NULL || expected == NULL) {
+        free(initial);
+        free(expected);
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    memcpy(initial, output, size);
+    select("scalar");
+    run(context, 0);
+    memcpy(expected, output, size);
+    memcpy(output, initial, size);
+    select(kernel);
+    run(context, 0);
+    int result = memcmp(expected, output, size) != 0;
+    free(initial);
+    free(expected);
+    return result;
+}
+
+void kernelTime(const char *kernel, int mismatch, const char *label, double pixels, int iterations, KernelRun run, void *context) {
+    double best = 0, total = 0;
+    for (int i = 0; i < iterations; i++) {
+        double start = kernelNow();
+        run(context, i);
+        double elapsed = kernelNow() - start;
+        total += elapsed;
+        if (i == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    printf("%-6s  %s  %s  mean %.2f ms  best %.2f ms  %.0f MPixel/s\n", kernel, mismatch ? "MISMATCH" : "ok", label,
+           total / iterations, best, pixels / best / 1000.0);
+}
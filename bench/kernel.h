@@ -0,0 +1,23 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <stddef.h>
+
+#include "image.h"
+
+// Selects a kernel of the module under test by name, returns nonzero if the CPU does not support it
+typedef int (*KernelSelect)(const char *kernel);
+
+// Runs the operation under test once with the selected kernel
+typedef void (*KernelRun)(void *context, int iteration);
+
+// Checks and times the selected kernel, returns the number of failed checks
+typedef int (*KernelCheck)(void *context, const char *kernel);
+
+int kernelImage(Image *image, int width, int height, int padding, unsigned int seed);
+double kernelNow();
+int kernelReport(const char *name, int passed);
+int kernelEach(KernelSelect select, KernelCheck check, void *context);
+int kernelMatches(KernelSelect select, const char *kernel, KernelRun run, void *context, void *output, size_t size);
+void kernelTime(const char *kernel, int mismatch, const char *label, double pixels, int iterations, KernelRun run, void *context);
+#endif // KERNEL_H
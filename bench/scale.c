@@ -0,0 +1,298 @@
+/**
+ * @file scale.c
+ * @brief Benchmark and correctness check of the scale kernels.
+ *
+ * Every kernel the CPU supports is compared byte by byte against the scalar kernel for both filters,
+ * all modes, odd sizes and up- and downscaling. The scalar kernel is checked against properties
+ * that hold for any correct scaler: a plain colour stays the same, scaling to the same size with
+ * the bilinear filter and copying with SCALE_CENTER keep every pixel, and the bars of SCALE_FIT have
+ * the background colour. scaleReader() has to match scaleImage() on the decoded image for every mode and
+ * band size, including a JPEG reduced while decoding and, when built with HAVE_LIBAVIF, the AVIF shipped as
+ * img/day.jpg. Then 4K to 1080p and 1080p to 5K are timed.
+ * Exits with 1 if any check fails.
+ *
+ * Build and run with: make bench-scale
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jpeglib.h>
+
+#include "scale.h"
+#include "kernel.h"
+
+#define BENCH_ITERATIONS 10
+#define BENCH_BMP_PATH "bench-scale.bmp"
+#define BENCH_JPEG_PATH "bench-scale.jpg"
+#define BENCH_AVIF_PATH "img/day.jpg" // Run from the repository root.
+
+static const int sizes[][4] = {{1, 1, 7, 5}, {13, 7, 3, 2}, {37, 29, 101, 67}, {640, 480, 333, 199}, {200, 100, 100, 200}};
+static const int timings[][4] = {{3840, 2160, 1920, 1080}, {1920, 1080, 5120, 2880}};
+
+// Images and options of one scale
+typedef struct BenchScale {
+    Image source; // Input.
+    Image target; // Output.
+    ScaleOptions options; // Mode and filter.
+} BenchScale;
+
+/**
+ * @brief Scales the source once, see KernelRun.
+ */
+static void benchRun(void *context, int iteration);
+
+/**
+ * @brief Compares a kernel against the scalar kernel on all modes and filters of one size.
+ *
+ * @return Returns 0 if all outputs match, or 1 otherwise.
+ */
+static int benchVerify(const char *kernel, const int *size);
+
+/**
+ * @brief Compares a kernel against the scalar kernel on all sizes and times it, see KernelCheck.
+ */
+static int benchCheck(void *context, const char *kernel);
+
+/**
+ * @brief Checks the output of the scalar kernel against known properties.
+ *
+ * @return Returns the number of failed checks.
+ */
+static int benchProperties();
+
+/**
+ * @brief Writes an image as a baseline JPEG.
+ */
+static int benchWriteJpeg(const char *path, const Image *image);
+
+/**
+ * @brief Compares scaleReader() on a file against scaleImage() on the image the reader decodes.
+ *
+ * @param path The image file.
+ * @param reduced Whether the decoder is expected to reduce the image for the small targets.
+ * @return Returns the number of failed checks.
+ */
+static int benchStream(const char *path, int reduced);
+
+static void benchRun(void *context, int iteration) {
+    BenchScale *bench = context;
+    scaleImage(&bench->source, &bench->target, &bench->options);
+}
+
+static int benchVerify(const char *kernel, const int *size) {
+    BenchScale bench;
+    if (kernelImage(&bench.source, size[0], size[1], 0, 1) != 0 || kernelImage(&bench.target, size[2], size[3], 0, 2) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    int result = 0;
+    for (int mode = SCALE_FILL; mode <= SCALE_SPAN && result == 0; mode++) {
+        for (int filter = SCALE_BILINEAR; filter <= SCALE_LANCZOS3 && result == 0; filter++) {
+            bench.options = (ScaleOptions){mode, filter, 0x336699, 3};
+            if (kernelMatches(scaleSetKernel, kernel, benchRun, &bench, bench.target.pixels,
+                              (size_t)bench.target.stride * bench.target.height) != 0) {
+                fprintf(stderr, "%s differs from scalar at %dx%d->%dx%d, %s %s\n", kernel, size[0], size[1], size[2], size[3],
+                        scaleModeName(mode), scaleFilterName(filter));
+                result = 1;
+            }
+        }
+    }
+
+    imageFree(&bench.source);
+    imageFree(&bench.target);
+    return result;
+}
+
+static int benchCheck(void *context, const char *kernel) {
+    int mismatch = 0;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]) && !mismatch; i++) {
+        mismatch = benchVerify(kernel, sizes[i]);
+    }
+
+    for (size_t i = 0; i < sizeof(timings) / sizeof(timings[0]); i++) {
+        BenchScale bench;
+        if (kernelImage(&bench.source, timings[i][0], timings[i][1], 0, 5) != 0 || imageCreate(&bench.target, timings[i][2], timings[i][3]) != 0) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        for (int filter = SCALE_BILINEAR; filter <= SCALE_LANCZOS3; filter++) {
+            bench.options = (ScaleOptions){SCALE_FILL, filter, 0, 0};
+            char label[64];
+            snprintf(label, sizeof(label), "%-8s  %dx%d->%dx%d", scaleFilterName(filter), timings[i][0], timings[i][1], timings[i][2],
+                     timings[i][3]);
+            kernelTime(kernel, mismatch, label, timings[i][2] * (double)timings[i][3], BENCH_ITERATIONS, benchRun, &bench);
+        }
+        imageFree(&bench.source);
+        imageFree(&bench.target);
+    }
+    return mismatch;
+}
+
+static int benchProperties() {
+    int failures = 0;
+    Image source, target;
+    scaleSetKernel("scalar");
+
+    // A plain colour stays the same with every filter and mode, the weights of each pixel sum to one.
+    if (imageCreate(&source, 97, 61) == 0 && imageCreate(&target, 250, 40) == 0) {
+        for (size_t i = 0; i < (size_t)source.stride * source.height; i += 4) {
+            memcpy(source.pixels + i, "\x20\x80\xe0\xff", 4);
+        }
+        for (int filter = SCALE_BILINEAR; filter <= SCALE_LANCZOS3; filter++) {
+            ScaleOptions options = {SCALE_STRETCH, filter, 0, 1};
+            scaleImage(&source, &target, &options);
+            for (size_t i = 0; i < (size_t)target.stride * target.height; i += 4) {
+                if (memcmp(target.pixels + i, "\x20\x80\xe0\xff", 4) != 0) {
+                    fprintf(stderr, "%s changes a plain colour\n", scaleFilterName(filter));
+                    failures++;
+                    break;
+                }
+            }
+        }
+
+        // Fitting 97x61 into 250x40 leaves bars left and right.
+        ScaleOptions options = {SCALE_FIT, SCALE_LANCZOS3, 0x336699, 1};
+        scaleImage(&source, &target, &options);
+        if (memcmp(target.pixels, "\x99\x66\x33\xff", 4) != 0
+            || memcmp(target.pixels + (size_t)target.width * 4 - 4, "\x99\x66\x33\xff", 4) != 0
+            || memcmp(target.pixels + (size_t)target.width * 2, "\x20\x80\xe0\xff", 4) != 0) {
+            fprintf(stderr, "fit does not show the background colour in the bars\n");
+            failures++;
+        }
+        imageFree(&source);
+        imageFree(&target);
+    }
+
+    // Scaling to the same size with bilinear weights and centering copy every pixel.
+    if (kernelImage(&source, 123, 45, 0, 4) == 0 && imageCreate(&target, 123, 45) == 0) {
+        for (int mode = SCALE_FILL; mode <= SCALE_CENTER; mode++) {
+            ScaleOptions options = {mode, SCALE_BILINEAR, 0, 1};
+            scaleImage(&source, &target, &options);
+            if (memcmp(source.pixels, target.pixels, (size_t)source.stride * source.height) != 0) {
+                fprintf(stderr, "%s at the same size changes the image\n", scaleModeName(mode));
+                failures++;
+            }
+        }
+        imageFree(&source);
+        imageFree(&target);
+    }
+    return failures;
+}
+
+static int benchWriteJpeg(const char *path, const Image *image) {
+    FILE *file = fopen(path, "wb");
+    unsigned char *row = malloc((size_t)image->width * 3);
+    if (file == NULL || row == NULL) {
+        free(row);
+        if (file != NULL) {
+            fclose(file);
+        }
+        return 1;
+    }
+    struct jpeg_compress_struct info;
+    struct jpeg_error_mgr manager;
+    info.err = jpeg_std_error(&manager);
+    jpeg_create_compress(&info);
+    jpeg_stdio_dest(&info, file);
+    info.image_width = image->width;
+    info.image_height = image->height;
+    info.input_components = 3;
+    info.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&info);
+    jpeg_start_compress(&info, TRUE);
+    while (info.next_scanline < info.image_height) {
+        const unsigned char *in = image->pixels + (size_t)info.next_scanline * image->stride;
+        for (int x = 0; x < image->width; x++) {
+            row[x * 3 + 0] = in[x * 4 + 2];
+            row[x * 3 + 1] = in[x * 4 + 1];
+            row[x * 3 + 2] = in[x * 4 + 0];
+        }
+        jpeg_write_scanlines(&info, &row, 1);
+    }
+    jpeg_finish_compress(&info);
+    jpeg_destroy_compress(&info);
+    free(row);
+    return fclose(file) != 0;
+}
+
+static int benchStream(const char *path, int reduced) {
+    static const int targets[][2] = {{160, 90}, {301, 377}, {1000, 1000}};
+    static const size_t budgets[] = {0, 1, 200 * 1024, 4 << 20};
+    int failures = 0, reductions = 0;
+
+    for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); t++) {
+        Image source, expected, actual;
+        if (imageCreate(&expected, targets[t][0], targets[t][1]) != 0 || imageCreate(&actual, targets[t][0], targets[t][1]) != 0) {
+            return failures + 1;
+        }
+        for (int mode = SCALE_FILL; mode <= SCALE_SPAN; mode++) {
+            ScaleOptions options = {mode, SCALE_LANCZOS3, 0x336699, 2, 0};
+            int failed = 0;
+            for (size_t b = 0; !failed && b < sizeof(budgets) / sizeof(budgets[0]); b++) {
+                ImageReader reader;
+                options.memory = budgets[b];
+                memset(actual.pixels, 0, (size_t)actual.stride * actual.height);
+                if (imageReaderOpen(&reader, path) != 0 || scaleReader(&reader, &actual, &options) != 0) {
+                    imageReaderClose(&reader);
+                    return failures + 1;
+                }
+                int denominator = (reader.sourceWidth + reader.width / 2) / reader.width;
+                imageReaderClose(&reader);
+
+                // The expected image is scaled from the whole image, decoded with the same reduction.
+                if (b == 0) {
+                    reductions += denominator > 1;
+                    failed = imageReaderOpen(&reader, path) != 0;
+                    imageReaderReduce(&reader, denominator);
+                    failed = failed || imageCreate(&source, reader.width, reader.height) != 0
+                        || imageReaderRead(&reader, source.pixels, source.stride, reader.height) != 0
+                        || scaleImage(&source, &expected, &options) != 0;
+                    imageReaderClose(&reader);
+                    imageFree(&source);
+                }
+                if (failed || memcmp(expected.pixels, actual.pixels, (size_t)expected.stride * expected.height) != 0) {
+                    fprintf(stderr, "scaleReader differs at %s->%dx%d, %s, budget %zu\n", path, targets[t][0], targets[t][1],
+                            scaleModeName(mode), budgets[b]);
+                    failed = 1;
+                }
+            }
+            failures += failed;
+        }
+        imageFree(&expected);
+        imageFree(&actual);
+    }
+    if ((reductions > 0) != reduced) {
+        fprintf(stderr, "%s was %s while decoding\n", path, reductions > 0 ? "reduced" : "not reduced");
+        failures++;
+    }
+    return failures;
+}
+
+int main() {
+    printf("Default kernel: %s\n", scaleKernelName());
+    int failures = benchProperties();
+    printf("Properties    %s\n", failures != 0 ? "FAILED" : "ok");
+
+    // A bottom-up BMP is read row by row, the JPEG is also reduced while decoding for the small targets.
+    Image image;
+    if (kernelImage(&image, 1283, 643, 0, 6) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    int streamFailures = imageWriteBmp(BENCH_BMP_PATH, &image) != 0 || benchWriteJpeg(BENCH_JPEG_PATH, &image) != 0;
+    imageFree(&image);
+    streamFailures += benchStream(BENCH_BMP_PATH, 0) + benchStream(BENCH_JPEG_PATH, 1);
+#ifdef HAVE_LIBAVIF
+    // AV1 frames are decoded whole, only the conversion to BGRA runs in bands.
+    streamFailures += benchStream(BENCH_AVIF_PATH, 0);
+#endif
+    remove(BENCH_BMP_PATH);
+    remove(BENCH_JPEG_PATH);
+    printf("Streaming     %s\n", streamFailures != 0 ? "FAILED" : "ok");
+    failures += streamFailures;
+
+    failures += kernelEach(scaleSetKernel, benchCheck, NULL);
+    return failures != 0;
+}
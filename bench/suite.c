@@ -0,0 +1,739 @@
+/**
+ * @file suite.c
+ * @brief Benchmark cases for the hot paths of the daemon.
+ *
+ * Covers:
+ * - reading and writing configs of growing size,
+ * - logging under contention and recording metrics,
+ * - reading config snapshots while they are replaced,
+ * - the schedule decisions,
+ * - image decoding and scaling, and streaming a large image into the scaler,
+ * - classifying an image,
+ * - rescanning and picking from a wallpaper library in name and shuffled order,
+ * - the end-to-end transition path driven by the Cycle, with a stub wallpaper backend that
+ *   renders the frames but does not show them.
+ *
+ * All inputs are generated in the working directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <jpeglib.h>
+#include <png.h>
+
+#include "log.h"
+#include "metrics.h"
+#include "config.h"
+#include "ini.h"
+#include "image.h"
+#include "scale.h"
+#include "blend.h"
+#include "cache.h"
+#include "background.h"
+#include "schedule.h"
+#include "cycle.h"
+#include "transition.h"
+#include "thread.h"
+#include "library.h"
+#include "analyze.h"
+#include "playlist.h"
+#include "bench.h"
+
+#define BENCH_KEYS_PER_SECTION 16
+#define BENCH_LOG_THREADS 8
+#define BENCH_LOG_BATCH 16 // Records per thread and sample, all threads together stay within half of the 256 slot ring.
+#define BENCH_METRICS_THREADS 4
+#define BENCH_IMAGE_WIDTH 1920
+#define BENCH_IMAGE_HEIGHT 1080
+#define BENCH_LARGE_WIDTH 7680
+#define BENCH_LARGE_HEIGHT 4320
+#define BENCH_LARGE_PATH "bench-8k.jpg"
+#define BENCH_TRANSITION_FRAMES 8
+#define BENCH_TRANSITION_WINDOW (30 * 60)
+#define BENCH_DAY_PATH "bench-day.jpg"
+#define BENCH_NIGHT_PATH "bench-night.jpg"
+#define BENCH_LIBRARY_PATH "bench-library"
+#define BENCH_LIBRARY_FILES 10000
+
+static const int configSizes[] = {16, 256, 4096}; // Number of keys of the generated configs.
+
+// Generated config of a given size
+typedef struct BenchConfig {
+    char path[64]; // Path of the config file.
+    char section[32]; // Section of the last key, the slowest to find in a linear scan.
+    char key[32]; // The last key.
+    IniDocument *document; // The loaded config.
+    int writes; // Number of writes so far, alternates the written value.
+} BenchConfig;
+
+// Simulated clock and cycle used by the schedule and transition cases
+typedef struct BenchCycle {
+    time_t now; // Simulated current time.
+    time_t windowStart; // Start of the crossfade window the transition case replays.
+    int frame; // Frame the transition case renders next.
+    Clock clock; // Clock reading now.
+    CycleBackend backend; // Stub or null backend.
+    Cycle cycle; // The cycle under test.
+    CycleSettings settings; // Settings of the cycle.
+} BenchCycle;
+
+// Source, target and options of an image.scale case
+typedef struct BenchScale {
+    Image source; // Pattern image of the source size.
+    Image target; // Target of the wanted size.
+    ScaleOptions options; // Filter and mode, all processors.
+} BenchScale;
+
+// File, target and options of an image.stream case
+typedef struct BenchStream {
+    const char *path; // Source image file.
+    Image target; // Target of the wanted size.
+    ScaleOptions options; // Mode, filter and memory budget.
+    int whole; // Decode the whole image with imageLoad() and scale it with scaleImage() instead.
+} BenchStream;
+
+// Generated library directory of the library.scan and library.pick cases
+typedef struct BenchLibrary {
+    Image images[2]; // Small images of two sizes, a changed file alternates between them.
+    ThreadEvent *scanned; // Signaled after each scan pass.
+    Library *library; // Open library of the pick case.
+    int changes; // Number of files changed so far, 0 to leave the directory unchanged.
+    long long sequence; // Position picked next.
+    Playlist playlist; // Shuffled order of the shuffle pick case.
+} BenchLibrary;
+
+/**
+ * @brief Writes a config with the given number of keys, BENCH_KEYS_PER_SECTION per section.
+ */
+static int benchWriteConfig(BenchConfig *config, int keys);
+
+/**
+ * @brief Fills an image with a smooth gradient and some noise, similar to a photo for the encoders.
+ */
+static void benchPattern(Image *image, unsigned int seed);
+
+/**
+ * @brief Encodes an image as JPEG with libjpeg.
+ */
+static int benchWriteJpeg(const char *imagePath, const Image *image);
+
+/**
+ * @brief Encodes an image as PNG with libpng.
+ */
+static int benchWritePng(const char *imagePath, const Image *image);
+
+/**
+ * @brief Writes the BENCH_LIBRARY_FILES images of the library directory.
+ */
+static int benchWriteLibrary(BenchLibrary *bench);
+
+/**
+ * @brief Library callback, signals the end of a scan pass.
+ */
+static void benchLibraryScanned(void *argument);
+
+/**
+ * @brief Returns the simulated time of a BenchCycle, the now function of its clock.
+ */
+static time_t benchClockNow(void *context);
+
+/**
+ * @brief Null backend calls, only the schedule is measured.
+ */
+static int benchNullWallpaper(void *context, const char *imagePath);
+static int benchNullFrame(void *context, const char *sourcePath, const char *targetPath, const TransitionStep *step);
+static void benchNullTray(void *context, int targetState);
+
+/**
+ * @brief Stub backend calls, resolve the cached wallpaper or render the frame without showing it.
+ */
+static int benchStubWallpaper(void *context, const char *imagePath);
+static int benchStubFrame(void *context, const char *sourcePath, const char *targetPath, const TransitionStep *step);
+
+/**
+ * @brief Case functions, see benchSuite() for what each one measures.
+ */
+static int benchIniRead(void *context, int thread);
+static int benchIniGet(void *context, int thread);
+static int benchIniWrite(void *context, int thread);
+static int benchLogWrite(void *context, int thread);
+static int benchMetricsCount(void *context, int thread);
+static int benchMetricsRecord(void *context, int thread);
+static int benchConfigAcquire(void *context, int thread);
+static int benchScheduleState(void *context, int thread);
+static int benchScheduleNext(void *context, int thread);
+static int benchSchedulePlan(void *context, int thread);
+static int benchCycleStep(void *context, int thread);
+static int benchImageDecode(void *context, int thread);
+static int benchImageScale(void *context, int thread);
+static int benchImageStream(void *context, int thread);
+static int benchImageBlend(void *context, int thread);
+static int benchImageAnalyze(void *context, int thread);
+static int benchCacheResolve(void *context, int thread);
+static int benchLibraryScan(void *context, int thread);
+static int benchLibraryPick(void *context, int thread);
+static int benchLibraryShuffle(void *context, int thread);
+static int benchBackgroundSet(void *context, int thread);
+static int benchTransitionFrame(void *context, int thread);
+
+/**
+ * @brief Waits until the log writer emptied the ring, called between samples.
+ */
+static int benchLogFlush(void *context, int thread);
+
+/**
+ * @brief Runs all cases.
+ *
+ * @return Returns 0 on success, or 1 if an input could not be generated or a case could not run.
+ */
+int benchSuite();
+
+static int benchWriteConfig(BenchConfig *config, int keys) {
+    snprintf(config->path, sizeof(config->path), "bench-%d.ini", keys);
+    FILE *file = fopen(config->path, "w");
+    if (file == NULL) {
+        return 1;
+    }
+    for (int i = 0; i < keys; i++) {
+        if (i % BENCH_KEYS_PER_SECTION == 0) {
+            fprintf(file, "[Section%d]\n", i / BENCH_KEYS_PER_SECTION);
+        }
+        fprintf(file, "KEY%d = ./img/value-%d.jpg\n", i, i);
+    }
+    fclose(file);
+    snprintf(config->section, sizeof(config->section), "Section%d", (keys - 1) / BENCH_KEYS_PER_SECTION);
+    snprintf(config->key, sizeof(config->key), "KEY%d", keys - 1);
+    config->document = iniLoad(config->path);
+    config->writes = 0;
+    return config->document == NULL;
+}
+
+static void benchPattern(Image *image, unsigned int seed) {
+    for (int y = 0; y < image->height; y++) {
+        unsigned char *row = image->pixels + (size_t)y * image->stride;
+        for (int x = 0; x < image->width; x++) {
+            seed = seed * 1103515245u + 12345u;
+            int noise = (seed >> 16) % 16;
+            row[x * 4 + 0] = (unsigned char)(x * 255 / image->width + noise);
+            row[x * 4 + 1] = (unsigned char)(y * 255 / image->height + noise);
+            row[x * 4 + 2] = (unsigned char)((x + y) * 127 / (image->width + image->height) + (seed >> 24) % 64);
+            row[x * 4 + 3] = 255;
+        }
+    }
+}
+
+static int benchWriteJpeg(const char *imagePath, const Image *image) {
+    FILE *file = fopen(imagePath, "wb");
+    unsigned char *row = malloc((size_t)image->width * 3);
+    if (file == NULL || row == NULL) {
+        if (file != NULL) {
+            fclose(file);
+        }
+        free(row);
+        return 1;
+    }
+
+    struct jpeg_compress_struct info;
+    struct jpeg_error_mgr errorManager;
+    info.err = jpeg_std_error(&errorManager);
+    jpeg_create_compress(&info);
+    jpeg_stdio_dest(&info, file);
+    info.image_width = image->width;
+    info.image_height = image->height;
+    info.input_components = 3;
+    info.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&info);
+    jpeg_set_quality(&info, 90, TRUE);
+    jpeg_start_compress(&info, TRUE);
+    while (info.next_scanline < info.image_height) {
+        const unsigned char *source = image->pixels + (size_t)info.next_scanline * image->stride;
+        for (int x = 0; x < image->width; x++) {
+            row[x * 3 + 0] = source[x * 4 + 2];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + 0];
+        }
+        jpeg_write_scanlines(&info, &row, 1);
+    }
+    jpeg_finish_compress(&info);
+    jpeg_destroy_compress(&info);
+    fclose(file);
+    free(row);
+    return 0;
+}
+
+static int benchWritePng(const char *imagePath, const Image *image) {
+    png_image png;
+    memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+    png.width = image->width;
+    png.height = image->height;
+    png.format = PNG_FORMAT_BGRA;
+    return png_image_write_to_file(&png, imagePath, 0, image->pixels, image->stride, NULL) == 0;
+}
+
+static int benchWriteLibrary(BenchLibrary *bench) {
+    char path[64];
+    mkdir(BENCH_LIBRARY_PATH, 0755);
+    for (int i = 0; i < BENCH_LIBRARY_FILES; i++) {
+        // The first pixel numbers the file, identical images would be picked only once.
+        Image *image = &bench->images[i % 2];
+        memcpy(image->pixels, &i, sizeof(i));
+        snprintf(path, sizeof(path), "%s/%05d.bmp", BENCH_LIBRARY_PATH, i);
+        if (imageWriteBmp(path, image) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void benchLibraryScanned(void *argument) {
+    eventSignal(((BenchLibrary *)argument)->scanned);
+}
+
+static time_t benchClockNow(void *context) {
+    return ((BenchCycle *)context)->now;
+}
+
+static int benchNullWallpaper(void *context, const char *imagePath) {
+    return 0;
+}
+
+static int benchNullFrame(void *context, const char *sourcePath, const char *targetPath, const TransitionStep *step) {
+    return 0;
+}
+
+static void benchNullTray(void *context, int targetState) {
+}
+
+static int benchStubWallpaper(void *context, const char *imagePath) {
+    char cachedPath[MAX_CACHE_PATH];
+    return wallpaperCacheResolve(imagePath, BENCH_IMAGE_WIDTH, BENCH_IMAGE_HEIGHT, cachedPath, sizeof(cachedPath));
+}
+
+static int benchStubFrame(void *context, const char *sourcePath, const char *targetPath, const TransitionStep *step) {
+    char framePath[MAX_CACHE_PATH];
+    return transitionRender(sourcePath, targetPath, step, BENCH_IMAGE_WIDTH, BENCH_IMAGE_HEIGHT, framePath, sizeof(framePath));
+}
+
+static int benchIniRead(void *context, int thread) {
+    BenchConfig *config = context;
+    char value[256];
+    return readIniValue(config->path, config->section, config->key, value, sizeof(value));
+}
+
+static int benchIniGet(void *context, int thread) {
+    BenchConfig *config = context;
+    return iniGet(config->document, config->section, config->key) == NULL;
+}
+
+static int benchIniWrite(void *context, int thread) {
+    BenchConfig *config = context;
+    // Alternate the value, writing an unchanged value could be skipped.
+    return writeIniValue(config->path, config->section, config->key, config->writes++ % 2 ? "./img/a.jpg" : "./img/b.jpg");
+}
+
+static int benchLogWrite(void *context, int thread) {
+    return info("Benchmark message from thread %d: %s", thread, (const char *)context);
+}
+
+static int benchLogFlush(void *context, int thread) {
+    logFlush();
+    return 0;
+}
+
+static int benchMetricsCount(void *context, int thread) {
+    metricsCount(METRIC_CYCLE_FRAMES);
+    return 0;
+}
+
+static int benchMetricsRecord(void *context, int thread) {
+    metricsRecord(METRIC_TRANSITION_RENDER, 1000 + thread * 37);
+    return 0;
+}
+
+static int benchConfigAcquire(void *context, int thread) {
+    // Thread 0 publishes on every call, the others only read.
+    if (thread == 0 && context != NULL) {
+        return configPublish(context);
+    }
+    const Config *config = configAcquire();
+    int result = config == NULL || config->fromTime >= config->toTime;
+    configRelease();
+    return result;
+}
+
+static int benchScheduleState(void *context, int thread) {
+    BenchCycle *bench = context;
+    int state;
+    bench->now += 7 * 60;
+    return backgroundStateAt(6, 22, bench->now, &state);
+}
+
+static int benchScheduleNext(void *context, int thread) {
+    BenchCycle *bench = context;
+    time_t next;
+    bench->now += 7 * 60;
+    return nextTransitionTime(6, 22, bench->now, &next);
+}
+
+static int benchSchedulePlan(void *context, int thread) {
+    BenchCycle *bench = context;
+    TransitionStep step;
+    bench->now += 7 * 60;
+    return transitionPlan(6, 22, BENCH_TRANSITION_FRAMES, BENCH_TRANSITION_WINDOW, bench->now, &step);
+}
+
+static int benchCycleStep(void *context, int thread) {
+    BenchCycle *bench = context;
+    time_t next;
+    int result = cycleStep(&bench->cycle, &bench->settings, &next);
+    bench->now = next;
+    return result;
+}
+
+static int benchImageDecode(void *context, int thread) {
+    Image image = {0};
+    int result = imageLoad(context, &image);
+    imageFree(&image);
+    return result;
+}
+
+static int benchImageScale(void *context, int thread) {
+    BenchScale *scale = context;
+    return scaleImage(&scale->source, &scale->target, &scale->options);
+}
+
+static int benchImageStream(void *context, int thread) {
+    BenchStream *stream = context;
+    if (stream->whole) {
+        Image source = {0};
+        int result = imageLoad(stream->path, &source) != 0 || scaleImage(&source, &stream->target, &stream->options) != 0;
+        imageFree(&source);
+        return result;
+    }
+    ImageReader reader;
+    if (imageReaderOpen(&reader, stream->path) != 0) {
+        return 1;
+    }
+    int result = scaleReader(&reader, &stream->target, &stream->options);
+    imageReaderClose(&reader);
+    return result;
+}
+
+static int benchImageBlend(void *context, int thread) {
+    Image *images = context;
+    return blendImages(&images[0], &images[1], &images[2], BLEND_MAX / 3);
+}
+
+static int benchImageAnalyze(void *context, int thread) {
+    ImageReader reader;
+    ImageAnalysis analysis;
+    if (imageReaderOpen(&reader, context) != 0) {
+        return 1;
+    }
+    int result = analyzeReader(&reader, &analysis);
+    imageReaderClose(&reader);
+    return result || analyzePeriod(&analysis) < 0;
+}
+
+static int benchCacheResolve(void *context, int thread) {
+    return benchStubWallpaper(NULL, context);
+}
+
+static int benchLibraryScan(void *context, int thread) {
+    BenchLibrary *bench = context;
+    char path[64];
+    // Rewriting a file with the other size changes it even within the same second.
+    if (bench->changes > 0) {
+        int file = bench->changes++ * 37 % BENCH_LIBRARY_FILES;
+        Image *image = &bench->images[(file + 1) % 2];
+        memcpy(image->pixels, &file, sizeof(file));
+        snprintf(path, sizeof(path), "%s/%05d.bmp", BENCH_LIBRARY_PATH, file);
+        if (imageWriteBmp(path, image) != 0) {
+            return 1;
+        }
+    }
+    // From the stored index to an up-to-date one: load, list, merge, and decode what changed.
+    Library *library = libraryOpen(BENCH_LIBRARY_PATH, benchLibraryScanned, bench);
+    if (library == NULL) {
+        return 1;
+    }
+    eventWait(bench->scanned, -1);
+    libraryRefresh(library);
+    int result = libraryPick(library, LIBRARY_ANY, 0, path, sizeof(path));
+    libraryClose(library);
+    return result;
+}
+
+static int benchLibraryPick(void *context, int thread) {
+    BenchLibrary *bench = context;
+    char path[256];
+    return libraryPick(bench->library, LIBRARY_ANY, bench->sequence++, path, sizeof(path));
+}
+
+static int benchLibraryShuffle(void *context, int thread) {
+    BenchLibrary *bench = context;
+    char path[256];
+    int count = libraryCount(bench->library, LIBRARY_ANY);
+    int position = playlistPosition(&bench->playlist, PLAYLIST_SHUFFLE, bench->sequence++, count);
+    return libraryPick(bench->library, LIBRARY_ANY, position, path, sizeof(path));
+}
+
+static int benchBackgroundSet(void *context, int thread) {
+    // Alternating between both images applies on every call, a single image is skipped after the first.
+    static int calls = 0;
+    const char **paths = context;
+    return setBackground(paths[calls++ % 2]);
+}
+
+static int benchTransitionFrame(void *context, int thread) {
+    BenchCycle *bench = context;
+    time_t next;
+    // Jump into the next frame of the window, the cycle renders it through the stub backend.
+    bench->frame = bench->frame % BENCH_TRANSITION_FRAMES + 1;
+    bench->now = bench->windowStart + (time_t)bench->frame * BENCH_TRANSITION_WINDOW / (BENCH_TRANSITION_FRAMES + 1) + 1;
+    return cycleStep(&bench->cycle, &bench->settings, &next);
+}
+
+int benchSuite() {
+    int result = 0;
+    char parameter[64];
+
+    // Configs of growing size.
+    for (size_t i = 0; i < sizeof(configSizes) / sizeof(configSizes[0]); i++) {
+        BenchConfig config;
+        if (benchWriteConfig(&config, configSizes[i]) != 0) {
+            fprintf(stderr, "Failure writing %s\n", config.path);
+            return 1;
+        }
+        snprintf(parameter, sizeof(parameter), "keys=%d", configSizes[i]);
+        BenchCase read = {"ini.read", parameter, 1, 2000, 1, benchIniRead, &config};
+        BenchCase get = {"ini.get", parameter, 1, 2000, 100, benchIniGet, &config};
+        BenchCase write = {"ini.write", parameter, 1, 200, 1, benchIniWrite, &config};
+        result |= benchRun(&read) | benchRun(&get) | benchRun(&write);
+        iniFree(config.document);
+        remove(config.path);
+    }
+
+    // Logging from several threads into the shared ring, which is drained between samples so the samples time
+    // enqueueing rather than the drop path. ops_per_second includes the drains, so it is the rate records reach
+    // the file; records still dropped count as failures and show up in failure_rate.
+    if (benchSelected("log.write")) {
+        setLogPath("bench.log");
+        setLogLevel("INFO");
+        if (logInit() != 0) {
+            fprintf(stderr, "Failure starting the log writer\n");
+            return 1;
+        }
+        for (int threads = 1; threads <= BENCH_LOG_THREADS; threads *= 2) {
+            BenchCase logWrite = {"log.write", "text", threads, 2000, BENCH_LOG_BATCH, benchLogWrite, "wallpaper changed to ./img/night.jpg",
+                                  benchLogFlush};
+            result |= benchRun(&logWrite);
+        }
+        logShutdown();
+        setLogLevel("NONE");
+    }
+
+    // Metrics record into per-thread shards, so more threads must not slow a single event down.
+    for (int threads = 1; threads <= BENCH_METRICS_THREADS; threads *= BENCH_METRICS_THREADS) {
+        BenchCase count = {"metrics.count", "counter", threads, 2000, 1000, benchMetricsCount, NULL};
+        BenchCase record = {"metrics.record", "histogram", threads, 2000, 1000, benchMetricsRecord, NULL};
+        result |= benchRun(&count) | benchRun(&record);
+    }
+
+    // Config snapshots, read alone and while one thread keeps publishing new ones.
+    Config snapshot = {BENCH_NIGHT_PATH, BENCH_DAY_PATH, 0, 6, 22, BENCH_TRANSITION_FRAMES, BENCH_TRANSITION_WINDOW};
+    configPublish(&snapshot);
+    for (int threads = 1; threads <= BENCH_METRICS_THREADS; threads *= BENCH_METRICS_THREADS) {
+        BenchCase acquire = {"config.acquire", "readers", threads, 2000, 1000, benchConfigAcquire, NULL};
+        result |= benchRun(&acquire);
+    }
+    BenchCase publish = {"config.acquire", "1 publisher", BENCH_METRICS_THREADS, 2000, 100, benchConfigAcquire, &snapshot};
+    result |= benchRun(&publish);
+    configCleanup();
+
+    // Schedule decisions, advancing through a year in 7 minute steps.
+    BenchCycle schedule = {.now = time(NULL)};
+    schedule.clock = (Clock){benchClockNow, &schedule};
+    schedule.backend = (CycleBackend){benchNullWallpaper, benchNullFrame, benchNullTray, &schedule};
+    schedule.settings = (CycleSettings){BENCH_NIGHT_PATH, BENCH_DAY_PATH, 6, 22, BENCH_TRANSITION_FRAMES, BENCH_TRANSITION_WINDOW};
+    schedule.cycle = (Cycle){&schedule.clock, &schedule.backend, DAY};
+    cycleStart(&schedule.cycle, &schedule.settings);
+    BenchCase state = {"schedule.state", "hours=6-22", 1, 2000, 100, benchScheduleState, &schedule};
+    BenchCase next = {"schedule.next", "hours=6-22", 1, 2000, 100, benchScheduleNext, &schedule};
+    BenchCase plan = {"schedule.plan", "frames=8", 1, 2000, 100, benchSchedulePlan, &schedule};
+    BenchCase step = {"cycle.step", "null backend", 1, 2000, 10, benchCycleStep, &schedule};
+    result |= benchRun(&state) | benchRun(&next) | benchRun(&plan) | benchRun(&step);
+
+    // Images: decode, scale, blend, classify, the cache lookup and applying through a backend.
+    if (!benchSelected("image.decode") && !benchSelected("image.scale") && !benchSelected("image.stream") && !benchSelected("image.blend")
+        && !benchSelected("image.analyze") && !benchSelected("cache.resolve") && !benchSelected("library.scan") && !benchSelected("library.pick")
+        && !benchSelected("background.set") && !benchSelected("transition.frame")) {
+        return result;
+    }
+    Image images[3] = {{0}, {0}, {0}};
+    if (imageCreate(&images[0], BENCH_IMAGE_WIDTH, BENCH_IMAGE_HEIGHT) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    benchPattern(&images[0], 1);
+    int inputs = benchWriteJpeg(BENCH_DAY_PATH, &images[0]) | benchWritePng("bench-day.png", &images[0])
+        | imageWriteBmp("bench-day.bmp", &images[0]);
+    benchPattern(&images[0], 2);
+    inputs |= benchWriteJpeg(BENCH_NIGHT_PATH, &images[0]);
+    if (inputs != 0) {
+        fprintf(stderr, "Failure writing the benchmark images\n");
+        imageFree(&images[0]);
+        return 1;
+    }
+
+    const char *decodePaths[] = {BENCH_DAY_PATH, "bench-day.png", "bench-day.bmp"};
+    for (size_t i = 0; i < sizeof(decodePaths) / sizeof(decodePaths[0]); i++) {
+        snprintf(parameter, sizeof(parameter), "%s 1920x1080", strrchr(decodePaths[i], '.') + 1);
+        BenchCase decode = {"image.decode", parameter, 1, 30, 1, benchImageDecode, (void *)decodePaths[i]};
+        result |= benchRun(&decode);
+    }
+
+    // A 4K source down to 1080p and a 1080p source up to 5K, with both filters.
+    const int scaleSizes[][4] = {{3840, 2160, 1920, 1080}, {1920, 1080, 5120, 2880}};
+    for (size_t i = 0; i < sizeof(scaleSizes) / sizeof(scaleSizes[0]) && benchSelected("image.scale"); i++) {
+        BenchScale scale = {{0}, {0}, {SCALE_FILL, SCALE_BILINEAR, 0x000000, 0, 0}};
+        if (imageCreate(&scale.source, scaleSizes[i][0], scaleSizes[i][1]) != 0
+            || imageCreate(&scale.target, scaleSizes[i][2], scaleSizes[i][3]) != 0) {
+            fprintf(stderr, "Out of memory\n");
+            imageFree(&scale.source);
+            result = 1;
+            break;
+        }
+        benchPattern(&scale.source, 3);
+        for (scale.options.filter = SCALE_BILINEAR; scale.options.filter <= SCALE_LANCZOS3; scale.options.filter++) {
+            snprintf(parameter, sizeof(parameter), "%s %s %dx%d->%dx%d", scaleKernelName(), scaleFilterName(scale.options.filter),
+                     scaleSizes[i][0], scaleSizes[i][1], scaleSizes[i][2], scaleSizes[i][3]);
+            BenchCase scaleCase = {"image.scale", parameter, 1, 10, 1, benchImageScale, &scale};
+            result |= benchRun(&scaleCase);
+        }
+        imageFree(&scale.source);
+        imageFree(&scale.target);
+    }
+
+    // An 8K JPEG to 1080p: whole decode and scale against streaming within a budget, which also reduces while decoding.
+    BenchStream stream = {BENCH_LARGE_PATH, {0}, {SCALE_FILL, SCALE_LANCZOS3, 0x000000, 0, 0}, 0};
+    if (benchSelected("image.stream")) {
+        Image large;
+        if (imageCreate(&large, BENCH_LARGE_WIDTH, BENCH_LARGE_HEIGHT) != 0
+            || imageCreate(&stream.target, BENCH_IMAGE_WIDTH, BENCH_IMAGE_HEIGHT) != 0) {
+            fprintf(stderr, "Out of memory\n");
+            imageFree(&large);
+            return 1;
+        }
+        benchPattern(&large, 4);
+        inputs = benchWriteJpeg(BENCH_LARGE_PATH, &large);
+        imageFree(&large);
+        const size_t budgets[] = {0, SCALE_DEFAULT_MEMORY, 16 << 20};
+        for (int i = -1; inputs == 0 && i < (int)(sizeof(budgets) / sizeof(budgets[0])); i++) {
+            stream.whole = i < 0;
+            stream.options.memory = i < 0 ? 0 : budgets[i];
+            if (stream.whole || stream.options.memory == 0) {
+                snprintf(parameter, sizeof(parameter), "%s 8k->1080p", stream.whole ? "whole" : "unbounded");
+            } else {
+                snprintf(parameter, sizeof(parameter), "budget %zuMB 8k->1080p", stream.options.memory >> 20);
+            }
+            BenchCase streamCase = {"image.stream", parameter, 1, 5, 1, benchImageStream, &stream};
+            result |= benchRun(&streamCase);
+        }
+        imageFree(&stream.target);
+        result |= inputs;
+    }
+
+    if (imageCreate(&images[1], BENCH_IMAGE_WIDTH, BENCH_IMAGE_HEIGHT) == 0
+        && imageCreate(&images[2], BENCH_IMAGE_WIDTH, BENCH_IMAGE_HEIGHT) == 0) {
+        snprintf(parameter, sizeof(parameter), "%s 1920x1080", blendKernelName());
+        BenchCase blend = {"image.blend", parameter, 1, 100, 1, benchImageBlend, images};
+        result |= benchRun(&blend);
+    }
+    for (int i = 0; i < 3; i++) {
+        imageFree(&images[i]);
+    }
+
+    // Classifying a library image: the reduced decode and the histograms.
+    snprintf(parameter, sizeof(parameter), "jpg 1920x1080 %s", analyzeKernelName());
+    BenchCase analyze = {"image.analyze", parameter, 1, 30, 1, benchImageAnalyze, BENCH_DAY_PATH};
+    result |= benchRun(&analyze);
+
+    BenchCase resolve = {"cache.resolve", "hit 1920x1080", 1, 500, 1, benchCacheResolve, BENCH_DAY_PATH};
+    result |= benchRun(&resolve);
+
+    // A library of 10000 small images: the first open builds the index, the cases start from the stored one.
+    BenchLibrary library = {{{0}, {0}}, eventCreate(), NULL, 0, 0};
+    if ((benchSelected("library.scan") || benchSelected("library.pick")) && library.scanned != NULL
+        && imageCreate(&library.images[0], 16, 9) == 0 && imageCreate(&library.images[1], 17, 9) == 0) {
+        benchPattern(&library.images[0], 5);
+        benchPattern(&library.images[1], 6);
+        library.library = benchWriteLibrary(&library) == 0 ? libraryOpen(BENCH_LIBRARY_PATH, benchLibraryScanned, &library) : NULL;
+        if (library.library == NULL) {
+            fprintf(stderr, "Failure writing the benchmark library\n");
+            result = 1;
+        } else {
+            eventWait(library.scanned, -1);
+            libraryRefresh(library.library);
+            snprintf(parameter, sizeof(parameter), "%d files", libraryCount(library.library, LIBRARY_ANY));
+            BenchCase pick = {"library.pick", parameter, 1, 2000, 100, benchLibraryPick, &library};
+            result |= benchRun(&pick);
+            // The shuffle reorders the whole folder once per pass.
+            snprintf(parameter, sizeof(parameter), "shuffle %d files", libraryCount(library.library, LIBRARY_ANY));
+            BenchCase shuffle = {"library.pick", parameter, 1, 2000, 100, benchLibraryShuffle, &library};
+            library.sequence = 0;
+            result |= benchRun(&shuffle);
+            playlistFree(&library.playlist);
+            libraryClose(library.library);
+
+            snprintf(parameter, sizeof(parameter), "%d files unchanged", BENCH_LIBRARY_FILES);
+            BenchCase unchanged = {"library.scan", parameter, 1, 20, 1, benchLibraryScan, &library};
+            result |= benchRun(&unchanged);
+            library.changes = 1;
+            snprintf(parameter, sizeof(parameter), "%d files 1 changed", BENCH_LIBRARY_FILES);
+            BenchCase changed = {"library.scan", parameter, 1, 20, 1, benchLibraryScan, &library};
+            result |= benchRun(&changed);
+        }
+    }
+    imageFree(&library.images[0]);
+    imageFree(&library.images[1]);
+    if (library.scanned != NULL) {
+        eventDestroy(library.scanned);
+    }
+
+    // setBackground() through the file sink: fingerprint, cache lookup and skip check without a desktop.
+    WallpaperBackend *sinkBackend = fileWallpaperCreate(NULL, BENCH_IMAGE_WIDTH, BENCH_IMAGE_HEIGHT);
+    if (sinkBackend == NULL) {
+        return 1;
+    }
+    setWallpaperBackend(sinkBackend);
+    const char *skipPaths[] = {BENCH_DAY_PATH, BENCH_DAY_PATH};
+    const char *applyPaths[] = {BENCH_DAY_PATH, BENCH_NIGHT_PATH};
+    BenchCase skip = {"background.set", "file sink skip", 1, 500, 1, benchBackgroundSet, skipPaths};
+    BenchCase apply = {"background.set", "file sink apply", 1, 500, 1, benchBackgroundSet, applyPaths};
+    result |= benchRun(&skip) | benchRun(&apply);
+    setWallpaperBackend(NULL);
+    fileWallpaperDestroy(sinkBackend);
+
+    // End-to-end crossfade: Cycle -> transitionPlan -> stub backend -> transitionRender.
+    BenchCycle transition = {0};
+    struct tm window = *localtime(&schedule.now);
+    window.tm_hour = 22;
+    window.tm_min = 0;
+    window.tm_sec = 0;
+    window.tm_isdst = -1;
+    transition.windowStart = mktime(&window) - BENCH_TRANSITION_WINDOW / 2;
+    transition.now = transition.windowStart - 1;
+    transition.clock = (Clock){benchClockNow, &transition};
+    transition.backend = (CycleBackend){benchStubWallpaper, benchStubFrame, benchNullTray, &transition};
+    transition.settings = schedule.settings;
+    transition.cycle = (Cycle){&transition.clock, &transition.backend, DAY};
+    cycleStart(&transition.cycle, &transition.settings);
+    BenchCase frame = {"transition.frame", "stub 1920x1080", 1, 40, 1, benchTransitionFrame, &transition};
+    result |= benchRun(&frame);
+    return result;
+}
@@ -0,0 +1,236 @@
+/**
+ * @file daemon.c
+ * @brief Linux entry point, runs the day/night cycle against the system clock without a tray.
+ *
+ * Reads the [Path], [Time], [Scale], [Transition] and [Log] sections of the config like the tray
+ * application and applies the wallpapers and crossfade frames through the X11 backend (built with
+ * WALLPAPER_X11, see make linux). The [Path] entries must name image files, folder rotation, the
+ * tray icon and the command queue are only part of the Windows front end. The config is read once
+ * at startup, and both images have to decode there: the X11 backend has no other decoder to fall back
+ * on, so AVIF images need a build with libavif. SIGINT and SIGTERM end the daemon.
+ *
+ * Usage: wallcycle [--config PATH] [--sink PATH] [--once]
+ *   --config  Config file, ./config.ini by default.
+ *   --sink    Append the applied paths to PATH through the file sink instead of setting the root window.
+ *   --once    Apply the wallpaper due now and exit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "ini.h"
+#include "config.h"
+#include "cache.h"
+#include "state.h"
+#include "schedule.h"
+#include "cycle.h"
+#include "transition.h"
+#include "background.h"
+#include "image.h"
+
+#define DAEMON_CONFIG_PATH "./config.ini"
+#define DAEMON_STATE_PATH "./state.bin"
+#define MAX_DAEMON_SLEEP 60 // Longest sleep in seconds, so a suspend or clock change is noticed.
+
+static volatile sig_atomic_t daemonStopping = 0; // Set by SIGINT and SIGTERM.
+
+/**
+ * @brief Reads the config and applies its scale options to the wallpaper cache.
+ *
+ * @param document The parsed config.
+ * @param config Receives the settings.
+ * @param settings Receives the cycle settings, the paths point into config.
+ * @return Returns 0 on success, or 1 if a value is missing or invalid.
+ */
+static int daemonReadConfig(const IniDocument *document, Config *config, CycleSettings *settings);
+
+/**
+ * @brief Checks that an image can be decoded, so a wallpaper that can never be shown fails at startup.
+ *
+ * @return Returns 0 if the image decodes, 1 otherwise.
+ */
+static int daemonCheckImage(const char *imagePath);
+
+/**
+ * @brief Applies a wallpaper through the current wallpaper backend.
+ *
+ * @param context Receives whether the apply failed, an int.
+ */
+static int daemonApplyWallpaper(void *context, const char *imagePath);
+
+/**
+ * @brief Renders a crossfade frame at screen resolution and applies it.
+ */
+static int daemonApplyFrame(void *context, const char *sourcePath, const char *targetPath, const TransitionStep *step);
+
+/**
+ * @brief Logs the change of state, there is no tray icon to animate.
+ */
+static void daemonAnimateTray(void *context, int targetState);
+
+/**
+ * @brief Ends the main loop.
+ */
+static void daemonStop(int signal);
+
+static int daemonReadConfig(const IniDocument *document, Config *config, CycleSettings *settings) {
+    if (configRead(document, config) != 0) {
+        return 1;
+    }
+    settings->nightPath = config->nightPath;
+    settings->dayPath = config->dayPath;
+    settings->fromTime = config->fromTime;
+    settings->toTime = config->toTime;
+    settings->transitionFrames = config->transitionFrames;
+    settings->transitionWindow = config->transitionWindow;
+    wallpaperCacheSetOptions(&config->scale);
+    wallpaperCacheSetLimit((long long)config->cacheSize << 20);
+    return 0;
+}
+
+static int daemonCheckImage(const char *imagePath) {
+    ImageReader reader;
+    if (imageReaderOpen(&reader, imagePath) != 0) {
+#ifdef HAVE_LIBAVIF
+        fprintf(stderr, "Cannot decode %s\n", imagePath);
+#else
+        fprintf(stderr, "Cannot decode %s, AVIF images need a build with libavif\n", imagePath);
+#endif
+        return 1;
+    }
+    imageReaderClose(&reader);
+    return 0;
+}
+
+static int daemonApplyWallpaper(void *context, const char *imagePath) {
+    int *failed = context;
+    *failed = setBackground(imagePath) != 0;
+    if (*failed) {
+        error("Failure setting wallpaper: %s", imagePath);
+    }
+    return *failed;
+}
+
+static int daemonApplyFrame(void *context, const char *sourcePath, const char *targetPath, const TransitionStep *step) {
+    int width, height;
+    char framePath[MAX_CACHE_PATH];
+    if (getScreenSize(&width, &height) != 0
+        || transitionRender(sourcePath, targetPath, step, width, height, framePath, sizeof(framePath)) != 0) {
+        error("Failure rendering transition frame %d", step->frame);
+        return 1;
+    }
+    return daemonApplyWallpaper(context, framePath);
+}
+
+static void daemonAnimateTray(void *context, int targetState) {
+    info("Switched to %s", targetState == NIGHT ? "night" : "day");
+}
+
+static void daemonStop(int signal) {
+    daemonStopping = 1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *configPath = DAEMON_CONFIG_PATH;
+    const char *sinkPath = NULL;
+    int once = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--once") == 0) {
+            once = 1;
+            continue;
+        }
+        if (value == NULL) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 2;
+        }
+        if (strcmp(argv[i], "--config") == 0) {
+            configPath = value;
+        } else if (strcmp(argv[i], "--sink") == 0) {
+            sinkPath = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        i++;
+    }
+
+    IniDocument *document = iniLoad(configPath);
+    if (document == NULL) {
+        fprintf(stderr, "Failure reading %s\n", configPath);
+        return 1;
+    }
+    char level[CONFIG_VALUE_LENGTH];
+    if (iniGetString(document, "Log", "LEVEL", level, sizeof(level)) == 0 && setLogLevel(level) != 0) {
+        fprintf(stderr, "Invalid log level %s\n", level);
+    }
+    if (logInit() != 0) {
+        fprintf(stderr, "Failure starting the log writer\n");
+    }
+
+    Config config;
+    CycleSettings settings;
+    int result = daemonReadConfig(document, &config, &settings);
+    iniFree(document);
+    if (result != 0) {
+        fprintf(stderr, "Invalid config %s\n", configPath);
+        logShutdown();
+        return 1;
+    }
+    if (daemonCheckImage(config.nightPath) != 0 || daemonCheckImage(config.dayPath) != 0) {
+        logShutdown();
+        return 1;
+    }
+
+    WallpaperBackend *sink = NULL;
+    if (sinkPath != NULL) {
+        sink = fileWallpaperCreate(sinkPath, 1920, 1080);
+        if (sink == NULL) {
+            logShutdown();
+            return 1;
+        }
+        setWallpaperBackend(sink);
+    } else if (getWallpaperBackend() == NULL) {
+        fprintf(stderr, "No wallpaper backend, build with make linux or pass --sink\n");
+        logShutdown();
+        return 1;
+    }
+    stateOpen(DAEMON_STATE_PATH);
+    signal(SIGINT, daemonStop);
+    signal(SIGTERM, daemonStop);
+
+    int failed = 0;
+    const CycleBackend backend = {daemonApplyWallpaper, daemonApplyFrame, daemonAnimateTray, &failed};
+    Cycle cycle = {&systemClock, &backend, DAY};
+    result = cycleStart(&cycle, &settings);
+    while (result == 0 && !once && !daemonStopping) {
+        time_t next;
+        if (cycleStep(&cycle, &settings, &next) != 0) {
+            result = 1;
+            break;
+        }
+        // A signal ends the sleep early.
+        time_t now = time(NULL);
+        if (next > now) {
+            sleep(next - now < MAX_DAEMON_SLEEP ? (unsigned int)(next - now) : MAX_DAEMON_SLEEP);
+        }
+    }
+    if (result != 0) {
+        fprintf(stderr, "Invalid settings\n");
+    } else if (once && failed) {
+        fprintf(stderr, "Failure setting the wallpaper, see the log\n");
+        result = 1;
+    }
+
+    stateClose();
+    setWallpaperBackend(NULL);
+    fileWallpaperDestroy(sink);
+    logShutdown();
+    return result;
+}
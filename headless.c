@@ -0,0 +1,237 @@
+/**
+ * @file headless.c
+ * @brief Headless simulation of the day/night cycle.
+ *
+ * Runs the same Cycle as the tray application with a simulated clock and null wallpaper and tray
+ * backends, jumping straight from one deadline to the next. Every decision is reported, and the run
+ * fails if the schedule stops advancing, a deadline would have skipped a state change or a crossfade
+ * frame fades towards the wrong background.
+ *
+ * Usage: wallcycle-headless [--from H] [--to H] [--frames N] [--window MINUTES]
+ *                           [--start YYYY-MM-DD] [--days N] [--tz ZONE] [--trace PATH] [--quiet]
+ *
+ * With --trace, the spans of the cycle are written as Chrome trace JSON to PATH.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "log.h"
+#include "trace.h"
+#include "schedule.h"
+#include "cycle.h"
+
+// Counters and options shared by the null backends
+typedef struct Simulation {
+    time_t now; // Simulated current time.
+    int quiet; // Only print the summary.
+    long wallpapers; // Number of wallpaper applies.
+    long frames; // Number of crossfade frames.
+    int frameToNight; // Direction of the frame applied by the current step, -1 if none.
+    long animations; // Number of tray animations.
+} Simulation;
+
+/**
+ * @brief Returns the simulated time, the now function of the simulated clock.
+ */
+static time_t simulationNow(void *context);
+
+/**
+ * @brief Prints the simulated time followed by a decision.
+ */
+static void simulationReport(const Simulation *simulation, const char *format, const char *argument);
+
+/**
+ * @brief Null wallpaper backend, counts and reports the apply.
+ */
+static int simulationApplyWallpaper(void *context, const char *imagePath);
+
+/**
+ * @brief Null crossfade backend, counts and reports the frame.
+ */
+static int simulationApplyFrame(void *context, const char *sourcePath, const char *targetPath, const TransitionStep *step);
+
+/**
+ * @brief Null tray backend, counts and reports the animation.
+ */
+static void simulationAnimateTray(void *context, int targetState);
+
+/**
+ * @brief Parses YYYY-MM-DD as local midnight.
+ *
+ * @return Returns 0 on success, or 1 if the date is invalid.
+ */
+static int parseDate(const char *text, time_t *date);
+
+static time_t simulationNow(void *context) {
+    return ((Simulation *)context)->now;
+}
+
+static void simulationReport(const Simulation *simulation, const char *format, const char *argument) {
+    if (simulation->quiet) {
+        return;
+    }
+    char timestamp[64];
+    struct tm local;
+    scheduleLocalTime(simulation->now, &local);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S %Z", &local);
+    printf("%s  ", timestamp);
+    printf(format, argument);
+    printf("\n");
+}
+
+static int simulationApplyWallpaper(void *context, const char *imagePath) {
+    Simulation *simulation = context;
+    simulation->wallpapers++;
+    simulationReport(simulation, "wallpaper %s", imagePath);
+    return 0;
+}
+
+static int simulationApplyFrame(void *context, const char *sourcePath, const char *targetPath, const TransitionStep *step) {
+    Simulation *simulation = context;
+    char description[64];
+    simulation->frames++;
+    simulation->frameToNight = step->toNight;
+    snprintf(description, sizeof(description), "%d/%d %s", step->frame, step->frames, step->toNight ? "day -> night" : "night -> day");
+    simulationReport(simulation, "frame %s", description);
+    return 0;
+}
+
+static void simulationAnimateTray(void *context, int targetState) {
+    Simulation *simulation = context;
+    simulation->animations++;
+    simulationReport(simulation, "tray %s", targetState == NIGHT ? "night" : "day");
+}
+
+static int parseDate(const char *text, time_t *date) {
+    struct tm day;
+    memset(&day, 0, sizeof(day));
+    if (sscanf(text, "%d-%d-%d", &day.tm_year, &day.tm_mon, &day.tm_mday) != 3) {
+        return 1;
+    }
+    day.tm_year -= 1900;
+    day.tm_mon -= 1;
+    day.tm_isdst = -1;
+    *date = mktime(&day);
+    return *date == (time_t)-1;
+}
+
+int main(int argc, char *argv[]) {
+    Simulation simulation;
+    memset(&simulation, 0, sizeof(simulation));
+    CycleSettings settings = {"./img/night.jpg", "./img/day.jpg", 6, 22, 0, 0};
+    int days = 365;
+    const char *start = NULL;
+    const char *tracePath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--quiet") == 0) {
+            simulation.quiet = 1;
+            continue;
+        }
+        if (value == NULL) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 2;
+        }
+        if (strcmp(argv[i], "--from") == 0) {
+            settings.fromTime = atoi(value);
+        } else if (strcmp(argv[i], "--to") == 0) {
+            settings.toTime = atoi(value);
+        } else if (strcmp(argv[i], "--frames") == 0) {
+            settings.transitionFrames = atoi(value);
+        } else if (strcmp(argv[i], "--window") == 0) {
+            settings.transitionWindow = atoi(value) * 60;
+        } else if (strcmp(argv[i], "--start") == 0) {
+            start = value;
+        } else if (strcmp(argv[i], "--days") == 0) {
+            days = atoi(value);
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            tracePath = value;
+            traceEnable(1);
+        } else if (strcmp(argv[i], "--tz") == 0) {
+            setenv("TZ", value, 1);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        i++;
+    }
+    tzset();
+    setLogLevel("NONE");
+
+    if (start != NULL) {
+        if (parseDate(start, &simulation.now) != 0) {
+            fprintf(stderr, "Invalid start date %s\n", start);
+            return 2;
+        }
+    } else {
+        struct tm year;
+        scheduleLocalTime(time(NULL), &year);
+        char firstDay[32];
+        snprintf(firstDay, sizeof(firstDay), "%d-01-01", year.tm_year + 1900);
+        parseDate(firstDay, &simulation.now);
+    }
+
+    struct tm endDay;
+    scheduleLocalTime(simulation.now, &endDay);
+    endDay.tm_mday += days;
+    endDay.tm_isdst = -1;
+    time_t end = mktime(&endDay);
+
+    const Clock clock = {simulationNow, &simulation};
+    const CycleBackend backend = {simulationApplyWallpaper, simulationApplyFrame, simulationAnimateTray, &simulation};
+    Cycle cycle = {&clock, &backend, DAY};
+
+    struct timespec wallStart, wallEnd;
+    timespec_get(&wallStart, TIME_UTC);
+
+    if (cycleStart(&cycle, &settings) != 0) {
+        fprintf(stderr, "Invalid settings\n");
+        return 1;
+    }
+    long steps = 0;
+    while (simulation.now < end) {
+        time_t next;
+        simulation.frameToNight = -1;
+        if (cycleStep(&cycle, &settings, &next) != 0) {
+            fprintf(stderr, "Step failed at %lld\n", (long long)simulation.now);
+            return 1;
+        }
+        steps++;
+
+        // Between two deadlines the state must not change, otherwise a transition was skipped.
+        int stateBeforeNext;
+        if (next <= simulation.now) {
+            fprintf(stderr, "Schedule did not advance at %lld\n", (long long)simulation.now);
+            return 1;
+        }
+        backgroundStateAt(settings.fromTime, settings.toTime, next - 1, &stateBeforeNext);
+        if (stateBeforeNext != cycle.backgroundState) {
+            fprintf(stderr, "Transition skipped between %lld and %lld\n", (long long)simulation.now, (long long)next);
+            return 1;
+        }
+
+        // A frame lies less than a window before the end of its window, the target holds from there to the next transition.
+        int target;
+        if (simulation.frameToNight >= 0
+            && (backgroundStateAt(settings.fromTime, settings.toTime, simulation.now + settings.transitionWindow, &target) != 0
+                || simulation.frameToNight != (target == NIGHT))) {
+            fprintf(stderr, "Frame fades towards the wrong background at %lld\n", (long long)simulation.now);
+            return 1;
+        }
+        simulation.now = next;
+    }
+
+    timespec_get(&wallEnd, TIME_UTC);
+    double elapsed = (wallEnd.tv_sec - wallStart.tv_sec) * 1000.0 + (wallEnd.tv_nsec - wallStart.tv_nsec) / 1000000.0;
+    if (tracePath != NULL && traceWrite(tracePath) != 0) {
+        fprintf(stderr, "Failure writing trace %s\n", tracePath);
+        return 1;
+    }
+    printf("Simulated %d days in %.1f ms: %ld steps, %ld wallpapers, %ld frames, %ld tray animations\n",
+           days, elapsed, steps, simulation.wallpapers, simulation.frames, simulation.animations);
+    return 0;
+}
@@ -0,0 +1,365 @@
+/**
+ * @file analyze.c
+ * @brief Brightness and colour temperature of images, used to tell day, night and twilight images apart.
+ *
+ * Every pixel adds to two histograms: its Rec. 709 luma (19 B + 183 G + 54 R) >> 8, and its red minus blue
+ * difference as a cheap colour temperature. The SSE2 and AVX2 kernels compute both for 16 or 32 pixels at once,
+ * then count the bins with one byte compare per bin in 8-bit lanes, which are summed up before they overflow.
+ * All kernels produce identical histograms. The fastest kernel the CPU supports is selected on first use.
+ *
+ * The period is decided from the mean luma, the share of dark pixels and the mean warmth. Images are read
+ * reduced while decoding where the format allows it, the histograms of a photo hardly change at 1/8 size.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ANALYZE_X86
+#endif
+
+#include "trace.h"
+#include "analyze.h"
+
+#define ANALYZE_REDUCTION 8 // Downscaling asked from the decoder.
+#define ANALYZE_BAND_ROWS 16 // Rows decoded at once.
+#define ANALYZE_FLUSH_VECTORS 255 // Vectors counted in 8-bit lanes before they are summed up.
+#define ANALYZE_DARK_BINS 4 // Luma bins counted as dark, luma below 64.
+#define ANALYZE_NIGHT_LUMINANCE 0.2f // Mean luma below which an image is a night image.
+#define ANALYZE_NIGHT_DARK 0.6f // Share of dark pixels from which a dim image is a night image.
+#define ANALYZE_DIM_LUMINANCE 0.35f // Mean luma below which an image is dim.
+#define ANALYZE_DAY_LUMINANCE 0.4f // Mean luma from which an image is a day image.
+#define ANALYZE_BRIGHT_LUMINANCE 0.7f // Mean luma from which an image is a day image regardless of its warmth.
+#define ANALYZE_TWILIGHT_WARMTH 0.15f // Mean warmth from which a not too bright image is a twilight image.
+
+typedef void (*AnalyzeKernel)(const unsigned char *pixels, size_t count, ImageAnalysis *analysis);
+
+typedef struct AnalyzeKernelEntry {
+    const char *name; // Name used by analyzeSetKernel().
+    AnalyzeKernel kernel; // Counts count contiguous BGRA pixels.
+    int (*supported)(); // Whether the CPU can run the kernel.
+} AnalyzeKernelEntry;
+
+/**
+ * @brief Clears the histograms.
+ */
+void analyzeReset(ImageAnalysis *analysis);
+
+/**
+ * @brief Adds the pixels of some rows to the histograms.
+ *
+ * @param analysis The histograms.
+ * @param pixels The first row, BGRA.
+ * @param stride Distance between the rows in bytes.
+ * @param width Pixels per row.
+ * @param rows Number of rows.
+ */
+void analyzeRows(ImageAnalysis *analysis, const unsigned char *pixels, int stride, int width, int rows);
+
+/**
+ * @brief Computes the histograms of an image file, reduced by up to 1/8 while decoding.
+ *
+ * @param reader A reader no row was read from yet, it is reduced and read to the end.
+ * @param analysis Receives the histograms.
+ * @return Returns 0 on success, or 1 if the image is corrupt or memory runs out.
+ */
+int analyzeReader(ImageReader *reader, ImageAnalysis *analysis);
+
+/**
+ * @brief Returns the mean luma from 0 (black) to 1 (white).
+ */
+float analyzeLuminance(const ImageAnalysis *analysis);
+
+/**
+ * @brief Returns the mean warmth from -1 (blue) to 1 (red).
+ */
+float analyzeWarmth(const ImageAnalysis *analysis);
+
+/**
+ * @brief Classifies an image by its histograms.
+ *
+ * Dark images are night images. Warm images that are not too bright, like a sunset, are twilight images.
+ * Bright images are day images, everything in between is twilight.
+ *
+ * @return ANALYZE_DAY, ANALYZE_NIGHT or ANALYZE_TWILIGHT.
+ */
+int analyzePeriod(const ImageAnalysis *analysis);
+
+/**
+ * @brief Returns the name of a period ("day", "night" or "twilight").
+ */
+const char *analyzePeriodName(int period);
+
+/**
+ * @brief Forces an analysis kernel ("scalar", "sse2" or "avx2").
+ *
+ * @param name The kernel name.
+ * @return Returns 0 on success, or 1 if the kernel is unknown or unsupported by the CPU.
+ */
+int analyzeSetKernel(const char *name);
+
+/**
+ * @brief Returns the name of the kernel in use, selecting the best one if none is selected yet.
+ */
+const char *analyzeKernelName();
+
+static void analyzeScalar(const unsigned char *pixels, size_t count, ImageAnalysis *analysis) {
+    for (size_t i = 0; i < count; i++, pixels += 4) {
+        int luma = (19 * pixels[0] + 183 * pixels[1] + 54 * pixels[2]) >> 8;
+        int warmth = pixels[2] - pixels[0];
+        analysis->luminance[luma >> 4]++;
+        analysis->warmth[(warmth + 256) >> 5]++;
+        analysis->luminanceSum += luma;
+        analysis->warmthSum += warmth;
+    }
+    analysis->pixels += count;
+}
+
+static int analyzeAlways() {
+    return 1;
+}
+
+#ifdef ANALYZE_X86
+
+__attribute__((target("sse2")))
+static void analyzeSse2(const unsigned char *pixels, size_t count, ImageAnalysis *analysis) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i lowBytes = _mm_set1_epi32(0x00ff00ff);
+    const __m128i lowHalf = _mm_set1_epi32(0xffff);
+    const __m128i blueRed = _mm_set1_epi32(54 << 16 | 19);
+    const __m128i green = _mm_set1_epi32(183);
+    const __m128i offset = _mm_set1_epi32(256);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    __m128i luminance[ANALYZE_BINS], warmth[ANALYZE_BINS];
+    size_t i = 0;
+
+    while (count - i >= 16) {
+        size_t vectors = (count - i) / 16 < ANALYZE_FLUSH_VECTORS ? (count - i) / 16 : ANALYZE_FLUSH_VECTORS;
+        __m128i luminanceSum = zero, warmthSum = zero;
+        for (int bin = 0; bin < ANALYZE_BINS; bin++) {
+            luminance[bin] = warmth[bin] = zero;
+        }
+        for (size_t v = 0; v < vectors; v++, i += 16) {
+            __m128i luma[4], warm[4];
+            for (int k = 0; k < 4; k++) {
+                // B and R in the low and high half of each pixel, G and A likewise.
+                __m128i p = _mm_loadu_si128((const __m128i *)(pixels + (i + k * 4) * 4));
+                __m128i br = _mm_and_si128(p, lowBytes);
+                __m128i ga = _mm_and_si128(_mm_srli_epi32(p, 8), lowBytes);
+                luma[k] = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(br, blueRed), _mm_madd_epi16(ga, green)), 8);
+                warm[k] = _mm_sub_epi32(_mm_srli_epi32(br, 16), _mm_and_si128(br, lowHalf));
+                luminanceSum = _mm_add_epi32(luminanceSum, luma[k]);
+                warmthSum = _mm_add_epi32(warmthSum, warm[k]);
+                warm[k] = _mm_srli_epi32(_mm_add_epi32(warm[k], offset), 5);
+            }
+            __m128i lumaBins = _mm_packus_epi16(_mm_packs_epi32(luma[0], luma[1]), _mm_packs_epi32(luma[2], luma[3]));
+            lumaBins = _mm_and_si128(_mm_srli_epi16(lumaBins, 4), nibble);
+            __m128i warmBins = _mm_packus_epi16(_mm_packs_epi32(warm[0], warm[1]), _mm_packs_epi32(warm[2], warm[3]));
+            __m128i value = zero;
+            for (int bin = 0; bin < ANALYZE_BINS; bin++, value = _mm_add_epi8(value, one)) {
+                luminance[bin] = _mm_sub_epi8(luminance[bin], _mm_cmpeq_epi8(lumaBins, value));
+                warmth[bin] = _mm_sub_epi8(warmth[bin], _mm_cmpeq_epi8(warmBins, value));
+            }
+        }
+
+        uint64_t counts[2];
+        int32_t sums[4];
+        for (int bin = 0; bin < ANALYZE_BINS; bin++) {
+            _mm_storeu_si128((__m128i *)counts, _mm_sad_epu8(luminance[bin], zero));
+            analysis->luminance[bin] += counts[0] + counts[1];
+            _mm_storeu_si128((__m128i *)counts, _mm_sad_epu8(warmth[bin], zero));
+            analysis->warmth[bin] += counts[0] + counts[1];
+        }
+        _mm_storeu_si128((__m128i *)sums, luminanceSum);
+        analysis->luminanceSum += (uint64_t)sums[0] + sums[1] + sums[2] + sums[3];
+        _mm_storeu_si128((__m128i *)sums, warmthSum);
+        analysis->warmthSum += (int64_t)sums[0] + sums[1] + sums[2] + sums[3];
+    }
+    analysis->pixels += i;
+    analyzeScalar(pixels + i * 4, count - i, analysis);
+}
+
+__attribute__((target("avx2")))
+static void analyzeAvx2(const unsigned char *pixels, size_t count, ImageAnalysis *analysis) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i lowBytes = _mm256_set1_epi32(0x00ff00ff);
+    const __m256i lowHalf = _mm256_set1_epi32(0xffff);
+    const __m256i blueRed = _mm256_set1_epi32(54 << 16 | 19);
+    const __m256i green = _mm256_set1_epi32(183);
+    const __m256i offset = _mm256_set1_epi32(256);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    __m256i luminance[ANALYZE_BINS], warmth[ANALYZE_BINS];
+    size_t i = 0;
+
+    // Pack works per 128-bit lane and mixes up the pixel order, which does not matter for counting.
+    while (count - i >= 32) {
+        size_t vectors = (count - i) / 32 < ANALYZE_FLUSH_VECTORS ? (count - i) / 32 : ANALYZE_FLUSH_VECTORS;
+        __m256i luminanceSum = zero, warmthSum = zero;
+        for (int bin = 0; bin < ANALYZE_BINS; bin++) {
+            luminance[bin] = warmth[bin] = zero;
+        }
+        for (size_t v = 0; v < vectors; v++, i += 32) {
+            __m256i luma[4], warm[4];
+            for (int k = 0; k < 4; k++) {
+                __m256i p = _mm256_loadu_si256((const __m256i *)(pixels + (i + k * 8) * 4));
+                __m256i br = _mm256_and_si256(p, lowBytes);
+                __m256i ga = _mm256_and_si256(_mm256_srli_epi32(p, 8), lowBytes);
+                luma[k] = _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(br, blueRed), _mm256_madd_epi16(ga, green)), 8);
+                warm[k] = _mm256_sub_epi32(_mm256_srli_epi32(br, 16), _mm256_and_si256(br, lowHalf));
+                luminanceSum = _mm256_add_epi32(luminanceSum, luma[k]);
+                warmthSum = _mm256_add_epi32(warmthSum, warm[k]);
+                warm[k] = _mm256_srli_epi32(_mm256_add_epi32(warm[k], offset), 5);
+            }
+            __m256i lumaBins = _mm256_packus_epi16(_mm256_packs_epi32(luma[0], luma[1]), _mm256_packs_epi32(luma[2], luma[3]));
+            lumaBins = _mm256_and_si256(_mm256_srli_epi16(lumaBins, 4), nibble);
+            __m256i warmBins = _mm256_packus_epi16(_mm256_packs_epi32(warm[0], warm[1]), _mm256_packs_epi32(warm[2], warm[3]));
+            __m256i value = zero;
+            for (int bin = 0; bin < ANALYZE_BINS; bin++, value = _mm256_add_epi8(value, one)) {
+                luminance[bin] = _mm256_sub_epi8(luminance[bin], _mm256_cmpeq_epi8(lumaBins, value));
+                warmth[bin] = _mm256_sub_epi8(warmth[bin], _mm256_cmpeq_epi8(warmBins, value));
+            }
+        }
+
+        uint64_t counts[4];
+        int32_t sums[8];
+        for (int bin = 0; bin < ANALYZE_BINS; bin++) {
+            _mm256_storeu_si256((__m256i *)counts, _mm256_sad_epu8(luminance[bin], zero));
+            analysis->luminance[bin] += counts[0] + counts[1] + counts[2] + counts[3];
+            _mm256_storeu_si256((__m256i *)counts, _mm256_sad_epu8(warmth[bin], zero));
+            analysis->warmth[bin] += counts[0] + counts[1] + counts[2] + counts[3];
+        }
+        _mm256_storeu_si256((__m256i *)sums, luminanceSum);
+        for (int k = 0; k < 8; k++) {
+            analysis->luminanceSum += (uint64_t)sums[k];
+        }
+        _mm256_storeu_si256((__m256i *)sums, warmthSum);
+        for (int k = 0; k < 8; k++) {
+            analysis->warmthSum += sums[k];
+        }
+    }
+    analysis->pixels += i;
+    analyzeSse2(pixels + i * 4, count - i, analysis);
+}
+
+static int analyzeHasSse2() {
+    return __builtin_cpu_supports("sse2");
+}
+
+static int analyzeHasAvx2() {
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+// Kernels from slowest to fastest.
+static const AnalyzeKernelEntry analyzeKernels[] = {
+    {"scalar", analyzeScalar, analyzeAlways},
+#ifdef ANALYZE_X86
+    {"sse2", analyzeSse2, analyzeHasSse2},
+    {"avx2", analyzeAvx2, analyzeHasAvx2},
+#endif
+};
+
+static const AnalyzeKernelEntry *analyzeKernel = NULL; // Kernel in use, NULL until first use.
+
+int analyzeSetKernel(const char *name) {
+    for (size_t i = 0; i < sizeof(analyzeKernels) / sizeof(analyzeKernels[0]); i++) {
+        if (strcmp(analyzeKernels[i].name, name) == 0 && analyzeKernels[i].supported()) {
+            analyzeKernel = &analyzeKernels[i];
+            return 0;
+        }
+    }
+    return 1;
+}
+
+const char *analyzeKernelName() {
+    if (analyzeKernel == NULL) {
+#ifdef ANALYZE_X86
+        __builtin_cpu_init();
+#endif
+        for (size_t i = sizeof(analyzeKernels) / sizeof(analyzeKernels[0]); i-- > 0;) {
+            if (analyzeKernels[i].supported()) {
+                analyzeKernel = &analyzeKernels[i];
+                break;
+            }
+        }
+    }
+    return analyzeKernel->name;
+}
+
+void analyzeReset(ImageAnalysis *analysis) {
+    memset(analysis, 0, sizeof(ImageAnalysis));
+}
+
+void analyzeRows(ImageAnalysis *analysis, const unsigned char *pixels, int stride, int width, int rows) {
+    analyzeKernelName();
+    if (stride == width * 4) {
+        analyzeKernel->kernel(pixels, (size_t)width * rows, analysis);
+        return;
+    }
+    for (int y = 0; y < rows; y++) {
+        analyzeKernel->kernel(pixels + (size_t)y * stride, width, analysis);
+    }
+}
+
+int analyzeReader(ImageReader *reader, ImageAnalysis *analysis) {
+    TRACE_SCOPE("analyzeReader");
+    analyzeReset(analysis);
+    imageReaderReduce(reader, ANALYZE_REDUCTION);
+    int stride = reader->width * 4;
+    unsigned char *band = malloc((size_t)stride * ANALYZE_BAND_ROWS);
+    if (band == NULL) {
+        return 1;
+    }
+    int result = 0;
+    for (int y = 0; result == 0 && y < reader->height; y += ANALYZE_BAND_ROWS) {
+        int rows = reader->height - y < ANALYZE_BAND_ROWS ? reader->height - y : ANALYZE_BAND_ROWS;
+        result = imageReaderRead(reader, band, stride, rows);
+        if (result == 0) {
+            analyzeRows(analysis, band, stride, reader->width, rows);
+        }
+    }
+    free(band);
+    return result;
+}
+
+float analyzeLuminance(const ImageAnalysis *analysis) {
+    return analysis->pixels > 0 ? (float)((double)analysis->luminanceSum / (255.0 * (double)analysis->pixels)) : 0.0f;
+}
+
+float analyzeWarmth(const ImageAnalysis *analysis) {
+    return analysis->pixels > 0 ? (float)((double)analysis->warmthSum / (255.0 * (double)analysis->pixels)) : 0.0f;
+}
+
+int analyzePeriod(const ImageAnalysis *analysis) {
+    unsigned long long dark = 0;
+    for (int bin = 0; bin < ANALYZE_DARK_BINS; bin++) {
+        dark += analysis->luminance[bin];
+    }
+    float luminance = analyzeLuminance(analysis);
+    float darkShare = analysis->pixels > 0 ? (float)((double)dark / (double)analysis->pixels) : 1.0f;
+
+    if (luminance < ANALYZE_NIGHT_LUMINANCE || (luminance < ANALYZE_DIM_LUMINANCE && darkShare >= ANALYZE_NIGHT_DARK)) {
+        return ANALYZE_NIGHT;
+    }
+    if (analyzeWarmth(analysis) >= ANALYZE_TWILIGHT_WARMTH && luminance < ANALYZE_BRIGHT_LUMINANCE) {
+        return ANALYZE_TWILIGHT;
+    }
+    return luminance >= ANALYZE_DAY_LUMINANCE ? ANALYZE_DAY : ANALYZE_TWILIGHT;
+}
+
+const char *analyzePeriodName(int period) {
+    switch (period) {
+        case ANALYZE_DAY:
+            return "day";
+        case ANALYZE_NIGHT:
+            return "night";
+        case ANALYZE_TWILIGHT:
+            return "twilight";
+    }
+    return "unknown";
+}
@@ -0,0 +1,32 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include "image.h"
+
+#define ANALYZE_BINS 16 // Bins of each histogram.
+
+// Periods an image suits, ANALYZE_DAY and ANALYZE_NIGHT match DAY and NIGHT of schedule.h
+#define ANALYZE_DAY 0
+#define ANALYZE_NIGHT 1
+#define ANALYZE_TWILIGHT 2
+#define ANALYZE_PERIODS 3
+
+// Histograms of the pixels of an image
+typedef struct ImageAnalysis {
+    unsigned long long luminance[ANALYZE_BINS]; // Pixels per Rec. 709 luma range, from black to white.
+    unsigned long long warmth[ANALYZE_BINS]; // Pixels per red minus blue range, from blue to red.
+    unsigned long long luminanceSum; // Sum of the luma of all pixels, 0 to 255 each.
+    long long warmthSum; // Sum of red minus blue of all pixels, -255 to 255 each.
+    unsigned long long pixels; // Number of pixels counted.
+} ImageAnalysis;
+
+void analyzeReset(ImageAnalysis *analysis);
+void analyzeRows(ImageAnalysis *analysis, const unsigned char *pixels, int stride, int width, int rows);
+int analyzeReader(ImageReader *reader, ImageAnalysis *analysis);
+float analyzeLuminance(const ImageAnalysis *analysis);
+float analyzeWarmth(const ImageAnalysis *analysis);
+int analyzePeriod(const ImageAnalysis *analysis);
+const char *analyzePeriodName(int period);
+int analyzeSetKernel(const char *name);
+const char *analyzeKernelName();
+#endif // ANALYZE_H
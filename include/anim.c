@@ -0,0 +1,162 @@
+/**
+ * @file anim.c
+ * @brief Decoder of the packed tray icon animation written by tooling/packAnimation.py.
+ *
+ * All numbers are little endian. The asset starts with a 16 byte header:
+ *     char magic[4] "WCAN", u16 version, u16 frameCount, u16 width, u16 height, u16 delay (ms), u16 reserved
+ * followed by frameCount + 1 u32 offsets from the start of the asset, where frame i spans
+ * offsets[i] to offsets[i + 1]. Frame i is stored as the XOR of its BGRA pixels with those of frame i - 1
+ * (frame 0 with zero), run-length encoded in pixels: a control byte c < 128 skips c + 1 unchanged pixels,
+ * c >= 128 is followed by c - 127 literal pixels. Since XOR is its own inverse, the same delta steps
+ * forwards from frame i - 1 to i and backwards from i to i - 1, so only the current frame is kept.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "anim.h"
+
+/**
+ * @brief Opens a packed animation and decodes its first frame.
+ *
+ * The asset is validated completely, so animSeek() cannot fail on malformed data later.
+ *
+ * @param animation The animation to initialize.
+ * @param data The packed asset, must stay valid until animClose().
+ * @param size The size of the packed asset in bytes.
+ * @return Returns 0 on success, or 1 if the asset is malformed or memory is exhausted.
+ */
+int animOpen(PackedAnimation *animation, const unsigned char *data, size_t size);
+
+/**
+ * @brief Frees the decoded frame of an animation.
+ */
+void animClose(PackedAnimation *animation);
+
+/**
+ * @brief Decodes a frame into the pixels of the animation.
+ *
+ * Steps through the deltas from the current frame, forwards or backwards, so neighbouring frames are cheap.
+ *
+ * @param animation The animation.
+ * @param frame The frame to decode, from 0 to frameCount - 1.
+ * @return Returns 0 on success, or 1 if the frame does not exist.
+ */
+int animSeek(PackedAnimation *animation, int frame);
+
+/**
+ * @brief Reads a little endian u16.
+ */
+static unsigned int animRead16(const unsigned char *data);
+
+/**
+ * @brief Reads a little endian u32.
+ */
+static uint32_t animRead32(const unsigned char *data);
+
+/**
+ * @brief XORs the delta of a frame into the pixels, or only validates it if pixels is NULL.
+ *
+ * @return Returns 0 on success, or 1 if the delta is malformed.
+ */
+static int animApply(const PackedAnimation *animation, int frame, unsigned char *pixels);
+
+static unsigned int animRead16(const unsigned char *data) {
+    return data[0] | (unsigned int)data[1] << 8;
+}
+
+static uint32_t animRead32(const unsigned char *data) {
+    return data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static int animApply(const PackedAnimation *animation, int frame, unsigned char *pixels) {
+    const unsigned char *table = animation->data + ANIM_HEADER_SIZE + (size_t)frame * 4;
+    size_t position = animRead32(table);
+    size_t end = animRead32(table + 4);
+    size_t pixel = 0;
+    size_t pixelCount = (size_t)animation->width * animation->height;
+
+    if (position > end || end > animation->size) {
+        return 1;
+    }
+    while (position < end) {
+        unsigned int control = animation->data[position++];
+        if (control < 128) {
+            pixel += control + 1;
+            continue;
+        }
+
+        size_t count = control - 127;
+        if (count * 4 > end - position || pixel + count > pixelCount) {
+            return 1;
+        }
+        if (pixels != NULL) {
+            unsigned char *target = pixels + pixel * 4;
+            const unsigned char *delta = animation->data + position;
+            for (size_t i = 0; i < count * 4; i++) {
+                target[i] ^= delta[i];
+            }
+        }
+        position += count * 4;
+        pixel += count;
+    }
+    return pixel > pixelCount;
+}
+
+int animOpen(PackedAnimation *animation, const unsigned char *data, size_t size) {
+    memset(animation, 0, sizeof(*animation));
+    animation->frame = -1;
+
+    if (size < ANIM_HEADER_SIZE || memcmp(data, ANIM_MAGIC, 4) != 0 || animRead16(data + 4) != ANIM_VERSION) {
+        error("Invalid animation header");
+        return 1;
+    }
+    animation->data = data;
+    animation->size = size;
+    animation->frameCount = animRead16(data + 6);
+    animation->width = animRead16(data + 8);
+    animation->height = animRead16(data + 10);
+    animation->delay = animRead16(data + 12);
+
+    if (animation->frameCount == 0 || animation->width == 0 || animation->height == 0
+        || size < ANIM_HEADER_SIZE + ((size_t)animation->frameCount + 1) * 4) {
+        error("Invalid animation: %d frames of %dx%d", animation->frameCount, animation->width, animation->height);
+        return 1;
+    }
+    for (int i = 0; i < animation->frameCount; i++) {
+        if (animApply(animation, i, NULL) != 0) {
+            error("Invalid animation frame: %d", i);
+            return 1;
+        }
+    }
+
+    animation->pixels = calloc((size_t)animation->width * animation->height, 4);
+    if (animation->pixels == NULL) {
+        error("Failure allocating animation frame");
+        return 1;
+    }
+    animApply(animation, 0, animation->pixels);
+    animation->frame = 0;
+    return 0;
+}
+
+void animClose(PackedAnimation *animation) {
+    free(animation->pixels);
+    animation->pixels = NULL;
+    animation->frame = -1;
+}
+
+int animSeek(PackedAnimation *animation, int frame) {
+    if (animation->pixels == NULL || frame < 0 || frame >= animation->frameCount) {
+        return 1;
+    }
+    while (animation->frame < frame) {
+        animApply(animation, ++animation->frame, animation->pixels);
+    }
+    while (animation->frame > frame) {
+        animApply(animation, animation->frame--, animation->pixels);
+    }
+    return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef ANIM_H
+#define ANIM_H
+
+#include <stddef.h>
+
+#define ANIM_MAGIC "WCAN"
+#define ANIM_VERSION 1
+#define ANIM_HEADER_SIZE 16
+
+// Packed animation, see anim.c for the format
+typedef struct PackedAnimation {
+    const unsigned char *data; // Packed asset, not owned.
+    size_t size; // Size of the packed asset in bytes.
+    int frameCount; // Number of frames.
+    int width; // Frame width in pixels.
+    int height; // Frame height in pixels.
+    int delay; // Time between two frames in milliseconds.
+    int frame; // Frame currently held in pixels, -1 if none.
+    unsigned char *pixels; // Current frame as top-down BGRA with straight alpha.
+} PackedAnimation;
+
+int animOpen(PackedAnimation *animation, const unsigned char *data, size_t size);
+void animClose(PackedAnimation *animation);
+int animSeek(PackedAnimation *animation, int frame);
+#endif // ANIM_H
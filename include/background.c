@@ -1,62 +1,601 @@
+/**
+ * @file background.c
+ * @brief Applies wallpapers through a platform backend.
+ *
+ * setBackground() scales the image through the wallpaper cache, skips the apply if the same wallpaper
+ * is still shown and hands the absolute path to the current WallpaperBackend. Backends exist for the
+ * Windows desktop, the X11 root window (built with WALLPAPER_X11, link with -lX11, see make linux) and
+ * a file sink that only records the paths.
+ */
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#ifdef _WIN32
 #include <windows.h>
+#endif
+#ifdef WALLPAPER_X11
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+#endif
+
 #include "log.h"
+#include "cache.h"
+#include "image.h"
+#include "metrics.h"
+#include "trace.h"
+#include "background.h"
 
 #define MAX_PATH 260
 #define MAX_LINE_LENGTH 256
+#define FILE_SINK_WIDTH 1920 // Screen width reported by the default sink of fileWallpaper.
+#define FILE_SINK_HEIGHT 1080 // Screen height reported by the default sink of fileWallpaper.
+
+// File sink backend and its context, allocated together by fileWallpaperCreate()
+typedef struct FileWallpaper {
+    WallpaperBackend backend; // Must stay first, fileWallpaperDestroy() frees through it.
+    WallpaperSink sink; // Context of the backend.
+    char path[]; // Copy of the sink path.
+} FileWallpaper;
+
+static char appliedFingerprint[FINGERPRINT_SIZE] = ""; // Fingerprint of the wallpaper applied last.
+#if defined(_WIN32)
+static const WallpaperBackend *wallpaperBackend = &win32Wallpaper; // Backend used by setBackground().
+#elif defined(WALLPAPER_X11)
+static const WallpaperBackend *wallpaperBackend = &x11Wallpaper; // Backend used by setBackground().
+#else
+static const WallpaperBackend *wallpaperBackend = NULL; // Backend used by setBackground().
+#endif
+
+/**
+ * @brief Selects the backend wallpapers are applied through.
+ *
+ * Not thread-safe, select the backend before the first wallpaper is applied.
+ *
+ * @param backend The backend, has to stay valid while it is used.
+ */
+void setWallpaperBackend(const WallpaperBackend *backend);
+
+/**
+ * @brief Returns the backend wallpapers are applied through, or NULL if there is none.
+ */
+const WallpaperBackend *getWallpaperBackend();
 
 /**
- * @brief Sets the desktop background and lock screen background using the specified image.
- * 
+ * @brief Sets the desktop background and, if the backend supports it, the lock screen background.
+ *
  * @param imagePath Path to the image file to be set as background.
  * @return 0 if successful, 1 if any operation fails.
  */
-int setBackground(char *imagePath);
+int setBackground(const char *imagePath);
 
 /**
  * @brief Sets the desktop wallpaper to the specified image.
- * 
+ *
+ * The image is handed to the backend as a cached BMP already scaled to the screen resolution. If it
+ * cannot be cached, only a backend with WALLPAPER_ORIGINAL gets the original file; the X11 backend would
+ * decode it with the same decoders that just failed. Files inside CACHE_DIRECTORY,
+ * such as transition frames, are already prepared and handed over as they are.
+ * Nothing is applied if the fingerprint matches the last applied wallpaper and the backend
+ * still shows that file, or cannot tell.
+ *
  * @param imagePath Path to the image file to be set as the desktop wallpaper.
  * @return 0 if successful, 1 otherwise.
  */
-int setDesktopBackground(char *imagePath);
+int setDesktopBackground(const char *imagePath);
 
 /**
- * @brief Sets the lock screen background to the specified image.
- * 
- * @param imagePath Path to the image file to be set as the lock screen background.
+ * @brief Returns the size the backend scales wallpapers to.
+ *
+ * In SCALE_SPAN mode this is the desktop across all monitors, otherwise the primary screen.
+ *
+ * @param width Receives the width in pixels.
+ * @param height Receives the height in pixels.
  * @return 0 if successful, 1 otherwise.
  */
-int setLockscreenBackground(char *imagePath);
+int getScreenSize(int *width, int *height);
+
+/**
+ * @brief Returns the fingerprint of the wallpaper applied last, or an empty string.
+ */
+const char *getAppliedFingerprint();
+
+/**
+ * @brief Restores the fingerprint of the wallpaper applied last, e.g. after a restart.
+ *
+ * @param fingerprint The fingerprint as returned by getAppliedFingerprint().
+ */
+void setAppliedFingerprint(const char *fingerprint);
+
+/**
+ * @brief Computes the fingerprint of a wallpaper.
+ *
+ * The fingerprint covers the path, modification time and size of the source image, like the cache key,
+ * so no image is read: "<file hash>|<width>x<height>|<fit>|<resolved path>". Transition frames alternate
+ * between two paths, so consecutive frames differ even if written within the same second.
+ *
+ * @param imagePath Path to the source image.
+ * @param resolvedPath Absolute path handed to the backend.
+ * @param width Target width in pixels.
+ * @param height Target height in pixels.
+ * @param fingerprint Receives the fingerprint.
+ * @param fingerprintSize The size of the fingerprint buffer.
+ * @return 0 if successful, 1 if the image does not exist.
+ */
+static int wallpaperFingerprint(const char *imagePath, const char *resolvedPath, int width, int height,
+                                char *fingerprint, size_t fingerprintSize);
+
+/**
+ * @brief Converts a path to the absolute path handed to the backend.
+ *
+ * @param path The path.
+ * @param absolutePath Receives the absolute path, MAX_PATH bytes.
+ * @return 0 if successful, 1 otherwise.
+ */
+static int wallpaperAbsolutePath(const char *path, char *absolutePath);
+
+/**
+ * @brief Returns whether the backend currently shows the given absolute path.
+ *
+ * A backend without WALLPAPER_QUERY is trusted to still show the wallpaper applied last.
+ */
+static int wallpaperShown(const char *absolutePath);
+
+/**
+ * @brief Creates a file sink backend with its own context.
+ *
+ * @param path File every applied path is appended to, copied, NULL to only keep the last one.
+ * @param width Reported screen width.
+ * @param height Reported screen height.
+ * @return The backend, or NULL if memory is exhausted. Must be freed with fileWallpaperDestroy().
+ */
+WallpaperBackend *fileWallpaperCreate(const char *path, int width, int height);
+
+/**
+ * @brief Frees a backend created by fileWallpaperCreate(), NULL is ignored.
+ */
+void fileWallpaperDestroy(WallpaperBackend *backend);
+
+/**
+ * @brief Appends the path to the file of the sink and remembers it.
+ */
+static int fileApply(void *context, const char *imagePath);
+
+/**
+ * @brief Receives the path applied last to the sink.
+ */
+static int fileQuery(void *context, char *imagePath, size_t imagePathSize);
+
+/**
+ * @brief Receives the screen size configured in the sink.
+ */
+static int fileScreenSize(void *context, int span, int *width, int *height);
+
+void setWallpaperBackend(const WallpaperBackend *backend) {
+    wallpaperBackend = backend;
+    info("Wallpaper backend: %s", backend != NULL ? backend->name : "none");
+}
 
-int setBackground(char *imagePath) {
+const WallpaperBackend *getWallpaperBackend() {
+    return wallpaperBackend;
+}
+
+int setBackground(const char *imagePath) {
+    uint64_t start = metricsNow();
+    if (wallpaperBackend == NULL) {
+        error("No wallpaper backend on this platform");
+        return 1;
+    }
     if (setDesktopBackground(imagePath) != 0) {
         error("Failiure setting Desktop Background!");
         return 1;
     }
 
-    if (setLockscreenBackground(imagePath) != 0) {
+    if ((wallpaperBackend->capabilities & WALLPAPER_LOCKSCREEN) != 0
+        && wallpaperBackend->applyLockscreen(wallpaperBackend->context, imagePath) != 0) {
         error("Failiure setting Lockscreen Background!");
         return 1;
     }
 
+    metricsRecordSince(METRIC_BACKGROUND_SET, start);
     return 0;
 }
 
-int setDesktopBackground(char *imagePath) {
+int setDesktopBackground(const char *imagePath) {
+    TRACE_SCOPE("setDesktopBackground");
     char absolutePath[MAX_PATH];
-    
-    if (!GetFullPathNameA(imagePath, MAX_PATH, absolutePath, NULL)) {
-        error("Failiure converting to absolute path: %ld", GetLastError());
+    char cachedPath[MAX_PATH];
+    const char *resolvedPath = imagePath;
+    int width = 0, height = 0;
+
+    if (getScreenSize(&width, &height) != 0) {
+        width = height = 0;
+    }
+    if (strncmp(imagePath, CACHE_DIRECTORY "/", sizeof(CACHE_DIRECTORY)) != 0) {
+        if (width > 0 && wallpaperCacheResolve(imagePath, width, height, cachedPath, sizeof(cachedPath)) == 0) {
+            resolvedPath = cachedPath;
+        } else if ((wallpaperBackend->capabilities & WALLPAPER_ORIGINAL) != 0) {
+            error("Failure caching wallpaper, using original: %s", imagePath);
+        } else {
+            error("Failure caching wallpaper, %s cannot show the original: %s", wallpaperBackend->name, imagePath);
+            return 1;
+        }
+    }
+
+    if (wallpaperAbsolutePath(resolvedPath, absolutePath) != 0) {
+        error("Failiure converting to absolute path: %s", resolvedPath);
+        return 1;
+    }
+
+    char fingerprint[FINGERPRINT_SIZE] = "";
+    if (wallpaperFingerprint(imagePath, absolutePath, width, height, fingerprint, sizeof(fingerprint)) == 0
+        && strcmp(fingerprint, appliedFingerprint) == 0
+        && wallpaperShown(absolutePath)) {
+        debug("Wallpaper already applied: %s", absolutePath);
+        metricsCount(METRIC_WALLPAPER_SKIPPED);
+        return 0;
+    }
+
+    uint64_t start = metricsNow();
+    if (wallpaperBackend->apply(wallpaperBackend->context, absolutePath) != 0) {
+        error("Failiure setting wallpaper through %s: %s", wallpaperBackend->name, absolutePath);
+        return 1;
+    }
+    metricsRecordSince(METRIC_WALLPAPER_APPLY, start);
+    strcpy(appliedFingerprint, fingerprint);
+    return 0;
+}
+
+const char *getAppliedFingerprint() {
+    return appliedFingerprint;
+}
+
+void setAppliedFingerprint(const char *fingerprint) {
+    snprintf(appliedFingerprint, sizeof(appliedFingerprint), "%s", fingerprint);
+}
+
+static int wallpaperFingerprint(const char *imagePath, const char *resolvedPath, int width, int height,
+                                char *fingerprint, size_t fingerprintSize) {
+    struct stat info;
+    if (stat(imagePath, &info) != 0) {
+        error("Failure reading wallpaper: %s", imagePath);
         return 1;
     }
-    if (!SystemParametersInfoA(SPI_SETDESKWALLPAPER, 0, (void *)absolutePath, SPIF_UPDATEINIFILE | SPIF_SENDCHANGE)) {
+
+    // FNV-1a over the path and the stat data.
+    long long file[2] = {(long long)info.st_mtime, (long long)info.st_size};
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char *c = imagePath; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+    }
+    for (size_t i = 0; i < sizeof(file); i++) {
+        hash = (hash ^ ((const unsigned char *)file)[i]) * 1099511628211ULL;
+    }
+
+    snprintf(fingerprint, fingerprintSize, "%016llx|%dx%d|%s|%s",
+             (unsigned long long)hash, width, height, scaleModeName(wallpaperCacheOptions()->mode), resolvedPath);
+    return 0;
+}
+
+static int wallpaperAbsolutePath(const char *path, char *absolutePath) {
+#ifdef _WIN32
+    return GetFullPathNameA(path, MAX_PATH, absolutePath, NULL) == 0;
+#else
+    char resolved[4096];
+    if (realpath(path, resolved) == NULL || strlen(resolved) >= MAX_PATH) {
+        return 1;
+    }
+    strcpy(absolutePath, resolved);
+    return 0;
+#endif
+}
+
+static int wallpaperShown(const char *absolutePath) {
+    if ((wallpaperBackend->capabilities & WALLPAPER_QUERY) == 0) {
+        return 1;
+    }
+    char currentPath[MAX_PATH] = "";
+    if (wallpaperBackend->query(wallpaperBackend->context, currentPath, sizeof(currentPath)) != 0) {
+        return 0;
+    }
+#ifdef _WIN32
+    return lstrcmpiA(currentPath, absolutePath) == 0;
+#else
+    return strcmp(currentPath, absolutePath) == 0;
+#endif
+}
+
+int getScreenSize(int *width, int *height) {
+    int span = wallpaperCacheOptions()->mode == SCALE_SPAN;
+    if (wallpaperBackend == NULL || wallpaperBackend->screenSize(wallpaperBackend->context, span, width, height) != 0
+        || *width <= 0 || *height <= 0) {
+        error("Failure reading screen size");
+        return 1;
+    }
+    return 0;
+}
+
+
+// ### File sink ### //
+
+
+static WallpaperSink fileSink = {NULL, FILE_SINK_WIDTH, FILE_SINK_HEIGHT, ""}; // Default context of fileWallpaper.
+const WallpaperBackend fileWallpaper = {"file", WALLPAPER_QUERY | WALLPAPER_ORIGINAL, fileApply, fileQuery, NULL, fileScreenSize, &fileSink};
+
+WallpaperBackend *fileWallpaperCreate(const char *path, int width, int height) {
+    size_t pathSize = path != NULL ? strlen(path) + 1 : 0;
+    FileWallpaper *file = calloc(1, sizeof(FileWallpaper) + pathSize);
+    if (file == NULL) {
+        error("Failure allocating wallpaper sink");
+        return NULL;
+    }
+    file->backend = fileWallpaper;
+    file->backend.context = &file->sink;
+    if (path != NULL) {
+        memcpy(file->path, path, pathSize);
+        file->sink.path = file->path;
+    }
+    file->sink.width = width;
+    file->sink.height = height;
+    return &file->backend;
+}
+
+void fileWallpaperDestroy(WallpaperBackend *backend) {
+    free(backend);
+}
+
+static int fileApply(void *context, const char *imagePath) {
+    WallpaperSink *sink = context;
+    if (sink->path != NULL) {
+        FILE *file = fopen(sink->path, "a");
+        if (file == NULL) {
+            error("Failure opening wallpaper sink: %s", sink->path);
+            return 1;
+        }
+        fprintf(file, "%s\n", imagePath);
+        fclose(file);
+    }
+    snprintf(sink->current, sizeof(sink->current), "%s", imagePath);
+    return 0;
+}
+
+static int fileQuery(void *context, char *imagePath, size_t imagePathSize) {
+    WallpaperSink *sink = context;
+    snprintf(imagePath, imagePathSize, "%s", sink->current);
+    return sink->current[0] == '\0';
+}
+
+static int fileScreenSize(void *context, int span, int *width, int *height) {
+    WallpaperSink *sink = context;
+    *width = sink->width;
+    *height = sink->height;
+    return 0;
+}
+
+
+// ### Windows ### //
+
+
+#ifdef _WIN32
+// Registry values written by this process, so an apply only writes them when they change
+typedef struct Win32State {
+    char style[3]; // WallpaperStyle written last, empty before the first prepared image.
+    char cacheDirectory[MAX_PATH]; // Absolute CACHE_DIRECTORY with a trailing separator, empty until the first apply.
+} Win32State;
+
+static Win32State win32State = {"", ""}; // Context of win32Wallpaper.
+
+/**
+ * @brief Sets the desktop wallpaper with SystemParametersInfoA().
+ *
+ * Images from the cache are already scaled, so their style is set to center or span. The original image
+ * is left to the style the user chose, Windows scales it.
+ */
+static int win32Apply(void *context, const char *imagePath);
+
+/**
+ * @brief Receives the desktop wallpaper with SystemParametersInfoA().
+ */
+static int win32Query(void *context, char *imagePath, size_t imagePathSize);
+
+/**
+ * @brief Receives the resolution of the primary screen, or of the virtual screen when spanning.
+ */
+static int win32ScreenSize(void *context, int span, int *width, int *height);
+
+const WallpaperBackend win32Wallpaper = {"win32", WALLPAPER_QUERY | WALLPAPER_ORIGINAL, win32Apply, win32Query, NULL, win32ScreenSize, &win32State};
+
+static int win32Apply(void *context, const char *imagePath) {
+    Win32State *state = context;
+    if (state->cacheDirectory[0] == '\0') {
+        DWORD length = GetFullPathNameA(CACHE_DIRECTORY "\\", sizeof(state->cacheDirectory), state->cacheDirectory, NULL);
+        if (length == 0 || length >= sizeof(state->cacheDirectory)) {
+            state->cacheDirectory[0] = '\0';
+        }
+    }
+    size_t cacheLength = strlen(state->cacheDirectory);
+    if (cacheLength > 0 && _strnicmp(imagePath, state->cacheDirectory, cacheLength) == 0) {
+        // The image already has the size of the screen, only a spanned image has to be stretched across monitors.
+        const char *style = wallpaperCacheOptions()->mode == SCALE_SPAN ? "22" : "10";
+        if (strcmp(style, state->style) != 0) {
+            if (RegSetKeyValueA(HKEY_CURRENT_USER, "Control Panel\\Desktop", "WallpaperStyle", REG_SZ, style, 3) != ERROR_SUCCESS
+                || RegSetKeyValueA(HKEY_CURRENT_USER, "Control Panel\\Desktop", "TileWallpaper", REG_SZ, "0", 2) != ERROR_SUCCESS) {
+                error("Failure setting wallpaper style");
+            } else {
+                strcpy(state->style, style);
+            }
+        }
+    }
+    TraceSpan apply = traceBegin("SystemParametersInfoA");
+    BOOL applied = SystemParametersInfoA(SPI_SETDESKWALLPAPER, 0, (void *)imagePath, SPIF_UPDATEINIFILE | SPIF_SENDCHANGE);
+    traceEnd(apply);
+    if (!applied) {
         error("Failiure setting wallpaper: %ld", GetLastError());
         return 1;
     }
     return 0;
 }
 
-int setLockscreenBackground(char *imagePath) {
+static int win32Query(void *context, char *imagePath, size_t imagePathSize) {
+    return !SystemParametersInfoA(SPI_GETDESKWALLPAPER, (UINT)imagePathSize, imagePath, 0);
+}
+
+static int win32ScreenSize(void *context, int span, int *width, int *height) {
+    *width = GetSystemMetrics(span ? SM_CXVIRTUALSCREEN : SM_CXSCREEN);
+    *height = GetSystemMetrics(span ? SM_CYVIRTUALSCREEN : SM_CYSCREEN);
+    return 0;
+}
+#endif
+
+
+// ### X11 ### //
+
+
+#ifdef WALLPAPER_X11
+// Pixmap set by this process, to tell whether the root window still shows our wallpaper
+typedef struct X11State {
+    Pixmap pixmap; // Pixmap set last, None before the first apply.
+    char path[MAX_PATH]; // Path of the image in the pixmap.
+} X11State;
+
+static X11State x11State = {None, ""}; // Context of x11Wallpaper.
+
+/**
+ * @brief Uploads the image into a pixmap and makes it the background of the root window.
+ *
+ * The pixmap is published in _XROOTPMAP_ID and ESETROOT_PMAP_ID like Esetroot and feh do, so
+ * compositors and pseudo-transparent terminals pick it up. The connection is closed with
+ * RetainPermanent so the pixmap outlives it, and the pixmap of the previous setter is freed by
+ * killing its retained client.
+ */
+static int x11Apply(void *context, const char *imagePath);
+
+/**
+ * @brief Receives the path of the wallpaper if the root window still shows the pixmap set last.
+ */
+static int x11Query(void *context, char *imagePath, size_t imagePathSize);
+
+/**
+ * @brief Receives the size of the root window.
+ *
+ * The root window background always covers all monitors, and the core protocol does not tell where
+ * the monitors are, so span is ignored: every mode scales to the whole root window, like SCALE_SPAN.
+ */
+static int x11ScreenSize(void *context, int span, int *width, int *height);
+
+/**
+ * @brief Reads a pixmap id property of the root window.
+ *
+ * @return The pixmap, or None if the property is not set.
+ */
+static Pixmap x11RootPixmap(Display *display, Window root, Atom property);
+
+const WallpaperBackend x11Wallpaper = {"x11", WALLPAPER_QUERY, x11Apply, x11Query, NULL, x11ScreenSize, &x11State};
+
+static Pixmap x11RootPixmap(Display *display, Window root, Atom property) {
+    Atom type;
+    int format;
+    unsigned long count, remaining;
+    unsigned char *data = NULL;
+    Pixmap pixmap = None;
+    if (XGetWindowProperty(display, root, property, 0, 1, False, XA_PIXMAP, &type, &format,
+                           &count, &remaining, &data) == Success && type == XA_PIXMAP && format == 32 && count == 1) {
+        pixmap = *(Pixmap *)data;
+    }
+    if (data != NULL) {
+        XFree(data);
+    }
+    return pixmap;
+}
+
+static int x11Apply(void *context, const char *imagePath) {
+    X11State *state = context;
+    Image image;
+    if (imageLoad(imagePath, &image) != 0) {
+        error("Failure loading wallpaper: %s", imagePath);
+        return 1;
+    }
+    Display *display = XOpenDisplay(NULL);
+    if (display == NULL) {
+        error("Failure opening X display");
+        imageFree(&image);
+        return 1;
+    }
+    TRACE_SCOPE("XPutImage");
+    int screen = DefaultScreen(display);
+    Window root = RootWindow(display, screen);
+    Visual *visual = DefaultVisual(display, screen);
+    int depth = DefaultDepth(display, screen);
+
+    // The BGRA rows match a 24/32-bit TrueColor visual in LSBFirst order, Xlib swaps for other servers.
+    if (depth < 24 || visual->red_mask != 0xff0000 || visual->green_mask != 0xff00 || visual->blue_mask != 0xff) {
+        error("Unsupported X visual: depth %d", depth);
+        XCloseDisplay(display);
+        imageFree(&image);
+        return 1;
+    }
+    XImage *ximage = XCreateImage(display, visual, depth, ZPixmap, 0, (char *)image.pixels,
+                                  image.width, image.height, 32, image.stride);
+    if (ximage == NULL) {
+        error("Failure creating X image");
+        XCloseDisplay(display);
+        imageFree(&image);
+        return 1;
+    }
+    ximage->byte_order = LSBFirst;
+    Pixmap pixmap = XCreatePixmap(display, root, image.width, image.height, depth);
+    GC gc = XCreateGC(display, pixmap, 0, NULL);
+    XPutImage(display, pixmap, gc, ximage, 0, 0, 0, 0, image.width, image.height);
+    XFreeGC(display, gc);
+    ximage->data = NULL; // Owned by the image.
+    XDestroyImage(ximage);
+    imageFree(&image);
+
+    Atom rootAtom = XInternAtom(display, "_XROOTPMAP_ID", False);
+    Atom esetrootAtom = XInternAtom(display, "ESETROOT_PMAP_ID", False);
+    Pixmap previous = x11RootPixmap(display, root, rootAtom);
+    if (previous != None && previous == x11RootPixmap(display, root, esetrootAtom)) {
+        XKillClient(display, previous);
+    }
+    XChangeProperty(display, root, rootAtom, XA_PIXMAP, 32, PropModeReplace, (unsigned char *)&pixmap, 1);
+    XChangeProperty(display, root, esetrootAtom, XA_PIXMAP, 32, PropModeReplace, (unsigned char *)&pixmap, 1);
+    XSetWindowBackgroundPixmap(display, root, pixmap);
+    XClearWindow(display, root);
+    XSetCloseDownMode(display, RetainPermanent);
+    XCloseDisplay(display);
+
+    state->pixmap = pixmap;
+    snprintf(state->path, sizeof(state->path), "%s", imagePath);
+    return 0;
+}
+
+static int x11Query(void *context, char *imagePath, size_t imagePathSize) {
+    X11State *state = context;
+    Display *display = XOpenDisplay(NULL);
+    if (display == NULL) {
+        return 1;
+    }
+    Pixmap current = x11RootPixmap(display, DefaultRootWindow(display), XInternAtom(display, "_XROOTPMAP_ID", False));
+    XCloseDisplay(display);
+    if (state->pixmap == None || current != state->pixmap) {
+        return 1;
+    }
+    snprintf(imagePath, imagePathSize, "%s", state->path);
+    return 0;
+}
+
+static int x11ScreenSize(void *context, int span, int *width, int *height) {
+    Display *display = XOpenDisplay(NULL);
+    if (display == NULL) {
+        error("Failure opening X display");
+        return 1;
+    }
+    *width = DisplayWidth(display, DefaultScreen(display));
+    *height = DisplayHeight(display, DefaultScreen(display));
+    XCloseDisplay(display);
     return 0;
-}
\ No newline at end of file
+}
+#endif
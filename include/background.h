@@ -1,12 +1,52 @@
 #ifndef BACKGROUND_H
 #define BACKGROUND_H
 
-#include <windows.h>
+#include <stddef.h>
 
 // Constants
 #define MAX_PATH 260
 #define MAX_LINE_LENGTH 256
+#define FINGERPRINT_SIZE 512
 
-int setBackground(char *imagePath);
+// Capabilities of a wallpaper backend
+#define WALLPAPER_QUERY 1 // query() reports the wallpaper currently shown.
+#define WALLPAPER_LOCKSCREEN 2 // applyLockscreen() sets the lock screen.
+#define WALLPAPER_ORIGINAL 4 // apply() takes the original image if it cannot be cached, the backend scales it itself.
+
+// Platform output for wallpapers, all functions receive the context
+typedef struct WallpaperBackend {
+    const char *name; // Name of the backend, a string literal.
+    int capabilities; // WALLPAPER_* flags.
+    int (*apply)(void *context, const char *imagePath); // Shows an image, the path is absolute.
+    int (*query)(void *context, char *imagePath, size_t imagePathSize); // Receives the image shown, NULL without WALLPAPER_QUERY.
+    int (*applyLockscreen)(void *context, const char *imagePath); // NULL without WALLPAPER_LOCKSCREEN.
+    int (*screenSize)(void *context, int span, int *width, int *height); // Receives the size a wallpaper is scaled to, span for all monitors.
+    void *context; // Passed to the functions.
+} WallpaperBackend;
+
+// Context of fileWallpaper
+typedef struct WallpaperSink {
+    const char *path; // File every applied path is appended to, NULL to only keep the last one.
+    int width; // Reported screen width.
+    int height; // Reported screen height.
+    char current[MAX_PATH]; // Path applied last.
+} WallpaperSink;
+
+extern const WallpaperBackend fileWallpaper; // Records the applied paths in a shared sink without a file, reporting 1920x1080.
+#ifdef _WIN32
+extern const WallpaperBackend win32Wallpaper; // SystemParametersInfoA() of the desktop.
+#endif
+#ifdef WALLPAPER_X11
+extern const WallpaperBackend x11Wallpaper; // Background pixmap of the X11 root window.
+#endif
+
+WallpaperBackend *fileWallpaperCreate(const char *path, int width, int height);
+void fileWallpaperDestroy(WallpaperBackend *backend);
+void setWallpaperBackend(const WallpaperBackend *backend);
+const WallpaperBackend *getWallpaperBackend();
+int setBackground(const char *imagePath);
+int getScreenSize(int *width, int *height);
+const char *getAppliedFingerprint();
+void setAppliedFingerprint(const char *fingerprint);
 
 #endif // BACKGROUND_H
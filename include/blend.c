@@ -0,0 +1,173 @@
+/**
+ * @file blend.c
+ * @brief Alpha blending of two equally sized images, used for the day/night crossfade.
+ *
+ * Every channel is computed as (from * (256 - alpha) + to * alpha + 128) >> 8. The SSE2 and AVX2 kernels
+ * evaluate the same formula in 16-bit lanes, so all kernels produce identical output. The fastest
+ * kernel the CPU supports is selected on first use.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLEND_X86
+#endif
+
+#include "blend.h"
+
+typedef void (*BlendKernel)(const unsigned char *from, const unsigned char *to, unsigned char *target, size_t length, int alpha);
+
+typedef struct BlendKernelEntry {
+    const char *name; // Name used by blendSetKernel().
+    BlendKernel kernel; // Blends length bytes.
+    int (*supported)(); // Whether the CPU can run the kernel.
+} BlendKernelEntry;
+
+/**
+ * @brief Blends two images into a third of the same size.
+ *
+ * @param from The image shown at alpha 0.
+ * @param to The image shown at alpha BLEND_MAX.
+ * @param target Receives the blend, may be one of the sources.
+ * @param alpha Weight of to, from 0 to BLEND_MAX.
+ * @return Returns 0 on success, or 1 if the sizes differ.
+ */
+int blendImages(const Image *from, const Image *to, Image *target, int alpha);
+
+/**
+ * @brief Forces a blend kernel ("scalar", "sse2" or "avx2").
+ *
+ * @param name The kernel name.
+ * @return Returns 0 on success, or 1 if the kernel is unknown or unsupported by the CPU.
+ */
+int blendSetKernel(const char *name);
+
+/**
+ * @brief Returns the name of the kernel in use, selecting the best one if none is selected yet.
+ */
+const char *blendKernelName();
+
+static void blendScalar(const unsigned char *from, const unsigned char *to, unsigned char *target, size_t length, int alpha) {
+    int inverse = BLEND_MAX - alpha;
+    for (size_t i = 0; i < length; i++) {
+        target[i] = (unsigned char)((from[i] * inverse + to[i] * alpha + 128) >> 8);
+    }
+}
+
+static int blendAlways() {
+    return 1;
+}
+
+#ifdef BLEND_X86
+
+__attribute__((target("sse2")))
+static void blendSse2(const unsigned char *from, const unsigned char *to, unsigned char *target, size_t length, int alpha) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weightTo = _mm_set1_epi16((short)alpha);
+    const __m128i weightFrom = _mm_set1_epi16((short)(BLEND_MAX - alpha));
+    const __m128i round = _mm_set1_epi16(128);
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(from + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(to + i));
+        __m128i low = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), weightFrom),
+                                                  _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), weightTo)), round);
+        __m128i high = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), weightFrom),
+                                                   _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), weightTo)), round);
+        _mm_storeu_si128((__m128i *)(target + i), _mm_packus_epi16(_mm_srli_epi16(low, 8), _mm_srli_epi16(high, 8)));
+    }
+    blendScalar(from + i, to + i, target + i, length - i, alpha);
+}
+
+__attribute__((target("avx2")))
+static void blendAvx2(const unsigned char *from, const unsigned char *to, unsigned char *target, size_t length, int alpha) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i weightTo = _mm256_set1_epi16((short)alpha);
+    const __m256i weightFrom = _mm256_set1_epi16((short)(BLEND_MAX - alpha));
+    const __m256i round = _mm256_set1_epi16(128);
+    size_t i = 0;
+
+    // Unpack and pack both work per 128-bit lane, so the byte order is preserved.
+    for (; i + 32 <= length; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(from + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(to + i));
+        __m256i low = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), weightFrom),
+                                                        _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), weightTo)), round);
+        __m256i high = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), weightFrom),
+                                                         _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), weightTo)), round);
+        _mm256_storeu_si256((__m256i *)(target + i), _mm256_packus_epi16(_mm256_srli_epi16(low, 8), _mm256_srli_epi16(high, 8)));
+    }
+    blendSse2(from + i, to + i, target + i, length - i, alpha);
+}
+
+static int blendHasSse2() {
+    return __builtin_cpu_supports("sse2");
+}
+
+static int blendHasAvx2() {
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+// Kernels from slowest to fastest.
+static const BlendKernelEntry blendKernels[] = {
+    {"scalar", blendScalar, blendAlways},
+#ifdef BLEND_X86
+    {"sse2", blendSse2, blendHasSse2},
+    {"avx2", blendAvx2, blendHasAvx2},
+#endif
+};
+
+static const BlendKernelEntry *blendKernel = NULL; // Kernel in use, NULL until first use.
+
+int blendSetKernel(const char *name) {
+    for (size_t i = 0; i < sizeof(blendKernels) / sizeof(blendKernels[0]); i++) {
+        if (strcmp(blendKernels[i].name, name) == 0 && blendKernels[i].supported()) {
+            blendKernel = &blendKernels[i];
+            return 0;
+        }
+    }
+    return 1;
+}
+
+const char *blendKernelName() {
+    if (blendKernel == NULL) {
+#ifdef BLEND_X86
+        __builtin_cpu_init();
+#endif
+        for (size_t i = sizeof(blendKernels) / sizeof(blendKernels[0]); i-- > 0;) {
+            if (blendKernels[i].supported()) {
+                blendKernel = &blendKernels[i];
+                break;
+            }
+        }
+    }
+    return blendKernel->name;
+}
+
+int blendImages(const Image *from, const Image *to, Image *target, int alpha) {
+    if (from->width != to->width || from->height != to->height
+        || from->width != target->width || from->height != target->height) {
+        return 1;
+    }
+    if (alpha < 0) {
+        alpha = 0;
+    } else if (alpha > BLEND_MAX) {
+        alpha = BLEND_MAX;
+    }
+
+    blendKernelName();
+    size_t rowLength = (size_t)from->width * 4;
+    if (from->stride == to->stride && from->stride == target->stride && (size_t)from->stride == rowLength) {
+        blendKernel->kernel(from->pixels, to->pixels, target->pixels, rowLength * from->height, alpha);
+        return 0;
+    }
+    for (int y = 0; y < from->height; y++) {
+        blendKernel->kernel(from->pixels + (size_t)y * from->stride, to->pixels + (size_t)y * to->stride,
+                            target->pixels + (size_t)y * target->stride, rowLength, alpha);
+    }
+    return 0;
+}
@@ -0,0 +1,12 @@
+#ifndef BLEND_H
+#define BLEND_H
+
+#include "image.h"
+
+// Blend weights, 0 shows the first image and BLEND_MAX the second
+#define BLEND_MAX 256
+
+int blendImages(const Image *from, const Image *to, Image *target, int alpha);
+int blendSetKernel(const char *name);
+const char *blendKernelName();
+#endif // BLEND_H
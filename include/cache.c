@@ -0,0 +1,360 @@
+/**
+ * @file cache.c
+ * @brief Cache of wallpapers decoded and scaled to the screen resolution.
+ *
+ * Each configured image is decoded and scaled once and stored as an uncompressed BMP in CACHE_DIRECTORY,
+ * which the OS can display without decoding or transcoding. Entries are named
+ * <path hash>-<key hash>.bmp, where the key covers the absolute path, modification time, file size,
+ * target resolution and scale options. When an image changes, the stale entries of the same path are removed.
+ *
+ * The entries together are kept below a size limit: a hit refreshes the modification time of its entry, and
+ * each new entry evicts the least recently used ones. Prefetched images whose slot has passed are not used
+ * again, so they age out like any other entry.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <utime.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <limits.h>
+#endif
+
+#include "log.h"
+#include "image.h"
+#include "trace.h"
+#include "cache.h"
+
+#define CACHE_VERSION 3 // Increase when the content of cache entries changes.
+#define CACHE_TOUCH_INTERVAL 60 // Seconds before a hit refreshes the time of its entry again.
+#define CACHE_NAME_LENGTH 37 // Length of an entry name, <16 hex digits>-<16 hex digits>.bmp.
+
+static ScaleOptions cacheOptions = {SCALE_FILL, SCALE_LANCZOS3, 0x000000, 0, SCALE_DEFAULT_MEMORY}; // Options new entries are scaled with.
+static long long cacheLimit = CACHE_DEFAULT_LIMIT; // Size limit of all entries in bytes, 0 for no limit.
+
+// Entry found while evicting
+typedef struct CacheEntry {
+    char name[CACHE_NAME_LENGTH + 1]; // File name in CACHE_DIRECTORY.
+    unsigned long long used; // Last use, in the units of the file system time stamps.
+    long long size; // Size in bytes.
+} CacheEntry;
+
+/**
+ * @brief Sets the options new entries are scaled with. Not thread-safe, call it from the thread resolving entries.
+ *
+ * @param options The options, copied.
+ */
+void wallpaperCacheSetOptions(const ScaleOptions *options);
+
+/**
+ * @brief Returns the options new entries are scaled with.
+ */
+const ScaleOptions *wallpaperCacheOptions();
+
+/**
+ * @brief Sets the size limit of the cache and evicts the least recently used entries above it.
+ *
+ * @param limit The limit in bytes, 0 for no limit.
+ */
+void wallpaperCacheSetLimit(long long limit);
+
+/**
+ * @brief Returns the path of the cached, screen-sized copy of an image, creating it if needed.
+ *
+ * @param imagePath Path to the source image.
+ * @param width Target width in pixels.
+ * @param height Target height in pixels.
+ * @param cachedPath Receives the path of the cached BMP.
+ * @param cachedPathSize The size of the cachedPath buffer.
+ * @return Returns 0 on success, or 1 if the image cannot be decoded or the cache cannot be written.
+ */
+int wallpaperCacheResolve(const char *imagePath, int width, int height, char *cachedPath, size_t cachedPathSize);
+
+/**
+ * @brief Feeds bytes into a 64-bit FNV-1a hash.
+ */
+static uint64_t cacheHash(uint64_t hash, const void *data, size_t length);
+
+/**
+ * @brief Removes all entries of a source path except the current one.
+ *
+ * @param pathHash Hash of the absolute source path.
+ * @param keepName File name of the entry to keep.
+ */
+static void cachePrune(uint64_t pathHash, const char *keepName);
+
+/**
+ * @brief Removes the least recently used entries until all entries fit into the size limit.
+ *
+ * Only files named like entries are counted, transition frames and the library index are left alone.
+ *
+ * @param keepName File name of an entry that is never removed, or NULL.
+ */
+static void cacheEvict(const char *keepName);
+
+/**
+ * @brief Appends an entry to a growing list.
+ *
+ * @return Returns 0 on success, or 1 if memory runs out.
+ */
+static int cacheAddEntry(CacheEntry **entries, int *count, int *capacity, const char *name, unsigned long long used, long long size);
+
+/**
+ * @brief Returns whether a file name has the form of an entry, <16 hex digits>-<16 hex digits>.bmp.
+ */
+static int cacheIsEntry(const char *name);
+
+/**
+ * @brief Orders entries from the least to the most recently used.
+ */
+static int cacheCompareUse(const void *a, const void *b);
+
+void wallpaperCacheSetOptions(const ScaleOptions *options) {
+    cacheOptions = *options;
+}
+
+const ScaleOptions *wallpaperCacheOptions() {
+    return &cacheOptions;
+}
+
+void wallpaperCacheSetLimit(long long limit) {
+    cacheLimit = limit;
+    cacheEvict(NULL);
+}
+
+static uint64_t cacheHash(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void cachePrune(uint64_t pathHash, const char *keepName) {
+    char prefix[32];
+    char entryPath[MAX_CACHE_PATH];
+    snprintf(prefix, sizeof(prefix), "%016llx-", (unsigned long long)pathHash);
+
+#ifdef _WIN32
+    char pattern[MAX_CACHE_PATH];
+    snprintf(pattern, sizeof(pattern), "%s/%s*.bmp", CACHE_DIRECTORY, prefix);
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA(pattern, &entry);
+    if (find == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    do {
+        if (strcmp(entry.cFileName, keepName) != 0) {
+            snprintf(entryPath, sizeof(entryPath), "%s/%s", CACHE_DIRECTORY, entry.cFileName);
+            remove(entryPath);
+        }
+    } while (FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    DIR *directory = opendir(CACHE_DIRECTORY);
+    if (directory == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL) {
+        if (strncmp(entry->d_name, prefix, strlen(prefix)) == 0 && strcmp(entry->d_name, keepName) != 0) {
+            snprintf(entryPath, sizeof(entryPath), "%s/%s", CACHE_DIRECTORY, entry->d_name);
+            remove(entryPath);
+        }
+    }
+    closedir(directory);
+#endif
+}
+
+static void cacheEvict(const char *keepName) {
+    if (cacheLimit <= 0) {
+        return;
+    }
+    CacheEntry *entries = NULL;
+    int count = 0, capacity = 0;
+    char entryPath[MAX_CACHE_PATH];
+
+#ifdef _WIN32
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA(CACHE_DIRECTORY "/*.bmp", &entry);
+    if (find == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    do {
+        unsigned long long used = (unsigned long long)entry.ftLastWriteTime.dwHighDateTime << 32 | entry.ftLastWriteTime.dwLowDateTime;
+        long long size = (long long)entry.nFileSizeHigh << 32 | entry.nFileSizeLow;
+        if (cacheIsEntry(entry.cFileName) && cacheAddEntry(&entries, &count, &capacity, entry.cFileName, used, size) != 0) {
+            break;
+        }
+    } while (FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    DIR *directory = opendir(CACHE_DIRECTORY);
+    if (directory == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL) {
+        struct stat info;
+        snprintf(entryPath, sizeof(entryPath), "%s/%s", CACHE_DIRECTORY, entry->d_name);
+        if (cacheIsEntry(entry->d_name) && stat(entryPath, &info) == 0
+            && cacheAddEntry(&entries, &count, &capacity, entry->d_name, (unsigned long long)info.st_mtime, (long long)info.st_size) != 0) {
+            break;
+        }
+    }
+    closedir(directory);
+#endif
+
+    long long total = 0;
+    for (int i = 0; i < count; i++) {
+        total += entries[i].size;
+    }
+    if (total > cacheLimit) {
+        qsort(entries, count, sizeof(CacheEntry), cacheCompareUse);
+        for (int i = 0; i < count && total > cacheLimit; i++) {
+            if (keepName != NULL && strcmp(entries[i].name, keepName) == 0) {
+                continue;
+            }
+            snprintf(entryPath, sizeof(entryPath), "%s/%s", CACHE_DIRECTORY, entries[i].name);
+            if (remove(entryPath) == 0) {
+                debug("Evicted %s from the wallpaper cache", entries[i].name);
+                total -= entries[i].size;
+            }
+        }
+    }
+    free(entries);
+}
+
+static int cacheAddEntry(CacheEntry **entries, int *count, int *capacity, const char *name, unsigned long long used, long long size) {
+    if (*count == *capacity) {
+        int grownCapacity = *capacity > 0 ? *capacity * 2 : 64;
+        CacheEntry *grown = realloc(*entries, grownCapacity * sizeof(CacheEntry));
+        if (grown == NULL) {
+            return 1;
+        }
+        *entries = grown;
+        *capacity = grownCapacity;
+    }
+    CacheEntry *entry = &(*entries)[(*count)++];
+    memcpy(entry->name, name, sizeof(entry->name)); // Checked by cacheIsEntry().
+    entry->used = used;
+    entry->size = size;
+    return 0;
+}
+
+static int cacheIsEntry(const char *name) {
+    for (int i = 0; i < 33; i++) {
+        int hex = (name[i] >= '0' && name[i] <= '9') || (name[i] >= 'a' && name[i] <= 'f');
+        if (i == 16 ? name[i] != '-' : !hex) {
+            return 0;
+        }
+    }
+    return strcmp(name + 33, ".bmp") == 0; // CACHE_NAME_LENGTH characters in total.
+}
+
+static int cacheCompareUse(const void *a, const void *b) {
+    const CacheEntry *left = a, *right = b;
+    return (left->used > right->used) - (left->used < right->used);
+}
+
+int wallpaperCacheResolve(const char *imagePath, int width, int height, char *cachedPath, size_t cachedPathSize) {
+    TRACE_SCOPE("wallpaperCacheResolve");
+    char absolutePath[MAX_CACHE_PATH];
+#ifdef _WIN32
+    if (!GetFullPathNameA(imagePath, sizeof(absolutePath), absolutePath, NULL)) {
+        return 1;
+    }
+#else
+    char resolved[PATH_MAX];
+    if (realpath(imagePath, resolved) == NULL || strlen(resolved) >= sizeof(absolutePath)) {
+        return 1;
+    }
+    strcpy(absolutePath, resolved);
+#endif
+
+    struct stat info;
+    if (stat(absolutePath, &info) != 0) {
+        error("Failure reading image: %s", imagePath);
+        return 1;
+    }
+
+    uint64_t pathHash = cacheHash(14695981039346656037ULL, absolutePath, strlen(absolutePath));
+    long long modified = (long long)info.st_mtime;
+    long long size = (long long)info.st_size;
+    int version = CACHE_VERSION;
+    uint64_t key = cacheHash(pathHash, &modified, sizeof(modified));
+    key = cacheHash(key, &size, sizeof(size));
+    key = cacheHash(key, &width, sizeof(width));
+    key = cacheHash(key, &height, sizeof(height));
+    key = cacheHash(key, &cacheOptions.mode, sizeof(cacheOptions.mode));
+    key = cacheHash(key, &cacheOptions.filter, sizeof(cacheOptions.filter));
+    key = cacheHash(key, &cacheOptions.background, sizeof(cacheOptions.background));
+    // The memory budget decides how far JPEGs are reduced while decoding, which changes the pixels.
+    key = cacheHash(key, &cacheOptions.memory, sizeof(cacheOptions.memory));
+    key = cacheHash(key, &version, sizeof(version));
+
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx-%016llx.bmp", (unsigned long long)pathHash, (unsigned long long)key);
+    if (snprintf(cachedPath, cachedPathSize, "%s/%s", CACHE_DIRECTORY, name) >= (int)cachedPathSize) {
+        return 1;
+    }
+
+    // A hit marks the entry as recently used for the eviction, at most once per CACHE_TOUCH_INTERVAL.
+    struct stat cached;
+    if (stat(cachedPath, &cached) == 0) {
+        if (time(NULL) - cached.st_mtime > CACHE_TOUCH_INTERVAL) {
+            utime(cachedPath, NULL);
+        }
+        return 0;
+    }
+
+#ifdef _WIN32
+    CreateDirectoryA(CACHE_DIRECTORY, NULL);
+#else
+    mkdir(CACHE_DIRECTORY, 0755);
+#endif
+
+    // The source is scaled while it is decoded, large images never exist in full.
+    ImageReader reader;
+    Image target;
+    if (imageReaderOpen(&reader, absolutePath) != 0) {
+        return 1;
+    }
+    if (imageCreate(&target, width, height) != 0) {
+        imageReaderClose(&reader);
+        return 1;
+    }
+    int scaled = scaleReader(&reader, &target, &cacheOptions);
+    imageReaderClose(&reader);
+    if (scaled != 0) {
+        error("Failure scaling wallpaper: %s", imagePath);
+        imageFree(&target);
+        return 1;
+    }
+
+    char tempPath[MAX_CACHE_PATH];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", cachedPath);
+    int failed = imageWriteBmp(tempPath, &target) != 0;
+    imageFree(&target);
+#ifdef _WIN32
+    failed = failed || !MoveFileExA(tempPath, cachedPath, MOVEFILE_REPLACE_EXISTING);
+#else
+    failed = failed || rename(tempPath, cachedPath) != 0;
+#endif
+    if (failed) {
+        error("Failure writing wallpaper cache: %s", cachedPath);
+        remove(tempPath);
+        return 1;
+    }
+
+    debug("Cached %s as %s", imagePath, cachedPath);
+    cachePrune(pathHash, name);
+    cacheEvict(name);
+    return 0;
+}
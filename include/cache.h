@@ -0,0 +1,16 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+
+#include "scale.h"
+
+#define CACHE_DIRECTORY "./cache"
+#define MAX_CACHE_PATH 512
+#define CACHE_DEFAULT_LIMIT ((long long)512 << 20) // Default size limit of all entries in bytes.
+
+void wallpaperCacheSetOptions(const ScaleOptions *options);
+const ScaleOptions *wallpaperCacheOptions();
+void wallpaperCacheSetLimit(long long limit);
+int wallpaperCacheResolve(const char *imagePath, int width, int height, char *cachedPath, size_t cachedPathSize);
+#endif // CACHE_H
@@ -0,0 +1,53 @@
+/**
+ * @file command.c
+ * @brief Lock-free single-producer/single-consumer queue of commands.
+ *
+ * The UI thread pushes commands from the tray menu and the worker thread pops them. Each side only
+ * writes its own index, so a push or pop is a few loads and one release store. The queue does not
+ * wake the consumer, the producer does that with the wait primitive the consumer blocks on.
+ */
+
+#include <stddef.h>
+
+#include "command.h"
+
+/**
+ * @brief Appends a command, called only from the producer thread.
+ *
+ * @param queue The queue.
+ * @param type One of the COMMAND_* types.
+ * @param value Argument of the command.
+ * @return Returns 0 on success, or 1 if the queue is full.
+ */
+int commandPush(CommandQueue *queue, int type, int value);
+
+/**
+ * @brief Removes the oldest command, called only from the consumer thread.
+ *
+ * @param queue The queue.
+ * @param command Receives the command.
+ * @return Returns 0 on success, or 1 if the queue is empty.
+ */
+int commandPop(CommandQueue *queue, Command *command);
+
+int commandPush(CommandQueue *queue, int type, int value) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&queue->tail, memory_order_acquire) >= COMMAND_QUEUE_SIZE) {
+        return 1;
+    }
+    Command *slot = &queue->slots[head & (COMMAND_QUEUE_SIZE - 1)];
+    slot->type = type;
+    slot->value = value;
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return 0;
+}
+
+int commandPop(CommandQueue *queue, Command *command) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&queue->head, memory_order_acquire)) {
+        return 1;
+    }
+    *command = queue->slots[tail & (COMMAND_QUEUE_SIZE - 1)];
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+
+#define COMMAND_QUEUE_SIZE 64 // Number of slots, must be a power of two.
+
+// Command types
+#define COMMAND_SET_DAY_HOUR 1 // Set FROM to value.
+#define COMMAND_SET_NIGHT_HOUR 2 // Set TO to value.
+#define COMMAND_FORCE_SWITCH 3 // Switch to the other background until the next transition.
+#define COMMAND_QUIT 4 // End the worker thread.
+
+typedef struct Command {
+    int type; // One of the COMMAND_* types.
+    int value; // Argument of the command.
+} Command;
+
+// Single-producer/single-consumer queue, the indices live on separate cache lines
+typedef struct CommandQueue {
+    alignas(64) atomic_size_t head; // Next slot the producer writes.
+    alignas(64) atomic_size_t tail; // Next slot the consumer reads.
+    Command slots[COMMAND_QUEUE_SIZE]; // Queued commands.
+} CommandQueue;
+
+int commandPush(CommandQueue *queue, int type, int value);
+int commandPop(CommandQueue *queue, Command *command);
+#endif // COMMAND_H
@@ -0,0 +1,250 @@
+/**
+ * @file config.c
+ * @brief The current settings as an immutable snapshot, read without locks.
+ *
+ * configPublish() copies the settings into a new snapshot and swaps the current pointer, so a reader
+ * sees either the old or the new snapshot and never a half-written path. Replaced snapshots are freed
+ * with epoch-based reclamation: a reader announces the epoch it started in, and a snapshot retired in
+ * epoch E is freed once no reader is still inside epoch E or earlier. Readers only do two stores and
+ * never wait, a publish never waits for readers either, it leaves busy snapshots for a later publish.
+ *
+ * Every thread gets a reader record on its first configAcquire(), which is never released, the
+ * application only has a handful of threads. A thread whose record cannot be allocated shares a
+ * fallback record that pins the first epoch, so no snapshot is freed anymore and reading never fails.
+ * Only one thread at a time may publish.
+ *
+ * configRead() parses and validates the settings of a loaded config.ini for every front end, so the
+ * tray application and the Linux daemon accept the same keys within the same limits.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "log.h"
+#include "cache.h"
+#include "config.h"
+
+// Snapshot with its reclamation data, the Config comes first so both pointers are the same
+typedef struct ConfigNode {
+    Config config; // The settings.
+    uint64_t retiredEpoch; // Epoch in which the snapshot was replaced.
+    struct ConfigNode *next; // Next snapshot waiting to be freed.
+} ConfigNode;
+
+// Epoch announced by one thread
+typedef struct ConfigReader {
+    atomic_uint_fast64_t epoch; // Epoch of the running read section, 0 outside of one.
+    struct ConfigReader *next; // Next record in configReaders.
+} ConfigReader;
+
+static _Atomic(ConfigNode *) configCurrent = NULL; // The current snapshot.
+static atomic_uint_fast64_t configEpoch = 1; // Global epoch, advanced by every publish.
+static ConfigReader configFallback = {0, NULL}; // Record of threads whose own record cannot be allocated.
+static _Atomic(ConfigReader *) configReaders = &configFallback; // Reader records of all threads, newest first.
+static ConfigNode *configRetired = NULL; // Replaced snapshots not yet freed, only used by the publisher.
+static _Thread_local ConfigReader *localReader = NULL; // Reader record of the calling thread.
+static _Thread_local int localDepth = 0; // Nesting depth of configAcquire() in the calling thread.
+
+/**
+ * @brief Reads and validates the settings of a config.
+ *
+ * [Path] and [Time] are required, [Scale], [Transition] and [Playlist] fall back to their defaults.
+ *
+ * @param document The parsed config.
+ * @param config Receives the settings, only complete if the function succeeds.
+ * @return Returns 0 on success, or 1 if a value is missing or invalid.
+ */
+int configRead(const IniDocument *document, Config *config);
+
+/**
+ * @brief Starts a read section and returns the current snapshot.
+ *
+ * The snapshot stays valid until the matching configRelease(). Sections may be nested.
+ *
+ * @return The current snapshot, or NULL if none was published yet.
+ */
+const Config *configAcquire();
+
+/**
+ * @brief Ends the read section started by configAcquire().
+ */
+void configRelease();
+
+/**
+ * @brief Publishes a copy of the settings as the current snapshot and retires the previous one.
+ *
+ * @param config The settings, copied.
+ * @return Returns 0 on success, or 1 if the snapshot cannot be allocated.
+ */
+int configPublish(const Config *config);
+
+/**
+ * @brief Frees the current and all retired snapshots. No thread may read the config anymore.
+ */
+void configCleanup();
+
+/**
+ * @brief Frees the retired snapshots that no reader can still see.
+ */
+static void configReclaim();
+
+int configRead(const IniDocument *document, Config *config) {
+    if (iniGetString(document, "Path", "NIGHT", config->nightPath, sizeof(config->nightPath)) != 0
+        || iniGetString(document, "Path", "DAY", config->dayPath, sizeof(config->dayPath)) != 0) {
+        error("Failure reading path");
+        return 1;
+    }
+    // AUTO is optional, folders then pick the images whose brightness and colours suit the period.
+    config->assignPeriods = 0;
+    iniGetInt(document, "Path", "AUTO", &config->assignPeriods);
+
+    if (iniGetInt(document, "Time", "FROM", &config->fromTime) != 0
+        || iniGetInt(document, "Time", "TO", &config->toTime) != 0
+        || config->fromTime < 0 || config->toTime >= 24 || config->fromTime >= config->toTime) {
+        error("Failure reading time");
+        return 1;
+    }
+
+    // Scaling is optional, the background is a hex colour RRGGBB.
+    char value[CONFIG_VALUE_LENGTH];
+    int scaleValid = 1;
+    int memory = (int)(SCALE_DEFAULT_MEMORY >> 20);
+    config->scale = (ScaleOptions){SCALE_FILL, SCALE_LANCZOS3, 0x000000, 0, SCALE_DEFAULT_MEMORY};
+    if (iniGetString(document, "Scale", "MODE", value, sizeof(value)) == 0) {
+        scaleValid &= scaleParseMode(value, &config->scale.mode) == 0;
+    }
+    if (iniGetString(document, "Scale", "FILTER", value, sizeof(value)) == 0) {
+        scaleValid &= scaleParseFilter(value, &config->scale.filter) == 0;
+    }
+    if (iniGetString(document, "Scale", "BACKGROUND", value, sizeof(value)) == 0) {
+        char *end;
+        config->scale.background = strtoul(value[0] == '#' ? value + 1 : value, &end, 16);
+        scaleValid &= *end == '\0' && config->scale.background <= 0xffffff;
+    }
+    // MEMORY is in MB, 0 removes the limit.
+    iniGetInt(document, "Scale", "MEMORY", &memory);
+    scaleValid &= memory >= 0 && memory <= CONFIG_MAX_SCALE_MEMORY;
+    config->scale.memory = (size_t)memory << 20;
+    // CACHE is in MB as well, 0 keeps every scaled image.
+    config->cacheSize = (int)(CACHE_DEFAULT_LIMIT >> 20);
+    iniGetInt(document, "Scale", "CACHE", &config->cacheSize);
+    scaleValid &= config->cacheSize >= 0 && config->cacheSize <= CONFIG_MAX_CACHE_SIZE;
+    if (!scaleValid) {
+        error("Failure reading scale");
+        return 1;
+    }
+
+    // The transition is optional, but its window must fit between FROM and TO.
+    int frames = 0, window = 0;
+    iniGetInt(document, "Transition", "FRAMES", &frames);
+    iniGetInt(document, "Transition", "WINDOW", &window);
+    int day = config->toTime - config->fromTime, night = 24 - day;
+    int shortestPeriod = day < night ? day : night;
+    if (frames < 0 || frames > CONFIG_MAX_TRANSITION_FRAMES || window < 0 || window > shortestPeriod * 60) {
+        error("Failure reading transition");
+        return 1;
+    }
+    config->transitionFrames = frames;
+    config->transitionWindow = window * 60;
+
+    // The playlist is optional, INTERVAL is in minutes and LEAD in seconds.
+    int interval = 0;
+    int playlistValid = 1;
+    config->playlist = (PlaylistOptions){PLAYLIST_SEQUENTIAL, 0, PLAYLIST_DEFAULT_LEAD};
+    if (iniGetString(document, "Playlist", "ORDER", value, sizeof(value)) == 0) {
+        playlistValid &= playlistParseOrder(value, &config->playlist.order) == 0;
+    }
+    iniGetInt(document, "Playlist", "INTERVAL", &interval);
+    iniGetInt(document, "Playlist", "LEAD", &config->playlist.lead);
+    playlistValid &= interval >= 0 && interval <= 24 * 60
+                     && config->playlist.lead >= 0 && config->playlist.lead <= CONFIG_MAX_PLAYLIST_LEAD;
+    if (!playlistValid) {
+        error("Failure reading playlist");
+        return 1;
+    }
+    config->playlist.interval = interval * 60;
+    // A lead as long as the interval would prepare the image after the next one.
+    if (config->playlist.interval > 0 && config->playlist.lead >= config->playlist.interval) {
+        config->playlist.lead = config->playlist.interval / 2;
+    }
+    return 0;
+}
+
+const Config *configAcquire() {
+    if (localReader == NULL) {
+        ConfigReader *reader = calloc(1, sizeof(ConfigReader));
+        if (reader == NULL) {
+            // Epoch 1 stays announced for good, every snapshot is retired in it or later and kept.
+            error("Failure allocating config reader, config snapshots are no longer freed");
+            atomic_store(&configFallback.epoch, 1);
+            localReader = &configFallback;
+            return (const Config *)atomic_load(&configCurrent);
+        }
+        reader->next = atomic_load(&configReaders);
+        while (!atomic_compare_exchange_weak(&configReaders, &reader->next, reader)) {
+        }
+        localReader = reader;
+    }
+    // The epoch is announced before the pointer is loaded, so a publish after the load sees it.
+    if (localReader != &configFallback && localDepth++ == 0) {
+        atomic_store(&localReader->epoch, atomic_load(&configEpoch));
+    }
+    return (const Config *)atomic_load(&configCurrent);
+}
+
+void configRelease() {
+    if (localReader != NULL && localReader != &configFallback && --localDepth == 0) {
+        atomic_store_explicit(&localReader->epoch, 0, memory_order_release);
+    }
+}
+
+int configPublish(const Config *config) {
+    ConfigNode *node = malloc(sizeof(ConfigNode));
+    if (node == NULL) {
+        error("Failure allocating config snapshot");
+        return 1;
+    }
+    node->config = *config;
+    node->next = NULL;
+
+    ConfigNode *previous = atomic_exchange(&configCurrent, node);
+    if (previous != NULL) {
+        // Readers announcing a later epoch load the pointer after the exchange and get the new snapshot.
+        previous->retiredEpoch = atomic_fetch_add(&configEpoch, 1);
+        previous->next = configRetired;
+        configRetired = previous;
+    }
+    configReclaim();
+    return 0;
+}
+
+static void configReclaim() {
+    uint64_t oldest = UINT64_MAX;
+    for (ConfigReader *reader = atomic_load(&configReaders); reader != NULL; reader = reader->next) {
+        uint64_t epoch = atomic_load(&reader->epoch);
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+
+    ConfigNode **link = &configRetired;
+    while (*link != NULL) {
+        ConfigNode *node = *link;
+        if (node->retiredEpoch < oldest) {
+            *link = node->next;
+            free(node);
+        } else {
+            link = &node->next;
+        }
+    }
+}
+
+void configCleanup() {
+    free(atomic_exchange(&configCurrent, NULL));
+    while (configRetired != NULL) {
+        ConfigNode *node = configRetired;
+        configRetired = node->next;
+        free(node);
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "ini.h"
+#include "scale.h"
+#include "playlist.h"
+
+#define CONFIG_VALUE_LENGTH 128 // Maximum length of a path in the config.
+#define CONFIG_MAX_TRANSITION_FRAMES 120 // Maximum number of blended frames per transition.
+#define CONFIG_MAX_SCALE_MEMORY 4096 // Maximum working memory budget of scaling in MB.
+#define CONFIG_MAX_CACHE_SIZE 65536 // Maximum size limit of the wallpaper cache in MB.
+#define CONFIG_MAX_PLAYLIST_LEAD 3600 // Maximum time in seconds an image is prepared before it is shown.
+
+// Immutable snapshot of the settings, replaced as a whole on reload
+typedef struct Config {
+    char nightPath[CONFIG_VALUE_LENGTH]; // Path to the night background image.
+    char dayPath[CONFIG_VALUE_LENGTH]; // Path to the day background image.
+    int assignPeriods; // Whether folders pick the images classified for the period instead of any image.
+    int fromTime; // Hour the day background starts.
+    int toTime; // Hour the night background starts.
+    int transitionFrames; // Number of blended frames per transition, 0 disables the crossfade.
+    int transitionWindow; // Length of the crossfade window around FROM and TO in seconds.
+    ScaleOptions scale; // How the images are scaled to the screen.
+    int cacheSize; // Size limit of the scaled images in the cache in MB, 0 for no limit.
+    PlaylistOptions playlist; // How the images of folders rotate and how early they are prepared.
+} Config;
+
+int configRead(const IniDocument *document, Config *config);
+const Config *configAcquire();
+void configRelease();
+int configPublish(const Config *config);
+void configCleanup();
+#endif // CONFIG_H
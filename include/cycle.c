@@ -0,0 +1,160 @@
+/**
+ * @file cycle.c
+ * @brief The day/night state machine, independent of the platform.
+ *
+ * The cycle reads the time from a Clock and acts only through a CycleBackend, so the same decisions drive
+ * the tray application and the headless simulation. Each step computes the background state and the
+ * crossfade frame at the current time, applies what changed and returns the time of the next step.
+ */
+
+#include <stdio.h>
+
+#include "log.h"
+#include "state.h"
+#include "metrics.h"
+#include "trace.h"
+#include "cycle.h"
+
+/**
+ * @brief Computes the current state and shows its wallpaper and tray icon.
+ *
+ * Used once at startup, afterwards only changes are applied by cycleStep().
+ *
+ * @param cycle The cycle, clock and backend have to be set.
+ * @param settings The current settings.
+ * @return Returns 0 on success, or 1 if the settings are invalid.
+ */
+int cycleStart(Cycle *cycle, const CycleSettings *settings);
+
+/**
+ * @brief Applies the state and crossfade frame due at the current time.
+ *
+ * @param cycle The cycle.
+ * @param settings The current settings, may change between steps.
+ * @param next Receives the time of the next transition or crossfade frame.
+ * @return Returns 0 on success, or 1 if the settings are invalid.
+ */
+int cycleStep(Cycle *cycle, const CycleSettings *settings, time_t *next);
+
+/**
+ * @brief Switches to the other background until the next scheduled transition.
+ *
+ * Switching again while a switch is active returns to the scheduled state.
+ *
+ * @param cycle The cycle.
+ * @param settings The current settings.
+ * @return Returns 0 on success, or 1 if the settings are invalid.
+ */
+int cycleSwitch(Cycle *cycle, const CycleSettings *settings);
+
+/**
+ * @brief Shows the wallpaper of the current state again, for when its image changed between steps.
+ *
+ * Nothing is applied during a crossfade, its next frame already uses the new image.
+ *
+ * @param cycle The cycle.
+ * @param settings The current settings.
+ * @return Returns 0 on success, or 1 if the wallpaper cannot be applied.
+ */
+int cycleRefresh(Cycle *cycle, const CycleSettings *settings);
+
+/**
+ * @brief Returns the image of a background state.
+ */
+static const char *cycleImage(const CycleSettings *settings, int state);
+
+static const char *cycleImage(const CycleSettings *settings, int state) {
+    return state == NIGHT ? settings->nightPath : settings->dayPath;
+}
+
+int cycleStart(Cycle *cycle, const CycleSettings *settings) {
+    TRACE_SCOPE("cycleStart");
+    time_t now = clockNow(cycle->clock);
+    if (backgroundStateAt(settings->fromTime, settings->toTime, now, &cycle->backgroundState) != 0) {
+        return 1;
+    }
+    stateSetBackground(cycle->backgroundState, now);
+    cycle->backend->applyWallpaper(cycle->backend->context, cycleImage(settings, cycle->backgroundState));
+    cycle->backend->animateTray(cycle->backend->context, cycle->backgroundState);
+    return 0;
+}
+
+int cycleStep(Cycle *cycle, const CycleSettings *settings, time_t *next) {
+    TRACE_SCOPE("cycleStep");
+    const CycleBackend *backend = cycle->backend;
+    time_t now = clockNow(cycle->clock);
+    TransitionStep *step = &cycle->transitionStep;
+    int wasTransitioning = step->active;
+    int previousFrame = step->frame;
+    int previousState = cycle->backgroundState;
+
+    if (transitionPlan(settings->fromTime, settings->toTime, settings->transitionFrames,
+                       settings->transitionWindow, now, step) != 0) {
+        error("Failure computing transition frame");
+    }
+    if (backgroundStateAt(settings->fromTime, settings->toTime, now, &cycle->backgroundState) != 0) {
+        return 1;
+    }
+    // A manual switch inverts the state and suppresses the crossfade until the next transition.
+    if (now < cycle->switchedUntil) {
+        cycle->backgroundState = cycle->backgroundState == DAY ? NIGHT : DAY;
+        step->active = 0;
+    } else {
+        cycle->switchedUntil = 0;
+    }
+    debug("backgroundState: %d", cycle->backgroundState);
+
+    // During a crossfade the frames replace the hard switch.
+    if (cycle->backgroundState != previousState) {
+        metricsCount(METRIC_CYCLE_TRANSITIONS);
+        stateSetBackground(cycle->backgroundState, now);
+        if (!step->active) {
+            backend->applyWallpaper(backend->context, cycleImage(settings, cycle->backgroundState));
+        }
+        backend->animateTray(backend->context, cycle->backgroundState);
+    }
+    if (step->active && step->frame > 0 && (!wasTransitioning || step->frame != previousFrame)) {
+        metricsCount(METRIC_CYCLE_FRAMES);
+        backend->applyFrame(backend->context, cycleImage(settings, step->toNight ? DAY : NIGHT),
+                            cycleImage(settings, step->toNight ? NIGHT : DAY), step);
+    } else if (wasTransitioning && !step->active) {
+        // The window ended, replace the last frame with the target image.
+        backend->applyWallpaper(backend->context, cycleImage(settings, cycle->backgroundState));
+    }
+
+    if (nextTransitionTime(settings->fromTime, settings->toTime, now, next) != 0) {
+        error("Failure computing next transition");
+        return 1;
+    }
+    if (step->next != 0 && step->next < *next) {
+        *next = step->next;
+    }
+    debug("Next transition: %lld", (long long)*next);
+    return 0;
+}
+
+int cycleSwitch(Cycle *cycle, const CycleSettings *settings) {
+    TRACE_SCOPE("cycleSwitch");
+    const CycleBackend *backend = cycle->backend;
+    time_t now = clockNow(cycle->clock);
+    if (now < cycle->switchedUntil) {
+        cycle->switchedUntil = 0;
+    } else if (nextTransitionTime(settings->fromTime, settings->toTime, now, &cycle->switchedUntil) != 0) {
+        return 1;
+    }
+
+    cycle->backgroundState = cycle->backgroundState == DAY ? NIGHT : DAY;
+    info("Switched to %s until %lld", cycle->backgroundState == DAY ? "day" : "night", (long long)cycle->switchedUntil);
+    metricsCount(METRIC_CYCLE_TRANSITIONS);
+    stateSetBackground(cycle->backgroundState, now);
+    backend->applyWallpaper(backend->context, cycleImage(settings, cycle->backgroundState));
+    backend->animateTray(backend->context, cycle->backgroundState);
+    return 0;
+}
+
+int cycleRefresh(Cycle *cycle, const CycleSettings *settings) {
+    if (cycle->transitionStep.active) {
+        return 0;
+    }
+    return cycle->backend->applyWallpaper(cycle->backend->context, cycleImage(settings, cycle->backgroundState));
+}
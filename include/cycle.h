@@ -0,0 +1,38 @@
+#ifndef CYCLE_H
+#define CYCLE_H
+
+#include <time.h>
+#include "schedule.h"
+
+// Settings of the day/night cycle
+typedef struct CycleSettings {
+    const char *nightPath; // Path to the night background image.
+    const char *dayPath; // Path to the day background image.
+    int fromTime; // Hour at which the day background starts.
+    int toTime; // Hour at which the night background starts.
+    int transitionFrames; // Number of blended frames per transition, 0 disables the crossfade.
+    int transitionWindow; // Length of the crossfade window in seconds.
+} CycleSettings;
+
+// Outputs of the cycle, all calls are made from the thread running the cycle
+typedef struct CycleBackend {
+    int (*applyWallpaper)(void *context, const char *imagePath); // Shows an image as wallpaper.
+    int (*applyFrame)(void *context, const char *sourcePath, const char *targetPath, const TransitionStep *step); // Shows a crossfade frame.
+    void (*animateTray)(void *context, int targetState); // Starts the tray icon animation towards DAY or NIGHT.
+    void *context; // Passed to every call.
+} CycleBackend;
+
+// State of the day/night cycle
+typedef struct Cycle {
+    const Clock *clock; // Source of the current time.
+    const CycleBackend *backend; // Wallpaper and tray outputs.
+    int backgroundState; // Current background state (DAY or NIGHT).
+    TransitionStep transitionStep; // Crossfade frame computed by the last cycleStep().
+    time_t switchedUntil; // End of a switch made by cycleSwitch(), 0 if the schedule applies.
+} Cycle;
+
+int cycleStart(Cycle *cycle, const CycleSettings *settings);
+int cycleStep(Cycle *cycle, const CycleSettings *settings, time_t *next);
+int cycleSwitch(Cycle *cycle, const CycleSettings *settings);
+int cycleRefresh(Cycle *cycle, const CycleSettings *settings);
+#endif // CYCLE_H
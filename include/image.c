@@ -0,0 +1,814 @@
+/**
+ * @file image.c
+ * @brief Decoding and BMP encoding of wallpaper images.
+ *
+ * Images are decoded into 32-bit BGRA. The decoder is chosen by the file content, not the extension:
+ * on Windows WIC handles JPEG, PNG and AVIF (with the AV1 extension installed); elsewhere libjpeg,
+ * libpng and, when built with HAVE_LIBAVIF, libavif are used. BMP is read natively everywhere.
+ *
+ * An ImageReader hands out the rows in bands, so a large image can be scaled without holding all of
+ * its pixels. JPEG can also be reduced by 1/2, 1/4 or 1/8 while decoding, which skips most of the
+ * inverse DCT. Interlaced PNG, progressive JPEG and AVIF still keep the whole coded image in the
+ * decoder, which ImageReader.retained reports.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef _WIN32
+#define COBJMACROS
+#include <windows.h>
+#include <wincodec.h>
+#else
+#include <setjmp.h>
+#include <jpeglib.h>
+#include <png.h>
+#ifdef HAVE_LIBAVIF
+#include <avif/avif.h>
+#endif
+#endif
+
+#include "log.h"
+#include "image.h"
+
+// Image formats detected by imageSniff
+#define IMAGE_UNKNOWN 0
+#define IMAGE_BMP 1
+#define IMAGE_JPEG 2
+#define IMAGE_PNG 3
+#define IMAGE_AVIF 4
+
+#define IMAGE_MAX_SIZE 65535 // Largest width or height accepted.
+
+// Format specific part of an ImageReader, each decoder embeds it as its first field
+typedef struct ImageDecoder {
+    int (*reduce)(ImageReader *reader, int denominator); // Returns the denominator applied, NULL if unsupported.
+    int (*read)(ImageReader *reader, unsigned char *pixels, int stride, int rows); // Reads the next rows as BGRA.
+    void (*close)(ImageReader *reader); // Releases the decoder.
+} ImageDecoder;
+
+/**
+ * @brief Allocates the pixels of an image.
+ *
+ * @param image The image to initialize.
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @return Returns 0 on success, or 1 if the size is invalid or the allocation fails.
+ */
+int imageCreate(Image *image, int width, int height);
+
+/**
+ * @brief Releases the pixels of an image.
+ *
+ * @param image The image, its fields are reset.
+ */
+void imageFree(Image *image);
+
+/**
+ * @brief Decodes an image file into 32-bit BGRA.
+ *
+ * @param imagePath Path to the image file.
+ * @param image Receives the decoded image, to be released with imageFree().
+ * @return Returns 0 on success, or 1 if the file cannot be read or decoded.
+ */
+int imageLoad(const char *imagePath, Image *image);
+
+/**
+ * @brief Opens an image file for reading its rows in bands.
+ *
+ * @param reader Receives the size and decoder, to be released with imageReaderClose().
+ * @param imagePath Path to the image file.
+ * @return Returns 0 on success, or 1 if the format is unknown or the header cannot be read.
+ */
+int imageReaderOpen(ImageReader *reader, const char *imagePath);
+
+/**
+ * @brief Asks the decoder to downscale by a power of two while decoding. Only valid before the first row is read.
+ *
+ * The new size is in reader->width and reader->height, rounded up.
+ *
+ * @param reader The reader.
+ * @param denominator 1, 2, 4 or 8.
+ * @return Returns the denominator applied, 1 if the format cannot be reduced.
+ */
+int imageReaderReduce(ImageReader *reader, int denominator);
+
+/**
+ * @brief Reads the next rows of an image.
+ *
+ * @param reader The reader.
+ * @param pixels Receives the rows as BGRA.
+ * @param stride Distance between the rows in bytes.
+ * @param rows Number of rows, clamped to the rows left.
+ * @return Returns 0 on success, or 1 if the data is corrupt.
+ */
+int imageReaderRead(ImageReader *reader, unsigned char *pixels, int stride, int rows);
+
+/**
+ * @brief Releases a reader, it may be closed before all rows are read.
+ */
+void imageReaderClose(ImageReader *reader);
+
+/**
+ * @brief Writes an image as an uncompressed 24-bit BMP.
+ *
+ * @param imagePath Path of the file to write.
+ * @param image The image to write.
+ * @return Returns 0 on success, or 1 if the file cannot be written.
+ */
+int imageWriteBmp(const char *imagePath, const Image *image);
+
+/**
+ * @brief Detects the format of an image file from its first bytes.
+ *
+ * @return One of the IMAGE_* format constants.
+ */
+static int imageSniff(const char *imagePath);
+
+/**
+ * @brief Opens an uncompressed 24 or 32-bit BMP.
+ */
+static int imageOpenBmp(ImageReader *reader, const char *imagePath);
+
+int imageCreate(Image *image, int width, int height) {
+    memset(image, 0, sizeof(Image));
+    if (width <= 0 || height <= 0 || width > IMAGE_MAX_SIZE || height > IMAGE_MAX_SIZE) {
+        return 1;
+    }
+    image->pixels = malloc((size_t)width * height * 4);
+    if (image->pixels == NULL) {
+        error("Failure allocating %dx%d image", width, height);
+        return 1;
+    }
+    image->width = width;
+    image->height = height;
+    image->stride = width * 4;
+    return 0;
+}
+
+void imageFree(Image *image) {
+    free(image->pixels);
+    memset(image, 0, sizeof(Image));
+}
+
+static int imageSniff(const char *imagePath) {
+    unsigned char header[12];
+    FILE *file = fopen(imagePath, "rb");
+    if (file == NULL) {
+        return IMAGE_UNKNOWN;
+    }
+    size_t length = fread(header, 1, sizeof(header), file);
+    fclose(file);
+
+    if (length >= 2 && header[0] == 'B' && header[1] == 'M') {
+        return IMAGE_BMP;
+    } else if (length >= 3 && header[0] == 0xFF && header[1] == 0xD8 && header[2] == 0xFF) {
+        return IMAGE_JPEG;
+    } else if (length >= 8 && memcmp(header, "\x89PNG\r\n\x1a\n", 8) == 0) {
+        return IMAGE_PNG;
+    } else if (length >= 12 && memcmp(header + 4, "ftyp", 4) == 0
+               && (memcmp(header + 8, "avif", 4) == 0 || memcmp(header + 8, "avis", 4) == 0)) {
+        return IMAGE_AVIF;
+    }
+    return IMAGE_UNKNOWN;
+}
+
+typedef struct ImageBmpDecoder {
+    ImageDecoder base;
+    FILE *file;
+    uint32_t offset; // Position of the pixel data.
+    int bytesPerPixel; // 3 or 4.
+    int topDown; // Rows are stored from the top.
+    size_t rowSize; // Stored row size, padded to 4 bytes.
+    unsigned char *row; // One stored row.
+} ImageBmpDecoder;
+
+static int imageReadBmp(ImageReader *reader, unsigned char *pixels, int stride, int rows) {
+    ImageBmpDecoder *bmp = (ImageBmpDecoder *)reader->decoder;
+    for (int i = 0; i < rows; i++) {
+        int y = reader->row + i;
+        long position = (long)(bmp->offset + (bmp->topDown ? y : reader->height - 1 - y) * bmp->rowSize);
+        // Bottom-up files are read backwards, top-down files only seek once.
+        if ((!bmp->topDown || y == 0) && fseek(bmp->file, position, SEEK_SET) != 0) {
+            return 1;
+        }
+        if (fread(bmp->row, 1, bmp->rowSize, bmp->file) != bmp->rowSize) {
+            return 1;
+        }
+        unsigned char *out = pixels + (size_t)i * stride;
+        for (int x = 0; x < reader->width; x++) {
+            out[x * 4 + 0] = bmp->row[x * bmp->bytesPerPixel + 0];
+            out[x * 4 + 1] = bmp->row[x * bmp->bytesPerPixel + 1];
+            out[x * 4 + 2] = bmp->row[x * bmp->bytesPerPixel + 2];
+            out[x * 4 + 3] = 255;
+        }
+    }
+    return 0;
+}
+
+static void imageCloseBmp(ImageReader *reader) {
+    ImageBmpDecoder *bmp = (ImageBmpDecoder *)reader->decoder;
+    fclose(bmp->file);
+    free(bmp->row);
+    free(bmp);
+}
+
+static int imageOpenBmp(ImageReader *reader, const char *imagePath) {
+    FILE *file = fopen(imagePath, "rb");
+    if (file == NULL) {
+        return 1;
+    }
+
+    unsigned char header[54];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)) {
+        fclose(file);
+        return 1;
+    }
+    uint32_t offset, compression;
+    int32_t width, height;
+    uint16_t bits;
+    memcpy(&offset, header + 10, 4);
+    memcpy(&width, header + 18, 4);
+    memcpy(&height, header + 22, 4);
+    memcpy(&bits, header + 28, 2);
+    memcpy(&compression, header + 30, 4);
+
+    int topDown = height < 0;
+    height = topDown ? -height : height;
+    ImageBmpDecoder *bmp = NULL;
+    if ((bits != 24 && bits != 32) || (compression != 0 && compression != 3)
+        || width <= 0 || width > IMAGE_MAX_SIZE || height <= 0 || height > IMAGE_MAX_SIZE
+        || (bmp = calloc(1, sizeof(ImageBmpDecoder))) == NULL) {
+        error("Unsupported BMP: %s", imagePath);
+        fclose(file);
+        return 1;
+    }
+
+    bmp->base = (ImageDecoder){NULL, imageReadBmp, imageCloseBmp};
+    bmp->file = file;
+    bmp->offset = offset;
+    bmp->bytesPerPixel = bits / 8;
+    bmp->topDown = topDown;
+    bmp->rowSize = ((size_t)width * bmp->bytesPerPixel + 3) & ~(size_t)3;
+    if ((bmp->row = malloc(bmp->rowSize)) == NULL) {
+        fclose(file);
+        free(bmp);
+        return 1;
+    }
+    reader->width = reader->sourceWidth = width;
+    reader->height = reader->sourceHeight = height;
+    reader->decoder = &bmp->base;
+    return 0;
+}
+
+#ifdef _WIN32
+
+typedef struct ImageWicDecoder {
+    ImageDecoder base;
+    HRESULT initialized; // Result of CoInitializeEx(), balanced on close.
+    IWICImagingFactory *factory;
+    IWICBitmapDecoder *decoder;
+    IWICBitmapFrameDecode *frame;
+    IWICBitmapSource *converted; // The frame converted to 32bppBGRA.
+    IWICBitmapSourceTransform *transform; // Scaled decoding after imageReaderReduce(), otherwise NULL.
+    WICPixelFormatGUID format; // Format transform delivers, 32bppBGRA or 24bppBGR.
+    unsigned char *band; // Rows in 24bppBGR from transform.
+    size_t bandSize; // Size of band in bytes.
+} ImageWicDecoder;
+
+static int imageReduceWic(ImageReader *reader, int denominator) {
+    ImageWicDecoder *wic = (ImageWicDecoder *)reader->decoder;
+    IWICBitmapSourceTransform *transform = NULL;
+    UINT width = (reader->sourceWidth + denominator - 1) / denominator;
+    UINT height = (reader->sourceHeight + denominator - 1) / denominator;
+    WICPixelFormatGUID format = GUID_WICPixelFormat32bppBGRA;
+
+    // Decoders without native scaling (PNG, AVIF) do not implement the interface.
+    if (FAILED(IWICBitmapFrameDecode_QueryInterface(wic->frame, &IID_IWICBitmapSourceTransform, (void **)&transform))) {
+        return 1;
+    }
+    UINT closestWidth = width, closestHeight = height;
+    if (FAILED(IWICBitmapSourceTransform_GetClosestSize(transform, &closestWidth, &closestHeight))
+        || closestWidth < width || closestHeight < height || closestWidth >= (UINT)reader->sourceWidth
+        || FAILED(IWICBitmapSourceTransform_GetClosestPixelFormat(transform, &format))
+        || (!IsEqualGUID(&format, &GUID_WICPixelFormat32bppBGRA) && !IsEqualGUID(&format, &GUID_WICPixelFormat24bppBGR))) {
+        IWICBitmapSourceTransform_Release(transform);
+        return 1;
+    }
+
+    wic->transform = transform;
+    wic->format = format;
+    reader->width = closestWidth;
+    reader->height = closestHeight;
+    return reader->sourceWidth / closestWidth;
+}
+
+static int imageReadWic(ImageReader *reader, unsigned char *pixels, int stride, int rows) {
+    ImageWicDecoder *wic = (ImageWicDecoder *)reader->decoder;
+    WICRect band = {0, reader->row, reader->width, rows};
+    UINT size = (UINT)stride * (rows - 1) + (UINT)reader->width * 4;
+    if (wic->transform == NULL) {
+        return FAILED(IWICBitmapSource_CopyPixels(wic->converted, &band, stride, size, pixels));
+    }
+    if (IsEqualGUID(&wic->format, &GUID_WICPixelFormat32bppBGRA)) {
+        return FAILED(IWICBitmapSourceTransform_CopyPixels(wic->transform, &band, reader->width, reader->height, &wic->format,
+                                                           WICBitmapTransformRotate0, stride, size, pixels));
+    }
+
+    // The rectangle is given in the scaled image.
+    UINT rowSize = ((UINT)reader->width * 3 + 3) & ~3u;
+    if (wic->bandSize < (size_t)rowSize * rows) {
+        free(wic->band);
+        wic->bandSize = (size_t)rowSize * rows;
+        if ((wic->band = malloc(wic->bandSize)) == NULL) {
+            wic->bandSize = 0;
+            return 1;
+        }
+    }
+    if (FAILED(IWICBitmapSourceTransform_CopyPixels(wic->transform, &band, reader->width, reader->height, &wic->format,
+                                                    WICBitmapTransformRotate0, rowSize, rowSize * rows, wic->band))) {
+        return 1;
+    }
+    for (int y = 0; y < rows; y++) {
+        const unsigned char *in = wic->band + (size_t)y * rowSize;
+        unsigned char *out = pixels + (size_t)y * stride;
+        for (int x = 0; x < reader->width; x++) {
+            out[x * 4 + 0] = in[x * 3 + 0];
+            out[x * 4 + 1] = in[x * 3 + 1];
+            out[x * 4 + 2] = in[x * 3 + 2];
+            out[x * 4 + 3] = 255;
+        }
+    }
+    return 0;
+}
+
+static void imageCloseWic(ImageReader *reader) {
+    ImageWicDecoder *wic = (ImageWicDecoder *)reader->decoder;
+    if (wic->transform != NULL) {
+        IWICBitmapSourceTransform_Release(wic->transform);
+    }
+    if (wic->converted != NULL) {
+        IWICBitmapSource_Release(wic->converted);
+    }
+    if (wic->frame != NULL) {
+        IWICBitmapFrameDecode_Release(wic->frame);
+    }
+    if (wic->decoder != NULL) {
+        IWICBitmapDecoder_Release(wic->decoder);
+    }
+    if (wic->factory != NULL) {
+        IWICImagingFactory_Release(wic->factory);
+    }
+    if (SUCCEEDED(wic->initialized)) {
+        CoUninitialize();
+    }
+    free(wic->band);
+    free(wic);
+}
+
+/**
+ * @brief Opens an image through the Windows Imaging Component, which decodes the bands asked for.
+ */
+static int imageOpenWic(ImageReader *reader, const char *imagePath) {
+    wchar_t widePath[MAX_PATH];
+    ImageWicDecoder *wic;
+    if (MultiByteToWideChar(CP_ACP, 0, imagePath, -1, widePath, MAX_PATH) == 0
+        || (wic = calloc(1, sizeof(ImageWicDecoder))) == NULL) {
+        return 1;
+    }
+
+    wic->base = (ImageDecoder){imageReduceWic, imageReadWic, imageCloseWic};
+    wic->initialized = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+    reader->decoder = &wic->base;
+    UINT width = 0, height = 0;
+    if (FAILED(CoCreateInstance(&CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, &IID_IWICImagingFactory, (void **)&wic->factory))
+        || FAILED(IWICImagingFactory_CreateDecoderFromFilename(wic->factory, widePath, NULL, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &wic->decoder))
+        || FAILED(IWICBitmapDecoder_GetFrame(wic->decoder, 0, &wic->frame))
+        || FAILED(WICConvertBitmapSource(&GUID_WICPixelFormat32bppBGRA, (IWICBitmapSource *)wic->frame, &wic->converted))
+        || FAILED(IWICBitmapSource_GetSize(wic->converted, &width, &height))) {
+        imageCloseWic(reader);
+        reader->decoder = NULL;
+        return 1;
+    }
+    reader->width = reader->sourceWidth = width;
+    reader->height = reader->sourceHeight = height;
+    return 0;
+}
+
+#else
+
+typedef struct ImageJpegError {
+    struct jpeg_error_mgr manager;
+    jmp_buf jump;
+} ImageJpegError;
+
+typedef struct ImageJpegDecoder {
+    ImageDecoder base;
+    struct jpeg_decompress_struct info;
+    ImageJpegError error;
+    FILE *file;
+    int started; // jpeg_start_decompress() was called.
+    unsigned char *row; // RGB scanline when libjpeg cannot write BGRA itself.
+} ImageJpegDecoder;
+
+static void imageJpegExit(j_common_ptr info) {
+    longjmp(((ImageJpegError *)info->err)->jump, 1);
+}
+
+static int imageReduceJpeg(ImageReader *reader, int denominator) {
+    ImageJpegDecoder *jpeg = (ImageJpegDecoder *)reader->decoder;
+    if (setjmp(jpeg->error.jump)) {
+        return 1;
+    }
+    // The scaled IDCT outputs 1/2, 1/4 or 1/8 of the blocks directly.
+    jpeg->info.scale_num = 1;
+    jpeg->info.scale_denom = denominator;
+    jpeg_calc_output_dimensions(&jpeg->info);
+    reader->width = jpeg->info.output_width;
+    reader->height = jpeg->info.output_height;
+    return denominator;
+}
+
+static int imageReadJpeg(ImageReader *reader, unsigned char *pixels, int stride, int rows) {
+    ImageJpegDecoder *jpeg = (ImageJpegDecoder *)reader->decoder;
+    if (setjmp(jpeg->error.jump)) {
+        return 1;
+    }
+    if (!jpeg->started) {
+        jpeg_start_decompress(&jpeg->info);
+        jpeg->started = 1;
+        if (jpeg->info.out_color_space == JCS_RGB && (jpeg->row = malloc((size_t)reader->width * 3)) == NULL) {
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < rows; i++) {
+        unsigned char *out = pixels + (size_t)i * stride;
+        unsigned char *row = jpeg->row != NULL ? jpeg->row : out;
+        jpeg_read_scanlines(&jpeg->info, &row, 1);
+        for (int x = 0; jpeg->row != NULL && x < reader->width; x++) {
+            out[x * 4 + 0] = row[x * 3 + 2];
+            out[x * 4 + 1] = row[x * 3 + 1];
+            out[x * 4 + 2] = row[x * 3 + 0];
+            out[x * 4 + 3] = 255;
+        }
+    }
+    return 0;
+}
+
+static void imageCloseJpeg(ImageReader *reader) {
+    ImageJpegDecoder *jpeg = (ImageJpegDecoder *)reader->decoder;
+    jpeg_destroy_decompress(&jpeg->info);
+    fclose(jpeg->file);
+    free(jpeg->row);
+    free(jpeg);
+}
+
+/**
+ * @brief Opens a JPEG through libjpeg, which decodes a few scanlines at a time.
+ */
+static int imageOpenJpeg(ImageReader *reader, const char *imagePath) {
+    ImageJpegDecoder *jpeg = calloc(1, sizeof(ImageJpegDecoder));
+    if (jpeg == NULL) {
+        return 1;
+    }
+    if ((jpeg->file = fopen(imagePath, "rb")) == NULL) {
+        free(jpeg);
+        return 1;
+    }
+
+    jpeg->base = (ImageDecoder){imageReduceJpeg, imageReadJpeg, imageCloseJpeg};
+    jpeg->info.err = jpeg_std_error(&jpeg->error.manager);
+    jpeg->error.manager.error_exit = imageJpegExit;
+    jpeg_create_decompress(&jpeg->info);
+    reader->decoder = &jpeg->base;
+    if (setjmp(jpeg->error.jump)) {
+        imageCloseJpeg(reader);
+        reader->decoder = NULL;
+        return 1;
+    }
+
+    jpeg_stdio_src(&jpeg->info, jpeg->file);
+    jpeg_read_header(&jpeg->info, TRUE);
+#ifdef JCS_EXTENSIONS
+    // libjpeg-turbo converts to BGRA itself, straight into the caller's rows.
+    jpeg->info.out_color_space = JCS_EXT_BGRA;
+#else
+    jpeg->info.out_color_space = JCS_RGB;
+#endif
+    jpeg_calc_output_dimensions(&jpeg->info);
+    reader->width = reader->sourceWidth = jpeg->info.output_width;
+    reader->height = reader->sourceHeight = jpeg->info.output_height;
+    if (jpeg->info.progressive_mode) {
+        // Progressive scans are buffered as coefficients of the whole image.
+        reader->retained = (size_t)jpeg->info.image_width * jpeg->info.image_height * jpeg->info.num_components * sizeof(JCOEF);
+    }
+    return 0;
+}
+
+typedef struct ImagePngDecoder {
+    ImageDecoder base;
+    png_structp png;
+    png_infop info;
+    FILE *file;
+    unsigned char *image; // Whole image of interlaced files, which cannot be read row by row.
+} ImagePngDecoder;
+
+static void imagePngWarning(png_structp png, png_const_charp message) {
+    (void)png;
+    debug("libpng: %s", message);
+}
+
+static int imageReadPng(ImageReader *reader, unsigned char *pixels, int stride, int rows) {
+    ImagePngDecoder *png = (ImagePngDecoder *)reader->decoder;
+    size_t rowSize = (size_t)reader->width * 4;
+    png_bytep *pointers = NULL;
+    if (setjmp(png_jmpbuf(png->png))) {
+        free(pointers);
+        return 1;
+    }
+
+    if (reader->retained != 0) {
+        if (png->image == NULL) {
+            if ((png->image = malloc(reader->retained)) == NULL
+                || (pointers = malloc(sizeof(png_bytep) * reader->height)) == NULL) {
+                free(pointers);
+                return 1;
+            }
+            for (int y = 0; y < reader->height; y++) {
+                pointers[y] = png->image + y * rowSize;
+            }
+            png_read_image(png->png, pointers);
+            free(pointers);
+        }
+        for (int i = 0; i < rows; i++) {
+            memcpy(pixels + (size_t)i * stride, png->image + (reader->row + i) * rowSize, rowSize);
+        }
+        return 0;
+    }
+
+    for (int i = 0; i < rows; i++) {
+        png_read_row(png->png, pixels + (size_t)i * stride, NULL);
+    }
+    return 0;
+}
+
+static void imageClosePng(ImageReader *reader) {
+    ImagePngDecoder *png = (ImagePngDecoder *)reader->decoder;
+    png_destroy_read_struct(&png->png, png->info != NULL ? &png->info : NULL, NULL);
+    fclose(png->file);
+    free(png->image);
+    free(png);
+}
+
+/**
+ * @brief Opens a PNG through libpng, which decodes a row at a time unless the file is interlaced.
+ */
+static int imageOpenPng(ImageReader *reader, const char *imagePath) {
+    ImagePngDecoder *png = calloc(1, sizeof(ImagePngDecoder));
+    if (png == NULL) {
+        return 1;
+    }
+    if ((png->file = fopen(imagePath, "rb")) == NULL) {
+        free(png);
+        return 1;
+    }
+    png->base = (ImageDecoder){NULL, imageReadPng, imageClosePng};
+    png->png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, imagePngWarning);
+    if (png->png == NULL || (png->info = png_create_info_struct(png->png)) == NULL) {
+        png_destroy_read_struct(png->png != NULL ? &png->png : NULL, NULL, NULL);
+        fclose(png->file);
+        free(png);
+        return 1;
+    }
+    reader->decoder = &png->base;
+    if (setjmp(png_jmpbuf(png->png))) {
+        imageClosePng(reader);
+        reader->decoder = NULL;
+        return 1;
+    }
+
+    png_init_io(png->png, png->file);
+    png_read_info(png->png, png->info);
+    // Palette, low bit depths, 16 bits and grey all become 8-bit BGRA, missing alpha is opaque.
+    png_set_expand(png->png);
+    png_set_strip_16(png->png);
+    png_set_gray_to_rgb(png->png);
+    png_set_bgr(png->png);
+    png_set_filler(png->png, 0xff, PNG_FILLER_AFTER);
+    int passes = png_set_interlace_handling(png->png);
+    png_read_update_info(png->png, png->info);
+
+    reader->width = reader->sourceWidth = png_get_image_width(png->png, png->info);
+    reader->height = reader->sourceHeight = png_get_image_height(png->png, png->info);
+    if (png_get_rowbytes(png->png, png->info) != (size_t)reader->width * 4) {
+        imageClosePng(reader);
+        reader->decoder = NULL;
+        return 1;
+    }
+    if (passes > 1) {
+        reader->retained = (size_t)reader->width * reader->height * 4;
+    }
+    return 0;
+}
+
+#ifdef HAVE_LIBAVIF
+#define IMAGE_AVIF_CONTEXT 2 // Rows converted above and below a band, so chroma is upsampled as for the whole image.
+
+typedef struct ImageAvifDecoder {
+    ImageDecoder base;
+    avifDecoder *decoder; // Owns the decoded YUV image.
+    unsigned char *band; // Band with its context rows.
+    size_t bandSize; // Size of band in bytes.
+} ImageAvifDecoder;
+
+static int imageReadAvif(ImageReader *reader, unsigned char *pixels, int stride, int rows) {
+    ImageAvifDecoder *avif = (ImageAvifDecoder *)reader->decoder;
+    avifImage *image = avif->decoder->image;
+
+    // Views of subsampled images start on an even row.
+    int first = reader->row - IMAGE_AVIF_CONTEXT;
+    int last = reader->row + rows + IMAGE_AVIF_CONTEXT;
+    first = first < 0 ? 0 : first & ~1;
+    last = last > reader->height ? reader->height : last;
+    size_t rowSize = (size_t)reader->width * 4;
+    if (avif->bandSize < rowSize * (last - first)) {
+        free(avif->band);
+        avif->bandSize = rowSize * (last - first);
+        if ((avif->band = malloc(avif->bandSize)) == NULL) {
+            avif->bandSize = 0;
+            return 1;
+        }
+    }
+
+    avifImage *view = avifImageCreateEmpty();
+    avifCropRect rect = {0, (uint32_t)first, (uint32_t)reader->width, (uint32_t)(last - first)};
+    avifRGBImage rgb;
+    int result = 1;
+    if (view != NULL && avifImageSetViewRect(view, image, &rect) == AVIF_RESULT_OK) {
+        avifRGBImageSetDefaults(&rgb, view);
+        rgb.format = AVIF_RGB_FORMAT_BGRA;
+        rgb.depth = 8;
+        rgb.pixels = avif->band;
+        rgb.rowBytes = (uint32_t)rowSize;
+        result = avifImageYUVToRGB(view, &rgb) != AVIF_RESULT_OK;
+    }
+    if (view != NULL) {
+        avifImageDestroy(view);
+    }
+    for (int i = 0; result == 0 && i < rows; i++) {
+        memcpy(pixels + (size_t)i * stride, avif->band + (reader->row + i - first) * rowSize, rowSize);
+    }
+    return result;
+}
+
+static void imageCloseAvif(ImageReader *reader) {
+    ImageAvifDecoder *avif = (ImageAvifDecoder *)reader->decoder;
+    if (avif->decoder != NULL) {
+        avifDecoderDestroy(avif->decoder);
+    }
+    free(avif->band);
+    free(avif);
+}
+
+/**
+ * @brief Opens an AVIF through libavif. AV1 frames are decoded as a whole, the conversion to BGRA runs in bands.
+ */
+static int imageOpenAvif(ImageReader *reader, const char *imagePath) {
+    ImageAvifDecoder *avif = calloc(1, sizeof(ImageAvifDecoder));
+    if (avif == NULL) {
+        return 1;
+    }
+    avif->base = (ImageDecoder){NULL, imageReadAvif, imageCloseAvif};
+    reader->decoder = &avif->base;
+    if ((avif->decoder = avifDecoderCreate()) == NULL || avifDecoderSetIOFile(avif->decoder, imagePath) != AVIF_RESULT_OK
+        || avifDecoderParse(avif->decoder) != AVIF_RESULT_OK || avifDecoderNextImage(avif->decoder) != AVIF_RESULT_OK) {
+        imageCloseAvif(reader);
+        reader->decoder = NULL;
+        return 1;
+    }
+    avifImage *image = avif->decoder->image;
+    reader->width = reader->sourceWidth = image->width;
+    reader->height = reader->sourceHeight = image->height;
+    reader->retained = (size_t)image->width * image->height * (image->depth > 8 ? 2 : 1) * (image->alphaPlane != NULL ? 4 : 3);
+    return 0;
+}
+#endif
+
+#endif
+
+int imageReaderOpen(ImageReader *reader, const char *imagePath) {
+    int format = imageSniff(imagePath);
+    int result = 1;
+    memset(reader, 0, sizeof(ImageReader));
+
+    if (format == IMAGE_BMP) {
+        result = imageOpenBmp(reader, imagePath);
+    } else if (format != IMAGE_UNKNOWN) {
+#ifdef _WIN32
+        result = imageOpenWic(reader, imagePath);
+#else
+        if (format == IMAGE_JPEG) {
+            result = imageOpenJpeg(reader, imagePath);
+        } else if (format == IMAGE_PNG) {
+            result = imageOpenPng(reader, imagePath);
+        }
+#ifdef HAVE_LIBAVIF
+        else if (format == IMAGE_AVIF) {
+            result = imageOpenAvif(reader, imagePath);
+        }
+#endif
+#endif
+    }
+
+    if (result == 0 && (reader->width <= 0 || reader->height <= 0 || reader->width > IMAGE_MAX_SIZE || reader->height > IMAGE_MAX_SIZE)) {
+        imageReaderClose(reader);
+        result = 1;
+    }
+    if (result != 0) {
+        error("Failure decoding image: %s", imagePath);
+    }
+    return result;
+}
+
+int imageReaderReduce(ImageReader *reader, int denominator) {
+    if (reader->row != 0 || denominator <= 1 || reader->decoder->reduce == NULL) {
+        return 1;
+    }
+    return reader->decoder->reduce(reader, denominator);
+}
+
+int imageReaderRead(ImageReader *reader, unsigned char *pixels, int stride, int rows) {
+    if (rows > reader->height - reader->row) {
+        rows = reader->height - reader->row;
+    }
+    if (rows <= 0) {
+        return 0;
+    }
+    if (reader->decoder->read(reader, pixels, stride, rows) != 0) {
+        return 1;
+    }
+    reader->row += rows;
+    return 0;
+}
+
+void imageReaderClose(ImageReader *reader) {
+    if (reader->decoder != NULL) {
+        reader->decoder->close(reader);
+    }
+    memset(reader, 0, sizeof(ImageReader));
+}
+
+int imageLoad(const char *imagePath, Image *image) {
+    ImageReader reader;
+    memset(image, 0, sizeof(Image));
+    if (imageReaderOpen(&reader, imagePath) != 0) {
+        return 1;
+    }
+    int failed = imageCreate(image, reader.width, reader.height) != 0
+        || imageReaderRead(&reader, image->pixels, image->stride, reader.height) != 0;
+    imageReaderClose(&reader);
+    if (failed) {
+        error("Failure decoding image: %s", imagePath);
+        imageFree(image);
+    }
+    return failed;
+}
+
+int imageWriteBmp(const char *imagePath, const Image *image) {
+    FILE *file = fopen(imagePath, "wb");
+    if (file == NULL) {
+        return 1;
+    }
+
+    uint32_t rowSize = ((uint32_t)image->width * 3 + 3) & ~3u;
+    uint32_t dataSize = rowSize * image->height;
+    unsigned char header[54] = {'B', 'M'};
+    uint32_t fileSize = sizeof(header) + dataSize, offset = sizeof(header), infoSize = 40;
+    int32_t width = image->width, height = image->height;
+    uint16_t planes = 1, bits = 24;
+    memcpy(header + 2, &fileSize, 4);
+    memcpy(header + 10, &offset, 4);
+    memcpy(header + 14, &infoSize, 4);
+    memcpy(header + 18, &width, 4);
+    memcpy(header + 22, &height, 4);
+    memcpy(header + 26, &planes, 2);
+    memcpy(header + 28, &bits, 2);
+    memcpy(header + 34, &dataSize, 4);
+
+    unsigned char *row = calloc(1, rowSize);
+    int failed = row == NULL || fwrite(header, 1, sizeof(header), file) != sizeof(header);
+    for (int y = image->height - 1; !failed && y >= 0; y--) {
+        const unsigned char *in = image->pixels + (size_t)y * image->stride;
+        for (int x = 0; x < image->width; x++) {
+            row[x * 3 + 0] = in[x * 4 + 0];
+            row[x * 3 + 1] = in[x * 4 + 1];
+            row[x * 3 + 2] = in[x * 4 + 2];
+        }
+        failed = fwrite(row, 1, rowSize, file) != rowSize;
+    }
+    free(row);
+    failed = fclose(file) != 0 || failed;
+    return failed;
+}
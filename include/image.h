@@ -0,0 +1,33 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+
+// 32-bit BGRA image, rows are stride bytes apart
+typedef struct Image {
+    int width;
+    int height;
+    int stride;
+    unsigned char *pixels;
+} Image;
+
+// Decoder handing out the rows of an image file from top to bottom
+typedef struct ImageReader {
+    int width; // Width of the rows returned, smaller than sourceWidth after imageReaderReduce().
+    int height; // Number of rows.
+    int sourceWidth; // Width stored in the file.
+    int sourceHeight; // Height stored in the file.
+    int row; // Next row returned by imageReaderRead().
+    size_t retained; // Bytes the decoder keeps for the whole image, 0 if it only holds a few rows.
+    struct ImageDecoder *decoder; // Format specific state.
+} ImageReader;
+
+int imageCreate(Image *image, int width, int height);
+void imageFree(Image *image);
+int imageLoad(const char *imagePath, Image *image);
+int imageReaderOpen(ImageReader *reader, const char *imagePath);
+int imageReaderReduce(ImageReader *reader, int denominator);
+int imageReaderRead(ImageReader *reader, unsigned char *pixels, int stride, int rows);
+void imageReaderClose(ImageReader *reader);
+int imageWriteBmp(const char *imagePath, const Image *image);
+#endif // IMAGE_H
@@ -1,32 +1,262 @@
 /**
  * @file ini.c
  * @brief This file contains functions for reading and writing values in INI configuration files.
+ *
+ * A configuration file is loaded once into an IniDocument. The document keeps every line of the
+ * file in order and indexes sections and keys in a hash table, so lookups do not touch the file again.
+ * All strings of a document live in a single arena that is released together with the document.
+ *
+ * Changes are made through an IniTransaction: any number of keys are set on a loaded document,
+ * which is then written once to a temporary file and moved over the original. Unchanged lines are
+ * written back verbatim.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
 #include "log.h"
+#include "ini.h"
+
+#define INI_ARENA_BLOCK_SIZE 4096
+#define INI_TABLE_MIN_SIZE 16
+
+// Line types of an IniDocument
+#define INI_LINE_OTHER 0
+#define INI_LINE_SECTION 1
+#define INI_LINE_ENTRY 2
+
+typedef struct IniArenaBlock {
+    struct IniArenaBlock *next; // Previously filled block.
+    size_t used; // Bytes handed out from data.
+    size_t size; // Capacity of data.
+    char data[]; // Storage.
+} IniArenaBlock;
+
+typedef struct IniLine {
+    int type; // INI_LINE_OTHER, INI_LINE_SECTION or INI_LINE_ENTRY.
+    const char *text; // Raw text as read from the file, NULL for lines changed by iniSet().
+    const char *section; // Section name for sections and entries.
+    const char *key; // Key for entries, NULL otherwise.
+    const char *value; // Value for entries, NULL otherwise.
+    uint32_t hash; // Hash of section and key, used by the index.
+    struct IniLine *sectionEnd; // For sections: the last line belonging to the section.
+    struct IniLine *next; // Next line in file order.
+} IniLine;
+
+struct IniTransaction {
+    IniDocument *document; // Document the changes are applied to.
+    char *configPath; // File the document is committed to.
+};
+
+struct IniDocument {
+    IniArenaBlock *arena; // Current arena block, older blocks are chained through next.
+    IniLine *first; // First line in file order.
+    IniLine *last; // Last line in file order.
+    IniLine **table; // Open addressing index of sections and entries.
+    size_t tableSize; // Number of slots in table, always a power of two.
+    size_t tableCount; // Number of used slots in table.
+};
+
+/**
+ * @brief Allocates memory from the arena of a document.
+ *
+ * @param document The document owning the arena.
+ * @param size The number of bytes needed.
+ * @return Pointer to the memory, or NULL if the allocation fails.
+ */
+static void *iniArenaAlloc(IniDocument *document, size_t size);
+
+/**
+ * @brief Copies a string of the given length into the arena of a document.
+ *
+ * @param document The document owning the arena.
+ * @param text The string to copy, does not need to be terminated.
+ * @param length The number of characters to copy.
+ * @return Pointer to the terminated copy, or NULL if the allocation fails.
+ */
+static char *iniArenaString(IniDocument *document, const char *text, size_t length);
+
+/**
+ * @brief Hashes a section and key pair (FNV-1a). A NULL key hashes the section itself.
+ */
+static uint32_t iniHash(const char *section, const char *key);
+
+/**
+ * @brief Finds the section line or entry line for a section and key. A NULL key finds the section.
+ *
+ * @return The line, or NULL if it does not exist.
+ */
+static IniLine *iniFind(const IniDocument *document, const char *section, const char *key);
+
+/**
+ * @brief Adds a section or entry line to the hash index, growing the index if needed.
+ *
+ * @return Returns 0 on success, or 1 if the index could not be grown.
+ */
+static int iniIndex(IniDocument *document, IniLine *line);
+
+/**
+ * @brief Tokenizes the text of an INI file into the lines of a document.
+ *
+ * @return Returns 0 on success, or 1 if an allocation fails.
+ */
+static int iniParse(IniDocument *document, char *text, size_t length);
+
+/**
+ * @brief Inserts a line into a document directly after another line.
+ *
+ * @param after The line to insert after, or NULL to append at the end.
+ */
+static void iniInsertAfter(IniDocument *document, IniLine *after, IniLine *line);
+
+/**
+ * @brief Sets the value of a key in a document, adding the key and section if needed.
+ *
+ * @return Returns 0 on success, or 1 if an allocation fails.
+ */
+static int iniSetValue(IniDocument *document, const char *section, const char *key, const char *value);
+
+/**
+ * @brief Renders a document back into INI text in a single buffer.
+ *
+ * @param document The document to render.
+ * @param length Receives the length of the text.
+ * @return The text, to be released with free(), or NULL if the allocation fails.
+ */
+static char *iniSerialize(const IniDocument *document, size_t *length);
+
+/**
+ * @brief Writes text to a temporary file next to the target, flushes it to disk and moves it over the target.
+ *
+ * @return Returns 0 on success, or 1 if an error occurs. The target is left untouched on failure.
+ */
+static int iniWriteAtomic(const char *configPath, const char *text, size_t length);
+
+/**
+ * @brief Copies a value into a buffer of the caller, truncating it if it does not fit.
+ *
+ * @return Returns 0 on success, or 1 if the value was truncated.
+ */
+static int iniCopyValue(char *value, size_t valueSize, const char *found);
+
+/**
+ * @brief Loads and indexes an INI file.
+ *
+ * The file is read once; afterwards all lookups are served from memory.
+ *
+ * @param configPath The path to the INI configuration file.
+ * @return The document, or NULL if the file cannot be read.
+ */
+IniDocument *iniLoad(const char *configPath);
+
+/**
+ * @brief Releases a document and all strings handed out by it.
+ *
+ * @param document The document to free, may be NULL.
+ */
+void iniFree(IniDocument *document);
+
+/**
+ * @brief Looks up the value of a key in a section.
+ *
+ * @param document The loaded document.
+ * @param section The section in the INI file where the key is located.
+ * @param key The key whose value is requested.
+ * @return The value owned by the document, or NULL if the key is not found.
+ */
+const char *iniGet(const IniDocument *document, const char *section, const char *key);
+
+/**
+ * @brief Copies the value of a key in a section into a buffer.
+ *
+ * @param document The loaded document.
+ * @param section The section in the INI file where the key is located.
+ * @param key The key whose value is requested.
+ * @param value A buffer to store the value.
+ * @param valueSize The size of the buffer.
+ * @return Returns 0 on success, or 1 if the key is not found or the value does not fit. A value that
+ *         does not fit is stored truncated.
+ */
+int iniGetString(const IniDocument *document, const char *section, const char *key, char *value, size_t valueSize);
+
+/**
+ * @brief Reads the value of a key in a section as an integer.
+ *
+ * @param document The loaded document.
+ * @param section The section in the INI file where the key is located.
+ * @param key The key whose value is requested.
+ * @param value Receives the parsed integer.
+ * @return Returns 0 on success, or 1 if the key is not found or is not an integer.
+ */
+int iniGetInt(const IniDocument *document, const char *section, const char *key, int *value);
+
+/**
+ * @brief Starts a batch of changes to an INI file.
+ *
+ * The current file is loaded, a missing file starts out empty.
+ *
+ * @param configPath The path to the INI file.
+ * @return The transaction, or NULL if the file exists but cannot be loaded.
+ */
+IniTransaction *iniBegin(const char *configPath);
+
+/**
+ * @brief Sets a key in a transaction. If the key does not exist, it is added to the section.
+ * If the section does not exist, it is created.
+ *
+ * @param transaction The open transaction.
+ * @param section The section in the INI file where the key is located.
+ * @param key The key to which the value should be written.
+ * @param value The value to write to the specified key.
+ * @return Returns 0 on success, or 1 if an error occurs.
+ */
+int iniSet(IniTransaction *transaction, const char *section, const char *key, const char *value);
+
+/**
+ * @brief Writes all changes of a transaction with a single atomic replace of the file and ends the transaction.
+ *
+ * @param transaction The open transaction, released in every case.
+ * @return Returns 0 on success, or 1 if an error occurs.
+ */
+int iniCommit(IniTransaction *transaction);
+
+/**
+ * @brief Ends a transaction without writing anything.
+ *
+ * @param transaction The open transaction, may be NULL.
+ */
+void iniAbort(IniTransaction *transaction);
 
 /**
  * @brief Reads a value associated with a given key from a specific section in an INI file.
  *
- * This function searches for a specified section and key in the INI file and retrieves the
- * corresponding value if found.
+ * This function loads the INI file, looks up the specified section and key and retrieves the
+ * corresponding value if found. Prefer iniLoad() when more than one value is needed.
  *
  * @param configPath The path to the INI configuration file.
  * @param section The section in the INI file where the key is located.
  * @param key The key whose value needs to be read.
  * @param value A buffer to store the value read from the INI file.
- * @return Returns 0 if the value is successfully read, or 1 if an error occurs or the key is not found.
+ * @param valueSize The size of the buffer.
+ * @return Returns 0 if the value is successfully read, or 1 if an error occurs, the key is not found or
+ *         the value does not fit. A value that does not fit is stored truncated.
  */
-int readIniValue(char *configPath, char *section, char *key, char *value);
+int readIniValue(const char *configPath, const char *section, const char *key, char *value, size_t valueSize);
 
 /**
  * @brief Writes a value to a specified key in a given section of an INI file.
  *
  * This function updates the value of a key in the specified section. If the key does not exist,
- * it is added to the section. If the section does not exist, it is created.
+ * it is added to the section. If the section does not exist, it is created. To change several keys
+ * use a transaction, which writes the file only once.
  *
  * @param configPath The path to the INI file.
  * @param section The section in the INI file where the key is located.
@@ -36,96 +266,508 @@ int readIniValue(char *configPath, char *section, char *key, char *value);
  */
 int writeIniValue(const char *configPath, const char *section, const char *key, const char *value);
 
-int readIniValue(char *configPath, char *section, char *key, char *value) {
-    FILE *file = fopen(configPath, "r");
-    if (file == NULL) {
-        return 1;
+static void *iniArenaAlloc(IniDocument *document, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    IniArenaBlock *block = document->arena;
+    if (block == NULL || block->size - block->used < size) {
+        size_t blockSize = size > INI_ARENA_BLOCK_SIZE ? size : INI_ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(IniArenaBlock) + blockSize);
+        if (block == NULL) {
+            error("Failure allocating config memory");
+            return NULL;
+        }
+        block->next = document->arena;
+        block->used = 0;
+        block->size = blockSize;
+        document->arena = block;
     }
+    void *memory = block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+static char *iniArenaString(IniDocument *document, const char *text, size_t length) {
+    char *copy = iniArenaAlloc(document, length + 1);
+    if (copy != NULL) {
+        memcpy(copy, text, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
 
-    char line[512];
-    int insideSection = 0;
+static uint32_t iniHash(const char *section, const char *key) {
+    uint32_t hash = 2166136261u;
+    for (const char *c = section; *c; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    hash = (hash ^ (key ? 1u : 0u)) * 16777619u;
+    for (const char *c = key; c && *c; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    return hash;
+}
 
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\n")] = 0;
+static IniLine *iniFind(const IniDocument *document, const char *section, const char *key) {
+    if (document == NULL || document->tableSize == 0) {
+        return NULL;
+    }
+    uint32_t hash = iniHash(section, key);
+    size_t mask = document->tableSize - 1;
+    for (size_t i = hash & mask; document->table[i] != NULL; i = (i + 1) & mask) {
+        IniLine *line = document->table[i];
+        if (line->hash != hash || strcmp(line->section, section) != 0) {
+            continue;
+        }
+        if (key == NULL ? line->type == INI_LINE_SECTION : (line->type == INI_LINE_ENTRY && strcmp(line->key, key) == 0)) {
+            return line;
+        }
+    }
+    return NULL;
+}
 
-        if (line[0] == '[') {
-            if (strncmp(line + 1, section, strlen(section)) == 0) {
-                insideSection = 1;
-            } else {
-                insideSection = 0;
+static int iniIndex(IniDocument *document, IniLine *line) {
+    if ((document->tableCount + 1) * 2 > document->tableSize) {
+        size_t newSize = document->tableSize ? document->tableSize * 2 : INI_TABLE_MIN_SIZE;
+        IniLine **newTable = calloc(newSize, sizeof(IniLine *));
+        if (newTable == NULL) {
+            error("Failure allocating config index");
+            return 1;
+        }
+        for (size_t i = 0; i < document->tableSize; i++) {
+            IniLine *entry = document->table[i];
+            if (entry == NULL) {
+                continue;
             }
+            size_t slot = entry->hash & (newSize - 1);
+            while (newTable[slot] != NULL) {
+                slot = (slot + 1) & (newSize - 1);
+            }
+            newTable[slot] = entry;
         }
+        free(document->table);
+        document->table = newTable;
+        document->tableSize = newSize;
+    }
+
+    size_t mask = document->tableSize - 1;
+    size_t slot = line->hash & mask;
+    while (document->table[slot] != NULL) {
+        slot = (slot + 1) & mask;
+    }
+    document->table[slot] = line;
+    document->tableCount++;
+    return 0;
+}
 
-        if (insideSection && strncmp(line, key, strlen(key)) == 0) {
-            sscanf(line, "%*s = %s", value);
-            fclose(file);
-            return 0;
+static int iniParse(IniDocument *document, char *text, size_t length) {
+    IniLine *section = NULL;
+    const char *sectionName = "";
+    char *end = text + length;
+
+    for (char *start = text; start < end;) {
+        char *lineEnd = memchr(start, '\n', end - start);
+        if (lineEnd == NULL) {
+            lineEnd = end;
+        }
+        char *next = lineEnd < end ? lineEnd + 1 : end;
+        if (lineEnd > start && lineEnd[-1] == '\r') {
+            lineEnd--;
         }
+
+        char *first = start;
+        char *last = lineEnd;
+        while (first < last && (*first == ' ' || *first == '\t')) {
+            first++;
+        }
+        while (last > first && (last[-1] == ' ' || last[-1] == '\t')) {
+            last--;
+        }
+
+        IniLine *line = iniArenaAlloc(document, sizeof(IniLine));
+        if (line == NULL) {
+            return 1;
+        }
+        memset(line, 0, sizeof(IniLine));
+        line->type = INI_LINE_OTHER;
+
+        char *equals = memchr(first, '=', last - first);
+        if (first < last && *first == '[' && memchr(first, ']', last - first) != NULL) {
+            char *nameEnd = memchr(first, ']', last - first);
+            line->type = INI_LINE_SECTION;
+            line->section = iniArenaString(document, first + 1, nameEnd - first - 1);
+            if (line->section == NULL) {
+                return 1;
+            }
+            line->sectionEnd = line;
+            line->hash = iniHash(line->section, NULL);
+            sectionName = line->section;
+            section = line;
+            if (iniFind(document, line->section, NULL) == NULL && iniIndex(document, line) != 0) {
+                return 1;
+            }
+        } else if (first < last && *first != ';' && *first != '#' && equals != NULL) {
+            char *keyEnd = equals;
+            char *valueStart = equals + 1;
+            while (keyEnd > first && (keyEnd[-1] == ' ' || keyEnd[-1] == '\t')) {
+                keyEnd--;
+            }
+            while (valueStart < last && (*valueStart == ' ' || *valueStart == '\t')) {
+                valueStart++;
+            }
+            line->type = INI_LINE_ENTRY;
+            line->section = sectionName;
+            line->key = iniArenaString(document, first, keyEnd - first);
+            line->value = iniArenaString(document, valueStart, last - valueStart);
+            if (line->key == NULL || line->value == NULL) {
+                return 1;
+            }
+            line->hash = iniHash(line->section, line->key);
+            if (iniFind(document, line->section, line->key) == NULL && iniIndex(document, line) != 0) {
+                return 1;
+            }
+        }
+
+        line->text = iniArenaString(document, start, lineEnd - start);
+        if (line->text == NULL) {
+            return 1;
+        }
+
+        if (document->last != NULL) {
+            document->last->next = line;
+        } else {
+            document->first = line;
+        }
+        document->last = line;
+        if (section != NULL && line->type != INI_LINE_OTHER) {
+            section->sectionEnd = line;
+        }
+        start = next;
+    }
+    return 0;
+}
+
+IniDocument *iniLoad(const char *configPath) {
+    FILE *file = fopen(configPath, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    IniDocument *document = calloc(1, sizeof(IniDocument));
+    if (document == NULL) {
+        fclose(file);
+        return NULL;
     }
 
+    size_t capacity = INI_ARENA_BLOCK_SIZE;
+    size_t length = 0;
+    char *text = malloc(capacity);
+    size_t readBytes;
+    while (text != NULL && (readBytes = fread(text + length, 1, capacity - length, file)) > 0) {
+        length += readBytes;
+        if (length == capacity) {
+            char *grown = realloc(text, capacity * 2);
+            if (grown == NULL) {
+                free(text);
+                text = NULL;
+                break;
+            }
+            text = grown;
+            capacity *= 2;
+        }
+    }
     fclose(file);
-    return 1;
+
+    if (text == NULL || iniParse(document, text, length) != 0) {
+        error("Failure parsing config: %s", configPath);
+        free(text);
+        iniFree(document);
+        return NULL;
+    }
+    free(text);
+    return document;
 }
 
-int writeIniValue(const char *configPath, const char *section, const char *key, const char *value) {
-    FILE *file = fopen(configPath, "r");
-    if (file == NULL) {
+void iniFree(IniDocument *document) {
+    if (document == NULL) {
+        return;
+    }
+    IniArenaBlock *block = document->arena;
+    while (block != NULL) {
+        IniArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(document->table);
+    free(document);
+}
+
+const char *iniGet(const IniDocument *document, const char *section, const char *key) {
+    IniLine *line = iniFind(document, section, key);
+    return line ? line->value : NULL;
+}
+
+int iniGetString(const IniDocument *document, const char *section, const char *key, char *value, size_t valueSize) {
+    const char *found = iniGet(document, section, key);
+    return found == NULL || iniCopyValue(value, valueSize, found) != 0;
+}
+
+int iniGetInt(const IniDocument *document, const char *section, const char *key, int *value) {
+    const char *found = iniGet(document, section, key);
+    if (found == NULL || *found == '\0') {
+        return 1;
+    }
+    char *end;
+    long parsed = strtol(found, &end, 10);
+    if (*end != '\0') {
         return 1;
     }
+    *value = (int)parsed;
+    return 0;
+}
 
-    char content[2048];
-    content[0] = '\0';
-    
-    char line[512];
-    int insideSection = 0;
-    int keyFound = 0;
-    
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\n")] = 0;
-
-        if (insideSection && strncmp(line, key, strlen(key)) == 0) {
-            keyFound = 1;
-            strcat(content, key);
-            strcat(content, " = ");
-            strcat(content, value);
-            strcat(content, "\n");
-            continue;
+int readIniValue(const char *configPath, const char *section, const char *key, char *value, size_t valueSize) {
+    IniDocument *document = iniLoad(configPath);
+    if (document == NULL) {
+        return 1;
+    }
+    const char *found = iniGet(document, section, key);
+    int result = found == NULL;
+    if (found != NULL && iniCopyValue(value, valueSize, found) != 0) {
+        error("Value of %s in [%s] of %s is longer than %zu bytes", key, section, configPath, valueSize - 1);
+        result = 1;
+    }
+    iniFree(document);
+    return result;
+}
+
+static int iniCopyValue(char *value, size_t valueSize, const char *found) {
+    if (valueSize == 0) {
+        return 1;
+    }
+    size_t length = strlen(found);
+    size_t copied = length < valueSize ? length : valueSize - 1;
+    memcpy(value, found, copied);
+    value[copied] = '\0';
+    return copied < length;
+}
+
+static void iniInsertAfter(IniDocument *document, IniLine *after, IniLine *line) {
+    if (after == NULL) {
+        after = document->last;
+    }
+    if (after == NULL) {
+        line->next = document->first;
+        document->first = line;
+    } else {
+        line->next = after->next;
+        after->next = line;
+    }
+    if (line->next == NULL) {
+        document->last = line;
+    }
+}
+
+static int iniSetValue(IniDocument *document, const char *section, const char *key, const char *value) {
+    char *valueCopy = iniArenaString(document, value, strlen(value));
+    if (valueCopy == NULL) {
+        return 1;
+    }
+
+    IniLine *line = iniFind(document, section, key);
+    if (line != NULL) {
+        line->value = valueCopy;
+        line->text = NULL;
+        return 0;
+    }
+
+    IniLine *sectionLine = iniFind(document, section, NULL);
+    if (sectionLine == NULL) {
+        if (document->last != NULL && (document->last->text == NULL || document->last->text[0] != '\0')) {
+            IniLine *blank = iniArenaAlloc(document, sizeof(IniLine));
+            if (blank == NULL) {
+                return 1;
+            }
+            memset(blank, 0, sizeof(IniLine));
+            blank->type = INI_LINE_OTHER;
+            blank->text = "";
+            iniInsertAfter(document, NULL, blank);
         }
 
-        if (line[0] == '[' && strncmp(line + 1, section, strlen(section)) == 0) {
-            insideSection = 1;
+        sectionLine = iniArenaAlloc(document, sizeof(IniLine));
+        if (sectionLine == NULL) {
+            return 1;
+        }
+        memset(sectionLine, 0, sizeof(IniLine));
+        sectionLine->type = INI_LINE_SECTION;
+        sectionLine->section = iniArenaString(document, section, strlen(section));
+        if (sectionLine->section == NULL) {
+            return 1;
         }
+        sectionLine->hash = iniHash(section, NULL);
+        sectionLine->sectionEnd = sectionLine;
+        iniInsertAfter(document, NULL, sectionLine);
+        if (iniIndex(document, sectionLine) != 0) {
+            return 1;
+        }
+    }
 
-        strcat(content, line);
-        strcat(content, "\n");
+    line = iniArenaAlloc(document, sizeof(IniLine));
+    if (line == NULL) {
+        return 1;
+    }
+    memset(line, 0, sizeof(IniLine));
+    line->type = INI_LINE_ENTRY;
+    line->section = sectionLine->section;
+    line->key = iniArenaString(document, key, strlen(key));
+    line->value = valueCopy;
+    if (line->key == NULL) {
+        return 1;
     }
+    line->hash = iniHash(section, key);
+    iniInsertAfter(document, sectionLine->sectionEnd, line);
+    sectionLine->sectionEnd = line;
+    return iniIndex(document, line);
+}
 
-    if (!keyFound) {
-        if (insideSection) {
-            strcat(content, key);
-            strcat(content, " = ");
-            strcat(content, value);
-            strcat(content, "\n");
+static char *iniSerialize(const IniDocument *document, size_t *length) {
+    size_t total = 0;
+    for (const IniLine *line = document->first; line != NULL; line = line->next) {
+        if (line->text != NULL) {
+            total += strlen(line->text) + 1;
+        } else if (line->type == INI_LINE_SECTION) {
+            total += strlen(line->section) + 3;
         } else {
-            strcat(content, "[");
-            strcat(content, section);
-            strcat(content, "]\n");
-            strcat(content, key);
-            strcat(content, " = ");
-            strcat(content, value);
-            strcat(content, "\n");
+            total += strlen(line->key) + strlen(line->value) + 4;
         }
     }
 
-    fclose(file);
+    char *text = malloc(total + 1);
+    if (text == NULL) {
+        error("Failure allocating config text");
+        return NULL;
+    }
+
+    char *out = text;
+    for (const IniLine *line = document->first; line != NULL; line = line->next) {
+        size_t partLength;
+        if (line->text != NULL) {
+            partLength = strlen(line->text);
+            memcpy(out, line->text, partLength);
+            out += partLength;
+        } else if (line->type == INI_LINE_SECTION) {
+            *out++ = '[';
+            partLength = strlen(line->section);
+            memcpy(out, line->section, partLength);
+            out += partLength;
+            *out++ = ']';
+        } else {
+            partLength = strlen(line->key);
+            memcpy(out, line->key, partLength);
+            out += partLength;
+            memcpy(out, " = ", 3);
+            out += 3;
+            partLength = strlen(line->value);
+            memcpy(out, line->value, partLength);
+            out += partLength;
+        }
+        *out++ = '\n';
+    }
+    *out = '\0';
+    *length = out - text;
+    return text;
+}
+
+static int iniWriteAtomic(const char *configPath, const char *text, size_t length) {
+    size_t pathLength = strlen(configPath);
+    char *tempPath = malloc(pathLength + sizeof(".tmp"));
+    if (tempPath == NULL) {
+        return 1;
+    }
+    memcpy(tempPath, configPath, pathLength);
+    memcpy(tempPath + pathLength, ".tmp", sizeof(".tmp"));
 
-    file = fopen(configPath, "w");
+    FILE *file = fopen(tempPath, "wb");
     if (file == NULL) {
+        error("Failure creating %s", tempPath);
+        free(tempPath);
         return 1;
     }
 
-    fputs(content, file);
-    fclose(file);
+    int failed = fwrite(text, 1, length, file) != length || fflush(file) != 0;
+#ifdef _WIN32
+    failed = failed || _commit(_fileno(file)) != 0;
+#else
+    failed = failed || fsync(fileno(file)) != 0;
+#endif
+    failed = fclose(file) != 0 || failed;
 
-    return 0;
+#ifdef _WIN32
+    failed = failed || !MoveFileExA(tempPath, configPath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    failed = failed || rename(tempPath, configPath) != 0;
+#endif
+
+    if (failed) {
+        error("Failure writing %s", configPath);
+        remove(tempPath);
+    }
+    free(tempPath);
+    return failed;
+}
+
+IniTransaction *iniBegin(const char *configPath) {
+    IniTransaction *transaction = calloc(1, sizeof(IniTransaction));
+    if (transaction == NULL) {
+        return NULL;
+    }
+
+    transaction->configPath = malloc(strlen(configPath) + 1);
+    FILE *file = fopen(configPath, "rb");
+    if (file != NULL) {
+        fclose(file);
+        transaction->document = iniLoad(configPath);
+    } else {
+        transaction->document = calloc(1, sizeof(IniDocument));
+    }
+
+    if (transaction->configPath == NULL || transaction->document == NULL) {
+        iniAbort(transaction);
+        return NULL;
+    }
+    strcpy(transaction->configPath, configPath);
+    return transaction;
+}
+
+int iniSet(IniTransaction *transaction, const char *section, const char *key, const char *value) {
+    return iniSetValue(transaction->document, section, key, value);
+}
+
+int iniCommit(IniTransaction *transaction) {
+    size_t length;
+    char *text = iniSerialize(transaction->document, &length);
+    int result = text == NULL || iniWriteAtomic(transaction->configPath, text, length) != 0;
+    free(text);
+    iniAbort(transaction);
+    return result;
+}
+
+void iniAbort(IniTransaction *transaction) {
+    if (transaction == NULL) {
+        return;
+    }
+    iniFree(transaction->document);
+    free(transaction->configPath);
+    free(transaction);
+}
+
+int writeIniValue(const char *configPath, const char *section, const char *key, const char *value) {
+    IniTransaction *transaction = iniBegin(configPath);
+    if (transaction == NULL) {
+        return 1;
+    }
+    if (iniSet(transaction, section, key, value) != 0) {
+        iniAbort(transaction);
+        return 1;
+    }
+    return iniCommit(transaction);
 }
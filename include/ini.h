@@ -4,7 +4,24 @@
 #include <stdio.h>
 #include <string.h>
 
+// Parsed and indexed INI file
+typedef struct IniDocument IniDocument;
+
+IniDocument *iniLoad(const char *configPath);
+void iniFree(IniDocument *document);
+const char *iniGet(const IniDocument *document, const char *section, const char *key);
+int iniGetString(const IniDocument *document, const char *section, const char *key, char *value, size_t valueSize);
+int iniGetInt(const IniDocument *document, const char *section, const char *key, int *value);
+
+// Batch of changes written to an INI file with one atomic replace
+typedef struct IniTransaction IniTransaction;
+
+IniTransaction *iniBegin(const char *configPath);
+int iniSet(IniTransaction *transaction, const char *section, const char *key, const char *value);
+int iniCommit(IniTransaction *transaction);
+void iniAbort(IniTransaction *transaction);
+
 // Function to read a specific key-value pair from an INI file
-int readIniValue(const char *configPath, const char *section, const char *key, char *value);
-int writeIniValue(const char *configPath, const char *section, const char *key, char *value);
+int readIniValue(const char *configPath, const char *section, const char *key, char *value, size_t valueSize);
+int writeIniValue(const char *configPath, const char *section, const char *key, const char *value);
 #endif // INI_H
@@ -0,0 +1,838 @@
+/**
+ * @file library.c
+ * @brief Directories of wallpapers with a persistent index of their files.
+ *
+ * A library keeps one LibraryEntry per file of its directory: size and modification time as listed,
+ * and the dimensions, content hash, brightness, warmth and period found by analyzing it once. The entries are stored
+ * sorted by name in CACHE_DIRECTORY/library-<path hash>.idx, so opening a library only reads that file and
+ * the first pick does not wait for the directory.
+ *
+ * A scanner thread per library lists the directory, which yields size and time without opening any file,
+ * and merges the listing with its entries by name. Only new files and files whose size or time changed
+ * are decoded, so a pass over an unchanged directory of thousands of images on a synced folder costs one
+ * listing. New files are analyzed by one worker per processor, and a file whose content hash matches an entry
+ * of the previous pass, e.g. after a rename or a touch, takes over its results without being decoded.
+ * A file watch starts another pass after changes. The scanner publishes copies of its entries,
+ * the owner thread swaps them in with libraryRefresh(), so picks never lock or touch the disk.
+ *
+ * Libraries are opened and closed from one thread. Opening a directory twice shares one library.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#include <limits.h>
+#include <unistd.h>
+#endif
+
+#include "log.h"
+#include "image.h"
+#include "analyze.h"
+#include "thread.h"
+#include "watch.h"
+#include "trace.h"
+#include "cache.h"
+#include "library.h"
+
+#define LIBRARY_PATH_SIZE 512
+#define LIBRARY_MAX_ENTRIES (1 << 20) // Upper bound of an index file, larger counts are treated as corrupt.
+#define LIBRARY_DEBOUNCE_MS 2000 // Quiet time after changes before the directory is listed again.
+#define LIBRARY_PUBLISH_BATCH 256 // Scanned files between two publishes while a pass is running.
+#define LIBRARY_MAX_WORKERS 16 // Upper bound of the threads analyzing files.
+#define LIBRARY_HASH_CHUNK (64 * 1024) // Bytes read at once when hashing a file.
+
+// Entries of a library and the ones that can be picked
+typedef struct LibraryIndex {
+    LibraryEntry *entries; // All files, sorted by name.
+    int count; // Number of entries.
+    int *usable; // Indices of the decoded entries without duplicate content, by period, then in name order.
+    int first[ANALYZE_PERIODS + 1]; // Position in usable of the first entry of each period, the last is the total.
+} LibraryIndex;
+
+struct Library {
+    char directory[LIBRARY_PATH_SIZE]; // Absolute path of the directory.
+    char indexPath[LIBRARY_PATH_SIZE]; // Path of the index file.
+    LibraryIndex *current; // Index picks are made from, only used by the owner thread.
+    _Atomic(LibraryIndex *) pending; // Index published by the scanner and not yet swapped in.
+    LibraryIndex scan; // Entries of the scanner, only used by the scanner thread.
+    LibraryEntry *known; // Decoded entries of the previous pass sorted by content hash, read by the workers.
+    int knownCount; // Number of known entries.
+    int *batch; // Indices of the entries the workers analyze.
+    atomic_int cursor; // Position in batch taken next by a worker.
+    int batchEnd; // End of the positions of the running batch.
+    ThreadEvent *wake; // Signaled to start a scan pass.
+    atomic_bool stop; // Set by libraryClose().
+    Thread *thread; // Scanner thread.
+    FileWatch *watch; // Watch of the directory, NULL if it cannot be watched.
+    LibraryCallback scanned; // Called on the scanner thread after every pass.
+    void *argument; // Passed to scanned.
+    int references; // Number of libraryOpen() calls not yet closed.
+    struct Library *next; // Next open library.
+};
+
+static Library *libraryOpened = NULL; // Open libraries, only used by the thread opening them.
+
+/**
+ * @brief Checks whether a path names a directory.
+ *
+ * @return Returns 1 for a directory, 0 for a file or a missing path.
+ */
+int libraryIsDirectory(const char *path);
+
+/**
+ * @brief Opens the library of a directory and starts its scanner and watch.
+ *
+ * The stored index is loaded before returning, the directory is listed on the scanner thread.
+ * If the directory is already open, its library is shared and keeps the callback of the first call.
+ *
+ * @param directory The directory, not searched recursively.
+ * @param scanned Called on the scanner thread after every scan pass, may be NULL.
+ * @param argument Passed to scanned.
+ * @return The library, or NULL if the path cannot be resolved or the threads cannot be started.
+ */
+Library *libraryOpen(const char *directory, LibraryCallback scanned, void *argument);
+
+/**
+ * @brief Closes a library. When its last user closes it, the scanner and the watch are stopped and it is freed.
+ *
+ * A running pass stops after the files being analyzed.
+ *
+ * @param library The library, may be NULL.
+ */
+void libraryClose(Library *library);
+
+/**
+ * @brief Returns the absolute path of the directory of a library.
+ */
+const char *libraryDirectory(const Library *library);
+
+/**
+ * @brief Swaps in the index last published by the scanner. Call it from the thread making the picks.
+ *
+ * @param library The library.
+ * @return Returns 1 if the index changed, or 0 if nothing was published since the last call.
+ */
+int libraryRefresh(Library *library);
+
+/**
+ * @brief Returns the number of entries that can be picked.
+ *
+ * @param library The library.
+ * @param period Count only the images of one period, or LIBRARY_ANY.
+ */
+int libraryCount(const Library *library, int period);
+
+/**
+ * @brief Returns an entry that can be picked.
+ *
+ * @param library The library.
+ * @param period The period, or LIBRARY_ANY.
+ * @param index From 0 to libraryCount() - 1.
+ * @return The entry, valid until the next libraryRefresh(), or NULL if index is out of range.
+ */
+const LibraryEntry *libraryEntry(const Library *library, int period, int index);
+
+/**
+ * @brief Returns the path of the image at a position of the library, wrapping around at the end.
+ *
+ * @param library The library.
+ * @param period Pick only among the images of one period, or LIBRARY_ANY.
+ * @param sequence Position of the image, any value.
+ * @param path Receives the path.
+ * @param size The size of the path buffer.
+ * @return Returns 0 on success, or 1 if the library holds no image of the period or the path does not fit.
+ */
+int libraryPick(const Library *library, int period, long long sequence, char *path, size_t size);
+
+/**
+ * @brief Body of the scanner thread, runs a pass each time the library is woken.
+ */
+static void libraryThread(void *argument);
+
+/**
+ * @brief Watch callback, wakes the scanner.
+ */
+static void libraryWatched(void *argument);
+
+/**
+ * @brief Lists the files of the directory with their size and time, sorted by name.
+ *
+ * @param directory The directory.
+ * @param entries Receives the pending entries, free() them.
+ * @param count Receives the number of entries.
+ * @return Returns 0 on success, or 1 if the directory cannot be read.
+ */
+static int libraryList(const char *directory, LibraryEntry **entries, int *count);
+
+/**
+ * @brief Merges a listing into the entries of the scanner, keeping the scans of unchanged files.
+ *
+ * @param index The entries of the scanner, replaced by the listing.
+ * @param listed The listing, owned by the index afterwards.
+ * @param count Number of listed entries.
+ * @param previous Receives the replaced entries and their count, free() them.
+ * @return Returns 1 if files were added, removed or changed, or 0 otherwise.
+ */
+static int libraryMerge(LibraryIndex *index, LibraryEntry *listed, int count, LibraryIndex *previous);
+
+/**
+ * @brief Fills in the dimensions, content hash and analysis of a file, from a known entry with the same content if there is one.
+ */
+static void libraryScanFile(Library *library, LibraryEntry *entry);
+
+/**
+ * @brief Body of the worker threads, analyzes the entries of the running batch until it is done.
+ */
+static void libraryWorker(void *argument);
+
+/**
+ * @brief Returns the range of usable entries of a period.
+ */
+static void libraryRange(const LibraryIndex *index, int period, int *first, int *count);
+
+/**
+ * @brief Runs one scan pass: list, merge, scan the pending files, publish and store the index.
+ */
+static void libraryScan(Library *library);
+
+/**
+ * @brief Publishes a copy of the entries of the scanner for the owner thread.
+ */
+static void libraryPublish(Library *library);
+
+/**
+ * @brief Copies entries into a new index and selects the usable ones.
+ *
+ * @return The index, or NULL if it cannot be allocated.
+ */
+static LibraryIndex *libraryCopy(const LibraryEntry *entries, int count);
+
+/**
+ * @brief Frees an index and its arrays.
+ */
+static void libraryFree(LibraryIndex *index);
+
+/**
+ * @brief Reads the index file. A missing or invalid file leaves the index empty.
+ */
+static void libraryLoad(const char *indexPath, LibraryIndex *index);
+
+/**
+ * @brief Writes the index file through a temporary file.
+ *
+ * @return Returns 0 on success, or 1 if the file cannot be written.
+ */
+static int librarySave(const char *indexPath, const LibraryIndex *index);
+
+/**
+ * @brief Feeds bytes into a 64-bit FNV-1a hash.
+ */
+static uint64_t libraryHash(uint64_t hash, const void *data, size_t length);
+
+/**
+ * @brief Orders entries by name.
+ */
+static int libraryCompareNames(const void *a, const void *b);
+
+// Content hash and position of a usable entry, sorted to find duplicates
+typedef struct LibraryDuplicate {
+    uint64_t hash; // Content hash.
+    int index; // Index of the entry.
+} LibraryDuplicate;
+
+/**
+ * @brief Orders duplicate candidates by hash, then by position.
+ */
+static int libraryCompareHashes(const void *a, const void *b);
+
+/**
+ * @brief Orders duplicate candidates by position.
+ */
+static int libraryComparePositions(const void *a, const void *b);
+
+/**
+ * @brief Orders entries by content hash.
+ */
+static int libraryCompareContent(const void *a, const void *b);
+
+static uint64_t libraryHash(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int libraryCompareNames(const void *a, const void *b) {
+    return strcmp(((const LibraryEntry *)a)->name, ((const LibraryEntry *)b)->name);
+}
+
+static int libraryCompareHashes(const void *a, const void *b) {
+    const LibraryDuplicate *left = a, *right = b;
+    if (left->hash != right->hash) {
+        return left->hash < right->hash ? -1 : 1;
+    }
+    return left->index - right->index;
+}
+
+static int libraryComparePositions(const void *a, const void *b) {
+    return ((const LibraryDuplicate *)a)->index - ((const LibraryDuplicate *)b)->index;
+}
+
+static int libraryCompareContent(const void *a, const void *b) {
+    uint64_t left = ((const LibraryEntry *)a)->hash, right = ((const LibraryEntry *)b)->hash;
+    return left < right ? -1 : left > right;
+}
+
+int libraryIsDirectory(const char *path) {
+    struct stat info;
+    return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+Library *libraryOpen(const char *directory, LibraryCallback scanned, void *argument) {
+    TRACE_SCOPE("libraryOpen");
+    Library *library = calloc(1, sizeof(Library));
+    if (library == NULL) {
+        return NULL;
+    }
+#ifdef _WIN32
+    DWORD length = GetFullPathNameA(directory, sizeof(library->directory), library->directory, NULL);
+    if (length == 0 || length >= sizeof(library->directory)) {
+        free(library);
+        return NULL;
+    }
+    // The index key must not depend on a trailing separator, but "C:\" keeps it.
+    if (length > 3 && (library->directory[length - 1] == '\\' || library->directory[length - 1] == '/')) {
+        library->directory[length - 1] = '\0';
+    }
+#else
+    char resolved[PATH_MAX];
+    if (realpath(directory, resolved) == NULL || strlen(resolved) >= sizeof(library->directory)) {
+        free(library);
+        return NULL;
+    }
+    strcpy(library->directory, resolved);
+#endif
+    for (Library *opened = libraryOpened; opened != NULL; opened = opened->next) {
+        if (strcmp(opened->directory, library->directory) == 0) {
+            opened->references++;
+            free(library);
+            return opened;
+        }
+    }
+    uint64_t pathHash = libraryHash(14695981039346656037ULL, library->directory, strlen(library->directory));
+    snprintf(library->indexPath, sizeof(library->indexPath), "%s/library-%016llx.idx", CACHE_DIRECTORY,
+             (unsigned long long)pathHash);
+    library->scanned = scanned;
+    library->argument = argument;
+    atomic_init(&library->pending, NULL);
+    atomic_init(&library->stop, false);
+
+    // Picks can be made from the stored index right away, the scanner brings it up to date.
+    libraryLoad(library->indexPath, &library->scan);
+    library->current = libraryCopy(library->scan.entries, library->scan.count);
+    library->wake = eventCreate();
+    if (library->current == NULL || library->wake == NULL) {
+        libraryClose(library);
+        return NULL;
+    }
+    library->thread = threadStart(libraryThread, library);
+    if (library->thread == NULL) {
+        error("Failure starting library scanner: %s", library->directory);
+        libraryClose(library);
+        return NULL;
+    }
+    eventSignal(library->wake);
+
+    library->watch = watchStart(library->directory, NULL, LIBRARY_DEBOUNCE_MS, libraryWatched, library);
+    if (library->watch == NULL) {
+        error("Failure watching library %s, changes apply after a restart", library->directory);
+    }
+    library->references = 1;
+    library->next = libraryOpened;
+    libraryOpened = library;
+    debug("Opened library %s with %d images", library->directory, library->current->first[ANALYZE_PERIODS]);
+    return library;
+}
+
+void libraryClose(Library *library) {
+    if (library == NULL || --library->references > 0) {
+        return;
+    }
+    for (Library **link = &libraryOpened; *link != NULL; link = &(*link)->next) {
+        if (*link == library) {
+            *link = library->next;
+            break;
+        }
+    }
+    // The watch wakes the scanner, so it stops first.
+    watchStop(library->watch);
+    if (library->thread != NULL) {
+        atomic_store(&library->stop, true);
+        eventSignal(library->wake);
+        threadJoin(library->thread);
+    }
+    if (library->wake != NULL) {
+        eventDestroy(library->wake);
+    }
+    libraryFree(atomic_exchange(&library->pending, NULL));
+    libraryFree(library->current);
+    free(library->scan.entries);
+    free(library);
+}
+
+const char *libraryDirectory(const Library *library) {
+    return library->directory;
+}
+
+int libraryRefresh(Library *library) {
+    LibraryIndex *index = atomic_exchange(&library->pending, NULL);
+    if (index == NULL) {
+        return 0;
+    }
+    libraryFree(library->current);
+    library->current = index;
+    return 1;
+}
+
+int libraryCount(const Library *library, int period) {
+    int first, count;
+    libraryRange(library->current, period, &first, &count);
+    return count;
+}
+
+const LibraryEntry *libraryEntry(const Library *library, int period, int index) {
+    const LibraryIndex *current = library->current;
+    int first, count;
+    libraryRange(current, period, &first, &count);
+    if (index < 0 || index >= count) {
+        return NULL;
+    }
+    return &current->entries[current->usable[first + index]];
+}
+
+int libraryPick(const Library *library, int period, long long sequence, char *path, size_t size) {
+    const LibraryIndex *current = library->current;
+    int first, count;
+    libraryRange(current, period, &first, &count);
+    if (count == 0) {
+        return 1;
+    }
+    long long slot = sequence % count;
+    if (slot < 0) {
+        slot += count;
+    }
+    const LibraryEntry *entry = &current->entries[current->usable[first + slot]];
+    return snprintf(path, size, "%s/%s", library->directory, entry->name) >= (int)size;
+}
+
+static void libraryRange(const LibraryIndex *index, int period, int *first, int *count) {
+    if (period < 0 || period >= ANALYZE_PERIODS) {
+        *first = 0;
+        *count = index->first[ANALYZE_PERIODS];
+    } else {
+        *first = index->first[period];
+        *count = index->first[period + 1] - index->first[period];
+    }
+}
+
+static void libraryThread(void *argument) {
+    Library *library = argument;
+    while (eventWait(library->wake, -1) && !atomic_load(&library->stop)) {
+        libraryScan(library);
+        if (library->scanned != NULL) {
+            library->scanned(library->argument);
+        }
+    }
+}
+
+static void libraryWatched(void *argument) {
+    Library *library = argument;
+    eventSignal(library->wake);
+}
+
+static int libraryList(const char *directory, LibraryEntry **entries, int *count) {
+    TRACE_SCOPE("libraryList");
+    LibraryEntry *listed = NULL;
+    int listedCount = 0, capacity = 0;
+    *entries = NULL;
+    *count = 0;
+
+#ifdef _WIN32
+    char pattern[LIBRARY_PATH_SIZE];
+    snprintf(pattern, sizeof(pattern), "%s\\*", directory);
+    WIN32_FIND_DATAA file;
+    HANDLE find = FindFirstFileA(pattern, &file);
+    if (find == INVALID_HANDLE_VALUE) {
+        return GetLastError() != ERROR_FILE_NOT_FOUND;
+    }
+    do {
+        // The listing already holds size and time, no file is opened for unchanged entries.
+        const char *name = file.cFileName;
+        if (file.dwFileAttributes & (FILE_ATTRIBUTE_DIRECTORY | FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM)) {
+            continue;
+        }
+        int64_t size = ((int64_t)file.nFileSizeHigh << 32) | file.nFileSizeLow;
+        uint64_t ticks = ((uint64_t)file.ftLastWriteTime.dwHighDateTime << 32) | file.ftLastWriteTime.dwLowDateTime;
+        int64_t modified = (int64_t)(ticks / 10000000ULL) - 11644473600LL;
+#else
+    DIR *handle = opendir(directory);
+    if (handle == NULL) {
+        return 1;
+    }
+    struct dirent *file;
+    while ((file = readdir(handle)) != NULL) {
+        const char *name = file->d_name;
+        char path[LIBRARY_PATH_SIZE];
+        struct stat info;
+        if (name[0] == '.' || snprintf(path, sizeof(path), "%s/%s", directory, name) >= (int)sizeof(path)
+            || stat(path, &info) != 0 || !S_ISREG(info.st_mode)) {
+            continue;
+        }
+        int64_t size = (int64_t)info.st_size;
+        int64_t modified = (int64_t)info.st_mtime;
+#endif
+        // Files being written by the cache or a sync client are left out until they are renamed.
+        size_t length = strlen(name);
+        if (length >= LIBRARY_NAME_SIZE || (length > 4 && strcmp(name + length - 4, ".tmp") == 0)) {
+            continue;
+        }
+        if (listedCount == capacity) {
+            capacity = capacity == 0 ? 256 : capacity * 2;
+            LibraryEntry *grown = capacity <= LIBRARY_MAX_ENTRIES ? realloc(listed, capacity * sizeof(LibraryEntry)) : NULL;
+            if (grown == NULL) {
+                break;
+            }
+            listed = grown;
+        }
+        LibraryEntry *entry = &listed[listedCount++];
+        memset(entry, 0, sizeof(LibraryEntry));
+        memcpy(entry->name, name, length + 1);
+        entry->status = LIBRARY_PENDING;
+        entry->size = size;
+        entry->modified = modified;
+#ifdef _WIN32
+    } while (FindNextFileA(find, &file));
+    FindClose(find);
+#else
+    }
+    closedir(handle);
+#endif
+
+    if (listedCount > 0) {
+        qsort(listed, listedCount, sizeof(LibraryEntry), libraryCompareNames);
+    }
+    *entries = listed;
+    *count = listedCount;
+    return 0;
+}
+
+static int libraryMerge(LibraryIndex *index, LibraryEntry *listed, int count, LibraryIndex *previous) {
+    int changed = count != index->count;
+    int old = 0;
+    for (int i = 0; i < count; i++) {
+        int order = 1;
+        while (old < index->count && (order = strcmp(index->entries[old].name, listed[i].name)) < 0) {
+            old++;
+            changed = 1;
+        }
+        const LibraryEntry *known = old < index->count && order == 0 ? &index->entries[old] : NULL;
+        if (known != NULL && known->status != LIBRARY_PENDING && known->size == listed[i].size
+            && known->modified == listed[i].modified) {
+            listed[i] = *known;
+        } else {
+            changed |= known == NULL || known->status != LIBRARY_PENDING;
+        }
+        old += known != NULL;
+    }
+    changed |= old < index->count;
+
+    *previous = *index;
+    index->entries = listed;
+    index->count = count;
+    return changed;
+}
+
+static void libraryScanFile(Library *library, LibraryEntry *entry) {
+    TRACE_SCOPE("libraryScanFile");
+    char path[LIBRARY_PATH_SIZE];
+    entry->status = LIBRARY_UNSUPPORTED;
+    ImageReader reader;
+    if (snprintf(path, sizeof(path), "%s/%s", library->directory, entry->name) >= (int)sizeof(path)
+        || imageReaderOpen(&reader, path) != 0) {
+        return;
+    }
+
+    // Only files the decoder accepts are hashed, anything else in the directory is never read in full.
+    FILE *file = fopen(path, "rb");
+    unsigned char *chunk = malloc(LIBRARY_HASH_CHUNK);
+    int failed = file == NULL || chunk == NULL;
+    uint64_t hash = 14695981039346656037ULL;
+    size_t length;
+    while (!failed && (length = fread(chunk, 1, LIBRARY_HASH_CHUNK, file)) > 0) {
+        hash = libraryHash(hash, chunk, length);
+    }
+    failed = failed || ferror(file);
+    free(chunk);
+    if (file != NULL) {
+        fclose(file);
+    }
+    if (failed) {
+        imageReaderClose(&reader);
+        return;
+    }
+
+    LibraryEntry key = {.hash = hash};
+    const LibraryEntry *known = library->knownCount > 0
+        ? bsearch(&key, library->known, library->knownCount, sizeof(LibraryEntry), libraryCompareContent) : NULL;
+    if (known != NULL) {
+        imageReaderClose(&reader);
+        entry->width = known->width;
+        entry->height = known->height;
+        entry->luminance = known->luminance;
+        entry->warmth = known->warmth;
+        entry->period = known->period;
+    } else {
+        ImageAnalysis analysis;
+        entry->width = reader.sourceWidth;
+        entry->height = reader.sourceHeight;
+        failed = analyzeReader(&reader, &analysis) != 0;
+        imageReaderClose(&reader);
+        if (failed) {
+            return;
+        }
+        entry->luminance = analyzeLuminance(&analysis);
+        entry->warmth = analyzeWarmth(&analysis);
+        entry->period = analyzePeriod(&analysis);
+    }
+    entry->hash = hash;
+    entry->status = LIBRARY_IMAGE;
+}
+
+static void libraryWorker(void *argument) {
+    Library *library = argument;
+    int position;
+    while (!atomic_load(&library->stop) && (position = atomic_fetch_add(&library->cursor, 1)) < library->batchEnd) {
+        libraryScanFile(library, &library->scan.entries[library->batch[position]]);
+    }
+}
+
+static void libraryScan(Library *library) {
+    TRACE_SCOPE("libraryScan");
+    LibraryEntry *listed;
+    LibraryIndex previous;
+    int count;
+    if (libraryList(library->directory, &listed, &count) != 0) {
+        error("Failure listing library %s", library->directory);
+        return;
+    }
+    LibraryIndex *index = &library->scan;
+    int changed = libraryMerge(index, listed, count, &previous);
+    if (changed) {
+        // Removed files must not be picked while the new ones are scanned.
+        libraryPublish(library);
+    }
+
+    int pending = 0;
+    for (int i = 0; i < index->count; i++) {
+        pending += index->entries[i].status == LIBRARY_PENDING;
+    }
+    library->batch = pending > 0 ? malloc(pending * sizeof(int)) : NULL;
+    if (library->batch == NULL) {
+        pending = 0;
+    }
+    for (int i = 0, position = 0; i < index->count && position < pending; i++) {
+        if (index->entries[i].status == LIBRARY_PENDING) {
+            library->batch[position++] = i;
+        }
+    }
+
+    // Decoded entries of the previous pass are found by content, so renamed or touched files are not decoded again.
+    library->known = previous.entries;
+    library->knownCount = 0;
+    for (int i = 0; pending > 0 && i < previous.count; i++) {
+        if (previous.entries[i].status == LIBRARY_IMAGE) {
+            previous.entries[library->knownCount++] = previous.entries[i];
+        }
+    }
+    if (library->knownCount > 1) {
+        qsort(library->known, library->knownCount, sizeof(LibraryEntry), libraryCompareContent);
+    }
+
+    // Batches are analyzed by one worker per processor, the scanner thread being one of them.
+    int workers = threadCpuCount();
+    workers = workers < 1 ? 1 : workers > LIBRARY_MAX_WORKERS ? LIBRARY_MAX_WORKERS : workers;
+    int scanned = 0;
+    for (int start = 0; start < pending && !atomic_load(&library->stop); start += LIBRARY_PUBLISH_BATCH) {
+        Thread *threads[LIBRARY_MAX_WORKERS];
+        int started = 0;
+        library->batchEnd = pending - start < LIBRARY_PUBLISH_BATCH ? pending : start + LIBRARY_PUBLISH_BATCH;
+        atomic_store(&library->cursor, start);
+        while (started < workers - 1 && started < library->batchEnd - start - 1
+               && (threads[started] = threadStart(libraryWorker, library)) != NULL) {
+            started++;
+        }
+        libraryWorker(library);
+        while (started > 0) {
+            threadJoin(threads[--started]);
+        }
+        scanned = library->batchEnd < atomic_load(&library->cursor) ? library->batchEnd : atomic_load(&library->cursor);
+        libraryPublish(library);
+    }
+    free(library->batch);
+    free(previous.entries);
+    library->batch = NULL;
+    library->known = NULL;
+    library->knownCount = 0;
+
+    // Files left pending by a stop are stored as pending and scanned by the next pass.
+    if ((changed || scanned > 0) && librarySave(library->indexPath, index) != 0) {
+        error("Failure writing library index: %s", library->indexPath);
+    }
+    debug("Scanned library %s: %d files, %d analyzed", library->directory, index->count, scanned);
+}
+
+static void libraryPublish(Library *library) {
+    LibraryIndex *index = libraryCopy(library->scan.entries, library->scan.count);
+    if (index == NULL) {
+        return;
+    }
+    // An index the owner has not swapped in yet is outdated.
+    libraryFree(atomic_exchange(&library->pending, index));
+}
+
+static LibraryIndex *libraryCopy(const LibraryEntry *entries, int count) {
+    LibraryIndex *index = calloc(1, sizeof(LibraryIndex));
+    if (index == NULL) {
+        return NULL;
+    }
+    index->count = count;
+    index->entries = malloc((count > 0 ? count : 1) * sizeof(LibraryEntry));
+    index->usable = malloc((count > 0 ? count : 1) * sizeof(int));
+    LibraryDuplicate *duplicates = malloc((count > 0 ? count : 1) * sizeof(LibraryDuplicate));
+    if (index->entries == NULL || index->usable == NULL || duplicates == NULL) {
+        free(duplicates);
+        libraryFree(index);
+        return NULL;
+    }
+    if (count > 0) {
+        memcpy(index->entries, entries, count * sizeof(LibraryEntry));
+    }
+
+    // A synced folder often holds the same image under several names, each content is picked once.
+    int images = 0;
+    for (int i = 0; i < count; i++) {
+        if (entries[i].status == LIBRARY_IMAGE) {
+            duplicates[images++] = (LibraryDuplicate){entries[i].hash, i};
+        }
+    }
+    if (images > 1) {
+        qsort(duplicates, images, sizeof(LibraryDuplicate), libraryCompareHashes);
+    }
+    int kept = 0;
+    for (int i = 0; i < images; i++) {
+        if (i == 0 || duplicates[i].hash != duplicates[i - 1].hash) {
+            duplicates[kept++].index = duplicates[i].index;
+        }
+    }
+    if (kept > 1) {
+        qsort(duplicates, kept, sizeof(LibraryDuplicate), libraryComparePositions);
+    }
+
+    // The usable entries are grouped by period, each group in name order.
+    int counts[ANALYZE_PERIODS] = {0};
+    for (int i = 0; i < kept; i++) {
+        int period = entries[duplicates[i].index].period;
+        counts[period >= 0 && period < ANALYZE_PERIODS ? period : ANALYZE_TWILIGHT]++;
+    }
+    int next[ANALYZE_PERIODS];
+    for (int period = 0; period < ANALYZE_PERIODS; period++) {
+        next[period] = index->first[period];
+        index->first[period + 1] = index->first[period] + counts[period];
+    }
+    for (int i = 0; i < kept; i++) {
+        int period = entries[duplicates[i].index].period;
+        index->usable[next[period >= 0 && period < ANALYZE_PERIODS ? period : ANALYZE_TWILIGHT]++] = duplicates[i].index;
+    }
+    free(duplicates);
+    return index;
+}
+
+static void libraryFree(LibraryIndex *index) {
+    if (index != NULL) {
+        free(index->entries);
+        free(index->usable);
+        free(index);
+    }
+}
+
+static void libraryLoad(const char *indexPath, LibraryIndex *index) {
+    TRACE_SCOPE("libraryLoad");
+    memset(index, 0, sizeof(LibraryIndex));
+    FILE *file = fopen(indexPath, "rb");
+    if (file == NULL) {
+        return;
+    }
+    LibraryHeader header;
+    int valid = fread(&header, sizeof(header), 1, file) == 1 && header.magic == LIBRARY_MAGIC
+        && header.version == LIBRARY_VERSION && header.entrySize == sizeof(LibraryEntry) && header.count <= LIBRARY_MAX_ENTRIES;
+    LibraryEntry *entries = valid && header.count > 0 ? malloc(header.count * sizeof(LibraryEntry)) : NULL;
+    valid = valid && (header.count == 0 || (entries != NULL && fread(entries, sizeof(LibraryEntry), header.count, file) == header.count));
+    valid = valid && (uint32_t)libraryHash(14695981039346656037ULL, entries, header.count * sizeof(LibraryEntry)) == header.checksum;
+    fclose(file);
+    if (!valid) {
+        // A torn or outdated index only costs a full scan.
+        error("Invalid library index %s, rebuilding it", indexPath);
+        free(entries);
+        return;
+    }
+    index->entries = entries;
+    index->count = (int)header.count;
+}
+
+static int librarySave(const char *indexPath, const LibraryIndex *index) {
+    TRACE_SCOPE("librarySave");
+    LibraryHeader header = {LIBRARY_MAGIC, LIBRARY_VERSION, sizeof(LibraryEntry), (uint32_t)index->count, 0, 0};
+    header.checksum = (uint32_t)libraryHash(14695981039346656037ULL, index->entries, index->count * sizeof(LibraryEntry));
+
+#ifdef _WIN32
+    CreateDirectoryA(CACHE_DIRECTORY, NULL);
+#else
+    mkdir(CACHE_DIRECTORY, 0755);
+#endif
+    char tempPath[LIBRARY_PATH_SIZE + sizeof(".tmp")];
+    if (snprintf(tempPath, sizeof(tempPath), "%s.tmp", indexPath) >= (int)sizeof(tempPath)) {
+        return 1;
+    }
+    FILE *file = fopen(tempPath, "wb");
+    if (file == NULL) {
+        return 1;
+    }
+    // Written like the config, the rename must not publish an index whose data is not on disk yet.
+    int failed = fwrite(&header, sizeof(header), 1, file) != 1
+        || (index->count > 0 && fwrite(index->entries, sizeof(LibraryEntry), index->count, file) != (size_t)index->count)
+        || fflush(file) != 0;
+#ifdef _WIN32
+    failed = failed || _commit(_fileno(file)) != 0;
+#else
+    failed = failed || fsync(fileno(file)) != 0;
+#endif
+    failed = fclose(file) != 0 || failed;
+#ifdef _WIN32
+    failed = failed || !MoveFileExA(tempPath, indexPath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    failed = failed || rename(tempPath, indexPath) != 0;
+#endif
+    if (failed) {
+        remove(tempPath);
+    }
+    return failed;
+}
@@ -0,0 +1,53 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LIBRARY_MAGIC 0x494c4357 // "WCLI"
+#define LIBRARY_VERSION 2
+#define LIBRARY_NAME_SIZE 260
+#define LIBRARY_ANY -1 // Picks from the images of all periods.
+
+// Scan status of a library entry
+#define LIBRARY_PENDING 0 // Listed, but not scanned yet.
+#define LIBRARY_IMAGE 1 // Decoded, can be picked.
+#define LIBRARY_UNSUPPORTED 2 // Not an image or corrupt, kept so it is not scanned again.
+
+// Header of the index file, all fields little endian, followed by count LibraryEntry records sorted by name
+typedef struct LibraryHeader {
+    uint32_t magic; // LIBRARY_MAGIC.
+    uint32_t version; // LIBRARY_VERSION.
+    uint32_t entrySize; // sizeof(LibraryEntry).
+    uint32_t count; // Number of entries.
+    uint32_t checksum; // Low 32 bits of the 64-bit FNV-1a of all entries.
+    uint32_t reserved; // Padding, always 0.
+} LibraryHeader;
+
+// One file of a library directory
+typedef struct LibraryEntry {
+    char name[LIBRARY_NAME_SIZE]; // File name inside the directory.
+    int32_t status; // One of the LIBRARY_* scan states.
+    int64_t size; // File size in bytes when it was scanned.
+    int64_t modified; // Modification time when it was scanned.
+    uint64_t hash; // 64-bit FNV-1a of the content.
+    int32_t width; // Width in pixels.
+    int32_t height; // Height in pixels.
+    float luminance; // Mean Rec. 709 luma from 0 to 1.
+    float warmth; // Mean red minus blue from -1 to 1.
+    int32_t period; // ANALYZE_DAY, ANALYZE_NIGHT or ANALYZE_TWILIGHT.
+    int32_t reserved; // Padding, always 0.
+} LibraryEntry;
+
+typedef struct Library Library;
+typedef void (*LibraryCallback)(void *argument);
+
+int libraryIsDirectory(const char *path);
+Library *libraryOpen(const char *directory, LibraryCallback scanned, void *argument);
+void libraryClose(Library *library);
+const char *libraryDirectory(const Library *library);
+int libraryRefresh(Library *library);
+int libraryCount(const Library *library, int period);
+const LibraryEntry *libraryEntry(const Library *library, int period, int index);
+int libraryPick(const Library *library, int period, long long sequence, char *path, size_t size);
+#endif // LIBRARY_H
@@ -1,140 +1,677 @@
 /**
  * @file log.c
  * @brief Logging utility for various log levels including DEBUG, INFO, and ERROR.
+ *
+ * Callers format their message once, directly into a slot of a lock-free multi-producer ring buffer,
+ * and return immediately. A background thread started by logInit() drains the ring in batches into a
+ * log file that stays open. When the ring is full, messages are dropped and counted instead of blocking.
+ *
+ * The level checks live in the macros of log.h: levels above LOG_COMPILED_LEVEL are removed at compile time
+ * and the arguments of runtime-disabled levels are never evaluated.
+ *
+ * The log file is rotated by size and age, keeping a configurable number of old files (general.log.1, ...).
+ * With LOG_FORMAT_BINARY the producer does not format at all: it stores the format string pointer and the
+ * raw arguments, and the writer emits compact records (see below) that tooling/logDecode.py renders back
+ * into the usual text lines.
+ *
+ * Binary layout, all integers little-endian:
+ *   file header:   "WCLOG001"
+ *   format record: 'F', u32 format id, u16 length, format string
+ *   message:       'M', u8 level, i64 timestamp, u32 format id, u16 args length, args
+ *   args:          per conversion 'i' i64 | 'u' u64 | 'f' f64 | 'p' u64 | 's' u16 length + bytes
+ * A format record precedes the first message using a format id in every file.
  */
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 #include <time.h>
+#include "log.h"
+#include "thread.h"
+#include "metrics.h"
 
 #define MAX_LOG_MSG 1024
+#define MAX_LOG_PATH 260
+#define LOG_RING_SIZE 256 // Number of slots in the ring, must be a power of two.
+#define LOG_FLUSH_INTERVAL_MS 250 // Maximum time a record waits in the ring.
+#define LOG_FORMAT_CACHE_SIZE 256 // Format ids remembered by the writer, must be a power of two.
+#define LOG_BINARY_MAGIC "WCLOG001"
 
-char *logPath = "general.log"; // Path to the log file.
+/*
+ * Slot of the ring. The sequence field implements a bounded MPSC queue (Vyukov): for the n-th lap of
+ * slot i it holds n * LOG_RING_SIZE while the slot is free and n * LOG_RING_SIZE + 1 while it holds a
+ * record. It is stored relative to the slot index, so the zero-initialized ring is valid without setup.
+ */
+typedef struct LogRecord {
+    atomic_size_t sequence; // Slot state, see above.
+    int level; // Log level of the record.
+    time_t timestamp; // Time the record was created.
+    int binary; // Whether message holds encoded arguments instead of text.
+    int length; // Length of the encoded arguments.
+    const char *format; // Format string, used by binary records.
+    char message[MAX_LOG_MSG]; // Formatted message or encoded arguments.
+} LogRecord;
+
+typedef struct LogFormatEntry {
+    const char *format; // Format string literal.
+    unsigned int id; // Hash of the format string.
+} LogFormatEntry;
+
+char logPath[MAX_LOG_PATH] = "general.log"; // Path to the log file.
 int logLevel = 1;  // Log level: 3 (DEBUG), 2 (INFO), 1 (ERROR), 0 (NONE).
 
+static LogRecord logRing[LOG_RING_SIZE]; // Records waiting to be written.
+static atomic_size_t logHead; // Next position producers claim.
+static atomic_size_t logTail; // Next position the writer thread consumes.
+static atomic_ulong logDropped; // Records dropped because the ring was full.
+static atomic_bool logStopping; // Set by logShutdown() to end the writer thread.
+static Thread *logThread = NULL; // Writer thread.
+static ThreadEvent *logEvent = NULL; // Wakes the writer thread early.
+static ThreadEvent *logDrained = NULL; // Signaled by the writer thread after each drain, wakes logFlush().
+static FILE *logFile = NULL; // Log file, open between logInit() and logShutdown().
+static long logFileSize; // Bytes in the current log file.
+static time_t logFileOpened; // Time the current log file was started.
+static LogFormatEntry logFormats[LOG_FORMAT_CACHE_SIZE]; // Formats already defined in the current file.
+
+static int logFormat = LOG_FORMAT_TEXT; // Format of new records.
+static long logMaxSize = 1024 * 1024; // Rotate once the file reaches this many bytes, 0 disables.
+static long logMaxAge = 7 * 24 * 60 * 60; // Rotate once the file is this many seconds old, 0 disables.
+static int logMaxFiles = 3; // Number of rotated files to keep.
+
+static const char *logLevelNames[] = {"NONE", "ERROR", "INFO", "DEBUG"};
+
 /**
  * @brief Retrieves the current time formatted as a string.
  *
- * This function populates the provided buffer with the current time
+ * This function populates the provided buffer with the given time
  * formatted as HH:MM:SS DD-MM-YYYY.
  *
+ * @param timestamp The time to format.
  * @param buffer A buffer to store the formatted time string.
  * @param bufferSize The size of the buffer.
- * @return Returns 0 on success.
+ * @return Returns 0 on success, or 1 if the time has no local representation; the buffer then holds the
+ *         seconds since the epoch.
  */
-int getCurrentTime(char *buffer, size_t bufferSize);
+int getCurrentTime(time_t timestamp, char *buffer, size_t bufferSize);
 
 /**
- * @brief Logs a message with the specified log level.
+ * @brief Queues a message with the specified log level.
  *
- * This function formats a log message and writes it to the log file with a timestamp
- * and the specified log level.
+ * The message is formatted once, straight into a free slot of the ring. The call never blocks;
+ * if the ring is full the message is dropped.
  *
- * @param level The log level as a string (e.g., "DEBUG", "INFO", "ERROR").
+ * @param level The log level of the message.
  * @param format A printf-style format string for the log message.
- * @return Returns 0 on success, or 1 if the log file cannot be opened.
+ * @param args The arguments for the format string.
+ * @return Returns 0 on success, or 1 if the message was dropped.
  */
-int logWithLevel(const char *level, const char *format, ...);
+int logWithLevel(int level, const char *format, va_list args);
 
 /**
- * @brief Logs a debug-level message.
+ * @brief Encodes the arguments of a format string for a binary record.
  *
- * This function writes a debug message to the log file if the current log level
- * is set to DEBUG (3) or higher.
+ * @param buffer Receives the encoded arguments.
+ * @param bufferSize The size of the buffer.
+ * @param format The printf-style format string.
+ * @param args The arguments for the format string.
+ * @return The number of bytes used.
+ */
+static int logEncodeArgs(char *buffer, int bufferSize, const char *format, va_list args);
+
+/**
+ * @brief Opens the log file in append mode and remembers its size and age.
  *
- * @param format A printf-style format string for the log message.
- * @return Returns 0 on success, or 1 if the log file cannot be opened.
+ * The age counts from the first record of an existing file, so restarting does not postpone rotation.
+ *
+ * @return Returns 0 on success, or 1 if the file cannot be opened.
+ */
+static int logOpen();
+
+/**
+ * @brief Reads the time of the first record of the open log file, so appending keeps the age of the file.
+ *
+ * @return The timestamp, or 0 if the file holds no record that can be read.
+ */
+static time_t logFileStart();
+
+/**
+ * @brief Closes the log file, shifts the rotated files by one and opens a fresh file.
+ *
+ * @return Returns 0 on success, or 1 if the new file cannot be opened.
+ */
+static int logRotate();
+
+/**
+ * @brief Writes a single record to the log file in the record's format.
  */
-int debug(const char *format, ...);
+static void logWriteRecord(const LogRecord *record);
 
 /**
- * @brief Logs an info-level message.
+ * @brief Writes all records currently in the ring to the log file.
  *
- * This function writes an informational message to the log file if the current log level
- * is set to INFO (2) or higher.
+ * Only called from the writer thread and from logShutdown() after the writer has stopped.
  *
- * @param format A printf-style format string for the log message.
- * @return Returns 0 on success, or 1 if the log file cannot be opened.
+ * @return The number of records written.
+ */
+static int logDrain();
+
+/**
+ * @brief Body of the writer thread.
  */
-int info(const char *format, ...);
+static void logWriterThread(void *argument);
 
 /**
- * @brief Logs an error-level message.
+ * @brief Sets the path of the log file. Must be called before logInit().
  *
- * This function writes an error message to the log file if the current log level
- * is set to ERROR (1) or higher.
+ * @param path The new path.
+ * @return Returns 0 on success, or 1 if the path is too long.
+ */
+int setLogPath(char *path);
+
+/**
+ * @brief Configures log rotation. Must be called before logInit().
  *
+ * @param maxSize Rotate once the file reaches this many bytes, 0 disables size based rotation.
+ * @param maxAge Rotate once the file is this many seconds old, 0 disables age based rotation.
+ * @param maxFiles Number of rotated files to keep.
+ * @return Returns 0 on success, or 1 if a value is negative.
+ */
+int setLogRotation(long maxSize, long maxAge, int maxFiles);
+
+/**
+ * @brief Selects the record format. Must be called before logInit().
+ *
+ * @param format LOG_FORMAT_TEXT or LOG_FORMAT_BINARY.
+ * @return Returns 0 on success, or 1 if the format is unknown.
+ */
+int setLogFormat(int format);
+
+/**
+ * @brief Starts the background thread that writes queued messages to the log file.
+ *
+ * @return Returns 0 on success, or 1 if the thread could not be started.
+ */
+int logInit();
+
+/**
+ * @brief Writes all queued messages, stops the writer thread and closes the log file.
+ */
+void logShutdown();
+
+/**
+ * @brief Blocks until the writer thread has written every message queued before the call.
+ *
+ * Returns immediately if the writer thread is not running.
+ */
+void logFlush();
+
+/**
+ * @brief Sets the runtime log level.
+ *
+ * @param level "DEBUG", "INFO", "ERROR", "NONE" or the numeric level.
+ * @return Returns 0 on success, or 1 if the level is unknown.
+ */
+int setLogLevel(char *level);
+
+/**
+ * @brief Logs a message with the specified log level.
+ *
+ * Normally called through the debug(), info() and error() macros of log.h, which check the level
+ * before any argument is evaluated.
+ *
+ * @param level The log level of the message.
  * @param format A printf-style format string for the log message.
- * @return Returns 0 on success, or 1 if the log file cannot be opened.
+ * @return Returns 0 on success, or 1 if the message was dropped.
  */
-int error(const char *format, ...);
+int logWrite(int level, const char *format, ...);
 
-int getCurrentTime(char *buffer, size_t bufferSize) {
-    time_t rawtime;
-    struct tm *timeinfo;
+int getCurrentTime(time_t timestamp, char *buffer, size_t bufferSize) {
+    struct tm timeinfo;
+#ifdef _WIN32
+    int failed = localtime_s(&timeinfo, &timestamp) != 0;
+#else
+    int failed = localtime_r(&timestamp, &timeinfo) == NULL;
+#endif
+    if (failed) {
+        snprintf(buffer, bufferSize, "%lld", (long long)timestamp);
+        return 1;
+    }
+    strftime(buffer, bufferSize, "%H:%M:%S %d-%m-%Y", &timeinfo);
+    return 0;
+}
+
+int logWithLevel(int level, const char *format, va_list args) {
+    size_t position = atomic_load_explicit(&logHead, memory_order_relaxed);
+    LogRecord *record;
+
+    for (;;) {
+        record = &logRing[position & (LOG_RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+        size_t expected = position - (position & (LOG_RING_SIZE - 1));
+        if (sequence == expected) {
+            if (atomic_compare_exchange_weak_explicit(&logHead, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if ((ptrdiff_t)(sequence - expected) < 0) {
+            atomic_fetch_add_explicit(&logDropped, 1, memory_order_relaxed);
+            metricsCount(METRIC_LOG_DROPPED);
+            return 1;
+        } else {
+            position = atomic_load_explicit(&logHead, memory_order_relaxed);
+        }
+    }
 
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
+    record->level = level;
+    record->timestamp = time(NULL);
+    record->format = format;
+    record->binary = logFormat == LOG_FORMAT_BINARY;
+    if (record->binary) {
+        record->length = logEncodeArgs(record->message, MAX_LOG_MSG, format, args);
+    } else {
+        vsnprintf(record->message, MAX_LOG_MSG, format, args);
+    }
+    atomic_store_explicit(&record->sequence, position - (position & (LOG_RING_SIZE - 1)) + 1, memory_order_release);
+    metricsCount(METRIC_LOG_MESSAGES);
 
-    strftime(buffer, bufferSize, "%H:%M:%S %d-%m-%Y", timeinfo);
+    if (logEvent != NULL && (level == LOG_LEVEL_ERROR || position - atomic_load_explicit(&logTail, memory_order_relaxed) >= LOG_RING_SIZE / 2)) {
+        eventSignal(logEvent);
+    }
     return 0;
 }
 
-int logWithLevel(const char *level, const char *format, ...) {
-    FILE *file = fopen(logPath, "a");
-    if (!file) {
+static int logEncodeArgs(char *buffer, int bufferSize, const char *format, va_list args) {
+    int length = 0;
+    for (const char *c = format; *c; c++) {
+        if (*c != '%') {
+            continue;
+        }
+        c++;
+        if (*c == '%') {
+            continue;
+        }
+
+        int longs = 0;
+        int isSize = 0;
+        int isLongDouble = 0;
+        for (; *c && strchr("-+ #0123456789.*hlzjtL", *c); c++) {
+            if (*c == '*') {
+                if (length + 9 <= bufferSize) {
+                    long long value = va_arg(args, int);
+                    buffer[length++] = 'i';
+                    memcpy(buffer + length, &value, 8);
+                    length += 8;
+                }
+            } else if (*c == 'l') {
+                longs++;
+            } else if (*c == 'L') {
+                isLongDouble = 1;
+            } else if (*c == 'z' || *c == 'j' || *c == 't') {
+                isSize = 1;
+            }
+        }
+        if (*c == '\0') {
+            break;
+        }
+
+        if (*c == 's') {
+            const char *text = va_arg(args, const char *);
+            if (text == NULL) {
+                text = "(null)";
+            }
+            size_t textLength = strlen(text);
+            if (length + 3 > bufferSize) {
+                break;
+            }
+            if (textLength > (size_t)(bufferSize - length - 3)) {
+                textLength = bufferSize - length - 3;
+            }
+            unsigned short shortLength = (unsigned short)textLength;
+            buffer[length++] = 's';
+            memcpy(buffer + length, &shortLength, 2);
+            memcpy(buffer + length + 2, text, textLength);
+            length += 2 + textLength;
+            continue;
+        }
+
+        if (length + 9 > bufferSize) {
+            break;
+        }
+        char tag;
+        unsigned long long bits;
+        if (strchr("di", *c)) {
+            long long value = isSize ? (long long)va_arg(args, ptrdiff_t)
+                : longs >= 2 ? va_arg(args, long long)
+                : longs == 1 ? va_arg(args, long) : va_arg(args, int);
+            tag = 'i';
+            memcpy(&bits, &value, 8);
+        } else if (strchr("uxXoc", *c)) {
+            bits = isSize ? va_arg(args, size_t)
+                : longs >= 2 ? va_arg(args, unsigned long long)
+                : longs == 1 ? va_arg(args, unsigned long) : va_arg(args, unsigned int);
+            tag = 'u';
+        } else if (strchr("fFeEgGaA", *c)) {
+            double value = isLongDouble ? (double)va_arg(args, long double) : va_arg(args, double);
+            tag = 'f';
+            memcpy(&bits, &value, 8);
+        } else if (*c == 'p') {
+            bits = (unsigned long long)(size_t)va_arg(args, void *);
+            tag = 'p';
+        } else {
+            break;
+        }
+        buffer[length++] = tag;
+        memcpy(buffer + length, &bits, 8);
+        length += 8;
+    }
+    return length;
+}
+
+static int logOpen() {
+    logFile = fopen(logPath, logFormat == LOG_FORMAT_BINARY ? "ab+" : "a+");
+    if (logFile == NULL) {
         printf("Error opening log file: %s\n", logPath);
         return 1;
     }
+    fseek(logFile, 0, SEEK_END);
+    logFileSize = ftell(logFile);
+    memset(logFormats, 0, sizeof(logFormats));
 
-    char timeBuffer[80];
-    getCurrentTime(timeBuffer, sizeof(timeBuffer));
+    if (logFormat == LOG_FORMAT_BINARY) {
+        char magic[sizeof(LOG_BINARY_MAGIC) - 1];
+        fseek(logFile, 0, SEEK_SET);
+        if (logFileSize > 0 && (fread(magic, 1, sizeof(magic), logFile) != sizeof(magic)
+                                || memcmp(magic, LOG_BINARY_MAGIC, sizeof(magic)) != 0)) {
+            // The existing file is not a binary log, start a new one instead of appending to it.
+            return logRotate();
+        }
+        if (logFileSize == 0) {
+            fwrite(LOG_BINARY_MAGIC, 1, sizeof(LOG_BINARY_MAGIC) - 1, logFile);
+            logFileSize = sizeof(LOG_BINARY_MAGIC) - 1;
+        }
+    }
 
-    char logMsg[MAX_LOG_MSG];
-    va_list args;
-    va_start(args, format);
-    vsnprintf(logMsg, MAX_LOG_MSG, format, args);
-    va_end(args);
+    // A fresh file, or one without a readable record, starts now.
+    logFileOpened = logFileSize > 0 ? logFileStart() : 0;
+    if (logFileOpened == 0) {
+        logFileOpened = time(NULL);
+    }
+    fseek(logFile, 0, SEEK_END);
+    return 0;
+}
+
+static time_t logFileStart() {
+    fseek(logFile, 0, SEEK_SET);
+    if (logFormat != LOG_FORMAT_BINARY) {
+        // "[ LEVEL | HH:MM:SS DD-MM-YYYY] message", the time is local like getCurrentTime() writes it.
+        struct tm start = {0};
+        if (fscanf(logFile, "[ %*[A-Z] | %d:%d:%d %d-%d-%d]", &start.tm_hour, &start.tm_min, &start.tm_sec,
+                   &start.tm_mday, &start.tm_mon, &start.tm_year) != 6) {
+            return 0;
+        }
+        start.tm_mon -= 1;
+        start.tm_year -= 1900;
+        start.tm_isdst = -1;
+        time_t timestamp = mktime(&start);
+        return timestamp == (time_t)-1 ? 0 : timestamp;
+    }
+
+    // Format records may precede the first message.
+    fseek(logFile, sizeof(LOG_BINARY_MAGIC) - 1, SEEK_SET);
+    for (;;) {
+        int type = fgetc(logFile);
+        if (type == 'F') {
+            unsigned int id;
+            unsigned short length;
+            if (fread(&id, 4, 1, logFile) != 1 || fread(&length, 2, 1, logFile) != 1 || fseek(logFile, length, SEEK_CUR) != 0) {
+                return 0;
+            }
+        } else if (type == 'M') {
+            long long timestamp;
+            if (fgetc(logFile) == EOF || fread(&timestamp, 8, 1, logFile) != 1) {
+                return 0;
+            }
+            return (time_t)timestamp;
+        } else {
+            return 0;
+        }
+    }
+}
+
+static int logRotate() {
+    char from[MAX_LOG_PATH + 16];
+    char to[MAX_LOG_PATH + 16];
+
+    fclose(logFile);
+    logFile = NULL;
+
+    snprintf(to, sizeof(to), "%s.%d", logPath, logMaxFiles);
+    remove(to);
+    for (int i = logMaxFiles - 1; i >= 1; i--) {
+        snprintf(from, sizeof(from), "%s.%d", logPath, i);
+        snprintf(to, sizeof(to), "%s.%d", logPath, i + 1);
+        rename(from, to);
+    }
+    if (logMaxFiles > 0) {
+        snprintf(to, sizeof(to), "%s.1", logPath);
+        rename(logPath, to);
+    } else {
+        remove(logPath);
+    }
+    return logOpen();
+}
+
+static void logWriteRecord(const LogRecord *record) {
+    static time_t cachedSecond = (time_t)-1;
+    static char cachedTime[80];
+
+    if (!record->binary) {
+        if (record->timestamp != cachedSecond) {
+            getCurrentTime(record->timestamp, cachedTime, sizeof(cachedTime));
+            cachedSecond = record->timestamp;
+        }
+        int written = fprintf(logFile, "[%6s | %19s] %s\n", logLevelNames[record->level], cachedTime, record->message);
+        logFileSize += written > 0 ? written : 0;
+        return;
+    }
+
+    // Look up the id of the format, defining it in this file on first use.
+    size_t slot = ((size_t)record->format >> 3) & (LOG_FORMAT_CACHE_SIZE - 1);
+    while (logFormats[slot].format != NULL && logFormats[slot].format != record->format) {
+        slot = (slot + 1) & (LOG_FORMAT_CACHE_SIZE - 1);
+        if (slot == (((size_t)record->format >> 3) & (LOG_FORMAT_CACHE_SIZE - 1))) {
+            memset(logFormats, 0, sizeof(logFormats));
+            break;
+        }
+    }
+    if (logFormats[slot].format != record->format) {
+        unsigned int id = 2166136261u;
+        for (const char *c = record->format; *c; c++) {
+            id = (id ^ (unsigned char)*c) * 16777619u;
+        }
+        size_t formatLength = strlen(record->format);
+        unsigned short shortLength = formatLength > 0xFFFF ? 0xFFFF : (unsigned short)formatLength;
+        fputc('F', logFile);
+        fwrite(&id, 4, 1, logFile);
+        fwrite(&shortLength, 2, 1, logFile);
+        fwrite(record->format, 1, shortLength, logFile);
+        logFileSize += 7 + shortLength;
+        logFormats[slot].format = record->format;
+        logFormats[slot].id = id;
+    }
+
+    unsigned char level = (unsigned char)record->level;
+    long long timestamp = (long long)record->timestamp;
+    unsigned short length = (unsigned short)record->length;
+    fputc('M', logFile);
+    fwrite(&level, 1, 1, logFile);
+    fwrite(&timestamp, 8, 1, logFile);
+    fwrite(&logFormats[slot].id, 4, 1, logFile);
+    fwrite(&length, 2, 1, logFile);
+    fwrite(record->message, 1, length, logFile);
+    logFileSize += 16 + length;
+}
+
+static int logDrain() {
+    int written = 0;
+
+    unsigned long dropped = atomic_exchange_explicit(&logDropped, 0, memory_order_relaxed);
+    if (dropped > 0) {
+        LogRecord notice = {.level = LOG_LEVEL_ERROR, .timestamp = time(NULL), .binary = logFormat == LOG_FORMAT_BINARY};
+        notice.format = "%lu log messages dropped";
+        if (notice.binary) {
+            notice.message[0] = 'u';
+            unsigned long long count = dropped;
+            memcpy(notice.message + 1, &count, 8);
+            notice.length = 9;
+        } else {
+            snprintf(notice.message, sizeof(notice.message), notice.format, dropped);
+        }
+        logWriteRecord(&notice);
+    }
+
+    size_t tail = atomic_load_explicit(&logTail, memory_order_relaxed);
+    for (;;) {
+        LogRecord *record = &logRing[tail & (LOG_RING_SIZE - 1)];
+        size_t lap = tail - (tail & (LOG_RING_SIZE - 1));
+        if (atomic_load_explicit(&record->sequence, memory_order_acquire) != lap + 1) {
+            break;
+        }
+
+        if ((logMaxSize > 0 && logFileSize >= logMaxSize)
+            || (logMaxAge > 0 && record->timestamp - logFileOpened >= logMaxAge)) {
+            fflush(logFile);
+            if (logRotate() != 0) {
+                return written;
+            }
+        }
+        logWriteRecord(record);
 
-    fprintf(file, "[%6s | %19s] %s\n", level, timeBuffer, logMsg);
+        atomic_store_explicit(&record->sequence, lap + LOG_RING_SIZE, memory_order_release);
+        tail++;
+        atomic_store_explicit(&logTail, tail, memory_order_relaxed);
+        written++;
+    }
 
-    fclose(file);
+    if (written > 0 || dropped > 0) {
+        fflush(logFile);
+    }
+    return written;
+}
+
+static void logWriterThread(void *argument) {
+    while (!atomic_load(&logStopping)) {
+        if (logFile == NULL || logDrain() == 0) {
+            eventWait(logEvent, LOG_FLUSH_INTERVAL_MS);
+        } else {
+            eventSignal(logDrained);
+        }
+    }
+}
+
+int setLogPath(char *path) {
+    if (strlen(path) >= sizeof(logPath)) {
+        return 1;
+    }
+    strcpy(logPath, path);
     return 0;
 }
 
-int debug(const char *format, ...) {
-    if (logLevel >= 3) {
-        va_list args;
-        va_start(args, format);
-        char logMsg[MAX_LOG_MSG];
-        vsnprintf(logMsg, MAX_LOG_MSG, format, args);
-        va_end(args);
-        return logWithLevel("DEBUG", "%s", logMsg);
+int logInit() {
+    if (logThread != NULL) {
+        return 0;
+    }
+
+    if (logOpen() != 0) {
+        return 1;
+    }
+
+    atomic_store(&logStopping, false);
+    logEvent = eventCreate();
+    logDrained = eventCreate();
+    logThread = logEvent && logDrained ? threadStart(logWriterThread, NULL) : NULL;
+    if (logThread == NULL) {
+        eventDestroy(logEvent);
+        eventDestroy(logDrained);
+        logEvent = NULL;
+        logDrained = NULL;
+        fclose(logFile);
+        logFile = NULL;
+        return 1;
     }
     return 0;
 }
 
-int info(const char *format, ...) {
-    if (logLevel >= 2) {
-        va_list args;
-        va_start(args, format);
-        char logMsg[MAX_LOG_MSG];
-        vsnprintf(logMsg, MAX_LOG_MSG, format, args);
-        va_end(args);
-        return logWithLevel("INFO", "%s", logMsg);
+int setLogRotation(long maxSize, long maxAge, int maxFiles) {
+    if (maxSize < 0 || maxAge < 0 || maxFiles < 0) {
+        return 1;
     }
+    logMaxSize = maxSize;
+    logMaxAge = maxAge;
+    logMaxFiles = maxFiles;
     return 0;
 }
 
-int error(const char *format, ...) {
-    if (logLevel >= 1) {
-        va_list args;
-        va_start(args, format);
-        char logMsg[MAX_LOG_MSG];
-        vsnprintf(logMsg, MAX_LOG_MSG, format, args);
-        va_end(args);
-        return logWithLevel("ERROR", "%s", logMsg);
+int setLogFormat(int format) {
+    if (format != LOG_FORMAT_TEXT && format != LOG_FORMAT_BINARY) {
+        return 1;
     }
+    logFormat = format;
     return 0;
 }
+
+void logShutdown() {
+    if (logThread == NULL) {
+        return;
+    }
+    atomic_store(&logStopping, true);
+    eventSignal(logEvent);
+    threadJoin(logThread);
+    logThread = NULL;
+
+    if (logFile != NULL) {
+        logDrain();
+        fclose(logFile);
+        logFile = NULL;
+    }
+    eventDestroy(logEvent);
+    eventDestroy(logDrained);
+    logEvent = NULL;
+    logDrained = NULL;
+}
+
+void logFlush() {
+    if (logThread == NULL) {
+        return;
+    }
+    // A slot claimed but not yet filled stops the writer, so it is woken until it got past the head.
+    size_t head = atomic_load_explicit(&logHead, memory_order_relaxed);
+    while ((ptrdiff_t)(atomic_load_explicit(&logTail, memory_order_relaxed) - head) < 0) {
+        eventSignal(logEvent);
+        eventWait(logDrained, 1);
+    }
+}
+
+int setLogLevel(char *level) {
+    for (int i = LOG_LEVEL_NONE; i <= LOG_LEVEL_DEBUG; i++) {
+        if (strcmp(level, logLevelNames[i]) == 0 || (level[0] == '0' + i && level[1] == '\0')) {
+            logLevel = i;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int logWrite(int level, const char *format, ...) {
+    if (level > logLevel) {
+        return 0;
+    }
+    va_list args;
+    va_start(args, format);
+    int result = logWithLevel(level, format, args);
+    va_end(args);
+    return result;
+}
@@ -3,10 +3,65 @@
 
 #include <stdio.h>
 
+// Log levels
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+
+// Log file formats
+#define LOG_FORMAT_TEXT 0
+#define LOG_FORMAT_BINARY 1
+
+// Most verbose level compiled into the binary, release builds pass -DLOG_COMPILED_LEVEL=2
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// MinGW builds use its C99 printf (-D__USE_MINGW_ANSI_STDIO=1), so formats like %zu are checked against that one
+#ifdef __MINGW_PRINTF_FORMAT
+#define LOG_PRINTF_FORMAT __MINGW_PRINTF_FORMAT
+#else
+#define LOG_PRINTF_FORMAT printf
+#endif
+
+extern int logLevel;
 
 int setLogPath(char *path);
 int setLogLevel(char *level);
-int debug(const char *format, ...);
-int error(const char *format, ...);
-int info(const char *format, ...);
-#endif // INI_H
+int setLogRotation(long maxSize, long maxAge, int maxFiles);
+int setLogFormat(int format);
+int logInit();
+void logShutdown();
+void logFlush();
+int logWrite(int level, const char *format, ...) __attribute__((format(LOG_PRINTF_FORMAT, 2, 3)));
+
+// Arguments are only evaluated and formatted if the level is enabled
+#define LOG_ENABLED(level) ((level) <= LOG_COMPILED_LEVEL && (level) <= logLevel)
+#define LOG_AT(level, ...) (LOG_ENABLED(level) ? logWrite((level), __VA_ARGS__) : 0)
+
+// Levels above LOG_COMPILED_LEVEL leave no code or format string behind; sizeof keeps the arguments type checked
+#define LOG_DISCARD(...) logDiscard(sizeof(printf(__VA_ARGS__)))
+
+static inline int logDiscard(size_t unused) {
+    return 0;
+}
+
+#if LOG_COMPILED_LEVEL >= LOG_LEVEL_DEBUG
+#define debug(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define debug(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_COMPILED_LEVEL >= LOG_LEVEL_INFO
+#define info(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define info(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_COMPILED_LEVEL >= LOG_LEVEL_ERROR
+#define error(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define error(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+#endif // LOG_H
@@ -0,0 +1,455 @@
+/**
+ * @file metrics.c
+ * @brief Counters and latency histograms of the hot paths.
+ *
+ * Every thread records into its own shard, allocated on its first event and never released, so
+ * recording is a thread-local lookup and a relaxed load and store without any locked instruction.
+ * Readers sum all shards; a snapshot taken while threads record may be off by the events in flight.
+ *
+ * Histograms are log-linear like HdrHistogram: every power of two is split into
+ * METRICS_SUB_BUCKETS linear buckets, which keeps the relative error of the percentiles below
+ * 1 / METRICS_SUB_BUCKETS over the whole 64-bit range.
+ *
+ * metricsServe() exports a JSON snapshot to every client connecting to a local named pipe on
+ * Windows or a Unix socket elsewhere, e.g. `type \\.\pipe\WallCycle.metrics` or
+ * `socat - UNIX-CONNECT:wallcycle.sock`.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "log.h"
+#include "thread.h"
+#include "metrics.h"
+
+#define METRICS_SUB_BITS 3
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BITS) // Linear buckets per power of two.
+#define METRICS_BUCKETS ((64 - METRICS_SUB_BITS + 1) * METRICS_SUB_BUCKETS)
+#define METRICS_BUFFER_SIZE 8192 // Size of a formatted snapshot.
+#define METRICS_ENDPOINT_SIZE 260
+#define METRICS_STOP_ATTEMPTS 100 // Connects tried by metricsStop() to wake the pipe thread.
+
+typedef struct MetricsHistogram {
+    atomic_uint_least64_t sum; // Sum of the recorded values.
+    atomic_uint_least64_t max; // Largest recorded value.
+    atomic_uint_least64_t buckets[METRICS_BUCKETS]; // Values per log-linear bucket.
+} MetricsHistogram;
+
+// Events recorded by one thread, only that thread writes
+typedef struct MetricsShard {
+    atomic_uint_least64_t counters[METRIC_COUNTERS]; // Counter values.
+    MetricsHistogram histograms[METRIC_HISTOGRAMS]; // Latency histograms.
+    struct MetricsShard *next; // Next shard in metricsShards.
+} MetricsShard;
+
+static const char *counterNames[METRIC_COUNTERS] = {
+    "log.messages", "log.dropped", "wallpaper.skipped", "cycle.transitions",
+    "cycle.frames", "animation.runs", "animation.frames",
+};
+static const char *histogramNames[METRIC_HISTOGRAMS] = {
+    "wallpaper.apply", "background.set", "config.read", "schedule.lateness",
+    "transition.render", "animation.frame", "wallpaper.prefetch",
+};
+
+static _Atomic(MetricsShard *) metricsShards = NULL; // All shards, newest first.
+static _Thread_local MetricsShard *localShard = NULL; // Shard of the calling thread.
+static uint64_t metricsStart = 0; // metricsNow() of the first snapshot or metricsServe().
+static char metricsEndpoint[METRICS_ENDPOINT_SIZE]; // Pipe name or socket path being served.
+static Thread *metricsThread = NULL; // Thread answering clients of the endpoint.
+static atomic_bool metricsStopping; // Set by metricsStop() to end metricsThread.
+#ifdef _WIN32
+static LARGE_INTEGER metricsFrequency; // Ticks per second of QueryPerformanceCounter().
+#else
+static int metricsSocket = -1; // Listening Unix socket.
+#endif
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds, the start of a latency measurement.
+ */
+uint64_t metricsNow();
+
+/**
+ * @brief Increments a counter of the calling thread.
+ *
+ * @param counter One of the METRIC_* counters.
+ */
+void metricsCount(int counter);
+
+/**
+ * @brief Adds to a counter of the calling thread.
+ *
+ * @param counter One of the METRIC_* counters.
+ * @param amount The amount to add.
+ */
+void metricsAdd(int counter, uint64_t amount);
+
+/**
+ * @brief Records a value in a histogram of the calling thread.
+ *
+ * @param histogram One of the METRIC_* histograms.
+ * @param value The value in nanoseconds.
+ */
+void metricsRecord(int histogram, uint64_t value);
+
+/**
+ * @brief Records the time elapsed since a metricsNow() timestamp.
+ *
+ * @param histogram One of the METRIC_* histograms.
+ * @param start The timestamp taken at the start of the operation.
+ */
+void metricsRecordSince(int histogram, uint64_t start);
+
+/**
+ * @brief Formats a snapshot of all metrics as JSON.
+ *
+ * @param buffer Receives the snapshot.
+ * @param bufferSize The size of the buffer, METRICS_BUFFER_SIZE is always enough.
+ * @return The length of the snapshot, truncated to bufferSize - 1.
+ */
+size_t metricsFormat(char *buffer, size_t bufferSize);
+
+/**
+ * @brief Writes a snapshot of all metrics to a file.
+ *
+ * @param path Path to the file, replaced if it exists.
+ * @return Returns 0 on success, or 1 if the file cannot be written.
+ */
+int metricsDump(const char *path);
+
+/**
+ * @brief Starts answering every client of a local endpoint with a snapshot.
+ *
+ * @param endpoint Named pipe on Windows (\\.\pipe\...), path of a Unix socket elsewhere.
+ * @return Returns 0 on success, or 1 if the endpoint cannot be created.
+ */
+int metricsServe(const char *endpoint);
+
+/**
+ * @brief Stops serving the endpoint started by metricsServe().
+ */
+void metricsStop();
+
+/**
+ * @brief Returns the shard of the calling thread, creating it on first use.
+ *
+ * @return The shard, or NULL if it cannot be allocated.
+ */
+static MetricsShard *metricsLocalShard();
+
+/**
+ * @brief Adds to a value only written by the calling thread, without a locked instruction.
+ */
+static inline void metricsBump(atomic_uint_least64_t *value, uint64_t amount);
+
+/**
+ * @brief Returns the log-linear bucket of a value.
+ */
+static int metricsBucket(uint64_t value);
+
+/**
+ * @brief Returns the largest value of a log-linear bucket.
+ */
+static uint64_t metricsBucketLimit(int bucket);
+
+/**
+ * @brief Returns the value below which a fraction of the values in merged buckets lie, at most max.
+ */
+static uint64_t metricsPercentile(const uint64_t *buckets, uint64_t count, uint64_t max, double fraction);
+
+/**
+ * @brief Answers clients of the endpoint until metricsStop() is called.
+ */
+static void metricsServeThread(void *argument);
+
+uint64_t metricsNow() {
+#ifdef _WIN32
+    LARGE_INTEGER counter;
+    if (metricsFrequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&metricsFrequency);
+    }
+    QueryPerformanceCounter(&counter);
+    uint64_t ticks = (uint64_t)counter.QuadPart, frequency = (uint64_t)metricsFrequency.QuadPart;
+    return ticks / frequency * 1000000000ULL + ticks % frequency * 1000000000ULL / frequency;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#endif
+}
+
+static MetricsShard *metricsLocalShard() {
+    if (localShard != NULL) {
+        return localShard;
+    }
+    MetricsShard *shard = calloc(1, sizeof(MetricsShard));
+    if (shard == NULL) {
+        return NULL;
+    }
+    shard->next = atomic_load(&metricsShards);
+    while (!atomic_compare_exchange_weak(&metricsShards, &shard->next, shard)) {
+    }
+    localShard = shard;
+    return shard;
+}
+
+static inline void metricsBump(atomic_uint_least64_t *value, uint64_t amount) {
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+void metricsCount(int counter) {
+    metricsAdd(counter, 1);
+}
+
+void metricsAdd(int counter, uint64_t amount) {
+    MetricsShard *shard = metricsLocalShard();
+    if (shard != NULL) {
+        metricsBump(&shard->counters[counter], amount);
+    }
+}
+
+static int metricsBucket(uint64_t value) {
+    if (value < METRICS_SUB_BUCKETS) {
+        return (int)value;
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    int shift = exponent - METRICS_SUB_BITS;
+    return (shift + 1) * METRICS_SUB_BUCKETS + (int)((value >> shift) & (METRICS_SUB_BUCKETS - 1));
+}
+
+static uint64_t metricsBucketLimit(int bucket) {
+    if (bucket < METRICS_SUB_BUCKETS) {
+        return (uint64_t)bucket;
+    }
+    int shift = bucket / METRICS_SUB_BUCKETS - 1;
+    uint64_t low = (uint64_t)(METRICS_SUB_BUCKETS + bucket % METRICS_SUB_BUCKETS) << shift;
+    return low + ((1ULL << shift) - 1);
+}
+
+void metricsRecord(int histogram, uint64_t value) {
+    MetricsShard *shard = metricsLocalShard();
+    if (shard == NULL) {
+        return;
+    }
+    MetricsHistogram *target = &shard->histograms[histogram];
+    metricsBump(&target->buckets[metricsBucket(value)], 1);
+    metricsBump(&target->sum, value);
+    if (value > atomic_load_explicit(&target->max, memory_order_relaxed)) {
+        atomic_store_explicit(&target->max, value, memory_order_relaxed);
+    }
+}
+
+void metricsRecordSince(int histogram, uint64_t start) {
+    metricsRecord(histogram, metricsNow() - start);
+}
+
+static uint64_t metricsPercentile(const uint64_t *buckets, uint64_t count, uint64_t max, double fraction) {
+    uint64_t rank = (uint64_t)(fraction * count + 0.5);
+    uint64_t seen = 0;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank && seen > 0) {
+            uint64_t limit = metricsBucketLimit(i);
+            return limit < max ? limit : max;
+        }
+    }
+    return 0;
+}
+
+size_t metricsFormat(char *buffer, size_t bufferSize) {
+    if (metricsStart == 0) {
+        metricsStart = metricsNow();
+    }
+    size_t length = 0;
+#define METRICS_APPEND(...) \
+    if (length < bufferSize) { \
+        int written = snprintf(buffer + length, bufferSize - length, __VA_ARGS__); \
+        length += written > 0 ? (size_t)written : 0; \
+    }
+
+    METRICS_APPEND("{\n  \"uptime_ns\": %llu,\n  \"counters\": {", (unsigned long long)(metricsNow() - metricsStart));
+    for (int c = 0; c < METRIC_COUNTERS; c++) {
+        uint64_t value = 0;
+        for (MetricsShard *shard = atomic_load(&metricsShards); shard != NULL; shard = shard->next) {
+            value += atomic_load_explicit(&shard->counters[c], memory_order_relaxed);
+        }
+        METRICS_APPEND("%s\n    \"%s\": %llu", c == 0 ? "" : ",", counterNames[c], (unsigned long long)value);
+    }
+
+    METRICS_APPEND("\n  },\n  \"histograms\": {");
+    for (int h = 0; h < METRIC_HISTOGRAMS; h++) {
+        uint64_t buckets[METRICS_BUCKETS] = {0};
+        uint64_t count = 0, sum = 0, max = 0;
+        for (MetricsShard *shard = atomic_load(&metricsShards); shard != NULL; shard = shard->next) {
+            MetricsHistogram *histogram = &shard->histograms[h];
+            for (int i = 0; i < METRICS_BUCKETS; i++) {
+                uint64_t bucket = atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+                buckets[i] += bucket;
+                count += bucket;
+            }
+            sum += atomic_load_explicit(&histogram->sum, memory_order_relaxed);
+            uint64_t shardMax = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+            max = shardMax > max ? shardMax : max;
+        }
+        METRICS_APPEND("%s\n    \"%s\": {\"count\": %llu, \"sum_ns\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, "
+                       "\"p99_ns\": %llu, \"max_ns\": %llu}",
+                       h == 0 ? "" : ",", histogramNames[h], (unsigned long long)count, (unsigned long long)sum,
+                       (unsigned long long)metricsPercentile(buckets, count, max, 0.5),
+                       (unsigned long long)metricsPercentile(buckets, count, max, 0.9),
+                       (unsigned long long)metricsPercentile(buckets, count, max, 0.99), (unsigned long long)max);
+    }
+    METRICS_APPEND("\n  }\n}\n");
+#undef METRICS_APPEND
+    return length < bufferSize ? length : bufferSize - 1;
+}
+
+int metricsDump(const char *path) {
+    char buffer[METRICS_BUFFER_SIZE];
+    size_t length = metricsFormat(buffer, sizeof(buffer));
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        error("Failure writing metrics: %s", path);
+        return 1;
+    }
+    size_t written = fwrite(buffer, 1, length, file);
+    fclose(file);
+    return written != length;
+}
+
+static void metricsServeThread(void *argument) {
+    char buffer[METRICS_BUFFER_SIZE];
+#ifdef _WIN32
+    while (!atomic_load(&metricsStopping)) {
+        HANDLE pipe = CreateNamedPipeA(metricsEndpoint, PIPE_ACCESS_OUTBOUND,
+                                       PIPE_TYPE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                                       1, METRICS_BUFFER_SIZE, 0, 0, NULL);
+        if (pipe == INVALID_HANDLE_VALUE) {
+            error("Failure creating metrics pipe: %ld", GetLastError());
+            return;
+        }
+        if ((ConnectNamedPipe(pipe, NULL) || GetLastError() == ERROR_PIPE_CONNECTED) && !atomic_load(&metricsStopping)) {
+            DWORD written;
+            size_t length = metricsFormat(buffer, sizeof(buffer));
+            WriteFile(pipe, buffer, (DWORD)length, &written, NULL);
+            FlushFileBuffers(pipe);
+        }
+        DisconnectNamedPipe(pipe);
+        CloseHandle(pipe);
+    }
+#else
+    while (!atomic_load(&metricsStopping)) {
+        int client = accept(metricsSocket, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error("Failure accepting metrics client: %s", strerror(errno));
+            return;
+        }
+        if (!atomic_load(&metricsStopping)) {
+            size_t length = metricsFormat(buffer, sizeof(buffer));
+            for (size_t sent = 0; sent < length;) {
+                ssize_t written = send(client, buffer + sent, length - sent, MSG_NOSIGNAL);
+                if (written <= 0) {
+                    break;
+                }
+                sent += (size_t)written;
+            }
+        }
+        close(client);
+    }
+#endif
+}
+
+int metricsServe(const char *endpoint) {
+    if (metricsThread != NULL || strlen(endpoint) >= sizeof(metricsEndpoint)) {
+        return 1;
+    }
+    strcpy(metricsEndpoint, endpoint);
+    if (metricsStart == 0) {
+        metricsStart = metricsNow();
+    }
+
+#ifndef _WIN32
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(endpoint) >= sizeof(address.sun_path)) {
+        error("Metrics socket path too long: %s", endpoint);
+        return 1;
+    }
+    strcpy(address.sun_path, endpoint);
+    unlink(endpoint);
+    metricsSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (metricsSocket < 0 || bind(metricsSocket, (struct sockaddr *)&address, sizeof(address)) != 0
+        || listen(metricsSocket, 4) != 0) {
+        error("Failure creating metrics socket %s: %s", endpoint, strerror(errno));
+        if (metricsSocket >= 0) {
+            close(metricsSocket);
+            metricsSocket = -1;
+        }
+        return 1;
+    }
+#endif
+
+    atomic_store(&metricsStopping, false);
+    metricsThread = threadStart(metricsServeThread, NULL);
+    if (metricsThread == NULL) {
+        error("Failure starting metrics thread");
+#ifndef _WIN32
+        close(metricsSocket);
+        metricsSocket = -1;
+        unlink(endpoint);
+#endif
+        return 1;
+    }
+    return 0;
+}
+
+void metricsStop() {
+    if (metricsThread == NULL) {
+        return;
+    }
+    atomic_store(&metricsStopping, true);
+
+    // The thread blocks waiting for a client, connecting once lets it see the flag.
+#ifdef _WIN32
+    // Between two clients no pipe instance exists, so the connect is retried for a moment.
+    for (int attempt = 0; attempt < METRICS_STOP_ATTEMPTS; attempt++) {
+        HANDLE client = CreateFileA(metricsEndpoint, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, NULL);
+        if (client != INVALID_HANDLE_VALUE) {
+            CloseHandle(client);
+            break;
+        }
+        Sleep(1);
+    }
+#else
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, metricsEndpoint);
+    int client = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (client >= 0) {
+        connect(client, (struct sockaddr *)&address, sizeof(address));
+        close(client);
+    }
+#endif
+    threadJoin(metricsThread);
+    metricsThread = NULL;
+#ifndef _WIN32
+    close(metricsSocket);
+    metricsSocket = -1;
+    unlink(metricsEndpoint);
+#endif
+}
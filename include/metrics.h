@@ -0,0 +1,36 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Counters
+#define METRIC_LOG_MESSAGES 0 // Messages queued by the logger.
+#define METRIC_LOG_DROPPED 1 // Messages dropped because the log ring was full.
+#define METRIC_WALLPAPER_SKIPPED 2 // Applies skipped because the wallpaper was already shown.
+#define METRIC_CYCLE_TRANSITIONS 3 // Changes between DAY and NIGHT.
+#define METRIC_CYCLE_FRAMES 4 // Crossfade frames applied.
+#define METRIC_ANIMATION_RUNS 5 // Tray icon animations started.
+#define METRIC_ANIMATION_FRAMES 6 // Tray icon frames shown.
+#define METRIC_COUNTERS 7
+
+// Latency histograms, values in nanoseconds
+#define METRIC_WALLPAPER_APPLY 0 // Apply of the wallpaper backend, e.g. SystemParametersInfoA().
+#define METRIC_BACKGROUND_SET 1 // setBackground(), including the cache lookup.
+#define METRIC_CONFIG_READ 2 // readConfig(), parse and validation.
+#define METRIC_SCHEDULE_LATENESS 3 // Time a deadline fired after it was due.
+#define METRIC_TRANSITION_RENDER 4 // transitionRender().
+#define METRIC_ANIMATION_FRAME 5 // Creating and showing one tray icon frame.
+#define METRIC_WALLPAPER_PREFETCH 6 // Preparing an upcoming wallpaper ahead of its change.
+#define METRIC_HISTOGRAMS 7
+
+uint64_t metricsNow();
+void metricsCount(int counter);
+void metricsAdd(int counter, uint64_t amount);
+void metricsRecord(int histogram, uint64_t value);
+void metricsRecordSince(int histogram, uint64_t start);
+size_t metricsFormat(char *buffer, size_t bufferSize);
+int metricsDump(const char *path);
+int metricsServe(const char *endpoint);
+void metricsStop();
+#endif // METRICS_H
@@ -0,0 +1,186 @@
+/**
+ * @file playlist.c
+ * @brief Rotation of the images of a folder within the day and night periods.
+ *
+ * Each period is cut into slots of the configured interval, starting with its crossfade window. Slots are
+ * numbered continuously across days, so the same time always shows the same image and nothing has to be
+ * stored: the sequence number of a slot maps to a position of the folder, either in name order or through
+ * a shuffled order of the pass it falls into. Each pass shows every image once, and a pass never starts
+ * with the image the previous pass ended with.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "playlist.h"
+#include "schedule.h"
+
+static const char *playlistOrders[] = {"sequential", "shuffle"};
+
+/**
+ * @brief Returns the slot of a period a point in time falls into.
+ *
+ * After the end of the period the last slot is kept until the period starts again.
+ *
+ * @param options The rotation settings.
+ * @param startHour The hour the period starts.
+ * @param endHour The hour the period ends.
+ * @param window The length of the crossfade window in seconds, the period starts with the window.
+ * @param when The point in time.
+ * @param sequence Receives the number of the slot, counted across days.
+ * @param end Receives the end of the slot, or 0 if the image does not change before the period starts again.
+ * @return Returns 0 on success, or 1 if the local time cannot be computed.
+ */
+int playlistSlot(const PlaylistOptions *options, int startHour, int endHour, int window, time_t when,
+                 long long *sequence, time_t *end);
+
+/**
+ * @brief Maps the number of a slot to the position of its image.
+ *
+ * @param playlist Keeps the shuffled order between calls, zero initialized before the first call.
+ * @param order PLAYLIST_SEQUENTIAL or PLAYLIST_SHUFFLE.
+ * @param sequence The number of the slot.
+ * @param count The number of images, greater than 0.
+ * @return The position from 0 to count - 1. Shuffling falls back to name order if memory runs out.
+ */
+int playlistPosition(Playlist *playlist, int order, long long sequence, int count);
+
+/**
+ * @brief Frees the shuffled order of a playlist.
+ */
+void playlistFree(Playlist *playlist);
+
+/**
+ * @brief Parses an order name ("sequential" or "shuffle").
+ *
+ * @param name The name.
+ * @param order Receives the PLAYLIST_* order.
+ * @return Returns 0 on success, or 1 if the name is unknown.
+ */
+int playlistParseOrder(const char *name, int *order);
+
+/**
+ * @brief Returns the name of an order.
+ */
+const char *playlistOrderName(int order);
+
+/**
+ * @brief Fills the order of a pass with a permutation seeded by the pass number.
+ */
+static void playlistPermute(int *order, int count, long long pass);
+
+/**
+ * @brief Returns the next value of a SplitMix64 generator.
+ */
+static uint64_t playlistRandom(uint64_t *state);
+
+int playlistSlot(const PlaylistOptions *options, int startHour, int endHour, int window, time_t when,
+                 long long *sequence, time_t *end) {
+    // The local day of the start hour numbers the period, which starts half a window earlier.
+    time_t shifted = when + window / 2;
+    struct tm start;
+    if (scheduleLocalTime(shifted, &start) != 0) {
+        return 1;
+    }
+    if (start.tm_hour < startHour) {
+        start.tm_mday--;
+    }
+    start.tm_hour = startHour;
+    start.tm_min = 0;
+    start.tm_sec = 0;
+    start.tm_isdst = -1;
+    time_t periodStart = mktime(&start);
+    if (periodStart == (time_t)-1) {
+        return 1;
+    }
+    periodStart -= window / 2;
+    long long day = start.tm_year * 366LL + start.tm_yday;
+    *end = 0;
+    if (options->interval <= 0) {
+        *sequence = day;
+        return 0;
+    }
+
+    int hours = endHour > startHour ? endHour - startHour : 24 - startHour + endHour;
+    long long slots = (hours * 60LL * 60 + options->interval - 1) / options->interval;
+    long long slot = when > periodStart ? (when - periodStart) / options->interval : 0;
+    if (slot < slots - 1) {
+        *end = periodStart + (time_t)((slot + 1) * options->interval);
+    } else {
+        slot = slots - 1;
+    }
+    *sequence = day * slots + slot;
+    return 0;
+}
+
+int playlistPosition(Playlist *playlist, int order, long long sequence, int count) {
+    long long pass = sequence / count;
+    int slot = (int)(sequence % count);
+    if (slot < 0) {
+        pass--;
+        slot += count;
+    }
+    // Two images alternate in any order.
+    if (order != PLAYLIST_SHUFFLE || count <= 2) {
+        return slot;
+    }
+    if (playlist->order == NULL || playlist->count != count || playlist->pass != pass) {
+        int *grown = realloc(playlist->order, count * sizeof(int));
+        if (grown == NULL) {
+            return slot;
+        }
+        playlist->order = grown;
+        playlist->count = count;
+        playlist->pass = pass;
+
+        // Only the first two images are ever swapped, so the last image of a pass does not depend on the pass before.
+        playlistPermute(grown, count, pass - 1);
+        int previous = grown[count - 1];
+        playlistPermute(grown, count, pass);
+        if (grown[0] == previous) {
+            grown[0] = grown[1];
+            grown[1] = previous;
+        }
+    }
+    return playlist->order[slot];
+}
+
+void playlistFree(Playlist *playlist) {
+    free(playlist->order);
+    memset(playlist, 0, sizeof(Playlist));
+}
+
+int playlistParseOrder(const char *name, int *order) {
+    for (int i = 0; i < (int)(sizeof(playlistOrders) / sizeof(playlistOrders[0])); i++) {
+        if (strcmp(playlistOrders[i], name) == 0) {
+            *order = i;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+const char *playlistOrderName(int order) {
+    return order >= 0 && order < (int)(sizeof(playlistOrders) / sizeof(playlistOrders[0])) ? playlistOrders[order] : "unknown";
+}
+
+static void playlistPermute(int *order, int count, long long pass) {
+    uint64_t state = (uint64_t)pass;
+    for (int i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    for (int i = count - 1; i > 0; i--) {
+        int j = (int)(playlistRandom(&state) % (uint64_t)(i + 1));
+        int swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+}
+
+static uint64_t playlistRandom(uint64_t *state) {
+    uint64_t value = (*state += 0x9e3779b97f4a7c15ULL);
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
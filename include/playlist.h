@@ -0,0 +1,31 @@
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+#include <time.h>
+
+// Orders in which the images of a folder rotate
+#define PLAYLIST_SEQUENTIAL 0 // In name order.
+#define PLAYLIST_SHUFFLE 1 // Every image once per pass, in a new order each pass.
+
+#define PLAYLIST_DEFAULT_LEAD 60 // Default seconds an image is prepared before it is shown.
+
+typedef struct PlaylistOptions {
+    int order; // PLAYLIST_SEQUENTIAL or PLAYLIST_SHUFFLE.
+    int interval; // Seconds each image is shown, 0 shows one image per period.
+    int lead; // Seconds before a change the next image is prepared.
+} PlaylistOptions;
+
+// Shuffled order of one pass, kept between picks
+typedef struct Playlist {
+    int *order; // Positions of the images in the order they are shown.
+    int count; // Number of images of the pass.
+    long long pass; // Number of the pass the order belongs to.
+} Playlist;
+
+int playlistSlot(const PlaylistOptions *options, int startHour, int endHour, int window, time_t when,
+                 long long *sequence, time_t *end);
+int playlistPosition(Playlist *playlist, int order, long long sequence, int count);
+void playlistFree(Playlist *playlist);
+int playlistParseOrder(const char *name, int *order);
+const char *playlistOrderName(int order);
+#endif // PLAYLIST_H
@@ -0,0 +1,823 @@
+/**
+ * @file scale.c
+ * @brief Resampling of wallpapers to the screen with fill, fit, center, stretch and span composition.
+ *
+ * Scaling is separable: a horizontal pass resamples every needed source row into an intermediate image
+ * with the target width, a vertical pass resamples its columns into the target. Both passes use 14-bit
+ * fixed point weights and clamp to bytes, like Pillow, so the SSE2 and AVX2 kernels compute exactly the
+ * same sums as the scalar kernel in a different order and all kernels produce identical output.
+ * Each pass splits its rows across threads.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCALE_X86
+#endif
+
+#include "log.h"
+#include "thread.h"
+#include "scale.h"
+
+#define SCALE_PRECISION 14 // Fraction bits of the weights.
+#define SCALE_ROUND (1 << (SCALE_PRECISION - 1)) // Added before the final shift.
+#define SCALE_MAX_THREADS 16 // Upper bound of threads per pass.
+#define SCALE_MIN_PIXELS_PER_THREAD (128 * 1024) // Smaller passes are not worth another thread.
+#define SCALE_MAX_REDUCTION 8 // Largest denominator asked from the decoder.
+#define SCALE_MIN_BAND_ROWS 8 // Rows decoded per band when the memory budget is too small.
+
+// Weights of one axis, output i reads counts[i] source pixels from starts[i]
+typedef struct ScaleAxis {
+    int count; // Number of outputs.
+    int taps; // Weights stored per output.
+    int *starts; // First source index per output.
+    int *counts; // Used weights per output.
+    int16_t *weights; // count * taps weights, each output sums to 1 << SCALE_PRECISION.
+} ScaleAxis;
+
+// Rows [first, last) of one pass
+typedef struct ScaleJob {
+    void (*function)(struct ScaleJob *); // The pass.
+    const Image *source; // Source of the pass.
+    Image *target; // Target of the pass.
+    const ScaleAxis *axis; // Weights of the pass.
+    int sourceRow; // Source row of row 0 of the pass: the first row read horizontally, or held by the intermediate image.
+    int targetX; // Left edge of the destination rectangle.
+    int targetY; // Top edge of the destination rectangle, or the intermediate row written first.
+    int first; // First row of the job.
+    int last; // Row after the last row of the job.
+} ScaleJob;
+
+// Source region mapped onto the destination rectangle of the target
+typedef struct ScaleRegion {
+    double sourceX; // Left edge of the source region, may be fractional.
+    double sourceY; // Top edge of the source region.
+    double sourceWidth; // Width of the source region.
+    double sourceHeight; // Height of the source region.
+    int x; // Left edge of the destination rectangle.
+    int y; // Top edge of the destination rectangle.
+    int width; // Width of the destination rectangle.
+    int height; // Height of the destination rectangle.
+} ScaleRegion;
+
+typedef void (*ScaleRowKernel)(const unsigned char *source, unsigned char *target, const ScaleAxis *axis);
+typedef void (*ScaleColumnKernel)(const unsigned char *source, size_t stride, unsigned char *target, size_t length,
+                                  const int16_t *weights, int count);
+
+typedef struct ScaleKernelEntry {
+    const char *name; // Name used by scaleSetKernel().
+    ScaleRowKernel row; // Horizontal pass over one row.
+    ScaleColumnKernel column; // Vertical pass producing one row.
+    int (*supported)(); // Whether the CPU can run the kernel.
+} ScaleKernelEntry;
+
+static const char *scaleModes[] = {"fill", "fit", "center", "stretch", "span"}; // Names by SCALE_* mode.
+static const char *scaleFilters[] = {"bilinear", "lanczos3"}; // Names by SCALE_* filter.
+
+/**
+ * @brief Scales an image into the target according to the composition mode.
+ *
+ * @param source The image to scale.
+ * @param target An allocated image of the wanted size, completely overwritten.
+ * @param options Mode, filter, background colour and thread limit.
+ * @return Returns 0 on success, or 1 on invalid sizes or options or if memory runs out.
+ */
+int scaleImage(const Image *source, Image *target, const ScaleOptions *options);
+
+/**
+ * @brief Scales an image while it is decoded, holding only a band of its rows at a time.
+ *
+ * Rows pass the horizontal filter band by band into a sliding window of intermediate rows, every target row is
+ * written once its window is complete. Bands are sized so the target, the decoder and the buffers stay within
+ * options->memory. Large downscales let the decoder reduce first, see imageReaderReduce().
+ *
+ * @param reader An opened reader, no rows read yet. Rows below the used region are not decoded.
+ * @param target An allocated image of the wanted size, completely overwritten.
+ * @param options Mode, filter, background colour, thread limit and memory budget.
+ * @return Returns 0 on success, or 1 on invalid sizes or options, corrupt data or if memory runs out.
+ */
+int scaleReader(ImageReader *reader, Image *target, const ScaleOptions *options);
+
+/**
+ * @brief Parses a composition mode name ("fill", "fit", "center", "stretch" or "span").
+ *
+ * @param name The name.
+ * @param mode Receives the SCALE_* mode.
+ * @return Returns 0 on success, or 1 if the name is unknown.
+ */
+int scaleParseMode(const char *name, int *mode);
+
+/**
+ * @brief Returns the name of a composition mode.
+ */
+const char *scaleModeName(int mode);
+
+/**
+ * @brief Parses a filter name ("bilinear" or "lanczos3").
+ *
+ * @param name The name.
+ * @param filter Receives the SCALE_* filter.
+ * @return Returns 0 on success, or 1 if the name is unknown.
+ */
+int scaleParseFilter(const char *name, int *filter);
+
+/**
+ * @brief Returns the name of a filter.
+ */
+const char *scaleFilterName(int filter);
+
+/**
+ * @brief Forces a scale kernel ("scalar", "sse2" or "avx2").
+ *
+ * @param name The kernel name.
+ * @return Returns 0 on success, or 1 if the kernel is unknown or unsupported by the CPU.
+ */
+int scaleSetKernel(const char *name);
+
+/**
+ * @brief Returns the name of the kernel in use, selecting the best one if none is selected yet.
+ */
+const char *scaleKernelName();
+
+/**
+ * @brief Computes the weights resampling a source range into a number of outputs.
+ *
+ * @param axis Receives the weights, to be released with scaleAxisFree().
+ * @param offset Start of the source range, may be fractional.
+ * @param length Length of the source range.
+ * @param size Number of source pixels, reads are clamped to it.
+ * @param count Number of outputs.
+ * @param filter SCALE_BILINEAR or SCALE_LANCZOS3.
+ * @return Returns 0 on success, or 1 if memory runs out.
+ */
+static int scaleAxisCreate(ScaleAxis *axis, double offset, double length, int size, int count, int filter);
+
+/**
+ * @brief Releases the weights of an axis.
+ */
+static void scaleAxisFree(ScaleAxis *axis);
+
+/**
+ * @brief Runs a pass over rows [first, last), split into jobs on up to threads threads.
+ */
+static void scaleParallel(const ScaleJob *pass, int first, int last, int threads);
+
+/**
+ * @brief Thread entry running one job.
+ */
+static void scaleRunJob(void *argument);
+
+/**
+ * @brief Resamples rows of the source into the intermediate image.
+ */
+static void scaleHorizontalPass(ScaleJob *job);
+
+/**
+ * @brief Resamples columns of the intermediate image into the destination rectangle.
+ */
+static void scaleVerticalPass(ScaleJob *job);
+
+/**
+ * @brief Returns whether the sizes and options can be scaled.
+ */
+static int scaleValid(int sourceWidth, int sourceHeight, const Image *target, const ScaleOptions *options);
+
+/**
+ * @brief Maps the source onto the target according to the composition mode.
+ */
+static void scaleRegion(int sourceWidth, int sourceHeight, const Image *target, int mode, ScaleRegion *region);
+
+/**
+ * @brief Computes the weights of both axes of a region.
+ *
+ * @return Returns 0 on success, or 1 if memory runs out.
+ */
+static int scaleAxesCreate(const ScaleRegion *region, int sourceWidth, int sourceHeight, int filter, ScaleAxis *horizontal,
+                           ScaleAxis *vertical);
+
+/**
+ * @brief Returns the number of threads for a pass over a number of pixels.
+ */
+static int scaleThreads(const ScaleOptions *options, long long pixels);
+
+/**
+ * @brief Returns the power of two a decoder may reduce the source by before scaling it.
+ */
+static int scaleReduction(int sourceWidth, int sourceHeight, const Image *target, int mode);
+
+/**
+ * @brief Fills a rectangle of the target with the background colour.
+ */
+static void scaleFillRect(Image *target, int x, int y, int width, int height, unsigned int background);
+
+/**
+ * @brief Fills the target around the destination rectangle with the background colour.
+ */
+static void scaleFillBorder(Image *target, int x, int y, int width, int height, unsigned int background);
+
+static const ScaleKernelEntry *scaleKernel = NULL; // Kernel in use, NULL until first use.
+
+static double scaleBilinear(double x) {
+    x = fabs(x);
+    return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+static double scaleSinc(double x) {
+    if (x == 0.0) {
+        return 1.0;
+    }
+    x *= M_PI;
+    return sin(x) / x;
+}
+
+static double scaleLanczos3(double x) {
+    return x > -3.0 && x < 3.0 ? scaleSinc(x) * scaleSinc(x / 3.0) : 0.0;
+}
+
+static inline unsigned char scaleClamp(int value) {
+    return value < 0 ? 0 : value > 255 ? 255 : (unsigned char)value;
+}
+
+static int scaleAxisCreate(ScaleAxis *axis, double offset, double length, int size, int count, int filter) {
+    double (*function)(double) = filter == SCALE_LANCZOS3 ? scaleLanczos3 : scaleBilinear;
+    double support = filter == SCALE_LANCZOS3 ? 3.0 : 1.0;
+    double scale = length / count;
+    // Downscaling widens the filter so every source pixel contributes.
+    double filterScale = scale > 1.0 ? scale : 1.0;
+    support *= filterScale;
+
+    axis->count = count;
+    axis->taps = (int)ceil(support) * 2 + 1;
+    axis->starts = malloc(sizeof(int) * count);
+    axis->counts = malloc(sizeof(int) * count);
+    axis->weights = calloc((size_t)count * axis->taps, sizeof(int16_t));
+    double *values = malloc(sizeof(double) * axis->taps);
+    if (axis->starts == NULL || axis->counts == NULL || axis->weights == NULL || values == NULL) {
+        free(values);
+        scaleAxisFree(axis);
+        return 1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        double center = offset + (i + 0.5) * scale;
+        int first = (int)floor(center - support + 0.5);
+        int last = (int)floor(center + support + 0.5);
+        first = first < 0 ? 0 : first;
+        last = last > size ? size : last;
+        if (last - first > axis->taps) {
+            last = first + axis->taps;
+        }
+        if (last <= first) {
+            // The range lies outside of the source, repeat the nearest pixel.
+            first = center < 0 ? 0 : size - 1;
+            last = first + 1;
+        }
+
+        double total = 0.0;
+        for (int k = 0; k < last - first; k++) {
+            values[k] = function((first + k - center + 0.5) / filterScale);
+            total += values[k];
+        }
+        int16_t *weights = axis->weights + (size_t)i * axis->taps;
+        for (int k = 0; k < last - first; k++) {
+            double weight = total != 0.0 ? values[k] / total : 1.0 / (last - first);
+            weights[k] = (int16_t)lround(weight * (1 << SCALE_PRECISION));
+        }
+        axis->starts[i] = first;
+        axis->counts[i] = last - first;
+    }
+    free(values);
+    return 0;
+}
+
+static void scaleAxisFree(ScaleAxis *axis) {
+    free(axis->starts);
+    free(axis->counts);
+    free(axis->weights);
+    axis->starts = axis->counts = NULL;
+    axis->weights = NULL;
+}
+
+static void scaleRowScalar(const unsigned char *source, unsigned char *target, const ScaleAxis *axis) {
+    for (int x = 0; x < axis->count; x++) {
+        const unsigned char *in = source + (size_t)axis->starts[x] * 4;
+        const int16_t *weights = axis->weights + (size_t)x * axis->taps;
+        int sums[4] = {SCALE_ROUND, SCALE_ROUND, SCALE_ROUND, SCALE_ROUND};
+        for (int k = 0; k < axis->counts[x]; k++) {
+            for (int c = 0; c < 4; c++) {
+                sums[c] += in[k * 4 + c] * weights[k];
+            }
+        }
+        for (int c = 0; c < 4; c++) {
+            target[x * 4 + c] = scaleClamp(sums[c] >> SCALE_PRECISION);
+        }
+    }
+}
+
+static void scaleColumnScalar(const unsigned char *source, size_t stride, unsigned char *target, size_t length,
+                              const int16_t *weights, int count) {
+    for (size_t i = 0; i < length; i++) {
+        int sum = SCALE_ROUND;
+        for (int k = 0; k < count; k++) {
+            sum += source[k * stride + i] * weights[k];
+        }
+        target[i] = scaleClamp(sum >> SCALE_PRECISION);
+    }
+}
+
+static int scaleAlways() {
+    return 1;
+}
+
+#ifdef SCALE_X86
+
+/**
+ * @brief Adds the remaining taps of one output pixel in pairs and stores it.
+ *
+ * @param in First source pixel of the tap k.
+ * @param weights Weights of the output pixel.
+ * @param k First tap not yet added.
+ * @param count Number of taps.
+ * @param sum Sums of the four channels so far, including the rounding.
+ * @param out Receives the pixel.
+ */
+__attribute__((target("sse2")))
+static inline void scaleRowTailSse2(const unsigned char *in, const int16_t *weights, int k, int count, __m128i sum,
+                                    unsigned char *out) {
+    const __m128i zero = _mm_setzero_si128();
+    for (; k + 2 <= count; k += 2) {
+        // Interleave two pixels to B0 B1 G0 G1 R0 R1 A0 A1, madd then sums each channel over both taps.
+        __m128i pixels = _mm_loadl_epi64((const __m128i *)(in + k * 4));
+        __m128i pairs = _mm_unpacklo_epi8(_mm_unpacklo_epi8(pixels, _mm_srli_si128(pixels, 4)), zero);
+        int32_t weight;
+        memcpy(&weight, weights + k, sizeof(weight));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(pairs, _mm_set1_epi32(weight)));
+    }
+    if (k < count) {
+        int32_t pixel;
+        memcpy(&pixel, in + k * 4, sizeof(pixel));
+        __m128i single = _mm_unpacklo_epi8(_mm_unpacklo_epi8(_mm_cvtsi32_si128(pixel), zero), zero);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(single, _mm_set1_epi32((uint16_t)weights[k])));
+    }
+    __m128i packed = _mm_packs_epi32(_mm_srai_epi32(sum, SCALE_PRECISION), zero);
+    int32_t result = _mm_cvtsi128_si32(_mm_packus_epi16(packed, zero));
+    memcpy(out, &result, sizeof(result));
+}
+
+__attribute__((target("sse2")))
+static void scaleRowSse2(const unsigned char *source, unsigned char *target, const ScaleAxis *axis) {
+    for (int x = 0; x < axis->count; x++) {
+        scaleRowTailSse2(source + (size_t)axis->starts[x] * 4, axis->weights + (size_t)x * axis->taps, 0,
+                         axis->counts[x], _mm_set1_epi32(SCALE_ROUND), target + x * 4);
+    }
+}
+
+__attribute__((target("avx2")))
+static void scaleRowAvx2(const unsigned char *source, unsigned char *target, const ScaleAxis *axis) {
+    // Spreads two pixels to B0 B1 G0 G1 R0 R1 A0 A1 as 16-bit words, one shuffle per tap pair without crossing lanes.
+    const __m256i interleave = _mm256_setr_epi8(0, -1, 4, -1, 1, -1, 5, -1, 2, -1, 6, -1, 3, -1, 7, -1,
+                                                0, -1, 4, -1, 1, -1, 5, -1, 2, -1, 6, -1, 3, -1, 7, -1);
+    const __m256i round = _mm256_set1_epi32(SCALE_ROUND);
+    int x = 0;
+
+    // Two output pixels per step: the low lane sums pixel x, the high lane pixel x + 1, over their common taps.
+    for (; x + 2 <= axis->count; x += 2) {
+        const unsigned char *in0 = source + (size_t)axis->starts[x] * 4;
+        const unsigned char *in1 = source + (size_t)axis->starts[x + 1] * 4;
+        const int16_t *weights0 = axis->weights + (size_t)x * axis->taps;
+        const int16_t *weights1 = weights0 + axis->taps;
+        int common = axis->counts[x] < axis->counts[x + 1] ? axis->counts[x] : axis->counts[x + 1];
+        __m256i sum = round;
+        int k = 0;
+        for (; k + 2 <= common; k += 2) {
+            __m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadl_epi64((const __m128i *)(in0 + k * 4))),
+                                                     _mm_loadl_epi64((const __m128i *)(in1 + k * 4)), 1);
+            int32_t pair0, pair1;
+            memcpy(&pair0, weights0 + k, sizeof(pair0));
+            memcpy(&pair1, weights1 + k, sizeof(pair1));
+            __m256i weight = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi32(pair0)), _mm_set1_epi32(pair1), 1);
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_shuffle_epi8(pixels, interleave), weight));
+        }
+        scaleRowTailSse2(in0, weights0, k, axis->counts[x], _mm256_castsi256_si128(sum), target + x * 4);
+        scaleRowTailSse2(in1, weights1, k, axis->counts[x + 1], _mm256_extracti128_si256(sum, 1), target + x * 4 + 4);
+    }
+    if (x < axis->count) {
+        scaleRowTailSse2(source + (size_t)axis->starts[x] * 4, axis->weights + (size_t)x * axis->taps, 0,
+                         axis->counts[x], _mm_set1_epi32(SCALE_ROUND), target + x * 4);
+    }
+}
+
+__attribute__((target("sse2")))
+static void scaleColumnSse2(const unsigned char *source, size_t stride, unsigned char *target, size_t length,
+                            const int16_t *weights, int count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(SCALE_ROUND);
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i sum0 = round, sum1 = round, sum2 = round, sum3 = round;
+        for (int k = 0; k < count; k += 2) {
+            // Interleave two rows byte by byte, madd then sums each byte over both rows.
+            __m128i a = _mm_loadu_si128((const __m128i *)(source + k * stride + i));
+            __m128i b = zero;
+            int32_t pair = (uint16_t)weights[k];
+            if (k + 1 < count) {
+                b = _mm_loadu_si128((const __m128i *)(source + (k + 1) * stride + i));
+                memcpy(&pair, weights + k, sizeof(pair));
+            }
+            __m128i weight = _mm_set1_epi32(pair);
+            __m128i low = _mm_unpacklo_epi8(a, b);
+            __m128i high = _mm_unpackhi_epi8(a, b);
+            sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_unpacklo_epi8(low, zero), weight));
+            sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_unpackhi_epi8(low, zero), weight));
+            sum2 = _mm_add_epi32(sum2, _mm_madd_epi16(_mm_unpacklo_epi8(high, zero), weight));
+            sum3 = _mm_add_epi32(sum3, _mm_madd_epi16(_mm_unpackhi_epi8(high, zero), weight));
+        }
+        __m128i first = _mm_packs_epi32(_mm_srai_epi32(sum0, SCALE_PRECISION), _mm_srai_epi32(sum1, SCALE_PRECISION));
+        __m128i second = _mm_packs_epi32(_mm_srai_epi32(sum2, SCALE_PRECISION), _mm_srai_epi32(sum3, SCALE_PRECISION));
+        _mm_storeu_si128((__m128i *)(target + i), _mm_packus_epi16(first, second));
+    }
+    scaleColumnScalar(source + i, stride, target + i, length - i, weights, count);
+}
+
+__attribute__((target("avx2")))
+static void scaleColumnAvx2(const unsigned char *source, size_t stride, unsigned char *target, size_t length,
+                            const int16_t *weights, int count) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i round = _mm256_set1_epi32(SCALE_ROUND);
+    size_t i = 0;
+
+    // Unpack and pack both work per 128-bit lane, so the byte order is preserved.
+    for (; i + 32 <= length; i += 32) {
+        __m256i sum0 = round, sum1 = round, sum2 = round, sum3 = round;
+        for (int k = 0; k < count; k += 2) {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(source + k * stride + i));
+            __m256i b = zero;
+            int32_t pair = (uint16_t)weights[k];
+            if (k + 1 < count) {
+                b = _mm256_loadu_si256((const __m256i *)(source + (k + 1) * stride + i));
+                memcpy(&pair, weights + k, sizeof(pair));
+            }
+            __m256i weight = _mm256_set1_epi32(pair);
+            __m256i low = _mm256_unpacklo_epi8(a, b);
+            __m256i high = _mm256_unpackhi_epi8(a, b);
+            sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(_mm256_unpacklo_epi8(low, zero), weight));
+            sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(_mm256_unpackhi_epi8(low, zero), weight));
+            sum2 = _mm256_add_epi32(sum2, _mm256_madd_epi16(_mm256_unpacklo_epi8(high, zero), weight));
+            sum3 = _mm256_add_epi32(sum3, _mm256_madd_epi16(_mm256_unpackhi_epi8(high, zero), weight));
+        }
+        __m256i first = _mm256_packs_epi32(_mm256_srai_epi32(sum0, SCALE_PRECISION), _mm256_srai_epi32(sum1, SCALE_PRECISION));
+        __m256i second = _mm256_packs_epi32(_mm256_srai_epi32(sum2, SCALE_PRECISION), _mm256_srai_epi32(sum3, SCALE_PRECISION));
+        _mm256_storeu_si256((__m256i *)(target + i), _mm256_packus_epi16(first, second));
+    }
+    scaleColumnSse2(source + i, stride, target + i, length - i, weights, count);
+}
+
+static int scaleHasSse2() {
+    return __builtin_cpu_supports("sse2");
+}
+
+static int scaleHasAvx2() {
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+// Kernels from slowest to fastest.
+static const ScaleKernelEntry scaleKernels[] = {
+    {"scalar", scaleRowScalar, scaleColumnScalar, scaleAlways},
+#ifdef SCALE_X86
+    {"sse2", scaleRowSse2, scaleColumnSse2, scaleHasSse2},
+    {"avx2", scaleRowAvx2, scaleColumnAvx2, scaleHasAvx2},
+#endif
+};
+
+int scaleSetKernel(const char *name) {
+    for (size_t i = 0; i < sizeof(scaleKernels) / sizeof(scaleKernels[0]); i++) {
+        if (strcmp(scaleKernels[i].name, name) == 0 && scaleKernels[i].supported()) {
+            scaleKernel = &scaleKernels[i];
+            return 0;
+        }
+    }
+    return 1;
+}
+
+const char *scaleKernelName() {
+    if (scaleKernel == NULL) {
+#ifdef SCALE_X86
+        __builtin_cpu_init();
+#endif
+        for (size_t i = sizeof(scaleKernels) / sizeof(scaleKernels[0]); i-- > 0;) {
+            if (scaleKernels[i].supported()) {
+                scaleKernel = &scaleKernels[i];
+                break;
+            }
+        }
+    }
+    return scaleKernel->name;
+}
+
+int scaleParseMode(const char *name, int *mode) {
+    for (int i = 0; i < (int)(sizeof(scaleModes) / sizeof(scaleModes[0])); i++) {
+        if (strcmp(scaleModes[i], name) == 0) {
+            *mode = i;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+const char *scaleModeName(int mode) {
+    return mode >= 0 && mode < (int)(sizeof(scaleModes) / sizeof(scaleModes[0])) ? scaleModes[mode] : "unknown";
+}
+
+int scaleParseFilter(const char *name, int *filter) {
+    for (int i = 0; i < (int)(sizeof(scaleFilters) / sizeof(scaleFilters[0])); i++) {
+        if (strcmp(scaleFilters[i], name) == 0) {
+            *filter = i;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+const char *scaleFilterName(int filter) {
+    return filter >= 0 && filter < (int)(sizeof(scaleFilters) / sizeof(scaleFilters[0])) ? scaleFilters[filter] : "unknown";
+}
+
+static void scaleRunJob(void *argument) {
+    ScaleJob *job = argument;
+    job->function(job);
+}
+
+static void scaleParallel(const ScaleJob *pass, int first, int last, int threads) {
+    ScaleJob jobs[SCALE_MAX_THREADS];
+    Thread *workers[SCALE_MAX_THREADS] = {NULL};
+    int rows = last - first;
+    if (rows <= 0) {
+        return;
+    }
+    if (threads > rows) {
+        threads = rows;
+    }
+
+    // The calling thread runs the first job itself.
+    for (int i = 0; i < threads; i++) {
+        jobs[i] = *pass;
+        jobs[i].first = first + (int)((long long)rows * i / threads);
+        jobs[i].last = first + (int)((long long)rows * (i + 1) / threads);
+        if (i > 0 && (workers[i] = threadStart(scaleRunJob, &jobs[i])) == NULL) {
+            scaleRunJob(&jobs[i]);
+        }
+    }
+    scaleRunJob(&jobs[0]);
+    for (int i = 1; i < threads; i++) {
+        if (workers[i] != NULL) {
+            threadJoin(workers[i]);
+        }
+    }
+}
+
+static void scaleHorizontalPass(ScaleJob *job) {
+    for (int y = job->first; y < job->last; y++) {
+        scaleKernel->row(job->source->pixels + (size_t)(job->sourceRow + y) * job->source->stride,
+                         job->target->pixels + (size_t)(job->targetY + y) * job->target->stride, job->axis);
+    }
+}
+
+static void scaleVerticalPass(ScaleJob *job) {
+    const ScaleAxis *axis = job->axis;
+    size_t length = (size_t)job->source->width * 4;
+    for (int y = job->first; y < job->last; y++) {
+        scaleKernel->column(job->source->pixels + (size_t)(axis->starts[y] - job->sourceRow) * job->source->stride,
+                            job->source->stride, job->target->pixels + (size_t)(job->targetY + y) * job->target->stride + (size_t)job->targetX * 4,
+                            length, axis->weights + (size_t)y * axis->taps, axis->counts[y]);
+    }
+}
+
+static void scaleFillRect(Image *target, int x, int y, int width, int height, unsigned int background) {
+    unsigned char pixel[4] = {background & 0xff, (background >> 8) & 0xff, (background >> 16) & 0xff, 255};
+    for (int row = y; row < y + height; row++) {
+        unsigned char *out = target->pixels + (size_t)row * target->stride + (size_t)x * 4;
+        for (int column = 0; column < width; column++) {
+            memcpy(out + column * 4, pixel, 4);
+        }
+    }
+}
+
+static void scaleFillBorder(Image *target, int x, int y, int width, int height, unsigned int background) {
+    scaleFillRect(target, 0, 0, target->width, y, background);
+    scaleFillRect(target, 0, y + height, target->width, target->height - y - height, background);
+    scaleFillRect(target, 0, y, x, height, background);
+    scaleFillRect(target, x + width, y, target->width - x - width, height, background);
+}
+
+static int scaleValid(int sourceWidth, int sourceHeight, const Image *target, const ScaleOptions *options) {
+    return sourceWidth > 0 && sourceHeight > 0 && target->width > 0 && target->height > 0
+        && options->mode >= SCALE_FILL && options->mode <= SCALE_SPAN
+        && (options->filter == SCALE_BILINEAR || options->filter == SCALE_LANCZOS3);
+}
+
+static void scaleRegion(int sourceWidth, int sourceHeight, const Image *target, int mode, ScaleRegion *region) {
+    *region = (ScaleRegion){0, 0, sourceWidth, sourceHeight, 0, 0, target->width, target->height};
+    double scaleX = (double)target->width / sourceWidth;
+    double scaleY = (double)target->height / sourceHeight;
+    if (mode == SCALE_FILL || mode == SCALE_SPAN) {
+        double scale = scaleX > scaleY ? scaleX : scaleY;
+        region->sourceWidth = target->width / scale;
+        region->sourceHeight = target->height / scale;
+        region->sourceX = (sourceWidth - region->sourceWidth) / 2.0;
+        region->sourceY = (sourceHeight - region->sourceHeight) / 2.0;
+    } else if (mode == SCALE_FIT) {
+        double scale = scaleX < scaleY ? scaleX : scaleY;
+        int width = (int)lround(sourceWidth * scale);
+        int height = (int)lround(sourceHeight * scale);
+        region->width = width < 1 ? 1 : width > target->width ? target->width : width;
+        region->height = height < 1 ? 1 : height > target->height ? target->height : height;
+        region->x = (target->width - region->width) / 2;
+        region->y = (target->height - region->height) / 2;
+    } else if (mode == SCALE_CENTER) {
+        // Pixels are copied one to one, the region has whole pixel edges.
+        region->width = sourceWidth < target->width ? sourceWidth : target->width;
+        region->height = sourceHeight < target->height ? sourceHeight : target->height;
+        region->x = (target->width - region->width) / 2;
+        region->y = (target->height - region->height) / 2;
+        region->sourceX = (sourceWidth - region->width) / 2;
+        region->sourceY = (sourceHeight - region->height) / 2;
+        region->sourceWidth = region->width;
+        region->sourceHeight = region->height;
+    }
+}
+
+static int scaleAxesCreate(const ScaleRegion *region, int sourceWidth, int sourceHeight, int filter, ScaleAxis *horizontal,
+                           ScaleAxis *vertical) {
+    if (scaleAxisCreate(horizontal, region->sourceX, region->sourceWidth, sourceWidth, region->width, filter) != 0) {
+        return 1;
+    }
+    if (scaleAxisCreate(vertical, region->sourceY, region->sourceHeight, sourceHeight, region->height, filter) != 0) {
+        scaleAxisFree(horizontal);
+        return 1;
+    }
+    return 0;
+}
+
+static int scaleThreads(const ScaleOptions *options, long long pixels) {
+    int threads = options->threads > 0 ? options->threads : threadCpuCount();
+    if (threads > pixels / SCALE_MIN_PIXELS_PER_THREAD) {
+        threads = (int)(pixels / SCALE_MIN_PIXELS_PER_THREAD);
+    }
+    return threads < 1 ? 1 : threads > SCALE_MAX_THREADS ? SCALE_MAX_THREADS : threads;
+}
+
+static int scaleReduction(int sourceWidth, int sourceHeight, const Image *target, int mode) {
+    double scaleX = (double)target->width / sourceWidth;
+    double scaleY = (double)target->height / sourceHeight;
+    double scale = mode == SCALE_FIT ? (scaleX < scaleY ? scaleX : scaleY) : (scaleX > scaleY ? scaleX : scaleY);
+    int denominator = 1;
+    // At least a 2:1 reduction is left to the filter, which antialiases better than the reduced IDCT.
+    while (mode != SCALE_CENTER && denominator < SCALE_MAX_REDUCTION && scale * denominator * 4 <= 1.0) {
+        denominator *= 2;
+    }
+    return denominator;
+}
+
+int scaleImage(const Image *source, Image *target, const ScaleOptions *options) {
+    if (!scaleValid(source->width, source->height, target, options)) {
+        return 1;
+    }
+    scaleKernelName();
+
+    ScaleRegion region;
+    scaleRegion(source->width, source->height, target, options->mode, &region);
+    scaleFillBorder(target, region.x, region.y, region.width, region.height, options->background);
+    if (options->mode == SCALE_CENTER) {
+        for (int row = 0; row < region.height; row++) {
+            memcpy(target->pixels + (size_t)(region.y + row) * target->stride + (size_t)region.x * 4,
+                   source->pixels + (size_t)((int)region.sourceY + row) * source->stride + (size_t)region.sourceX * 4,
+                   (size_t)region.width * 4);
+        }
+        return 0;
+    }
+
+    ScaleAxis horizontal, vertical;
+    if (scaleAxesCreate(&region, source->width, source->height, options->filter, &horizontal, &vertical) != 0) {
+        return 1;
+    }
+
+    // Only the source rows read by the vertical pass are resampled horizontally.
+    int firstRow = vertical.starts[0];
+    int lastRow = vertical.starts[region.height - 1] + vertical.counts[region.height - 1];
+    Image intermediate;
+    if (imageCreate(&intermediate, region.width, lastRow - firstRow) != 0) {
+        scaleAxisFree(&horizontal);
+        scaleAxisFree(&vertical);
+        return 1;
+    }
+
+    int threads = scaleThreads(options, (long long)region.width * (lastRow - firstRow + region.height));
+    ScaleJob pass = {scaleHorizontalPass, source, &intermediate, &horizontal, firstRow, 0, 0, 0, 0};
+    scaleParallel(&pass, 0, intermediate.height, threads);
+    pass = (ScaleJob){scaleVerticalPass, &intermediate, target, &vertical, firstRow, region.x, region.y, 0, 0};
+    scaleParallel(&pass, 0, region.height, threads);
+
+    imageFree(&intermediate);
+    scaleAxisFree(&horizontal);
+    scaleAxisFree(&vertical);
+    return 0;
+}
+
+int scaleReader(ImageReader *reader, Image *target, const ScaleOptions *options) {
+    if (!scaleValid(reader->width, reader->height, target, options)) {
+        return 1;
+    }
+    scaleKernelName();
+    imageReaderReduce(reader, scaleReduction(reader->width, reader->height, target, options->mode));
+
+    ScaleRegion region;
+    scaleRegion(reader->width, reader->height, target, options->mode, &region);
+    scaleFillBorder(target, region.x, region.y, region.width, region.height, options->background);
+    ScaleAxis horizontal = {0}, vertical = {0};
+    int center = options->mode == SCALE_CENTER;
+    if (!center && scaleAxesCreate(&region, reader->width, reader->height, options->filter, &horizontal, &vertical) != 0) {
+        return 1;
+    }
+
+    // Source rows [firstRow, lastRow) are used, the intermediate rows of one target row fit in a window.
+    int firstRow = center ? (int)region.sourceY : vertical.starts[0];
+    int lastRow = center ? firstRow + region.height : vertical.starts[region.height - 1] + vertical.counts[region.height - 1];
+    int window = center ? 0 : vertical.taps;
+
+    // The budget covers the target, the decoder state, a band of source rows and its intermediate rows.
+    size_t sourceRowSize = (size_t)reader->width * 4;
+    size_t intermediateRowSize = center ? 0 : (size_t)region.width * 4;
+    size_t fixed = (size_t)target->stride * target->height + reader->retained + window * intermediateRowSize;
+    size_t bandRows = lastRow - firstRow;
+    if (options->memory != 0) {
+        size_t rows = options->memory > fixed ? (options->memory - fixed) / (sourceRowSize + intermediateRowSize) : 0;
+        if (rows < SCALE_MIN_BAND_ROWS) {
+            info("Scaling %dx%d to %dx%d exceeds the memory budget of %zu MB", reader->width, reader->height,
+                 target->width, target->height, options->memory >> 20);
+            rows = SCALE_MIN_BAND_ROWS;
+        }
+        bandRows = rows < bandRows ? rows : bandRows;
+    }
+
+    Image band = {0}, intermediate = {0};
+    int failed = imageCreate(&band, reader->width, (int)bandRows) != 0
+        || (!center && imageCreate(&intermediate, region.width, window + (int)bandRows) != 0);
+    int bufferFirst = firstRow; // Source row held by the first intermediate row.
+    int filled = firstRow; // Source row after the last intermediate row.
+    int next = 0; // Next target row.
+    while (!failed && reader->row < lastRow) {
+        int bandFirst = reader->row;
+        int rows = lastRow - bandFirst < (int)bandRows ? lastRow - bandFirst : (int)bandRows;
+        if (imageReaderRead(reader, band.pixels, band.stride, rows) != 0) {
+            failed = 1;
+            break;
+        }
+        int useful = bandFirst < firstRow ? firstRow : bandFirst;
+        int end = bandFirst + rows;
+        if (end <= useful) {
+            continue;
+        }
+
+        if (center) {
+            for (int row = useful; row < end; row++) {
+                memcpy(target->pixels + (size_t)(region.y + row - firstRow) * target->stride + (size_t)region.x * 4,
+                       band.pixels + (size_t)(row - bandFirst) * band.stride + (size_t)region.sourceX * 4,
+                       (size_t)region.width * 4);
+            }
+            next = end - firstRow;
+            continue;
+        }
+
+        // Rows no pending target row reads are dropped, less than a window is left, so the band fits behind it.
+        if (filled + (end - useful) - bufferFirst > intermediate.height) {
+            int keep = vertical.starts[next] < filled ? vertical.starts[next] : filled;
+            memmove(intermediate.pixels, intermediate.pixels + (size_t)(keep - bufferFirst) * intermediate.stride,
+                    (size_t)(filled - keep) * intermediate.stride);
+            bufferFirst = keep;
+        }
+        int ready = next;
+        while (ready < region.height && vertical.starts[ready] + vertical.counts[ready] <= end) {
+            ready++;
+        }
+
+        int threads = scaleThreads(options, (long long)region.width * (end - useful + ready - next));
+        ScaleJob pass = {scaleHorizontalPass, &band, &intermediate, &horizontal, useful - bandFirst, 0, filled - bufferFirst, 0, 0};
+        scaleParallel(&pass, 0, end - useful, threads);
+        filled = end;
+        pass = (ScaleJob){scaleVerticalPass, &intermediate, target, &vertical, bufferFirst, region.x, region.y, 0, 0};
+        scaleParallel(&pass, next, ready, threads);
+        next = ready;
+    }
+
+    imageFree(&band);
+    imageFree(&intermediate);
+    scaleAxisFree(&horizontal);
+    scaleAxisFree(&vertical);
+    return failed || next != region.height;
+}
@@ -0,0 +1,35 @@
+#ifndef SCALE_H
+#define SCALE_H
+
+#include "image.h"
+
+// Composition modes
+#define SCALE_FILL 0 // Cover the target, cropping the overflow evenly.
+#define SCALE_FIT 1 // Show the whole image, the bars are filled with the background colour.
+#define SCALE_CENTER 2 // Unscaled and centered, cropped or surrounded by the background colour.
+#define SCALE_STRETCH 3 // Cover the target, ignoring the aspect ratio.
+#define SCALE_SPAN 4 // Like SCALE_FILL, but the target is the desktop across all monitors.
+
+// Resampling filters
+#define SCALE_BILINEAR 0 // Triangle filter, support 1.
+#define SCALE_LANCZOS3 1 // Windowed sinc, support 3, sharper when downscaling.
+
+#define SCALE_DEFAULT_MEMORY ((size_t)64 << 20) // Default working memory budget of scaleReader().
+
+typedef struct ScaleOptions {
+    int mode; // One of the SCALE_* modes.
+    int filter; // SCALE_BILINEAR or SCALE_LANCZOS3.
+    unsigned int background; // Colour of uncovered areas as 0xRRGGBB.
+    int threads; // Maximum number of threads, 0 for one per processor.
+    size_t memory; // Working memory budget of scaleReader() in bytes, 0 for no limit.
+} ScaleOptions;
+
+int scaleImage(const Image *source, Image *target, const ScaleOptions *options);
+int scaleReader(ImageReader *reader, Image *target, const ScaleOptions *options);
+int scaleParseMode(const char *name, int *mode);
+const char *scaleModeName(int mode);
+int scaleParseFilter(const char *name, int *filter);
+const char *scaleFilterName(int filter);
+int scaleSetKernel(const char *name);
+const char *scaleKernelName();
+#endif // SCALE_H
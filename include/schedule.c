@@ -0,0 +1,425 @@
+/**
+ * @file schedule.c
+ * @brief Deadline based scheduling for the day/night transitions.
+ *
+ * Instead of polling the clock, the worker thread computes the next instant at which the
+ * background state can change and blocks until then. The wait can be cut short by
+ * scheduleWake(), which is used for shutdown and settings changes.
+ *
+ * The decisions only depend on the time passed in, which comes from a Clock. systemClock reads
+ * the real time, the headless simulation passes a simulated one.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
+#include "log.h"
+#include "metrics.h"
+#include "schedule.h"
+
+// Seconds between 1601-01-01 (FILETIME epoch) and 1970-01-01 (time_t epoch).
+#define FILETIME_UNIX_OFFSET 11644473600LL
+#define FILETIME_TICKS_PER_SECOND 10000000LL
+
+#ifdef _WIN32
+static HANDLE scheduleTimer = NULL; // Waitable timer armed with the next deadline.
+static HANDLE wakeEvent = NULL; // Auto-reset event used to interrupt a wait.
+static VOID (WINAPI *scheduleSystemTime)(LPFILETIME) = NULL; // Precise system time from Windows 8 on, looked up on first use.
+#else
+static int timerFd = -1; // timerfd armed with the next deadline.
+static int wakeFd = -1; // eventfd used to interrupt a wait.
+#endif
+
+/**
+ * @brief Reads the real time, the now function of systemClock.
+ */
+static time_t systemClockNow(void *context);
+
+const Clock systemClock = {systemClockNow, NULL}; // Clock reading the real time.
+
+/**
+ * @brief Creates the timer and wake objects used by scheduleWaitUntil().
+ *
+ * @return Returns 0 on success, or 1 if the objects could not be created.
+ */
+int scheduleInit();
+
+/**
+ * @brief Releases the timer and wake objects.
+ */
+void scheduleCleanup();
+
+/**
+ * @brief Returns the current time of a clock.
+ *
+ * @param clock The clock, NULL for systemClock.
+ */
+time_t clockNow(const Clock *clock);
+
+/**
+ * @brief Computes the background state at a point in time.
+ *
+ * It is DAY from the full hour fromTime up to toTime in local time and NIGHT otherwise.
+ *
+ * @param fromTime Hour at which the day background starts.
+ * @param toTime Hour at which the night background starts.
+ * @param now The point in time.
+ * @param state Receives DAY or NIGHT.
+ * @return Returns 0 on success, or 1 if the times are invalid.
+ */
+int backgroundStateAt(int fromTime, int toTime, time_t now, int *state);
+
+/**
+ * @brief Computes the next instant at which the background state can change.
+ *
+ * The candidates are the full hours fromTime and toTime of today and tomorrow in local time.
+ * mktime() resolves them, so DST shifts are taken into account.
+ *
+ * @param fromTime Hour at which the day background starts.
+ * @param toTime Hour at which the night background starts.
+ * @param now The current time.
+ * @param next Receives the earliest transition strictly after now.
+ * @return Returns 0 on success, or 1 if the times are invalid.
+ */
+int nextTransitionTime(int fromTime, int toTime, time_t now, time_t *next);
+
+/**
+ * @brief Computes the next transition like nextTransitionTime() and which of the two hours it belongs to.
+ *
+ * If both hours resolve to the same instant, e.g. when a DST shift skips the hours between them,
+ * toTime wins, since its background is the one shown afterwards.
+ *
+ * @param fromTime Hour at which the day background starts.
+ * @param toTime Hour at which the night background starts.
+ * @param now The current time.
+ * @param next Receives the earliest transition strictly after now.
+ * @param toNight Receives non-zero if the transition is the one scheduled at toTime.
+ * @return Returns 0 on success, or 1 if the times are invalid.
+ */
+static int nextTransition(int fromTime, int toTime, time_t now, time_t *next, int *toNight);
+
+/**
+ * @brief Converts a time to local time, thread safe unlike localtime().
+ *
+ * @param time The point in time.
+ * @param local Receives the local time.
+ * @return Returns 0 on success, or 1 if the time cannot be represented.
+ */
+int scheduleLocalTime(time_t time, struct tm *local);
+
+/**
+ * @brief Blocks the calling thread until the deadline passes or scheduleWake() is called.
+ *
+ * @param deadline The absolute time to wait for.
+ * @return SCHEDULE_TIMEOUT if the deadline passed, SCHEDULE_WOKEN if the wait was interrupted,
+ *         or SCHEDULE_ERROR on failure.
+ */
+int scheduleWaitUntil(time_t deadline);
+
+/**
+ * @brief Computes the crossfade frame shown at a point in time.
+ *
+ * A window of window seconds is centered on every FROM/TO instant and split into frames + 1 equal
+ * parts. Part k shows the blend of source and target with weight k / (frames + 1).
+ *
+ * @param fromTime Hour at which the day background starts.
+ * @param toTime Hour at which the night background starts.
+ * @param frames Number of blended frames per transition, 0 disables transitions.
+ * @param window Length of the transition window in seconds.
+ * @param now The current time.
+ * @param step Receives the frame and the time of the next frame. If no window is active, next is the
+ *             time of the first frame of the next window.
+ * @return Returns 0 on success, or 1 if the times are invalid.
+ */
+int transitionPlan(int fromTime, int toTime, int frames, int window, time_t now, TransitionStep *step);
+
+/**
+ * @brief Interrupts a pending or the next call to scheduleWaitUntil().
+ *
+ * @return Returns 0 on success, or 1 on failure.
+ */
+int scheduleWake();
+
+/**
+ * @brief Records how late a deadline fired in the METRIC_SCHEDULE_LATENESS histogram.
+ */
+static void scheduleRecordLateness(time_t deadline);
+
+/**
+ * @brief Returns the start of part k of a transition window, rounded up to full seconds.
+ */
+static time_t transitionPartStart(time_t start, int frames, int window, int k);
+
+static time_t systemClockNow(void *context) {
+    return time(NULL);
+}
+
+int scheduleInit() {
+#ifdef _WIN32
+    scheduleTimer = CreateWaitableTimer(NULL, TRUE, NULL);
+    wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (scheduleTimer == NULL || wakeEvent == NULL) {
+        error("Failure creating schedule timer: %ld", GetLastError());
+        scheduleCleanup();
+        return 1;
+    }
+#else
+    timerFd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (timerFd < 0 || wakeFd < 0) {
+        error("Failure creating schedule timer: %s", strerror(errno));
+        scheduleCleanup();
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+void scheduleCleanup() {
+#ifdef _WIN32
+    if (scheduleTimer != NULL) {
+        CloseHandle(scheduleTimer);
+        scheduleTimer = NULL;
+    }
+    if (wakeEvent != NULL) {
+        CloseHandle(wakeEvent);
+        wakeEvent = NULL;
+    }
+#else
+    if (timerFd >= 0) {
+        close(timerFd);
+        timerFd = -1;
+    }
+    if (wakeFd >= 0) {
+        close(wakeFd);
+        wakeFd = -1;
+    }
+#endif
+}
+
+time_t clockNow(const Clock *clock) {
+    if (clock == NULL) {
+        clock = &systemClock;
+    }
+    return clock->now(clock->context);
+}
+
+int scheduleLocalTime(time_t time, struct tm *local) {
+#ifdef _WIN32
+    return localtime_s(local, &time) != 0;
+#else
+    return localtime_r(&time, local) == NULL;
+#endif
+}
+
+int backgroundStateAt(int fromTime, int toTime, time_t now, int *state) {
+    if (fromTime < 0 || toTime >= 24 || fromTime >= toTime) {
+        error("Invalid time");
+        return 1;
+    }
+    struct tm local;
+    if (scheduleLocalTime(now, &local) != 0) {
+        error("Failure converting %lld to local time", (long long)now);
+        return 1;
+    }
+    *state = local.tm_hour >= fromTime && local.tm_hour < toTime ? DAY : NIGHT;
+    return 0;
+}
+
+int nextTransitionTime(int fromTime, int toTime, time_t now, time_t *next) {
+    int toNight;
+    return nextTransition(fromTime, toTime, now, next, &toNight);
+}
+
+static int nextTransition(int fromTime, int toTime, time_t now, time_t *next, int *toNight) {
+    if (fromTime < 0 || toTime < 0 || fromTime >= 24 || toTime >= 24) {
+        error("Invalid transition times: %d - %d", fromTime, toTime);
+        return 1;
+    }
+
+    struct tm today;
+    if (scheduleLocalTime(now, &today) != 0) {
+        error("Failure converting %lld to local time", (long long)now);
+        return 1;
+    }
+    int hours[] = {fromTime, toTime};
+    time_t best = 0;
+    int bestIndex = 0;
+
+    for (int day = 0; day < 2; day++) {
+        for (int i = 0; i < sizeof(hours) / sizeof(hours[0]); i++) {
+            struct tm candidate = today;
+            candidate.tm_mday += day;
+            candidate.tm_hour = hours[i];
+            candidate.tm_min = 0;
+            candidate.tm_sec = 0;
+            candidate.tm_isdst = -1;
+
+            time_t candidateTime = mktime(&candidate);
+            if (candidateTime == (time_t)-1) {
+                continue;
+            }
+            // In the hour repeated when DST ends, mktime() may pick the second instance; the state changes at the first.
+            struct tm earlier;
+            if (scheduleLocalTime(candidateTime - 3600, &earlier) == 0 && earlier.tm_hour == hours[i] && earlier.tm_min == 0
+                && earlier.tm_sec == 0) {
+                candidateTime -= 3600;
+            }
+            if (candidateTime <= now) {
+                continue;
+            }
+            // Candidates are visited in order, so toTime wins a tie with fromTime of the same day.
+            if (best == 0 || candidateTime <= best) {
+                best = candidateTime;
+                bestIndex = i;
+            }
+        }
+    }
+
+    if (best == 0) {
+        error("Failure computing next transition");
+        return 1;
+    }
+    *next = best;
+    *toNight = bestIndex == 1;
+    return 0;
+}
+
+int scheduleWaitUntil(time_t deadline) {
+#ifdef _WIN32
+    LARGE_INTEGER dueTime;
+    dueTime.QuadPart = ((LONGLONG)deadline + FILETIME_UNIX_OFFSET) * FILETIME_TICKS_PER_SECOND;
+    if (!SetWaitableTimer(scheduleTimer, &dueTime, 0, NULL, NULL, FALSE)) {
+        error("Failure arming schedule timer: %ld", GetLastError());
+        return SCHEDULE_ERROR;
+    }
+
+    HANDLE handles[] = {wakeEvent, scheduleTimer};
+    DWORD result = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+    CancelWaitableTimer(scheduleTimer);
+
+    if (result == WAIT_OBJECT_0) {
+        return SCHEDULE_WOKEN;
+    } else if (result == WAIT_OBJECT_0 + 1) {
+        scheduleRecordLateness(deadline);
+        return SCHEDULE_TIMEOUT;
+    }
+    error("Failure waiting for schedule timer: %ld", GetLastError());
+    return SCHEDULE_ERROR;
+#else
+    // TFD_TIMER_CANCEL_ON_SET makes a clock change end the wait, so the deadline is recomputed.
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = deadline;
+    if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, NULL) != 0) {
+        error("Failure arming schedule timer: %s", strerror(errno));
+        return SCHEDULE_ERROR;
+    }
+
+    struct pollfd fds[] = {
+        {.fd = wakeFd, .events = POLLIN},
+        {.fd = timerFd, .events = POLLIN},
+    };
+    while (poll(fds, 2, -1) < 0) {
+        if (errno != EINTR) {
+            error("Failure waiting for schedule timer: %s", strerror(errno));
+            return SCHEDULE_ERROR;
+        }
+    }
+
+    uint64_t counter;
+    if (fds[0].revents & POLLIN) {
+        while (read(wakeFd, &counter, sizeof(counter)) > 0) {
+        }
+        return SCHEDULE_WOKEN;
+    }
+    if (read(timerFd, &counter, sizeof(counter)) < 0 && errno == ECANCELED) {
+        return SCHEDULE_WOKEN;
+    }
+    scheduleRecordLateness(deadline);
+    return SCHEDULE_TIMEOUT;
+#endif
+}
+
+static void scheduleRecordLateness(time_t deadline) {
+    long long now; // Nanoseconds since 1970-01-01.
+#ifdef _WIN32
+    // GetSystemTimePreciseAsFileTime() is not imported, so the binary still loads on Windows 7.
+    if (scheduleSystemTime == NULL) {
+        FARPROC precise = GetProcAddress(GetModuleHandleA("kernel32.dll"), "GetSystemTimePreciseAsFileTime");
+        scheduleSystemTime = precise != NULL ? (VOID (WINAPI *)(LPFILETIME))precise : GetSystemTimeAsFileTime;
+    }
+    FILETIME fileTime;
+    scheduleSystemTime(&fileTime);
+    ULARGE_INTEGER ticks = {.LowPart = fileTime.dwLowDateTime, .HighPart = fileTime.dwHighDateTime};
+    now = ((long long)ticks.QuadPart - FILETIME_UNIX_OFFSET * FILETIME_TICKS_PER_SECOND) * 100;
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_REALTIME, &time);
+    now = (long long)time.tv_sec * 1000000000LL + time.tv_nsec;
+#endif
+    long long lateness = now - (long long)deadline * 1000000000LL;
+    metricsRecord(METRIC_SCHEDULE_LATENESS, lateness > 0 ? (uint64_t)lateness : 0);
+}
+
+static time_t transitionPartStart(time_t start, int frames, int window, int k) {
+    long long offset = (long long)k * window;
+    return start + (time_t)((offset + frames) / (frames + 1));
+}
+
+int transitionPlan(int fromTime, int toTime, int frames, int window, time_t now, TransitionStep *step) {
+    memset(step, 0, sizeof(*step));
+    if (frames <= 0 || window <= 0) {
+        step->next = 0;
+        return 0;
+    }
+
+    // The first transition whose window has not ended yet.
+    time_t transition;
+    if (nextTransition(fromTime, toTime, now - window / 2, &transition, &step->toNight) != 0) {
+        return 1;
+    }
+    time_t start = transition - window / 2;
+    step->frames = frames;
+
+    if (now < start) {
+        step->next = transitionPartStart(start, frames, window, 1);
+        return 0;
+    }
+
+    long long elapsed = (long long)(now - start);
+    int frame = (int)(elapsed * (frames + 1) / window);
+    if (frame > frames) {
+        frame = frames;
+    }
+    step->active = 1;
+    step->frame = frame;
+    step->frames = frames;
+    step->next = transitionPartStart(start, frames, window, frame + 1);
+    return 0;
+}
+
+int scheduleWake() {
+#ifdef _WIN32
+    if (wakeEvent == NULL || !SetEvent(wakeEvent)) {
+        return 1;
+    }
+#else
+    uint64_t one = 1;
+    if (wakeFd < 0 || write(wakeFd, &one, sizeof(one)) != sizeof(one)) {
+        return 1;
+    }
+#endif
+    return 0;
+}
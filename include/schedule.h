@@ -0,0 +1,41 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <time.h>
+
+// Results of scheduleWaitUntil
+#define SCHEDULE_ERROR -1
+#define SCHEDULE_TIMEOUT 0
+#define SCHEDULE_WOKEN 1
+
+// Background states
+#define DAY 0
+#define NIGHT 1
+
+// Source of the current time, replaceable for simulations
+typedef struct Clock {
+    time_t (*now)(void *context); // Returns the current time.
+    void *context; // Passed to now.
+} Clock;
+
+// Crossfade position at a point in time
+typedef struct TransitionStep {
+    int active; // Non-zero while inside a transition window.
+    int toNight; // Non-zero if the window fades from day to night.
+    int frame; // Current frame, 0 shows the source image and frames + 1 the target.
+    int frames; // Number of blended frames of the window.
+    time_t next; // Time at which the step changes next.
+} TransitionStep;
+
+extern const Clock systemClock;
+
+int scheduleInit();
+void scheduleCleanup();
+time_t clockNow(const Clock *clock);
+int scheduleLocalTime(time_t time, struct tm *local);
+int backgroundStateAt(int fromTime, int toTime, time_t now, int *state);
+int nextTransitionTime(int fromTime, int toTime, time_t now, time_t *next);
+int transitionPlan(int fromTime, int toTime, int frames, int window, time_t now, TransitionStep *step);
+int scheduleWaitUntil(time_t deadline);
+int scheduleWake();
+#endif // SCHEDULE_H
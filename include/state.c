@@ -0,0 +1,208 @@
+/**
+ * @file state.c
+ * @brief Runtime state kept in a small memory-mapped file, separate from the user settings in config.ini.
+ *
+ * The file holds one fixed-layout StateData record. Setters change the mapped record only if a value
+ * actually changes, then update the checksum and schedule the page for write back. A record with a wrong
+ * magic, version, size or checksum, e.g. after a torn write, is replaced by defaults: the background state
+ * is recomputed from the clock anyway and a lost fingerprint only costs one wallpaper apply.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "log.h"
+#include "trace.h"
+#include "state.h"
+
+#ifdef _WIN32
+static HANDLE stateFile = INVALID_HANDLE_VALUE; // Open state file.
+static HANDLE stateMapping = NULL; // File mapping of the state file.
+#else
+static int stateFd = -1; // Open state file.
+#endif
+static StateData *state = NULL; // Mapped state record, NULL if not open.
+
+/**
+ * @brief Opens and maps the state file, creating or resetting it if it is missing or invalid.
+ *
+ * @param statePath The path to the state file.
+ * @return Returns 0 on success, or 1 if the file cannot be created or mapped.
+ */
+int stateOpen(const char *statePath);
+
+/**
+ * @brief Writes back and unmaps the state file.
+ */
+void stateClose();
+
+/**
+ * @brief Returns the mapped state record, or NULL if the state file is not open.
+ */
+const StateData *stateGet();
+
+/**
+ * @brief Records the background state. Nothing is written if the state did not change.
+ *
+ * @param backgroundState DAY or NIGHT.
+ * @param transitionTime The time of the change.
+ * @return Returns 0 on success, or 1 if the state file is not open.
+ */
+int stateSetBackground(int backgroundState, time_t transitionTime);
+
+/**
+ * @brief Records the fingerprint of the wallpaper applied last. Nothing is written if it did not change.
+ *
+ * @param fingerprint The fingerprint, truncated to STATE_FINGERPRINT_SIZE - 1 characters.
+ * @return Returns 0 on success, or 1 if the state file is not open.
+ */
+int stateSetFingerprint(const char *fingerprint);
+
+/**
+ * @brief Computes the checksum of a state record.
+ */
+static uint32_t stateChecksum(const StateData *data);
+
+/**
+ * @brief Updates the checksum and schedules the mapped page for write back.
+ */
+static void stateCommit();
+
+static uint32_t stateChecksum(const StateData *data) {
+    const unsigned char *bytes = (const unsigned char *)data + offsetof(StateData, backgroundState);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(StateData) - offsetof(StateData, backgroundState); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void stateCommit() {
+    TRACE_SCOPE("stateCommit");
+    state->checksum = stateChecksum(state);
+#ifdef _WIN32
+    FlushViewOfFile(state, sizeof(StateData));
+#else
+    msync(state, sizeof(StateData), MS_ASYNC);
+#endif
+}
+
+int stateOpen(const char *statePath) {
+    if (state != NULL) {
+        return 0;
+    }
+
+#ifdef _WIN32
+    stateFile = CreateFileA(statePath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (stateFile == INVALID_HANDLE_VALUE) {
+        error("Failure opening state file %s: %ld", statePath, GetLastError());
+        return 1;
+    }
+    // Mapping with a size grows a shorter file.
+    stateMapping = CreateFileMappingA(stateFile, NULL, PAGE_READWRITE, 0, sizeof(StateData), NULL);
+    state = stateMapping != NULL ? MapViewOfFile(stateMapping, FILE_MAP_WRITE, 0, 0, sizeof(StateData)) : NULL;
+    if (state == NULL) {
+        error("Failure mapping state file %s: %ld", statePath, GetLastError());
+        stateClose();
+        return 1;
+    }
+#else
+    stateFd = open(statePath, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (stateFd < 0) {
+        error("Failure opening state file %s: %s", statePath, strerror(errno));
+        return 1;
+    }
+    off_t size = lseek(stateFd, 0, SEEK_END);
+    if (size < (off_t)sizeof(StateData) && ftruncate(stateFd, sizeof(StateData)) != 0) {
+        error("Failure resizing state file %s: %s", statePath, strerror(errno));
+        stateClose();
+        return 1;
+    }
+    void *mapping = mmap(NULL, sizeof(StateData), PROT_READ | PROT_WRITE, MAP_SHARED, stateFd, 0);
+    if (mapping == MAP_FAILED) {
+        error("Failure mapping state file %s: %s", statePath, strerror(errno));
+        stateClose();
+        return 1;
+    }
+    state = mapping;
+#endif
+
+    if (state->magic != STATE_MAGIC || state->version != STATE_VERSION || state->size != sizeof(StateData)
+        || state->checksum != stateChecksum(state)) {
+        if (state->magic != 0) {
+            error("Invalid state file %s, resetting it", statePath);
+        }
+        memset(state, 0, sizeof(StateData));
+        state->magic = STATE_MAGIC;
+        state->version = STATE_VERSION;
+        state->size = sizeof(StateData);
+        state->backgroundState = -1;
+        stateCommit();
+    }
+    return 0;
+}
+
+void stateClose() {
+#ifdef _WIN32
+    if (state != NULL) {
+        FlushViewOfFile(state, sizeof(StateData));
+        UnmapViewOfFile(state);
+    }
+    if (stateMapping != NULL) {
+        CloseHandle(stateMapping);
+        stateMapping = NULL;
+    }
+    if (stateFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(stateFile);
+        stateFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (state != NULL) {
+        msync(state, sizeof(StateData), MS_SYNC);
+        munmap(state, sizeof(StateData));
+    }
+    if (stateFd >= 0) {
+        close(stateFd);
+        stateFd = -1;
+    }
+#endif
+    state = NULL;
+}
+
+const StateData *stateGet() {
+    return state;
+}
+
+int stateSetBackground(int backgroundState, time_t transitionTime) {
+    if (state == NULL) {
+        return 1;
+    }
+    if (state->backgroundState != backgroundState) {
+        state->backgroundState = backgroundState;
+        state->lastTransition = transitionTime;
+        stateCommit();
+    }
+    return 0;
+}
+
+int stateSetFingerprint(const char *fingerprint) {
+    if (state == NULL) {
+        return 1;
+    }
+    if (strncmp(state->fingerprint, fingerprint, sizeof(state->fingerprint) - 1) != 0) {
+        memset(state->fingerprint, 0, sizeof(state->fingerprint));
+        strncpy(state->fingerprint, fingerprint, sizeof(state->fingerprint) - 1);
+        stateCommit();
+    }
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define STATE_MAGIC 0x54534357 // "WCST"
+#define STATE_VERSION 1
+#define STATE_FINGERPRINT_SIZE 512
+
+// Layout of the state file, all fields little endian
+typedef struct StateData {
+    uint32_t magic; // STATE_MAGIC.
+    uint32_t version; // STATE_VERSION.
+    uint32_t size; // sizeof(StateData).
+    uint32_t checksum; // FNV-1a of all bytes after this field.
+    int32_t backgroundState; // DAY or NIGHT, -1 if unknown.
+    int32_t reserved; // Padding, always 0.
+    int64_t lastTransition; // Time of the last change of backgroundState, 0 if unknown.
+    char fingerprint[STATE_FINGERPRINT_SIZE]; // Fingerprint of the wallpaper applied last.
+} StateData;
+
+int stateOpen(const char *statePath);
+void stateClose();
+const StateData *stateGet();
+int stateSetBackground(int backgroundState, time_t transitionTime);
+int stateSetFingerprint(const char *fingerprint);
+#endif // STATE_H
@@ -0,0 +1,226 @@
+/**
+ * @file thread.c
+ * @brief Minimal portable threads and auto-reset events on top of Win32 or pthreads.
+ */
+
+#include <stdlib.h>
+#include "thread.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+struct Thread {
+    void (*function)(void *); // Function run by the thread.
+    void *argument; // Argument passed to function.
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+};
+
+struct ThreadEvent {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    int signaled;
+#endif
+};
+
+/**
+ * @brief Starts a new thread running function(argument).
+ *
+ * @param function The function to run.
+ * @param argument The argument passed to the function.
+ * @return The thread, or NULL if it could not be started.
+ */
+Thread *threadStart(void (*function)(void *), void *argument);
+
+/**
+ * @brief Waits for a thread to finish and releases it.
+ *
+ * @param thread The thread to join.
+ * @return Returns 0 on success, or 1 on failure.
+ */
+int threadJoin(Thread *thread);
+
+/**
+ * @brief Returns the number of logical processors, at least 1.
+ */
+int threadCpuCount();
+
+/**
+ * @brief Creates an auto-reset event in the non-signaled state.
+ *
+ * @return The event, or NULL on failure.
+ */
+ThreadEvent *eventCreate();
+
+/**
+ * @brief Releases an event.
+ *
+ * @param event The event, may be NULL.
+ */
+void eventDestroy(ThreadEvent *event);
+
+/**
+ * @brief Signals an event, releasing one waiter or the next call to eventWait().
+ *
+ * @param event The event to signal.
+ * @return Returns 0 on success, or 1 on failure.
+ */
+int eventSignal(ThreadEvent *event);
+
+/**
+ * @brief Waits until an event is signaled and resets it.
+ *
+ * @param event The event to wait for.
+ * @param timeoutMs Maximum time to wait in milliseconds, or -1 to wait forever.
+ * @return Returns 1 if the event was signaled, or 0 on timeout.
+ */
+int eventWait(ThreadEvent *event, int timeoutMs);
+
+#ifdef _WIN32
+static DWORD WINAPI threadEntry(LPVOID argument) {
+    Thread *thread = argument;
+    thread->function(thread->argument);
+    return 0;
+}
+#else
+static void *threadEntry(void *argument) {
+    Thread *thread = argument;
+    thread->function(thread->argument);
+    return NULL;
+}
+#endif
+
+Thread *threadStart(void (*function)(void *), void *argument) {
+    Thread *thread = malloc(sizeof(Thread));
+    if (thread == NULL) {
+        return NULL;
+    }
+    thread->function = function;
+    thread->argument = argument;
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, threadEntry, thread, 0, NULL);
+    if (thread->handle == NULL) {
+        free(thread);
+        return NULL;
+    }
+#else
+    if (pthread_create(&thread->handle, NULL, threadEntry, thread) != 0) {
+        free(thread);
+        return NULL;
+    }
+#endif
+    return thread;
+}
+
+int threadJoin(Thread *thread) {
+    if (thread == NULL) {
+        return 1;
+    }
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+    free(thread);
+    return 0;
+}
+
+int threadCpuCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = (int)info.dwNumberOfProcessors;
+#else
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return count > 0 ? count : 1;
+}
+
+ThreadEvent *eventCreate() {
+    ThreadEvent *event = malloc(sizeof(ThreadEvent));
+    if (event == NULL) {
+        return NULL;
+    }
+#ifdef _WIN32
+    event->handle = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (event->handle == NULL) {
+        free(event);
+        return NULL;
+    }
+#else
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_mutex_init(&event->mutex, NULL);
+    pthread_cond_init(&event->condition, &attributes);
+    pthread_condattr_destroy(&attributes);
+    event->signaled = 0;
+#endif
+    return event;
+}
+
+void eventDestroy(ThreadEvent *event) {
+    if (event == NULL) {
+        return;
+    }
+#ifdef _WIN32
+    CloseHandle(event->handle);
+#else
+    pthread_cond_destroy(&event->condition);
+    pthread_mutex_destroy(&event->mutex);
+#endif
+    free(event);
+}
+
+int eventSignal(ThreadEvent *event) {
+#ifdef _WIN32
+    return !SetEvent(event->handle);
+#else
+    pthread_mutex_lock(&event->mutex);
+    event->signaled = 1;
+    pthread_cond_signal(&event->condition);
+    pthread_mutex_unlock(&event->mutex);
+    return 0;
+#endif
+}
+
+int eventWait(ThreadEvent *event, int timeoutMs) {
+#ifdef _WIN32
+    return WaitForSingleObject(event->handle, timeoutMs < 0 ? INFINITE : (DWORD)timeoutMs) == WAIT_OBJECT_0;
+#else
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    if (timeoutMs >= 0) {
+        deadline.tv_sec += timeoutMs / 1000;
+        deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&event->mutex);
+    int result = 0;
+    while (!event->signaled && result != ETIMEDOUT) {
+        result = timeoutMs < 0 ? pthread_cond_wait(&event->condition, &event->mutex)
+                               : pthread_cond_timedwait(&event->condition, &event->mutex, &deadline);
+    }
+    int signaled = event->signaled;
+    event->signaled = 0;
+    pthread_mutex_unlock(&event->mutex);
+    return signaled;
+#endif
+}
@@ -0,0 +1,15 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+// Portable thread and event primitives
+typedef struct Thread Thread;
+typedef struct ThreadEvent ThreadEvent;
+
+Thread *threadStart(void (*function)(void *), void *argument);
+int threadJoin(Thread *thread);
+int threadCpuCount();
+ThreadEvent *eventCreate();
+void eventDestroy(ThreadEvent *event);
+int eventSignal(ThreadEvent *event);
+int eventWait(ThreadEvent *event, int timeoutMs);
+#endif // THREAD_H
@@ -0,0 +1,187 @@
+/**
+ * @file trace.c
+ * @brief Optional trace spans, written as Chrome trace JSON on request.
+ *
+ * While tracing is enabled, every finished span is stored in a ring of the last TRACE_CAPACITY spans.
+ * traceWrite() saves them in the Trace Event Format, which chrome://tracing and ui.perfetto.dev show
+ * as a flame view per thread. While tracing is disabled, traceBegin() and traceEnd() only check a flag.
+ *
+ * Spans are rare (startup, transitions, animations), so the ring is guarded by a spinlock.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "log.h"
+#include "metrics.h"
+#include "trace.h"
+
+#define TRACE_CAPACITY 4096 // Number of spans kept, the oldest are overwritten.
+#define TRACE_MAX_THREADS 16 // Number of thread names kept.
+
+// Finished span
+typedef struct TraceEvent {
+    const char *name; // Name of the span.
+    uint64_t start; // metricsNow() at the start.
+    uint64_t duration; // Duration in nanoseconds.
+    int thread; // Id of the recording thread.
+} TraceEvent;
+
+static atomic_bool traceOn; // Whether new spans are recorded.
+static atomic_flag traceLock = ATOMIC_FLAG_INIT; // Guards traceEvents and traceCount.
+static TraceEvent traceEvents[TRACE_CAPACITY]; // Ring of finished spans.
+static uint64_t traceCount = 0; // Number of spans recorded since the start.
+static atomic_int traceThreads; // Number of thread ids handed out.
+static const char *traceThreadNames[TRACE_MAX_THREADS]; // Names by thread id.
+static _Thread_local int traceThread = 0; // Id of the calling thread, 0 until first used.
+
+/**
+ * @brief Enables or disables recording of new spans. Recorded spans are kept.
+ *
+ * @param enabled Nonzero to enable tracing.
+ */
+void traceEnable(int enabled);
+
+/**
+ * @brief Returns whether tracing is enabled.
+ */
+int traceEnabled();
+
+/**
+ * @brief Names the calling thread in the trace, e.g. "ui".
+ *
+ * @param name The name, a string literal.
+ */
+void traceThreadName(const char *name);
+
+/**
+ * @brief Starts a span.
+ *
+ * @param name Name of the span, a string literal.
+ * @return The span to pass to traceEnd().
+ */
+TraceSpan traceBegin(const char *name);
+
+/**
+ * @brief Ends a span and records it if tracing was enabled when it started.
+ *
+ * @param span The span returned by traceBegin().
+ */
+void traceEnd(TraceSpan span);
+
+/**
+ * @brief Ends the span of TRACE_SCOPE() when its variable goes out of scope.
+ */
+void traceEndScope(TraceSpan *span);
+
+/**
+ * @brief Writes the recorded spans as Chrome trace JSON.
+ *
+ * @param path Path to the trace file, replaced if it exists.
+ * @return Returns 0 on success, or 1 if the file cannot be written.
+ */
+int traceWrite(const char *path);
+
+/**
+ * @brief Returns the id of the calling thread, assigning one on first use.
+ */
+static int traceThreadId();
+
+void traceEnable(int enabled) {
+    atomic_store(&traceOn, enabled != 0);
+}
+
+int traceEnabled() {
+    return atomic_load_explicit(&traceOn, memory_order_relaxed);
+}
+
+static int traceThreadId() {
+    if (traceThread == 0) {
+        traceThread = atomic_fetch_add(&traceThreads, 1) + 1;
+    }
+    return traceThread;
+}
+
+void traceThreadName(const char *name) {
+    int thread = traceThreadId();
+    if (thread < TRACE_MAX_THREADS) {
+        traceThreadNames[thread] = name;
+    }
+}
+
+TraceSpan traceBegin(const char *name) {
+    TraceSpan span = {name, 0};
+    if (traceEnabled()) {
+        span.start = metricsNow();
+    }
+    return span;
+}
+
+void traceEnd(TraceSpan span) {
+    if (span.start == 0) {
+        return;
+    }
+    TraceEvent event = {span.name, span.start, metricsNow() - span.start, traceThreadId()};
+    while (atomic_flag_test_and_set_explicit(&traceLock, memory_order_acquire)) {
+    }
+    traceEvents[traceCount % TRACE_CAPACITY] = event;
+    traceCount++;
+    atomic_flag_clear_explicit(&traceLock, memory_order_release);
+}
+
+void traceEndScope(TraceSpan *span) {
+    traceEnd(*span);
+}
+
+int traceWrite(const char *path) {
+    TraceEvent *events = malloc(sizeof(traceEvents));
+    if (events == NULL) {
+        return 1;
+    }
+
+    // Copy the ring, oldest span first, so the file is written without holding the lock.
+    while (atomic_flag_test_and_set_explicit(&traceLock, memory_order_acquire)) {
+    }
+    size_t count = traceCount < TRACE_CAPACITY ? (size_t)traceCount : TRACE_CAPACITY;
+    for (size_t i = 0; i < count; i++) {
+        events[i] = traceEvents[(traceCount - count + i) % TRACE_CAPACITY];
+    }
+    atomic_flag_clear_explicit(&traceLock, memory_order_release);
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        error("Failure writing trace: %s", path);
+        free(events);
+        return 1;
+    }
+
+    // Timestamps are microseconds since the oldest span.
+    uint64_t origin = count > 0 ? events[0].start : 0;
+    for (size_t i = 1; i < count; i++) {
+        origin = events[i].start < origin ? events[i].start : origin;
+    }
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    int threads = atomic_load(&traceThreads);
+    const char *separator = "";
+    for (int thread = 1; thread <= threads && thread < TRACE_MAX_THREADS; thread++) {
+        if (traceThreadNames[thread] != NULL) {
+            fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                    separator, thread, traceThreadNames[thread]);
+            separator = ",\n";
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        fprintf(file, "%s{\"name\": \"%s\", \"cat\": \"wallcycle\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d}",
+                separator, events[i].name, (events[i].start - origin) / 1000.0, events[i].duration / 1000.0, events[i].thread);
+        separator = ",\n";
+    }
+    fprintf(file, "\n]}\n");
+    int result = ferror(file) != 0;
+    fclose(file);
+    free(events);
+    info("Trace with %zu spans written to %s", count, path);
+    return result;
+}
@@ -0,0 +1,24 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Span being measured, name must be a string literal
+typedef struct TraceSpan {
+    const char *name; // Name shown in the trace viewer.
+    uint64_t start; // metricsNow() at the start, 0 if tracing was disabled.
+} TraceSpan;
+
+void traceEnable(int enabled);
+int traceEnabled();
+void traceThreadName(const char *name);
+TraceSpan traceBegin(const char *name);
+void traceEnd(TraceSpan span);
+void traceEndScope(TraceSpan *span);
+int traceWrite(const char *path);
+
+// Traces the rest of the enclosing block, ending the span on every return
+#define TRACE_SCOPE_NAME(line) traceScope##line
+#define TRACE_SCOPE_AT(name, line) TraceSpan TRACE_SCOPE_NAME(line) __attribute__((cleanup(traceEndScope))) = traceBegin(name)
+#define TRACE_SCOPE(name) TRACE_SCOPE_AT(name, __LINE__)
+#endif // TRACE_H
@@ -0,0 +1,71 @@
+/**
+ * @file transition.c
+ * @brief Rendering of the crossfade frames between the day and night wallpapers.
+ *
+ * transitionPlan() in schedule.c decides which frame is due. Each frame is rendered only when it is due,
+ * from the cached screen-sized copies of both images, and written to one of two alternating files in
+ * CACHE_DIRECTORY so the file on screen is never overwritten.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "log.h"
+#include "image.h"
+#include "blend.h"
+#include "cache.h"
+#include "metrics.h"
+#include "trace.h"
+#include "transition.h"
+
+/**
+ * @brief Renders a crossfade frame as a BMP at the given resolution.
+ *
+ * @param fromPath Path to the image the window fades from.
+ * @param toPath Path to the image the window fades to.
+ * @param step The frame to render.
+ * @param width Target width in pixels.
+ * @param height Target height in pixels.
+ * @param framePath Receives the path of the rendered frame.
+ * @param framePathSize The size of the framePath buffer.
+ * @return Returns 0 on success, or 1 on failure.
+ */
+int transitionRender(const char *fromPath, const char *toPath, const TransitionStep *step, int width, int height, char *framePath, size_t framePathSize);
+
+int transitionRender(const char *fromPath, const char *toPath, const TransitionStep *step, int width, int height, char *framePath, size_t framePathSize) {
+    TRACE_SCOPE("transitionRender");
+    uint64_t start = metricsNow();
+    char fromCached[MAX_CACHE_PATH];
+    char toCached[MAX_CACHE_PATH];
+    if (wallpaperCacheResolve(fromPath, width, height, fromCached, sizeof(fromCached)) != 0
+        || wallpaperCacheResolve(toPath, width, height, toCached, sizeof(toCached)) != 0) {
+        error("Failure caching transition images");
+        return 1;
+    }
+
+    Image from = {0}, to = {0};
+    if (imageLoad(fromCached, &from) != 0 || imageLoad(toCached, &to) != 0) {
+        error("Failure loading transition images");
+        imageFree(&from);
+        imageFree(&to);
+        return 1;
+    }
+
+    // The blend is written over the source image, so only two images are held at a time.
+    int alpha = step->frame * BLEND_MAX / (step->frames + 1);
+    int result = blendImages(&from, &to, &from, alpha);
+    if (result != 0) {
+        error("Transition images differ in size: %dx%d, %dx%d", from.width, from.height, to.width, to.height);
+    } else {
+        snprintf(framePath, framePathSize, "%s/transition-%d.bmp", CACHE_DIRECTORY, step->frame % 2);
+        result = imageWriteBmp(framePath, &from);
+    }
+    debug("Transition frame %d, alpha %d, kernel %s", step->frame, alpha, blendKernelName());
+
+    imageFree(&from);
+    imageFree(&to);
+    if (result == 0) {
+        metricsRecordSince(METRIC_TRANSITION_RENDER, start);
+    }
+    return result;
+}
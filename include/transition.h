@@ -0,0 +1,8 @@
+#ifndef TRANSITION_H
+#define TRANSITION_H
+
+#include <stddef.h>
+#include "schedule.h"
+
+int transitionRender(const char *fromPath, const char *toPath, const TransitionStep *step, int width, int height, char *framePath, size_t framePathSize);
+#endif // TRANSITION_H
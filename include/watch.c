@@ -0,0 +1,274 @@
+/**
+ * @file watch.c
+ * @brief File change notifications using ReadDirectoryChangesW on Windows and inotify on Linux.
+ *
+ * A watch observes one directory, optionally filtered to a single file name. Bursts of changes
+ * (an editor saving, an atomic replace) are debounced: the callback runs once the directory has
+ * been quiet for the debounce interval.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+
+#include "log.h"
+#include "thread.h"
+#include "watch.h"
+
+#define WATCH_BUFFER_SIZE 4096
+#define MAX_WATCH_NAME 260
+
+struct FileWatch {
+    char fileName[MAX_WATCH_NAME]; // File to report, empty to report every change in the directory.
+    int debounceMs; // Quiet time before the callback runs.
+    WatchCallback callback; // Called on the watch thread after a change.
+    void *argument; // Passed to callback.
+    Thread *thread; // Thread waiting for notifications.
+#ifdef _WIN32
+    HANDLE directory; // Directory opened for overlapped change notifications.
+    HANDLE stopEvent; // Signaled by watchStop().
+    HANDLE ioEvent; // Signaled when ReadDirectoryChangesW completes.
+#else
+    int inotifyFd; // inotify instance watching the directory.
+    int stopFd; // eventfd signaled by watchStop().
+#endif
+};
+
+/**
+ * @brief Starts watching a directory.
+ *
+ * @param directory The directory to watch.
+ * @param fileName Only report changes to this file, or NULL to report every change in the directory.
+ * @param debounceMs Quiet time in milliseconds before a burst of changes is reported.
+ * @param callback Called on the watch thread once per debounced burst of changes.
+ * @param argument Passed to the callback.
+ * @return The watch, or NULL if the directory cannot be watched.
+ */
+FileWatch *watchStart(const char *directory, const char *fileName, int debounceMs, WatchCallback callback, void *argument);
+
+/**
+ * @brief Stops a watch and waits for its thread to finish.
+ *
+ * @param watch The watch, may be NULL.
+ */
+void watchStop(FileWatch *watch);
+
+/**
+ * @brief Body of the watch thread.
+ */
+static void watchThread(void *argument);
+
+/**
+ * @brief Checks whether a changed name is relevant for a watch.
+ */
+static int watchMatches(const FileWatch *watch, const char *name) {
+    return watch->fileName[0] == '\0' || strcmp(watch->fileName, name) == 0;
+}
+
+#ifdef _WIN32
+
+static int watchRequest(FileWatch *watch, void *buffer, OVERLAPPED *overlapped) {
+    memset(overlapped, 0, sizeof(OVERLAPPED));
+    overlapped->hEvent = watch->ioEvent;
+    return ReadDirectoryChangesW(watch->directory, buffer, WATCH_BUFFER_SIZE, FALSE,
+                                 FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE,
+                                 NULL, overlapped, NULL);
+}
+
+static void watchThread(void *argument) {
+    FileWatch *watch = argument;
+    DWORD buffer[WATCH_BUFFER_SIZE / sizeof(DWORD)];
+    OVERLAPPED overlapped;
+    int pending = 0;
+
+    if (!watchRequest(watch, buffer, &overlapped)) {
+        error("Failure watching directory: %ld", GetLastError());
+        return;
+    }
+
+    for (;;) {
+        HANDLE handles[] = {watch->stopEvent, watch->ioEvent};
+        DWORD result = WaitForMultipleObjects(2, handles, FALSE, pending ? (DWORD)watch->debounceMs : INFINITE);
+
+        if (result == WAIT_OBJECT_0) {
+            break;
+        } else if (result == WAIT_TIMEOUT) {
+            pending = 0;
+            watch->callback(watch->argument);
+        } else if (result == WAIT_OBJECT_0 + 1) {
+            DWORD bytes = 0;
+            if (GetOverlappedResult(watch->directory, &overlapped, &bytes, FALSE)) {
+                if (bytes == 0) {
+                    // The buffer overflowed, changes were lost, so assume the file changed.
+                    pending = 1;
+                }
+                for (char *entry = (char *)buffer; bytes > 0;) {
+                    FILE_NOTIFY_INFORMATION *info = (FILE_NOTIFY_INFORMATION *)entry;
+                    char name[MAX_WATCH_NAME];
+                    int length = WideCharToMultiByte(CP_UTF8, 0, info->FileName, info->FileNameLength / sizeof(wchar_t),
+                                                     name, sizeof(name) - 1, NULL, NULL);
+                    name[length > 0 ? length : 0] = '\0';
+                    if (watchMatches(watch, name)) {
+                        pending = 1;
+                    }
+                    if (info->NextEntryOffset == 0) {
+                        break;
+                    }
+                    entry += info->NextEntryOffset;
+                }
+            }
+            if (!watchRequest(watch, buffer, &overlapped)) {
+                error("Failure watching directory: %ld", GetLastError());
+                break;
+            }
+        } else {
+            error("Failure waiting for directory changes: %ld", GetLastError());
+            break;
+        }
+    }
+
+    CancelIo(watch->directory);
+    GetOverlappedResult(watch->directory, &overlapped, &(DWORD){0}, TRUE);
+}
+
+FileWatch *watchStart(const char *directory, const char *fileName, int debounceMs, WatchCallback callback, void *argument) {
+    FileWatch *watch = calloc(1, sizeof(FileWatch));
+    if (watch == NULL) {
+        return NULL;
+    }
+    if (fileName != NULL && strlen(fileName) < sizeof(watch->fileName)) {
+        strcpy(watch->fileName, fileName);
+    }
+    watch->debounceMs = debounceMs;
+    watch->callback = callback;
+    watch->argument = argument;
+
+    watch->directory = CreateFileA(directory, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                   NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    watch->stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    watch->ioEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (watch->directory == INVALID_HANDLE_VALUE || watch->stopEvent == NULL || watch->ioEvent == NULL
+        || (watch->thread = threadStart(watchThread, watch)) == NULL) {
+        error("Failure watching %s: %ld", directory, GetLastError());
+        watchStop(watch);
+        return NULL;
+    }
+    return watch;
+}
+
+void watchStop(FileWatch *watch) {
+    if (watch == NULL) {
+        return;
+    }
+    if (watch->thread != NULL) {
+        SetEvent(watch->stopEvent);
+        threadJoin(watch->thread);
+    }
+    if (watch->directory != INVALID_HANDLE_VALUE && watch->directory != NULL) {
+        CloseHandle(watch->directory);
+    }
+    if (watch->stopEvent != NULL) {
+        CloseHandle(watch->stopEvent);
+    }
+    if (watch->ioEvent != NULL) {
+        CloseHandle(watch->ioEvent);
+    }
+    free(watch);
+}
+
+#else
+
+static void watchThread(void *argument) {
+    FileWatch *watch = argument;
+    char buffer[WATCH_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int pending = 0;
+
+    for (;;) {
+        struct pollfd fds[] = {
+            {.fd = watch->stopFd, .events = POLLIN},
+            {.fd = watch->inotifyFd, .events = POLLIN},
+        };
+        int result = poll(fds, 2, pending ? watch->debounceMs : -1);
+
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error("Failure waiting for directory changes: %s", strerror(errno));
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            break;
+        }
+        if (result == 0) {
+            pending = 0;
+            watch->callback(watch->argument);
+            continue;
+        }
+
+        ssize_t length;
+        while ((length = read(watch->inotifyFd, buffer, sizeof(buffer))) > 0) {
+            for (char *entry = buffer; entry < buffer + length;) {
+                struct inotify_event *event = (struct inotify_event *)entry;
+                if ((event->mask & IN_Q_OVERFLOW) || (event->len > 0 && watchMatches(watch, event->name))) {
+                    pending = 1;
+                }
+                entry += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+}
+
+FileWatch *watchStart(const char *directory, const char *fileName, int debounceMs, WatchCallback callback, void *argument) {
+    FileWatch *watch = calloc(1, sizeof(FileWatch));
+    if (watch == NULL) {
+        return NULL;
+    }
+    if (fileName != NULL && strlen(fileName) < sizeof(watch->fileName)) {
+        strcpy(watch->fileName, fileName);
+    }
+    watch->debounceMs = debounceMs;
+    watch->callback = callback;
+    watch->argument = argument;
+
+    watch->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    watch->stopFd = eventfd(0, EFD_CLOEXEC);
+    if (watch->inotifyFd < 0 || watch->stopFd < 0
+        || inotify_add_watch(watch->inotifyFd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE) < 0
+        || (watch->thread = threadStart(watchThread, watch)) == NULL) {
+        error("Failure watching %s: %s", directory, strerror(errno));
+        watchStop(watch);
+        return NULL;
+    }
+    return watch;
+}
+
+void watchStop(FileWatch *watch) {
+    if (watch == NULL) {
+        return;
+    }
+    if (watch->thread != NULL) {
+        uint64_t one = 1;
+        if (write(watch->stopFd, &one, sizeof(one)) == sizeof(one)) {
+            threadJoin(watch->thread);
+        }
+    }
+    if (watch->inotifyFd >= 0) {
+        close(watch->inotifyFd);
+    }
+    if (watch->stopFd >= 0) {
+        close(watch->stopFd);
+    }
+    free(watch);
+}
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+// Watches a directory for changes and reports them debounced on a background thread
+typedef struct FileWatch FileWatch;
+typedef void (*WatchCallback)(void *argument);
+
+FileWatch *watchStart(const char *directory, const char *fileName, int debounceMs, WatchCallback callback, void *argument);
+void watchStop(FileWatch *watch);
+#endif // WATCH_H
@@ -5,112 +5,324 @@
  * The application reads configuration from an INI file, sets the background to a day or night image, and animates the system tray icon accordingly.
  * 
  * @include <stdio.h>
+ * @include <stdlib.h>
+ * @include <string.h>
  * @include <windows.h>
  * @include "background.h"
  * @include <stdbool.h>
  * @include "resource.h"
  * @include "ini.h"
  * @include "log.h"
+ * @include "schedule.h"
+ * @include "watch.h"
+ * @include "cache.h"
+ * @include "transition.h"
+ * @include "anim.h"
+ * @include "state.h"
+ * @include "cycle.h"
+ * @include "metrics.h"
+ * @include "trace.h"
+ * @include "command.h"
+ * @include "config.h"
+ * @include "library.h"
+ * @include "analyze.h"
+ * @include "playlist.h"
  * 
  * @global NOTIFYICONDATA notifData - Data structure for the system tray icon.
  * @global HINSTANCE hInstance - Handle to the application instance.
  * @global HWND hiddenWindow - Handle to the hidden window used for message processing.
- * @global HICON animationIcons[ANIMATION_FRAMES] - Array of icons for animation frames.
- * @global volatile bool stopThread - Flag to stop the background thread.
- * @global int sleepTime - Sleep time between background checks.
- * @global char nightPath[MAX_VALUE_LENGTH] - Path to the night background image.
- * @global char dayPath[MAX_VALUE_LENGTH] - Path to the day background image.
- * @global int fromTime - Start time for the day background.
- * @global int toTime - End time for the day background.
- * @global int backgroundState - Current background state (DAY or NIGHT).
- * @global volatile bool day2Night - Flag indicating if the transition is from day to night.
+ * @global PackedAnimation trayAnimation - Packed tray icon animation, decoded one frame at a time.
+ * @global HICON animationIcon - Icon of the frame currently shown in the tray.
+ * @global IniDocument *configDocument - Config as parsed by the last readConfig().
+ * @global atomic_bool configChanged - Flag set by the config watch when config.ini changed since the last readConfig().
+ * @global CommandQueue commands - Commands from the UI thread to the background thread.
+ * @global bool quitRequested - Set by the background thread when it received COMMAND_QUIT.
+ * @global FileWatch *configWatch - Watch reporting changes of config.ini.
+ * @global PathLibrary nightLibrary - Library of the night images if NIGHT names a directory.
+ * @global PathLibrary dayLibrary - Library of the day images if DAY names a directory.
+ * @global atomic_bool libraryScanned - Flag set by the library scanners when an index may have changed.
+ * @global time_t libraryRotation - Time the image of a library changes next, 0 if none does.
+ * @global const CycleBackend desktopBackend - Wallpaper and tray outputs of the desktop.
+ * @global Cycle cycle - Day/night state machine, driven by the system clock.
+ * @global int animationFrame - Icon frame currently shown in the tray.
+ * @global int animationStartFrame - Frame the running icon animation started from.
+ * @global int animationTargetFrame - Frame the running icon animation ends on.
+ * @global DWORD animationStartTick - Tick count at which the running icon animation started.
+ * @global TraceSpan animationSpan - Trace span of the running icon animation.
  * 
  * @define CONFIG_PATH - Path to the configuration file.
+ * @define CONFIG_DIRECTORY - Directory containing the configuration file.
+ * @define CONFIG_NAME - File name of the configuration file.
+ * @define CONFIG_DEBOUNCE_MS - Quiet time before a changed configuration is reloaded.
  * @define CONFIG_PATH_SIZE - Size of the configuration path.
+ * @define STATE_PATH - Path to the runtime state file.
  * @define MAX_VALUE_LENGTH - Maximum length of configuration values.
- * @define ANIMATION_FRAMES - Number of frames in the icon animation.
- * @define NIGHT - Constant representing night state.
- * @define DAY - Constant representing day state.
- * 
- * @function loadAnimationIcons - Loads the icons for the animation frames.
- * @function cleanupAnimationIcons - Cleans up the loaded animation icons.
- * @function animateIconDayToNight - Animates the icon from day to night.
- * @function animateIconNightToDay - Animates the icon from night to day.
- * @function changeBackground - Changes the desktop background based on the current state.
+ * @define ANIMATION_DEFAULT_FRAME_MS - Time between two icon frames if the animation does not specify one.
+ * @define ANIMATION_TIMER - Timer id driving the icon animation.
+ * @define WM_APP_ANIMATE - Message starting an icon animation, wParam holds the target state.
+ * @define METRICS_PIPE - Named pipe answering with a snapshot of the metrics.
+ * @define METRICS_PATH - File the metrics are dumped to at exit.
+ * @define TRACE_PATH_FORMAT - strftime() format of the trace files saved from the menu.
+ * @define MENU_EXIT - Menu command ending the program.
+ * @define MENU_TRACE - Menu command enabling or disabling tracing.
+ * @define MENU_SAVE_TRACE - Menu command saving the recorded trace.
+ * @define MENU_SWITCH - Menu command switching to the other background until the next transition.
+ * 
+ * @function loadAnimation - Opens the packed animation embedded in the resources.
+ * @function cleanupAnimation - Releases the animation and the icon shown.
+ * @function createAnimationIcon - Creates the icon of one animation frame.
+ * @function showAnimationFrame - Shows an animation frame in the tray.
+ * @function requestIconAnimation - Requests the icon animation towards a state.
+ * @function startIconAnimation - Starts or redirects the icon animation on the UI thread.
+ * @function stepIconAnimation - Shows the icon frame due at the current time.
+ * @function applyTransitionFrame - Renders and applies a crossfade frame.
+ * @function getCycleSettings - Collects the settings of a config snapshot for the cycle.
+ * @function updateLibrary - Opens, replaces or closes the library of a [Path] entry.
+ * @function pickLibraryImage - Picks the image of a library for the rotation slot of a state at a point in time.
+ * @function nextLibraryRotation - Returns the time the image of a library changes next.
+ * @function prefetchWallpapers - Prepares the images shown at a point in time in the wallpaper cache.
+ * @function requestLibraryRefresh - Marks the libraries as changed and wakes the background thread.
  * @function WinMain - Entry point for the application.
  * @function WindowProc - Window procedure for handling messages.
  * @function makeAbsolutePath - Converts a relative path to an absolute path.
  * @function createConfig - Creates a default configuration file.
  * @function readConfig - Reads the configuration from the INI file.
- * @function updateBackgroundStateConfig - Updates the background state in the configuration file.
+ * @function applyConfig - Validates a parsed configuration and publishes it as the current snapshot.
+ * @function readLogConfig - Applies the optional log settings of the INI file.
+ * @function readTraceConfig - Applies the optional trace setting of the INI file.
+ * @function saveTrace - Writes the recorded trace spans to a new file.
+ * @function applyBackground - Sets the background and records the applied fingerprint.
+ * @function requestConfigReload - Marks the configuration as changed and wakes the background thread.
+ * @function sendCommand - Queues a command for the background thread and wakes it.
+ * @function handleCommand - Executes a command on the background thread.
  * @function checkIfConfig - Checks if the configuration file exists and creates it if necessary.
- * @function programLoop - Main loop for the background thread.
+ * @function programLoop - Main loop for the background thread, sleeps until the next transition, rotation or prefetch.
  * @function ProgramLoopThread - Thread function for the program loop.
  * @function initializeMain - Initializes the main components of the application.
  * @function initializeAnimation - Initializes the animation based on the current background state.
- * @function setBackgroundState - Sets the background state based on the current time.
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <windows.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include "background.h"
 #include "resource.h"
 #include "ini.h"
 #include "log.h"
+#include "schedule.h"
+#include "watch.h"
+#include "cache.h"
+#include "transition.h"
+#include "anim.h"
+#include "state.h"
+#include "cycle.h"
+#include "metrics.h"
+#include "trace.h"
+#include "command.h"
+#include "config.h"
+#include "library.h"
+#include "analyze.h"
+#include "playlist.h"
 
 // Constants
 #define CONFIG_PATH "./config.ini"
+#define CONFIG_DIRECTORY "."
+#define CONFIG_NAME "config.ini"
+#define CONFIG_DEBOUNCE_MS 250
 #define CONFIG_PATH_SIZE sizeof(CONFIG_PATH)
+#define STATE_PATH "./state.bin"
 #define MAX_VALUE_LENGTH 128
-#define ANIMATION_FRAMES 34 //!TODO Make dynamic
-#define NIGHT 1
-#define DAY 0
+#define ANIMATION_DEFAULT_FRAME_MS 10
+#define ANIMATION_TIMER 1
+#define WM_APP_ANIMATE (WM_APP + 1)
+#define METRICS_PIPE "\\\\.\\pipe\\WallCycle.metrics"
+#define METRICS_PATH "./metrics.json"
+#define TRACE_PATH_FORMAT "./trace-%Y%m%d-%H%M%S.json"
+#define MENU_EXIT 1
+#define MENU_TRACE 2
+#define MENU_SAVE_TRACE 3
+#define MENU_SWITCH 4
 
 // Global variables
 NOTIFYICONDATA notifData; // Data structure for the system tray icon.
 HINSTANCE hInstance; // Handle to the application instance.
 HWND hiddenWindow; // Handle to the hidden window used for message processing.
-HICON animationIcons[ANIMATION_FRAMES]; // Array of icons for animation frames.
-volatile bool stopThread = false; // Flag to stop the background thread.
-int sleepTime = 30; // Sleep time between background checks.
-
-char nightPath[MAX_VALUE_LENGTH]; // Path to the night background image.
-char dayPath[MAX_VALUE_LENGTH]; // Path to the day background image.
-int fromTime, toTime; // Time ranges for day and night backgrounds.
-int backgroundState = DAY; // Current background state (DAY or NIGHT).
-volatile bool day2Night = true; // Flag indicating if the transition is from day to night.
+PackedAnimation trayAnimation; // Packed tray icon animation, decoded one frame at a time.
+HICON animationIcon = NULL; // Icon of the frame currently shown in the tray.
+
+IniDocument *configDocument = NULL; // Config as parsed by the last readConfig().
+atomic_bool configChanged = false; // Flag set by the config watch when config.ini changed since the last readConfig().
+CommandQueue commands; // Commands from the UI thread to the background thread.
+bool quitRequested = false; // Set by the background thread when it received COMMAND_QUIT.
+FileWatch *configWatch = NULL; // Watch reporting changes of config.ini.
+
+// Library behind a [Path] entry naming a directory, only used by the background thread
+typedef struct PathLibrary {
+    Library *library; // The open library, NULL if the entry names a file.
+    char path[CONFIG_VALUE_LENGTH]; // Entry the library was opened for.
+    char picked[MAX_PATH]; // Path of the image picked for the current time.
+    char upcoming[MAX_PATH]; // Path of the image picked for the prefetch.
+    char prefetched[MAX_PATH]; // Path of the image prepared last.
+    Playlist playlist; // Shuffled order of the images, for the current time.
+    Playlist upcomingPlaylist; // Shuffled order of the images, for the prefetch, which may be a pass ahead.
+} PathLibrary;
+
+PathLibrary nightLibrary = {NULL}; // Library of the night images if NIGHT names a directory.
+PathLibrary dayLibrary = {NULL}; // Library of the day images if DAY names a directory.
+atomic_bool libraryScanned = false; // Flag set by the library scanners when an index may have changed.
+time_t libraryRotation = 0; // Time the image of a library changes next, 0 if none does.
+
+// Icon animation state, only used by the UI thread.
+int animationFrame = 0; // Icon frame currently shown in the tray.
+int animationStartFrame = 0; // Frame the running icon animation started from.
+int animationTargetFrame = 0; // Frame the running icon animation ends on.
+DWORD animationStartTick = 0; // Tick count at which the running icon animation started.
+TraceSpan animationSpan = {NULL, 0}; // Trace span of the running icon animation.
 
 
 // ### Function definitions ### //
 
 
 /**
- * @brief Loads the icons for the animation frames.
+ * @brief Opens the packed animation embedded as ANIMATION_DATA resource.
+ * 
+ * Only the header is read and validated, frames are decoded when they are shown.
+ * 
+ * @return 0 on success, non-zero on failure.
+ */
+int loadAnimation();
+
+/**
+ * @brief Releases the animation and the icon currently shown.
+ */
+void cleanupAnimation();
+
+/**
+ * @brief Creates the icon of one animation frame.
+ * 
+ * @param frame The frame, from 0 to trayAnimation.frameCount - 1.
+ * 
+ * @return The icon, or NULL on failure. The caller destroys it.
+ */
+HICON createAnimationIcon(int frame);
+
+/**
+ * @brief Shows an animation frame in the tray and destroys the icon of the previous one.
+ * 
+ * @param frame The frame to show.
+ * @param message NIM_ADD for the first frame, NIM_MODIFY afterwards.
+ * 
+ * @return 0 on success, non-zero on failure.
  */
-void loadAnimationIcons();
+int showAnimationFrame(int frame, DWORD message);
 
 /**
- * @brief Cleans up the loaded animation icons.
+ * @brief Requests the system tray icon animation towards a state.
+ * 
+ * Safe to call from any thread, the animation runs on the UI thread.
+ * 
+ * @param context Unused.
+ * @param targetState DAY or NIGHT.
  */
-void cleanupAnimationIcons();
+void requestIconAnimation(void *context, int targetState);
 
 /**
- * @brief Animates the system tray icon from day to night.
+ * @brief Starts the icon animation towards a state, continuing from the frame currently shown.
+ * 
+ * A running animation is redirected, so a new transition cancels the previous one.
+ * 
+ * @param targetState DAY or NIGHT.
  */
-void animateIconDayToNight();
+void startIconAnimation(int targetState);
 
 /**
- * @brief Animates the system tray icon from night to day.
+ * @brief Shows the icon frame due at the current time and stops the timer at the last frame.
+ * 
+ * Frames are derived from the elapsed time, so frames are dropped if the timer fires late.
  */
-void animateIconNightToDay();
+void stepIconAnimation();
 
 /**
- * @brief Changes the desktop background based on the current state.
+ * @brief Renders a crossfade frame at screen resolution and applies it.
+ * 
+ * @param context Unused.
+ * @param sourcePath Path to the image the window fades from.
+ * @param targetPath Path to the image the window fades to.
+ * @param step The frame to show.
  * 
  * @return 0 on success, non-zero on failure.
  */
-int changeBackground();
+int applyTransitionFrame(void *context, const char *sourcePath, const char *targetPath, const TransitionStep *step);
+
+/**
+ * @brief Collects the settings of a config snapshot for the cycle.
+ * 
+ * @param config The snapshot, acquired with configAcquire().
+ * @param settings Receives the settings, the paths point into the snapshot.
+ */
+void getCycleSettings(const Config *config, CycleSettings *settings);
+
+/**
+ * @brief Opens the library of a [Path] entry naming a directory, and closes it once the entry names a file.
+ * 
+ * A library already open for the same entry is kept, so a reload does not scan it again.
+ * 
+ * @param library The library of NIGHT or DAY.
+ * @param path The entry.
+ */
+void updateLibrary(PathLibrary *library, const char *path);
+
+/**
+ * @brief Picks the image of a library for the rotation slot of a state at a point in time.
+ * 
+ * Without an [Playlist] INTERVAL the pick advances once per day, when the crossfade window towards the state
+ * starts, so both sides of a crossfade stay the same for all of its frames. With it, the first slot starts
+ * with the window as well.
+ * 
+ * @param library The library of the state.
+ * @param config The snapshot, the [Path] entry is returned unchanged if it names a file or the library holds no image yet.
+ * @param state DAY or NIGHT.
+ * @param when The point in time.
+ * @param playlist Keeps the shuffled order between picks, the current pick and the prefetch each have their own.
+ * @param picked Receives the path of a picked image.
+ * @param size The size of the picked buffer.
+ * 
+ * @return The path of the image.
+ */
+const char *pickLibraryImage(PathLibrary *library, const Config *config, int state, time_t when, Playlist *playlist, char *picked, size_t size);
+
+/**
+ * @brief Returns the time the image of a library changes next within its period.
+ * 
+ * @param config The snapshot.
+ * @param now The current time.
+ * 
+ * @return The time, or 0 if no image rotates before the next transition.
+ */
+time_t nextLibraryRotation(const Config *config, time_t now);
+
+/**
+ * @brief Prepares the images shown at a point in time in the wallpaper cache.
+ * 
+ * Decoding and scaling happen here, so the change itself only applies a cached image. Images prepared
+ * by the last call are skipped.
+ * 
+ * @param config The snapshot.
+ * @param when The point in time, [Playlist] LEAD seconds ahead of now.
+ */
+void prefetchWallpapers(const Config *config, time_t when);
+
+/**
+ * @brief Marks the libraries as changed and wakes the background thread.
+ * 
+ * Called on the scanner threads, the new indices are swapped in by the background thread.
+ * 
+ * @param argument Unused.
+ */
+void requestLibraryRefresh(void *argument);
 
 /**
  * @brief Entry point for the application.
@@ -161,11 +373,86 @@ int createConfig();
 int readConfig();
 
 /**
- * @brief Updates the background state in the configuration file.
+ * @brief Validates a parsed configuration and publishes it as the current snapshot.
+ * 
+ * Only a complete and valid config replaces the current snapshot, readers keep the one they acquired.
+ * 
+ * @param document The parsed config, owned by the function afterwards.
+ * 
+ * @return 0 on success, non-zero on failure.
+ */
+int applyConfig(IniDocument *document);
+
+/**
+ * @brief Applies the optional [Log] settings (level, format, rotation) of the INI file.
+ * 
+ * Must run before logInit(). Missing keys keep their defaults.
+ * 
+ * @param document The parsed config.
  * 
  * @return 0 on success, non-zero on failure.
  */
-int updateBackgroundStateConfig();
+int readLogConfig(IniDocument *document);
+
+/**
+ * @brief Applies the optional [Trace] setting of the INI file.
+ * 
+ * Runs at startup before anything is traced, so the startup itself can be traced.
+ * 
+ * @param document The parsed config.
+ * 
+ * @return 0 on success, non-zero on failure.
+ */
+int readTraceConfig(IniDocument *document);
+
+/**
+ * @brief Writes the recorded trace spans to a new file named after the current time.
+ * 
+ * @return 0 on success, non-zero on failure.
+ */
+int saveTrace();
+
+/**
+ * @brief Sets the background and stores the fingerprint of the applied wallpaper in the state file.
+ * 
+ * setBackground() skips the apply if the wallpaper is already shown.
+ * 
+ * @param context Unused.
+ * @param imagePath Path to the image.
+ * 
+ * @return 0 on success, non-zero on failure.
+ */
+int applyBackground(void *context, const char *imagePath);
+
+/**
+ * @brief Marks the configuration as changed and wakes the background thread to reload it.
+ * 
+ * Used as callback of the config file watch.
+ * 
+ * @param argument Unused.
+ */
+void requestConfigReload(void *argument);
+
+/**
+ * @brief Queues a command for the background thread and wakes it.
+ * 
+ * Only called from the UI thread, the queue has a single producer.
+ * 
+ * @param type One of the COMMAND_* types.
+ * @param value Argument of the command.
+ * 
+ * @return 0 on success, non-zero if the queue is full.
+ */
+int sendCommand(int type, int value);
+
+/**
+ * @brief Executes a command on the background thread.
+ * 
+ * @param command The command.
+ * 
+ * @return 0 on success, non-zero on failure.
+ */
+int handleCommand(const Command *command);
 
 /**
  * @brief Checks if the configuration file exists and creates it if necessary.
@@ -177,6 +464,9 @@ int checkIfConfig();
 /**
  * @brief Main loop for the background thread.
  * 
+ * Executes the queued commands, applies the current state and crossfade frame and then
+ * blocks until the next transition or frame, a command or a config change.
+ * 
  * @return 0 on success, non-zero on failure.
  */
 int programLoop();
@@ -204,43 +494,227 @@ int initializeMain();
  */
 int initializeAnimation();
 
-/**
- * @brief Set the Background State object
- * 
- * @param backgroundStatePtr 
- * @param fromTimePtr 
- * @param toTimePtr 
- * @return int 
- */
-int setBackgroundState(int *backgroundStatePtr, int *fromTimePtr, int *toTimePtr);
+const CycleBackend desktopBackend = {applyBackground, applyTransitionFrame, requestIconAnimation, NULL}; // Wallpaper and tray outputs of the desktop.
+Cycle cycle = {&systemClock, &desktopBackend, DAY}; // Day/night state machine, driven by the system clock.
 
 
 // ### Main Loop ### //
 
 
 int programLoop() {
-    
-    if (readConfig(CONFIG_PATH, nightPath, dayPath, &fromTime, &toTime) != 0) {
-        error("Failure reading config");
+
+    Command command;
+    while (commandPop(&commands, &command) == 0) {
+        if (handleCommand(&command) != 0) {
+            error("Failure executing command %d", command.type);
+        }
+        if (quitRequested) {
+            return 0;
+        }
+    }
+
+    // A changed image of the current state is shown without waiting for the next transition.
+    time_t now = clockNow(cycle.clock);
+    bool refresh = libraryRotation != 0 && now >= libraryRotation;
+    if (atomic_exchange(&configChanged, false)) {
+        if (readConfig() != 0) {
+            error("Failure reloading config, keeping previous settings");
+        } else {
+            // The scale options may have changed, the images are prepared again.
+            nightLibrary.prefetched[0] = '\0';
+            dayLibrary.prefetched[0] = '\0';
+            refresh = true;
+        }
+    }
+    if (atomic_exchange(&libraryScanned, false)) {
+        refresh |= nightLibrary.library != NULL && libraryRefresh(nightLibrary.library);
+        refresh |= dayLibrary.library != NULL && libraryRefresh(dayLibrary.library);
+    }
+
+    // The snapshot is held for the step and the prefetch, the cycle does not keep the paths.
+    CycleSettings settings;
+    time_t nextTransition;
+    const Config *config = configAcquire();
+    getCycleSettings(config, &settings);
+    int result = cycleStep(&cycle, &settings, &nextTransition);
+    if (result == 0 && refresh && cycleRefresh(&cycle, &settings) != 0) {
+        error("Failure showing the changed wallpaper");
+    }
+
+    // Every change is prepared LEAD seconds ahead: wake then, prepare what will be shown, and wake again at the change.
+    int lead = config->playlist.lead;
+    time_t wake = nextTransition;
+    libraryRotation = nextLibraryRotation(config, now);
+    if (result == 0) {
+        prefetchWallpapers(config, now + lead);
+        time_t deadlines[] = {nextTransition, libraryRotation};
+        for (size_t i = 0; i < sizeof(deadlines) / sizeof(deadlines[0]); i++) {
+            time_t due = deadlines[i] - lead > now ? deadlines[i] - lead : deadlines[i];
+            if (deadlines[i] != 0 && due < wake) {
+                wake = due;
+            }
+        }
+    }
+    configRelease();
+    if (result != 0) {
+        error("Failure computing next transition");
+        return 1;
+    }
+
+    if (scheduleWaitUntil(wake) == SCHEDULE_ERROR) {
+        error("Failure waiting for next transition");
         return 1;
     }
-    changeBackground();
-    Sleep(1000); //!TODO Make mechanic for dynamic sleeptimes
     return 0;
 }
 
-int changeBackground() {
-    int initialBackgroundState = backgroundState;
-    debug("backgroundState: %d", backgroundState);
+int handleCommand(const Command *command) {
+    CycleSettings settings;
+    char value[MAX_VALUE_LENGTH];
+    switch (command->type) {
+        case COMMAND_SET_DAY_HOUR:
+        case COMMAND_SET_NIGHT_HOUR: {
+            int day = command->type == COMMAND_SET_DAY_HOUR;
+            const Config *config = configAcquire();
+            int newFromTime = day ? command->value : config->fromTime;
+            int newToTime = day ? config->toTime : command->value;
+            configRelease();
+            if (newFromTime < 0 || newToTime >= 24 || newFromTime >= newToTime) {
+                error("Invalid time: day from %d to %d", newFromTime, newToTime);
+                return 1;
+            }
+            snprintf(value, sizeof(value), "%d", command->value);
+            if (writeIniValue(CONFIG_PATH, "Time", day ? "FROM" : "TO", value) != 0) {
+                return 1;
+            }
+            return readConfig();
+        }
+        case COMMAND_FORCE_SWITCH: {
+            getCycleSettings(configAcquire(), &settings);
+            int result = cycleSwitch(&cycle, &settings);
+            configRelease();
+            return result;
+        }
+        case COMMAND_QUIT:
+            quitRequested = true;
+            return 0;
+    }
+    return 1;
+}
+
+void getCycleSettings(const Config *config, CycleSettings *settings) {
+    time_t now = clockNow(cycle.clock);
+    settings->nightPath = pickLibraryImage(&nightLibrary, config, NIGHT, now, &nightLibrary.playlist, nightLibrary.picked, sizeof(nightLibrary.picked));
+    settings->dayPath = pickLibraryImage(&dayLibrary, config, DAY, now, &dayLibrary.playlist, dayLibrary.picked, sizeof(dayLibrary.picked));
+    settings->fromTime = config->fromTime;
+    settings->toTime = config->toTime;
+    settings->transitionFrames = config->transitionFrames;
+    settings->transitionWindow = config->transitionWindow;
+}
 
-    setBackgroundState(&backgroundState, &fromTime, &toTime);
-    if (backgroundState == NIGHT && initialBackgroundState == DAY) {
-        setBackground(nightPath);
-        animateIconDayToNight();
-    } else if (backgroundState == DAY && initialBackgroundState == NIGHT ) {
-        setBackground(dayPath);
-        animateIconNightToDay();
+void updateLibrary(PathLibrary *library, const char *path) {
+    if (!libraryIsDirectory(path)) {
+        libraryClose(library->library);
+        library->library = NULL;
+        return;
     }
+    if (library->library != NULL && strcmp(library->path, path) == 0) {
+        return;
+    }
+    libraryClose(library->library);
+    snprintf(library->path, sizeof(library->path), "%s", path);
+    library->library = libraryOpen(path, requestLibraryRefresh, NULL);
+    if (library->library == NULL) {
+        error("Failure opening library %s", path);
+    }
+}
+
+const char *pickLibraryImage(PathLibrary *library, const Config *config, int state, time_t when, Playlist *playlist, char *picked, size_t size) {
+    const char *path = state == NIGHT ? config->nightPath : config->dayPath;
+    if (library->library == NULL) {
+        return path;
+    }
+    // Without images of the period, twilight images suit it best, then any image does.
+    int period = config->assignPeriods ? state : LIBRARY_ANY;
+    if (period != LIBRARY_ANY && libraryCount(library->library, period) == 0) {
+        period = libraryCount(library->library, ANALYZE_TWILIGHT) > 0 ? ANALYZE_TWILIGHT : LIBRARY_ANY;
+    }
+    int count = libraryCount(library->library, period);
+    int startHour = state == NIGHT ? config->toTime : config->fromTime;
+    int endHour = state == NIGHT ? config->fromTime : config->toTime;
+    long long sequence;
+    time_t end;
+    if (count == 0 || playlistSlot(&config->playlist, startHour, endHour, config->transitionWindow, when, &sequence, &end) != 0) {
+        return path;
+    }
+    int position = playlistPosition(playlist, config->playlist.order, sequence, count);
+    if (libraryPick(library->library, period, position, picked, size) != 0) {
+        return path;
+    }
+    return picked;
+}
+
+time_t nextLibraryRotation(const Config *config, time_t now) {
+    time_t next = 0;
+    for (int state = DAY; state <= NIGHT; state++) {
+        const PathLibrary *library = state == NIGHT ? &nightLibrary : &dayLibrary;
+        int startHour = state == NIGHT ? config->toTime : config->fromTime;
+        int endHour = state == NIGHT ? config->fromTime : config->toTime;
+        long long sequence;
+        time_t end;
+        if (library->library != NULL && libraryCount(library->library, LIBRARY_ANY) > 1
+            && playlistSlot(&config->playlist, startHour, endHour, config->transitionWindow, now, &sequence, &end) == 0
+            && end != 0 && (next == 0 || end < next)) {
+            next = end;
+        }
+    }
+    return next;
+}
+
+void prefetchWallpapers(const Config *config, time_t when) {
+    int width, height;
+    char cachedPath[MAX_CACHE_PATH];
+    if (getScreenSize(&width, &height) != 0) {
+        return;
+    }
+    for (int state = DAY; state <= NIGHT; state++) {
+        PathLibrary *library = state == NIGHT ? &nightLibrary : &dayLibrary;
+        const char *path = pickLibraryImage(library, config, state, when, &library->upcomingPlaylist, library->upcoming, sizeof(library->upcoming));
+        if (strcmp(path, library->prefetched) == 0) {
+            continue;
+        }
+        TRACE_SCOPE("prefetchWallpapers");
+        uint64_t start = metricsNow();
+        // A failure is reported again when the image is applied, it is not retried before.
+        snprintf(library->prefetched, sizeof(library->prefetched), "%s", path);
+        if (wallpaperCacheResolve(path, width, height, cachedPath, sizeof(cachedPath)) == 0) {
+            debug("Prefetched %s", path);
+        }
+        metricsRecordSince(METRIC_WALLPAPER_PREFETCH, start);
+    }
+}
+
+void requestLibraryRefresh(void *argument) {
+    atomic_store(&libraryScanned, true);
+    scheduleWake();
+}
+
+int applyTransitionFrame(void *context, const char *sourcePath, const char *targetPath, const TransitionStep *step) {
+    int width, height;
+    char framePath[MAX_CACHE_PATH];
+    if (getScreenSize(&width, &height) != 0
+        || transitionRender(sourcePath, targetPath, step, width, height, framePath, sizeof(framePath)) != 0) {
+        error("Failure rendering transition frame %d", step->frame);
+        return 1;
+    }
+    return applyBackground(context, framePath);
+}
+
+int applyBackground(void *context, const char *imagePath) {
+    if (setBackground(imagePath) != 0) {
+        return 1;
+    }
+    stateSetFingerprint(getAppliedFingerprint());
     return 0;
 }
 
@@ -248,7 +722,6 @@ int changeBackground() {
 // ### Config ### //
 
 
-//!TODO Overwork config
 int checkIfConfig() {
     const char *configPathPtr = CONFIG_PATH;
     FILE *file = fopen(configPathPtr, "r");
@@ -266,86 +739,116 @@ int checkIfConfig() {
 }
 
 int createConfig() {
-    const char *configPathPtr = CONFIG_PATH;
-    FILE *file = fopen(configPathPtr, "w");
-    if (file == NULL) {
+    IniTransaction *transaction = iniBegin(CONFIG_PATH);
+    if (transaction == NULL) {
         error("Failed to create config file");
         return 1;
     }
-    fclose(file);
-    writeIniValue(configPathPtr, "Path", "NIGHT", ".img\\night.jpg");
-    writeIniValue(configPathPtr, "Path", "DAY", ".img\\day.jpg");
-    writeIniValue(configPathPtr, "Time", "FROM", "0");
-    writeIniValue(configPathPtr, "Time", "TO", "24");
-    return 0;
+    if (iniSet(transaction, "Path", "NIGHT", "./img/night.jpg") != 0
+        || iniSet(transaction, "Path", "DAY", "./img/day.jpg") != 0
+        || iniSet(transaction, "Path", "AUTO", "0") != 0
+        || iniSet(transaction, "Scale", "MODE", "fill") != 0
+        || iniSet(transaction, "Scale", "FILTER", "lanczos3") != 0
+        || iniSet(transaction, "Scale", "BACKGROUND", "000000") != 0
+        || iniSet(transaction, "Scale", "MEMORY", "64") != 0
+        || iniSet(transaction, "Scale", "CACHE", "512") != 0
+        || iniSet(transaction, "Time", "FROM", "6") != 0
+        || iniSet(transaction, "Time", "TO", "22") != 0
+        || iniSet(transaction, "Log", "LEVEL", "ERROR") != 0
+        || iniSet(transaction, "Log", "FORMAT", "text") != 0
+        || iniSet(transaction, "Log", "MAX_SIZE", "1024") != 0
+        || iniSet(transaction, "Log", "MAX_AGE", "168") != 0
+        || iniSet(transaction, "Log", "MAX_FILES", "3") != 0
+        || iniSet(transaction, "Transition", "FRAMES", "0") != 0
+        || iniSet(transaction, "Transition", "WINDOW", "30") != 0
+        || iniSet(transaction, "Playlist", "ORDER", "sequential") != 0
+        || iniSet(transaction, "Playlist", "INTERVAL", "0") != 0
+        || iniSet(transaction, "Playlist", "LEAD", "60") != 0
+        || iniSet(transaction, "Trace", "ENABLED", "0") != 0) {
+        iniAbort(transaction);
+        error("Failed to create config file");
+        return 1;
+    }
+    return iniCommit(transaction);
 }
 
 int readConfig() {
+    TRACE_SCOPE("readConfig");
+    uint64_t start = metricsNow();
+    IniDocument *document = iniLoad(CONFIG_PATH);
+    if (document == NULL) {
+        error("Failure loading config");
+        return 1;
+    }
+    int result = applyConfig(document);
+    metricsRecordSince(METRIC_CONFIG_READ, start);
+    return result;
+}
 
-    const char *configPathPtr = CONFIG_PATH;
-    int *fromTimePtr = &fromTime;
-    int *toTimePtr = &toTime;
-    int *backgroundStatePtr = &backgroundState;
-
-    const char *pathSection = "Path";
-    const char *pathKeys[] = {"NIGHT", "DAY"};
-
-    const char *timeSection = "Time";
-    const char *timeKeys[] = {"FROM", "TO"};
+int applyConfig(IniDocument *document) {
+    // Only a complete and valid config replaces the current one.
+    Config config;
+    if (configRead(document, &config) != 0 || configPublish(&config) != 0) {
+        iniFree(document);
+        return 1;
+    }
+    // Runs on the thread applying the wallpapers, or before it starts.
+    wallpaperCacheSetOptions(&config.scale);
+    wallpaperCacheSetLimit((long long)config.cacheSize << 20);
+    updateLibrary(&nightLibrary, config.nightPath);
+    updateLibrary(&dayLibrary, config.dayPath);
+    iniFree(configDocument);
+    configDocument = document;
+    return 0;
+}
 
-    const char *stateSection = "State";
-    const char *stateKeys[] = {"BACKGROUND"};
+int readTraceConfig(IniDocument *document) {
+    int enabled = 0;
+    iniGetInt(document, "Trace", "ENABLED", &enabled);
+    traceEnable(enabled);
+    return 0;
+}
 
-    for (int i = 0; i < sizeof(pathKeys) / sizeof(pathKeys[0]); i++) {
-        char value[MAX_VALUE_LENGTH];
-        if (readIniValue(configPathPtr, pathSection, pathKeys[i], value) != 0) {
-            error("Failure reading path");
-            return 1;
-        }
-        if (i == 0) {
-            strcpy(nightPath, value);
-        } else {
-            strcpy(dayPath, value);
-        }
+int saveTrace() {
+    char tracePath[MAX_PATH];
+    struct tm local;
+    if (scheduleLocalTime(time(NULL), &local) != 0) {
+        return 1;
     }
+    strftime(tracePath, sizeof(tracePath), TRACE_PATH_FORMAT, &local);
+    return traceWrite(tracePath);
+}
 
-    for (int i = 0; i < sizeof(timeKeys) / sizeof(timeKeys[0]); i++) {
-        char value[MAX_VALUE_LENGTH];
-        if (readIniValue(configPathPtr, timeSection, timeKeys[i], value) != 0) {
-            error("Failure reading time");
-            return 1;
-        }
-        if (i == 0) {
-            *fromTimePtr = atoi(value);
-        } else {
-            *toTimePtr = atoi(value);
-        }
-    }
+void requestConfigReload(void *argument) {
+    atomic_store(&configChanged, true);
+    scheduleWake();
+}
 
-    for (int i = 0; i < sizeof(stateKeys) / sizeof(timeKeys[0]); i++) {
-        char value[MAX_VALUE_LENGTH];
-        if (readIniValue(configPathPtr, stateSection, stateKeys[i], value) != 0) {
-            error("Failiure reading state");
-            //!TODO Add Error fallback
-            return 1;
-        } else {
-            *backgroundStatePtr = atoi(value);
-        }
+int sendCommand(int type, int value) {
+    if (commandPush(&commands, type, value) != 0) {
+        error("Command queue full, dropping command %d", type);
+        return 1;
     }
-    
+    scheduleWake();
     return 0;
 }
 
-int updateBackgroundStateConfig() {
-
+int readLogConfig(IniDocument *document) {
     char value[MAX_VALUE_LENGTH];
-    int intValue;
-    readIniValue(CONFIG_PATH, "State", "BACKGROUND", value);
-    intValue = atoi(value);
-    if (intValue != backgroundState) {
-        char value[MAX_VALUE_LENGTH];
-        snprintf (value, sizeof(value), "%d", backgroundState);
-        writeIniValue(CONFIG_PATH, "State", "BACKGROUND", value);
+    if (iniGetString(document, "Log", "LEVEL", value, sizeof(value)) == 0 && setLogLevel(value) != 0) {
+        error("Invalid log level: %s", value);
+    }
+    if (iniGetString(document, "Log", "FORMAT", value, sizeof(value)) == 0 && strcmp(value, "binary") == 0) {
+        setLogFormat(LOG_FORMAT_BINARY);
+        setLogPath("general.bin");
+    }
+
+    int maxSize = 1024, maxAge = 7 * 24, maxFiles = 3;
+    iniGetInt(document, "Log", "MAX_SIZE", &maxSize);
+    iniGetInt(document, "Log", "MAX_AGE", &maxAge);
+    iniGetInt(document, "Log", "MAX_FILES", &maxFiles);
+    if (setLogRotation(maxSize * 1024L, maxAge * 60L * 60L, maxFiles) != 0) {
+        error("Invalid log rotation settings");
     }
     return 0;
 }
@@ -361,6 +864,16 @@ LRESULT CALLBACK WindowProc(HWND hiddenWindow, UINT uMsg, WPARAM wParam, LPARAM
             PostQuitMessage(0);
             return 0;
 
+        case WM_APP_ANIMATE:
+            startIconAnimation((int)wParam);
+            return 0;
+
+        case WM_TIMER:
+            if (wParam == ANIMATION_TIMER) {
+                stepIconAnimation();
+            }
+            return 0;
+
         case WM_USER + 1:
             if (lParam == WM_RBUTTONDOWN) {
                 HMENU hMenu = CreatePopupMenu();
@@ -423,9 +936,12 @@ LRESULT CALLBACK WindowProc(HWND hiddenWindow, UINT uMsg, WPARAM wParam, LPARAM
                         AppendMenu(hTimeMenuNight, MF_STRING, 223, TEXT("23"));
                         AppendMenu(hTimeMenuNight, MF_STRING, 224, TEXT("24"));
 
+                AppendMenu(hMenu, MF_STRING, MENU_SWITCH, TEXT("Switch Now"));
                 AppendMenu(hMenu, MF_SEPARATOR, 0, NULL);
+                AppendMenu(hMenu, MF_STRING | (traceEnabled() ? MF_CHECKED : 0), MENU_TRACE, TEXT("Tracing"));
+                AppendMenu(hMenu, MF_STRING, MENU_SAVE_TRACE, TEXT("Save Trace"));
                 AppendMenu(hMenu, MF_SEPARATOR, 0, NULL);
-                AppendMenu(hMenu, MF_STRING, 1, TEXT("Exit"));
+                AppendMenu(hMenu, MF_STRING, MENU_EXIT, TEXT("Exit"));
 
                 POINT pt;
                 GetCursorPos(&pt);
@@ -437,25 +953,25 @@ LRESULT CALLBACK WindowProc(HWND hiddenWindow, UINT uMsg, WPARAM wParam, LPARAM
             return 0;
 
         case WM_COMMAND:
-            stopThread = true;
-            if (LOWORD(wParam) == 1) {
-                stopThread = true;      
-                PostQuitMessage(0);     
-
-            }else if (LOWORD(wParam) >= 100 && LOWORD(wParam) <= 124) {
+            if (LOWORD(wParam) == MENU_EXIT) {
+                PostQuitMessage(0);
+            } else if (LOWORD(wParam) == MENU_SWITCH) {
+                sendCommand(COMMAND_FORCE_SWITCH, 0);
+            } else if (LOWORD(wParam) == MENU_TRACE) {
+                traceEnable(!traceEnabled());
+                info("Tracing %s", traceEnabled() ? "enabled" : "disabled");
+            } else if (LOWORD(wParam) == MENU_SAVE_TRACE) {
+                if (saveTrace() != 0) {
+                    error("Failure saving trace");
+                }
+            } else if (LOWORD(wParam) >= 100 && LOWORD(wParam) <= 124) {
                 int param = LOWORD(wParam) - 100;
                 info("Selected Day Time: %d", param);
-                char value[MAX_VALUE_LENGTH];
-                snprintf (value, sizeof(value), "%d", param);
-                writeIniValue(CONFIG_PATH, "Time", "FROM", value);
-                stopThread = false;
+                sendCommand(COMMAND_SET_DAY_HOUR, param);
             } else if (LOWORD(wParam) >= 200 && LOWORD(wParam) <= 224) {
                 int param = LOWORD(wParam) - 200;
                 info("Selected Night Time: %d", param);
-                char value[MAX_VALUE_LENGTH];
-                snprintf (value, sizeof(value), "%d", param);
-                writeIniValue(CONFIG_PATH, "Time", "TO", value);
-                stopThread = false;
+                sendCommand(COMMAND_SET_NIGHT_HOUR, param);
             }
             return 0;
 
@@ -464,12 +980,12 @@ LRESULT CALLBACK WindowProc(HWND hiddenWindow, UINT uMsg, WPARAM wParam, LPARAM
 }
 
 DWORD WINAPI ProgramLoopThread(LPVOID lpParam) {
-    while (!stopThread) {
+    traceThreadName("cycle");
+    while (!quitRequested) {
         if (programLoop() != 0) {
             error("Program loop encountered an error");
             break;
         }
-        Sleep(10);
     }
     return 0;
 }
@@ -477,16 +993,39 @@ DWORD WINAPI ProgramLoopThread(LPVOID lpParam) {
 int APIENTRY WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR lpCmdLine, int nCmdShow) {
     hInstance = hInst;
 
+    // The config is parsed once, the log settings have to be applied before logInit().
     checkIfConfig(CONFIG_PATH);
-    loadAnimationIcons();
+    IniDocument *document = iniLoad(CONFIG_PATH);
+    if (document != NULL) {
+        readLogConfig(document);
+        readTraceConfig(document);
+    }
+    traceThreadName("ui");
+    TraceSpan startup = traceBegin("startup");
+    if (logInit() == 0) {
+        atexit(logShutdown);
+    }
+    if (metricsServe(METRICS_PIPE) != 0) {
+        error("Failure serving metrics, they are only dumped at exit");
+    }
+
+    if (loadAnimation() != 0) {
+        error("Failure loading animation, the tray icon stays static");
+    }
 
     char configPath[MAX_PATH] = CONFIG_PATH;
 
-    if (readConfig(CONFIG_PATH, nightPath, dayPath, &fromTime, &toTime) != 0) {
+    if (document == NULL || applyConfig(document) != 0) {
         error("Failure initializing config");
         return 1;
     }
 
+    if (stateOpen(STATE_PATH) != 0) {
+        error("Failure opening state file, state is not kept across restarts");
+    } else {
+        setAppliedFingerprint(stateGet()->fingerprint);
+    }
+
     if (makeAbsolutePath(configPath, configPath) != 0) {
         error("Failure converting config path to absolute");
         return 1;
@@ -508,7 +1047,7 @@ int APIENTRY WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR lpCmdLine, int
     notifData.hWnd = hiddenWindow;
 
  
-    notifData.uID = ANIMATION0;
+    notifData.uID = ICON_ID;
     notifData.uFlags = NIF_ICON | NIF_MESSAGE | NIF_TIP;
     notifData.uCallbackMessage = WM_USER + 1;
 
@@ -519,13 +1058,22 @@ int APIENTRY WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR lpCmdLine, int
         return 1;
     }
 
-    changeBackground(nightPath, dayPath, &backgroundState, &fromTime, &toTime);
+    if (scheduleInit() != 0) {
+        error("Failure initializing schedule");
+        return 1;
+    }
+
+    configWatch = watchStart(CONFIG_DIRECTORY, CONFIG_NAME, CONFIG_DEBOUNCE_MS, requestConfigReload, NULL);
+    if (configWatch == NULL) {
+        error("Failure watching config, changes apply after a restart");
+    }
 
     HANDLE hThread = CreateThread(NULL, 0, ProgramLoopThread, NULL, 0, NULL);
     if (hThread == NULL) {
         error("Failed to create thread for program loop");
         return 1;
     }
+    traceEnd(startup);
 
    
     MSG msg;
@@ -535,9 +1083,32 @@ int APIENTRY WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR lpCmdLine, int
     }
 
    
-    stopThread = true;
+    // The worker drains the queue before its next wait, so it exits as soon as the command is queued.
+    while (commandPush(&commands, COMMAND_QUIT, 0) != 0) {
+        scheduleWake();
+        Sleep(1);
+    }
+    scheduleWake();
     WaitForSingleObject(hThread, INFINITE);
     CloseHandle(hThread);
+    KillTimer(hiddenWindow, ANIMATION_TIMER);
+    cleanupAnimation();
+    watchStop(configWatch);
+    libraryClose(nightLibrary.library);
+    libraryClose(dayLibrary.library);
+    playlistFree(&nightLibrary.playlist);
+    playlistFree(&dayLibrary.playlist);
+    playlistFree(&nightLibrary.upcomingPlaylist);
+    playlistFree(&dayLibrary.upcomingPlaylist);
+    scheduleCleanup();
+    iniFree(configDocument);
+    configCleanup();
+    stateClose();
+    metricsStop();
+    metricsDump(METRICS_PATH);
+    if (traceEnabled()) {
+        saveTrace();
+    }
 
    
     Shell_NotifyIcon(NIM_DELETE, &notifData);
@@ -550,16 +1121,13 @@ int APIENTRY WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR lpCmdLine, int
 
 
 int initializeMain() {
+    TRACE_SCOPE("initializeMain");
     initializeAnimation();
-    setBackgroundState(&backgroundState, &fromTime, &toTime);
-    if (backgroundState == NIGHT) {
-        setBackground(nightPath);
-        animateIconDayToNight();
-    } else if (backgroundState == DAY) {
-        setBackground(dayPath);
-        animateIconNightToDay();
-    }
-    return 0;
+    CycleSettings settings;
+    getCycleSettings(configAcquire(), &settings);
+    int result = cycleStart(&cycle, &settings);
+    configRelease();
+    return result;
 }
 
 
@@ -567,94 +1135,161 @@ int initializeMain() {
 
 
 int initializeAnimation () {
-    setBackgroundState(&backgroundState, &fromTime, &toTime);
-    if (backgroundState == DAY) {
-        notifData.hIcon = LoadIcon(hInstance, MAKEINTRESOURCE(ANIMATION0));
-        if (notifData.hIcon == NULL) {
-            error("Failed to load tray icon");
-            return 1;
-        }
-        Shell_NotifyIcon(NIM_ADD, &notifData);
-    } else if (backgroundState == NIGHT) {
-        notifData.hIcon = LoadIcon(hInstance, MAKEINTRESOURCE(ANIMATION20));
+    int backgroundState;
+    const Config *config = configAcquire();
+    int result = backgroundStateAt(config->fromTime, config->toTime, clockNow(cycle.clock), &backgroundState);
+    configRelease();
+    if (result != 0) {
+        error("Invalid background state");
+        return 1;
+    }
+    if (trayAnimation.frameCount == 0) {
+        notifData.hIcon = LoadIcon(hInstance, MAKEINTRESOURCE(ICON_ID));
         if (notifData.hIcon == NULL) {
             error("Failed to load tray icon");
             return 1;
         }
         Shell_NotifyIcon(NIM_ADD, &notifData);
-    } else {
-        error("Invalid background state");
+        return 0;
+    }
+    // Start on the opposite end, initializeMain() animates towards the current state.
+    return showAnimationFrame(backgroundState == DAY ? 0 : trayAnimation.frameCount - 1, NIM_ADD);
+}
+
+int loadAnimation() {
+    HRSRC resource = FindResource(hInstance, MAKEINTRESOURCE(ANIMATION_DATA), RT_RCDATA);
+    HGLOBAL handle = resource != NULL ? LoadResource(hInstance, resource) : NULL;
+    const unsigned char *data = handle != NULL ? LockResource(handle) : NULL;
+    if (data == NULL) {
+        error("Failed to load animation resource: %ld", GetLastError());
         return 1;
     }
+
+    // Resources stay mapped for the lifetime of the process, so the asset is not copied.
+    if (animOpen(&trayAnimation, data, SizeofResource(hInstance, resource)) != 0) {
+        trayAnimation.frameCount = 0;
+        return 1;
+    }
+    if (trayAnimation.delay <= 0) {
+        trayAnimation.delay = ANIMATION_DEFAULT_FRAME_MS;
+    }
+    debug("Animation: %d frames of %dx%d", trayAnimation.frameCount, trayAnimation.width, trayAnimation.height);
     return 0;
 }
 
-void loadAnimationIcons() {
-    int iconIds[ANIMATION_FRAMES] = {
-        ANIMATION0, ANIMATION1, ANIMATION2, ANIMATION3, ANIMATION4,
-        ANIMATION5, ANIMATION6, ANIMATION7, ANIMATION8, ANIMATION9,
-        ANIMATION10, ANIMATION11, ANIMATION12, ANIMATION13, ANIMATION14,
-        ANIMATION15, ANIMATION16, ANIMATION17, ANIMATION18, ANIMATION19, ANIMATION20,
-        ANIMATION21, ANIMATION22, ANIMATION23, ANIMATION24, ANIMATION25,
-        ANIMATION26, ANIMATION27, ANIMATION28, ANIMATION29, ANIMATION30,
-        ANIMATION31, ANIMATION32, ANIMATION33
-    }; //make dynamic
-    
-
-    for (int i = 0; i < ANIMATION_FRAMES; i++) {
-        animationIcons[i] = LoadIcon(hInstance, MAKEINTRESOURCE(iconIds[i]));
-        if (animationIcons[i] == NULL) {
-            error("Failed to load icon frame: %d", iconIds[i]);
-        }
+void cleanupAnimation() {
+    if (animationIcon != NULL) {
+        DestroyIcon(animationIcon);
+        animationIcon = NULL;
     }
+    animClose(&trayAnimation);
 }
 
-void cleanupAnimationIcons() {
-    for (int i = 0; i < ANIMATION_FRAMES; i++) {
-        if (animationIcons[i] != NULL) {
-            DestroyIcon(animationIcons[i]);
-        }
+HICON createAnimationIcon(int frame) {
+    if (animSeek(&trayAnimation, frame) != 0) {
+        return NULL;
     }
-}
 
-void animateIconDayToNight() {
-    for (int i = ANIMATION_FRAMES - 1; i >= 0; i--) {
-        notifData.hIcon = animationIcons[i];
-        Shell_NotifyIcon(NIM_MODIFY, &notifData);
-        Sleep(10);
+    BITMAPINFO info;
+    ZeroMemory(&info, sizeof(info));
+    info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    info.bmiHeader.biWidth = trayAnimation.width;
+    info.bmiHeader.biHeight = -trayAnimation.height; // Top-down like the decoded frame.
+    info.bmiHeader.biPlanes = 1;
+    info.bmiHeader.biBitCount = 32;
+    info.bmiHeader.biCompression = BI_RGB;
+
+    void *bits = NULL;
+    HICON icon = NULL;
+    HBITMAP color = CreateDIBSection(NULL, &info, DIB_RGB_COLORS, &bits, NULL, 0);
+    // The alpha channel decides the transparency, the AND mask is all zeros; its rows are padded to 16 bits.
+    void *maskBits = calloc((size_t)(trayAnimation.width + 15) / 16 * 2, trayAnimation.height);
+    HBITMAP mask = maskBits != NULL ? CreateBitmap(trayAnimation.width, trayAnimation.height, 1, 1, maskBits) : NULL;
+    free(maskBits);
+    if (color != NULL && mask != NULL) {
+        memcpy(bits, trayAnimation.pixels, (size_t)trayAnimation.width * trayAnimation.height * 4);
+        ICONINFO iconInfo = {TRUE, 0, 0, mask, color};
+        icon = CreateIconIndirect(&iconInfo);
+    }
+    // CreateIconIndirect() copies the bitmaps.
+    if (color != NULL) {
+        DeleteObject(color);
     }
+    if (mask != NULL) {
+        DeleteObject(mask);
+    }
+    return icon;
 }
 
-void animateIconNightToDay() {
-    for (int i = 0; i < ANIMATION_FRAMES; i++) {
-        notifData.hIcon = animationIcons[i];
-        Shell_NotifyIcon(NIM_MODIFY, &notifData);
-        Sleep(10);
+int showAnimationFrame(int frame, DWORD message) {
+    TRACE_SCOPE("showAnimationFrame");
+    uint64_t start = metricsNow();
+    HICON icon = createAnimationIcon(frame);
+    if (icon == NULL) {
+        error("Failed to create icon frame: %d", frame);
+        return 1;
+    }
+
+    notifData.hIcon = icon;
+    Shell_NotifyIcon(message, &notifData);
+    if (animationIcon != NULL) {
+        DestroyIcon(animationIcon);
     }
+    animationIcon = icon;
+    animationFrame = frame;
+    metricsCount(METRIC_ANIMATION_FRAMES);
+    metricsRecordSince(METRIC_ANIMATION_FRAME, start);
+    return 0;
 }
 
+void requestIconAnimation(void *context, int targetState) {
+    if (!PostMessage(hiddenWindow, WM_APP_ANIMATE, targetState, 0)) {
+        error("Failure requesting icon animation: %ld", GetLastError());
+    }
+}
 
-// ### 
+void startIconAnimation(int targetState) {
+    if (trayAnimation.frameCount == 0) {
+        return;
+    }
+    metricsCount(METRIC_ANIMATION_RUNS);
+    traceEnd(animationSpan); // A redirected animation ends the span of the previous one.
+    animationSpan.start = 0;
+    animationSpan = traceBegin("iconAnimation");
+    animationStartFrame = animationFrame;
+    animationTargetFrame = targetState == NIGHT ? 0 : trayAnimation.frameCount - 1;
+    animationStartTick = GetTickCount();
+    if (SetTimer(hiddenWindow, ANIMATION_TIMER, trayAnimation.delay, NULL) == 0) {
+        error("Failure starting icon animation: %ld", GetLastError());
+        animationStartTick -= (DWORD)trayAnimation.frameCount * trayAnimation.delay; // Jump to the last frame.
+    }
+    stepIconAnimation();
+}
 
+void stepIconAnimation() {
+    int distance = abs(animationTargetFrame - animationStartFrame);
+    int elapsedFrames = (int)((GetTickCount() - animationStartTick) / trayAnimation.delay);
+    int frame = animationTargetFrame;
 
-int setBackgroundState(int *backgroundStatePtr, int *fromTimePtr, int *toTimePtr) {
-    SYSTEMTIME time;
-    GetLocalTime(&time);
-    int hour = time.wHour;
-    if (*fromTimePtr < 24 && *toTimePtr < 24 && *fromTimePtr < *toTimePtr) {
-        if (hour >= *fromTimePtr && hour < *toTimePtr) {
-            *backgroundStatePtr = DAY;
-        } else {
-            *backgroundStatePtr = NIGHT;
-        }
-        updateBackgroundStateConfig();
+    if (elapsedFrames < distance) {
+        frame = animationStartFrame + (animationTargetFrame > animationStartFrame ? elapsedFrames : -elapsedFrames);
     } else {
-        error("Invalid time");
-        return 1;
+        KillTimer(hiddenWindow, ANIMATION_TIMER);
+    }
+
+    if (frame != animationFrame) {
+        showAnimationFrame(frame, NIM_MODIFY);
+    }
+    if (frame == animationTargetFrame) {
+        traceEnd(animationSpan);
+        animationSpan.start = 0;
     }
-    return 0;
 }
 
+
+// ### 
+
+
 int makeAbsolutePath(char *relativePath, char *absolutePath) {
     if (!GetFullPathNameA(relativePath, MAX_PATH, absolutePath, NULL)) {
         error("Failiure converting to absolute path: %ld", GetLastError());
@@ -0,0 +1,87 @@
+"""Module to render a binary WallCycle log (`FORMAT = binary` in the `[Log]` section) back into the text log format.
+"""
+import argparse
+import re
+import struct
+import sys
+import time
+
+MAGIC = b"WCLOG001"
+LEVEL_NAMES = ["NONE", "ERROR", "INFO", "DEBUG"]
+CONVERSION = re.compile(r"%([-+ #0]*(?:\*|\d+)?(?:\.(?:\*|\d+))?)(?:hh|h|ll|l|L|z|j|t)?([diouxXcsfFeEgGaAp%])")
+
+def to_python_format(format_string):
+    """Strip C length modifiers and map conversions Python's % operator does not know."""
+    def replace(match):
+        flags, conversion = match.groups()
+        if conversion == "p":
+            return "0x%" + flags + "x"
+        if conversion in "aA":
+            return "%" + flags + "e"
+        if conversion == "F":
+            return "%" + flags + "f"
+        return "%" + flags + conversion
+    return CONVERSION.sub(replace, format_string)
+
+def decode_args(data):
+    """Decode the argument block of a message record into a tuple."""
+    args = []
+    offset = 0
+    while offset < len(data):
+        tag = data[offset:offset + 1]
+        offset += 1
+        if tag == b"s":
+            (length,) = struct.unpack_from("<H", data, offset)
+            args.append(data[offset + 2:offset + 2 + length].decode("utf-8", "replace"))
+            offset += 2 + length
+        elif tag == b"i":
+            args.append(struct.unpack_from("<q", data, offset)[0])
+            offset += 8
+        elif tag in (b"u", b"p"):
+            args.append(struct.unpack_from("<Q", data, offset)[0])
+            offset += 8
+        elif tag == b"f":
+            args.append(struct.unpack_from("<d", data, offset)[0])
+            offset += 8
+        else:
+            raise ValueError(f"Unknown argument tag {tag!r}")
+    return tuple(args)
+
+def decode(stream, output):
+    """Render all records of a binary log stream as `[LEVEL | time] msg` lines."""
+    if stream.read(len(MAGIC)) != MAGIC:
+        raise ValueError("Not a binary WallCycle log")
+
+    formats = {}
+    while True:
+        record_type = stream.read(1)
+        if not record_type:
+            break
+        if record_type == b"F":
+            format_id, length = struct.unpack("<IH", stream.read(6))
+            formats[format_id] = to_python_format(stream.read(length).decode("utf-8", "replace"))
+        elif record_type == b"M":
+            level, timestamp, format_id, length = struct.unpack("<BqIH", stream.read(15))
+            args = decode_args(stream.read(length))
+            format_string = formats.get(format_id, f"<unknown format {format_id:08x}>")
+            try:
+                message = format_string % args
+            except (TypeError, ValueError):
+                message = f"{format_string} {args!r}"
+            level_name = LEVEL_NAMES[level] if level < len(LEVEL_NAMES) else str(level)
+            time_string = time.strftime("%H:%M:%S %d-%m-%Y", time.localtime(timestamp))
+            output.write(f"[{level_name:>6} | {time_string:>19}] {message}\n")
+        else:
+            raise ValueError(f"Unknown record type {record_type!r}")
+
+def main():
+    parser = argparse.ArgumentParser(description="Render a binary WallCycle log as text.")
+    parser.add_argument("files", nargs="+", help="Binary log files, oldest first (e.g. general.bin.2 general.bin.1 general.bin)")
+
+    args = parser.parse_args()
+    for path in args.files:
+        with open(path, "rb") as stream:
+            decode(stream, sys.stdout)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,107 @@
+"""Module to pack the `.png` frames of the tray animation into a single asset, see `include/anim.c` for the format.
+
+Frames are taken in file name order, made transparent where they match the background color, scaled to
+the icon size and stored as run-length encoded XOR deltas of the previous frame.
+"""
+import argparse
+import os
+import struct
+from PIL import Image
+from pngToIco import hex_to_rgb, remove_color
+
+MAGIC = b"WCAN"
+VERSION = 1
+MAX_RUN = 128
+
+def load_frame(input_png, target_color, tolerance, size):
+    """Loads a PNG as BGRA bytes of the given size, with fully transparent pixels zeroed."""
+    img = remove_color(input_png, target_color, tolerance).resize((size, size), Image.LANCZOS)
+    pixels = bytearray(img.tobytes("raw", "BGRA"))
+    for i in range(0, len(pixels), 4):
+        if pixels[i + 3] == 0:
+            pixels[i:i + 4] = b"\0\0\0\0"
+    return bytes(pixels)
+
+def encode_delta(previous, current):
+    """Encodes the XOR of two frames as runs of unchanged pixels and literal pixels."""
+    delta = bytes(a ^ b for a, b in zip(previous, current))
+    pixels = [delta[i:i + 4] for i in range(0, len(delta), 4)]
+    zero = b"\0\0\0\0"
+    out = bytearray()
+    i = 0
+    while i < len(pixels):
+        start = i
+        if pixels[i] == zero:
+            while i < len(pixels) and pixels[i] == zero and i - start < MAX_RUN:
+                i += 1
+            if i < len(pixels):
+                out.append(i - start - 1)
+        else:
+            while i < len(pixels) and pixels[i] != zero and i - start < MAX_RUN:
+                i += 1
+            out.append(127 + i - start)
+            out.extend(b"".join(pixels[start:i]))
+    return bytes(out)
+
+def pack(frames, size, delay):
+    """Builds the packed asset from a list of BGRA frames."""
+    deltas = []
+    previous = bytes(len(frames[0]))
+    for frame in frames:
+        deltas.append(encode_delta(previous, frame))
+        previous = frame
+
+    header = MAGIC + struct.pack("<6H", VERSION, len(frames), size, size, delay, 0)
+    offset = len(header) + (len(frames) + 1) * 4
+    offsets = []
+    for delta in deltas:
+        offsets.append(offset)
+        offset += len(delta)
+    offsets.append(offset)
+    return header + struct.pack(f"<{len(offsets)}I", *offsets) + b"".join(deltas)
+
+def make_resources_rc(folder, asset):
+    """Generates a resource.rc file embedding the packed animation."""
+    project_root = os.path.abspath(os.path.join(os.path.dirname(__file__), ".."))
+    relative_path = os.path.relpath(os.path.abspath(asset), project_root).replace(os.sep, "/")
+
+    with open(os.path.join(folder, "resource.rc"), "w") as f:
+        f.write("#include \"resource.h\"\n\n")
+        f.write("ICON_ID ICON \"include/src/icon.ico\"\n\n")
+        f.write(f"ANIMATION_DATA RCDATA \"{relative_path}\"\n")
+
+def make_resources_h(folder):
+    """Generates a resource.h file with the resource ids."""
+    with open(os.path.join(folder, "resource.h"), "w") as f:
+        f.write("#ifndef RESOURCE_H\n#define RESOURCE_H\n\n")
+        f.write("#define ICON_ID 101\n")
+        f.write("#define ANIMATION_DATA 102\n")
+        f.write("\n#endif\n")
+
+def main():
+    parser = argparse.ArgumentParser(description="Pack PNG animation frames into a single delta encoded asset.")
+    parser.add_argument("-c", "--color", required=True, help="Background color to remove in HEX format (e.g., #FF0000)")
+    parser.add_argument("-f", "--folder", required=True, help="Folder containing the PNG frames")
+    parser.add_argument("--tolerance", type=int, default=0, help="Color tolerance (default 0 for exact match)")
+    parser.add_argument("-s", "--size", type=int, default=32, help="Icon size in pixels (default 32)")
+    parser.add_argument("-d", "--delay", type=int, default=10, help="Time between frames in ms (default 10)")
+    parser.add_argument("-o", "--output", help="Output file (default <folder>/animation.bin)")
+
+    args = parser.parse_args()
+    png_files = sorted(f for f in os.listdir(args.folder) if f.lower().endswith(".png"))
+    if not png_files:
+        print("No PNG files found in the folder.")
+        return
+
+    target_color = hex_to_rgb(args.color)
+    frames = [load_frame(os.path.join(args.folder, f), target_color, args.tolerance, args.size) for f in png_files]
+    output = args.output or os.path.join(args.folder, "animation.bin")
+    with open(output, "wb") as f:
+        f.write(pack(frames, args.size, args.delay))
+    print(f"Packed {len(frames)} frames of {args.size}x{args.size} into {output} ({os.path.getsize(output)} bytes)")
+
+    make_resources_rc(args.folder, output)
+    make_resources_h(args.folder)
+
+if __name__ == "__main__":
+    main()
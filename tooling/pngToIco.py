@@ -11,8 +11,8 @@ def hex_to_rgb(hex_color):
         raise ValueError("Hex color must be in the format #RRGGBB")
     return tuple(int(hex_color[i:i+2], 16) for i in (0, 2, 4))
 
-def remove_color_and_save_as_ico(input_png, output_ico, target_color, tolerance=0):
-    """Removes a specific color from a PNG and saves it as an ICO file."""
+def remove_color(input_png, target_color, tolerance=0):
+    """Opens a PNG as RGBA and makes a specific color transparent."""
     img = Image.open(input_png).convert("RGBA")
     data = img.getdata()
 
@@ -25,7 +25,11 @@ def remove_color_and_save_as_ico(input_png, output_ico, target_color, tolerance=
             new_data.append(item)
 
     img.putdata(new_data)
-    img.save(output_ico, format="ICO")
+    return img
+
+def remove_color_and_save_as_ico(input_png, output_ico, target_color, tolerance=0):
+    """Removes a specific color from a PNG and saves it as an ICO file."""
+    remove_color(input_png, target_color, tolerance).save(output_ico, format="ICO")
 
 def process_folder(hex_color, folder, tolerance=0):
     """Processes all PNG files in a folder and converts them to ICO."""